@@ -51,9 +51,12 @@ ShowHelp()
     printf $Green"--cflags value"$EndGreen":\n\tSets \$CFLAGS to the desired value.\n"
     printf $Green"--ldflags value"$EndGreen":\n\tSets \$LDFLAGS to the desired value.\n"
     printf $Green"--cc value"$EndGreen":\n\tSets \$CC to be the compiler for Epoch.\n"
+    printf $Green"--benchmarks"$EndGreen":\n\tAlso build epochbench, which measures membus latency and throughput\n"
+    printf "\tagainst a private Epoch instance. It is placed in bin/.\n"
 }
 
 NEED_EMPTY_CFLAGS="0"
+BUILD_BENCHMARKS="0"
 outdir="../built"
 
 if [ "$CC" = "" ]; then
@@ -127,6 +130,9 @@ if [ "$#" != "0" ]; then
 		elif [ "$1" = "--ldflags" ]; then
 			shift
 			LDFLAGS="$1"
+	
+		elif [ "$1" = "--benchmarks" ]; then
+			BUILD_BENCHMARKS="1"
 		fi
 		
 		shift
@@ -148,12 +154,24 @@ mkdir objects
 cd objects
 
 CMD "$CC $CFLAGS -c ../src/actions.c"
+CMD "$CC $CFLAGS -c ../src/capture.c"
 CMD "$CC $CFLAGS -c ../src/config.c"
+CMD "$CC $CFLAGS -c ../src/configcache.c"
+CMD "$CC $CFLAGS -c ../src/configlex.c"
 CMD "$CC $CFLAGS -c ../src/console.c"
+CMD "$CC $CFLAGS -c ../src/events.c"
+CMD "$CC $CFLAGS -c ../src/jobs.c"
+CMD "$CC $CFLAGS -c ../src/killall.c"
+CMD "$CC $CFLAGS -c ../src/logrotate.c"
+CMD "$CC $CFLAGS -c ../src/logstore.c"
 CMD "$CC $CFLAGS -c ../src/main.c"
 CMD "$CC $CFLAGS -c ../src/membus.c"
 CMD "$CC $CFLAGS -c ../src/modes.c"
+CMD "$CC $CFLAGS -c ../src/overlay.c"
 CMD "$CC $CFLAGS -c ../src/parse.c"
+CMD "$CC $CFLAGS -c ../src/procscan.c"
+CMD "$CC $CFLAGS -c ../src/syslog.c"
+CMD "$CC $CFLAGS -c ../src/tail.c"
 CMD "$CC $CFLAGS -c ../src/utilfuncs.c"
 
 printf "\nBuilding main executable.\n\n"
@@ -162,7 +180,15 @@ mkdir -p $outdir/sbin/
 mkdir -p $outdir/bin/
 
 CMD "$CC $LDFLAGS $CFLAGS -o $outdir/sbin/epoch\
- actions.o config.o console.o main.o membus.o modes.o parse.o utilfuncs.o"
+ actions.o capture.o config.o configcache.o configlex.o console.o events.o jobs.o killall.o logrotate.o logstore.o main.o membus.o modes.o overlay.o parse.o procscan.o syslog.o tail.o utilfuncs.o -lpthread"
+
+if [ "$BUILD_BENCHMARKS" = "1" ]; then
+	printf "\nBuilding benchmarks.\n\n"
+	
+	CMD "$CC $CFLAGS -c ../src/epochbench.c"
+	CMD "$CC $LDFLAGS $CFLAGS -o $outdir/bin/epochbench\
+ actions.o capture.o config.o configcache.o configlex.o console.o epochbench.o events.o jobs.o killall.o logrotate.o logstore.o membus.o modes.o overlay.o parse.o procscan.o syslog.o tail.o utilfuncs.o -lpthread"
+fi
 
 printf "\nCreating symlinks.\n"
 cd $outdir/sbin/
@@ -17,13 +17,28 @@
 #include <sys/stat.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
+#include <sys/mman.h>
 #include <sys/syscall.h>
 #include <signal.h>
 #include "epoch.h"
 
+/*What we hand a re-executed Epoch about each object, followed by the object ID.*/
+struct _RXDObject
+{
+	unsigned long ObjectPID;
+	unsigned long StartedSince;
+	Bool Started;
+	Bool AutoRestart;
+};
+
+struct _RXDGlobals
+{ /*Only the ones that can change after boot.*/
+	Bool EnableLogging;
+	Bool DisableCAD;
+};
+
 /*Prototypes.*/
 static void MountVirtuals(void);
-static void PrimaryLoop(void);
 
 /*Globals.*/
 struct _HaltParams HaltParams = { -1 };
@@ -78,20 +93,52 @@ static void MountVirtuals(void)
 	}
 }
 
-static void PrimaryLoop(void)
+void PrimaryLoop(void)
 { /*Loop that provides essentially everything we cycle through.*/
 	unsigned long CurMin = 0, CurSec = 0;
 	ObjTable *Worker = NULL;
 	struct tm TimeStruct;
 	time_t TimeCore;
 	short LoopStepper = 0, ScanStepper = 0;
+	pid_t ChildPID = 0;
+	int RawExitStatus = 0;
+	
+	if (!Events_Init())
+	{ /*Both bootup and reexec come through here, so this is the place for it.*/
+		const char *EventsErr = "Failed to start the event stream. \"epoch subscribe\" won't work.";
+		
+		SpitWarning(EventsErr);
+		WriteLogLine(EventsErr, true);
+	}
 	
 	for (ContinuePrimaryLoop = true; ContinuePrimaryLoop; ++LoopStepper)
 	{	
 	
-		/**The line below is of critical importance. It harvests
-		 * the zombies created by all processes throughout the system.**/
-		while (waitpid(-1, NULL, WNOHANG) > 0);
+		/**The loop below is of critical importance. It harvests
+		 * the zombies created by all processes throughout the system.
+		 * Jobs get told when one of their commands is done.**/
+		while ((ChildPID = waitpid(-1, &RawExitStatus, WNOHANG)) > 0)
+		{
+			if (Jobs_ChildExited(ChildPID, RawExitStatus) || !ObjectTable) continue;
+			
+			for (Worker = ObjectTable; Worker < ObjectTable + ObjectCount; ++Worker)
+			{ /*Not a job's command, so maybe it was an object's process.*/
+				if (Worker->Started && Worker->ObjectPID == (unsigned long)ChildPID)
+				{
+					Events_Emit(EVENT_EXITED, Worker->ObjectID, RawExitStatus);
+					Tail_Exited(Worker->ObjectID, RawExitStatus);
+					break;
+				}
+			}
+		}
+		
+		Jobs_Service(); /*Step all membus jobs along.*/
+		
+		Events_Service(); /*Take new subscribers and push out anything they haven't gotten yet.*/
+		
+		Capture_Service(0); /*Log whatever objects have printed.*/
+		
+		Syslog_Service(); /*And whatever came in on /dev/log.*/
 		
 		/*Do not flood the system with this big loop more than necessary.*/
 		if (LoopStepper == 5)
@@ -105,6 +152,13 @@ static void PrimaryLoop(void)
 			
 			ParseMemBus(); /*Check membus for new data.*/
 			
+			Log_Service(); /*Write out log lines that have waited long enough.*/
+			
+			if (HaltParams.HaltMode == -1 && !Jobs_Running())
+			{ /*Nothing's going on, so parse a few more of the objects boot didn't need.*/
+				Config_MaterializeIdle();
+			}
+			
 			if (HaltParams.HaltMode != -1)
 			{
 				time(&TimeCore);
@@ -155,10 +209,13 @@ static void PrimaryLoop(void)
 			}
 			
 			if (ObjectTable)
-			{
-				for (Worker = ObjectTable; Worker->Next != NULL; Worker = Worker->Next)
+			{ /*Every object that needs a PID found this pass shares one look at /proc.*/
+				ProcScan_Hold();
+				
+				for (Worker = ObjectTable; Worker < ObjectTable + ObjectCount; ++Worker)
 				{ /*Handle objects intended for automatic restart.*/
-					if (Worker->Opts.AutoRestart && Worker->Started && !ObjectProcessRunning(Worker))
+					if (Worker->Opts.AutoRestart && Worker->Started && !ObjectProcessRunning(Worker) &&
+						!Jobs_ObjectBusy(Worker->ObjectID))
 					{
 						char TmpBuf[MAX_LINE_SIZE];
 						
@@ -167,6 +224,8 @@ static void PrimaryLoop(void)
 							continue;
 						}
 						
+						Log_SetObject(Worker->ObjectID);
+						
 						/*Don't let us enter a restart loop.*/
 						if (Worker->StartedSince + 5 > time(NULL))
 						{
@@ -182,6 +241,7 @@ static void PrimaryLoop(void)
 							Worker->Started = false;
 							Worker->ObjectPID = 0;
 							Worker->StartedSince = 0;
+							Log_SetObject(NULL);
 							continue;
 						}
 						
@@ -191,6 +251,7 @@ static void PrimaryLoop(void)
 						if (ProcessConfigObject(Worker, true, false))
 						{
 							snprintf(TmpBuf, MAX_LINE_SIZE, "AUTORESTART: Object %s successfully restarted.", Worker->ObjectID);
+							Events_Emit(EVENT_RESTARTED, Worker->ObjectID, (long)Worker->ObjectPID);
 						}
 						else
 						{
@@ -202,6 +263,7 @@ static void PrimaryLoop(void)
 						}
 						
 						WriteLogLine(TmpBuf, true);
+						Log_SetObject(NULL);
 					}
 					
 					/*Rescan PIDs every minute to keep them up-to-date.*/
@@ -210,6 +272,8 @@ static void PrimaryLoop(void)
 						AdvancedPIDFind(Worker, true);
 					}
 				}
+				
+				ProcScan_Unhold();
 			}
 			
 			if (ScanStepper == 240)
@@ -233,12 +297,15 @@ void EmergencyShell(void)
 	
 	fprintf(stderr, "\nSyncing disks...\n");
 	fflush(NULL);
+	Log_Shutdown();
 	sync(); /*First things first, sync disks.*/
 	
 	fprintf(stderr, "Shutting down Epoch...\n");
 	fflush(NULL);
 	ShutdownConfig(); /*Release all memory.*/
 	ShutdownMemBus(true); /*Stop the membus.*/
+	Events_Shutdown();
+	Syslog_Shutdown();
 	
 	fprintf(stderr, "Launching the shell...\n");
 	fflush(NULL);
@@ -252,279 +319,465 @@ void EmergencyShell(void)
 	while (1) sleep(1); /*Hang forever to prevent a kernel panic.*/
 }
 
-void RecoverFromReexec(Bool ViaMemBus)
-{ /*This is called when we are reexecuted from ReexecuteEpoch() to receive data*/
-	pid_t ChildPID = 0;
-	ObjTable *CurObj = NULL;
-	char InBuf[MEMBUS_MSGSIZE] = { '\0' };
-	char *MCode = MEMBUS_CODE_RXD;
-	unsigned long MCodeLength = strlen(MCode) + 1;
-	short HPS = 0;
-	unsigned long TInc = 0;
+void RXD_Append(struct _RXDState *State, unsigned char Type, const void *Data, unsigned long Length)
+{ /*Starts a new record in the reexec state.*/
+	unsigned long Header[2];
 	
-	MemBusKey = MEMKEY + 1;
+	State->Size = (State->Size + sizeof(long) - 1) & ~(sizeof(long) - 1); /*Keep every header aligned.*/
+	State->LastRecord = State->Size;
 	
-	if (!InitConfig())
-	{
-		EmulWall("Epoch: "CONSOLE_COLOR_RED "ERROR: " CONSOLE_ENDCOLOR
-		"Cannot reload configuration for re-exec!", false);
-		EmergencyShell();
-	}
+	Header[0] = Type;
+	Header[1] = 0;
+	RXD_Extend(State, Header, sizeof Header);
+	RXD_Extend(State, Data, Length);
+}
 
-	if (!InitMemBus(false))
-	{
-		EmulWall("Epoch: "CONSOLE_COLOR_RED "ERROR: " CONSOLE_ENDCOLOR
-				"Re-executed process cannot connect to modified membus.", false);
-		EmergencyShell();
-	}
-	
-	while (!MemBus_BinRead(InBuf, sizeof InBuf, false)) usleep(100);
+void RXD_Extend(struct _RXDState *State, const void *Data, unsigned long Length)
+{ /*Adds more data onto the end of the last record.*/
+	unsigned char *NewBlob = NULL;
 	
-	memcpy(&ChildPID, InBuf + MCodeLength, sizeof(pid_t));
+	if (State->Failed || !Length) return;
 	
-	while (!MemBus_BinRead(InBuf, sizeof InBuf, false)) usleep(100);
-	
-	while (!strcmp(InBuf, MCode))
+	if (State->Size + Length > State->Capacity)
 	{
-		if ((CurObj = LookupObjectInTable(InBuf + MCodeLength)) != NULL)
+		unsigned long NewCapacity = State->Capacity ? State->Capacity : 4096;
+		
+		while (NewCapacity < State->Size + Length) NewCapacity *= 2;
+		
+		if (!(NewBlob = realloc(State->Blob, NewCapacity)))
 		{
-			unsigned long TLength = strlen(CurObj->ObjectID) + 1;
-			
-			memcpy(&CurObj->ObjectPID, (InBuf + MCodeLength + TLength), sizeof(long));
-			memcpy(&CurObj->Started, (InBuf + MCodeLength + TLength + sizeof(long)), sizeof(Bool));
-			memcpy(&CurObj->StartedSince, (InBuf + MCodeLength + TLength + sizeof(long) + sizeof(Bool)), sizeof(long));
+			State->Failed = true;
+			return;
 		}
 		
-		while (!MemBus_BinRead(InBuf, sizeof InBuf, false)) usleep(100);
+		/*Zero the padding, since it goes into the memfd.*/
+		memset(NewBlob + State->Capacity, 0, NewCapacity - State->Capacity);
+		
+		State->Blob = NewBlob;
+		State->Capacity = NewCapacity;
 	}
 	
-	MCode = MEMBUS_CODE_RXD_OPTS;
-	MCodeLength = strlen(MCode) + 1;
-	
-	/*Retrieve the HaltParams structure.*/
-	memcpy((void*)&HaltParams.HaltMode, InBuf + MCodeLength + (HPS++ * sizeof(long)), sizeof(long));
-	memcpy((void*)&HaltParams.TargetHour, InBuf + MCodeLength + (HPS++ * sizeof(long)), sizeof(long));
-	memcpy((void*)&HaltParams.TargetMin, InBuf + MCodeLength + (HPS++ * sizeof(long)), sizeof(long));
-	memcpy((void*)&HaltParams.TargetSec, InBuf + MCodeLength + (HPS++ * sizeof(long)), sizeof(long));
-	memcpy((void*)&HaltParams.TargetMonth, InBuf + MCodeLength + (HPS++ * sizeof(long)), sizeof(long));
-	memcpy((void*)&HaltParams.TargetDay, InBuf + MCodeLength + (HPS++ * sizeof(long)), sizeof(long));
-	memcpy((void*)&HaltParams.TargetYear, InBuf + MCodeLength + (HPS++ * sizeof(long)), sizeof(long));
-	memcpy((void*)&HaltParams.JobID, InBuf + MCodeLength + (HPS++ * sizeof(long)), sizeof(long));
+	memcpy(State->Blob + State->Size, Data, Length);
+	State->Size += Length;
 	
-	/*Retrieve our important options.*/
-	while (!MemBus_BinRead(InBuf, sizeof InBuf, false)) usleep(100);
-	EnableLogging = (Bool)*(InBuf + MCodeLength);
+	if (State->LastRecord)
+	{ /*Keep the record's length current. The magic and version sit at zero, so no record ever does.*/
+		((unsigned long*)(State->Blob + State->LastRecord))[1] = State->Size - State->LastRecord - sizeof(long) * 2;
+	}
+}
 
-	/*Retrieve the current runlevel.*/
-	while (!MemBus_BinRead(InBuf, sizeof InBuf, false)) usleep(100);
-	snprintf(CurRunlevel, sizeof CurRunlevel, "%s", InBuf + MCodeLength);
+int RXD_AddDescriptor(struct _RXDState *State, int Descriptor)
+{ /*Returns a dup of Descriptor that will survive execve(), or -1. The dup doesn't have close-on-exec set.*/
+	int NewDescriptor = -1;
 	
-	MemBus_Write(MCode, false); /*Tell the child they can quit.*/
+	if (State->NumDescriptors == RXD_MAX_DESCRIPTORS || (NewDescriptor = dup(Descriptor)) == -1) return -1;
 	
-	/*Wait for the child to terminate.*/
-	waitpid(ChildPID, NULL, 0); /*We don't really have to, but I think we should.*/
+	State->Descriptors[State->NumDescriptors++] = NewDescriptor;
 	
-	/**
-	 * EVERYTHING BEYOND HERE IS USED TO RESUME NORMAL OPERATION!
-	 * **/
+	return NewDescriptor;
+}
+
+static void RXD_SaveState(struct _RXDState *State)
+{ /*Everything a running Epoch knows that isn't in the config file.*/
+	const ObjTable *Worker = ObjectTable;
+	struct _RXDObject Object;
+	struct _RXDGlobals Globals;
+	const struct _MemLogPage *Page = NULL;
+	const unsigned long Version = RXD_STATE_VERSION;
+	
+	RXD_Extend(State, RXD_STATE_MAGIC, sizeof RXD_STATE_MAGIC - 1);
+	RXD_Extend(State, &Version, sizeof(long));
+	
+	for (; Worker < ObjectTable + ObjectCount; ++Worker)
+	{
+		Object.ObjectPID = Worker->ObjectPID;
+		Object.StartedSince = Worker->StartedSince;
+		Object.Started = Worker->Started;
+		Object.AutoRestart = Worker->Opts.AutoRestart; /*Stop jobs turn this off while they run.*/
+		
+		RXD_Append(State, RXD_REC_OBJECT, &Object, sizeof Object);
+		RXD_Extend(State, Worker->ObjectID, strlen(Worker->ObjectID) + 1);
+	}
 	
-	/*Bring down the old, custom membus and bring up the classic.*/
-	ShutdownMemBus(false);
-	MemBusKey = MEMKEY;
+	RXD_Append(State, RXD_REC_HALTPARAMS, &HaltParams, sizeof HaltParams);
 	
-	/*Reset environment variables.*/
-	setenv("USER", ENVVAR_USER, true);
-	setenv("PATH", ENVVAR_PATH, true);
-	setenv("HOME", ENVVAR_HOME, true);
-	setenv("SHELL", ENVVAR_SHELL, true);
+	Globals.EnableLogging = EnableLogging;
+	Globals.DisableCAD = DisableCAD;
+	RXD_Append(State, RXD_REC_GLOBALS, &Globals, sizeof Globals);
 	
-	if (!InitMemBus(true))
-	{
-		SpitWarning("Cannot restart normal membus after re-exec. System is otherwise operational.");
+	RXD_Append(State, RXD_REC_RUNLEVEL, CurRunlevel, strlen(CurRunlevel) + 1);
+	
+	for (Page = MemLog.Head; Page; Page = Page->Next)
+	{ /*One record per page. The old image kept it all in one, and the new one reads either.*/
+		RXD_Append(State, RXD_REC_MEMLOG, Page->Data, Page->Used);
 	}
 	
-	if (ViaMemBus) /*Client probably wants confirmation.*/
+	Jobs_SaveState(State);
+	Events_SaveState(State);
+	Capture_SaveState(State);
+	Tail_SaveState(State);
+	Syslog_SaveState(State);
+	
+	RXD_Append(State, RXD_REC_END, NULL, 0);
+}
+
+static void RXD_Discard(struct _RXDState *State)
+{ /*Reexec didn't happen. Give back everything we made for it.*/
+	unsigned long Inc = 0;
+	
+	for (; Inc < State->NumDescriptors; ++Inc)
 	{
-		/*Handle pings.*/
-		for (; !HandleMemBusPings() && TInc < 100000; ++TInc)
-		{ /*Wait ten seconds.*/
-			 usleep(100);
-		}
-		
-		if (TInc < 100000)
-		{ /*Do not attempt this if we didn't receive a ping because it will only slow us down
-			with another ten second timeout.*/
-			/*Tell the client we are done.*/
-			MemBus_Write(MEMBUS_CODE_ACKNOWLEDGED " " MEMBUS_CODE_RXD, true);
-		}
+		close(State->Descriptors[Inc]);
 	}
-		
-	FinaliseLogStartup(false); /*Bring back logging.*/
-	LogInMemory = false;
 	
-	WriteLogLine(CONSOLE_COLOR_GREEN "Re-executed Epoch.\nNow using " VERSIONSTRING
-				"\nCompiled " __DATE__ " " __TIME__ "." CONSOLE_ENDCOLOR, true);
-				
-	PrimaryLoop(); /*Does everything until the end of time.*/
+	free(State->Blob);
+	memset(State, 0, sizeof(struct _RXDState));
 }
 
-void ReexecuteEpoch(void)
-{ /*Used when Epoch needs to be restarted after we already booted.*/
-	pid_t PID = 0;
-	FILE *TestDescriptor = fopen(EPOCH_BINARY_PATH, "rb");
-	char OutBuf[MEMBUS_MSGSIZE] = { '\0' };
-	ObjTable *Worker = ObjectTable;
-	const char *MCode = MEMBUS_CODE_RXD;
-	unsigned long MCodeLength = strlen(MCode) + 1;
-	short HPS = 0;
+static int RXD_CreateMemfd(const struct _RXDState *State)
+{ /*No close-on-exec here, that's the whole point.*/
+	unsigned long Written = 0;
+	long Result = 0;
+	int Descriptor = -1;
 	
-	ShutdownMemBus(true); /*We are now going to use a different MemBus key.*/
-	MemBusKey = MEMKEY + 1; /*This prevents clients from interfering.*/
-		
+#ifdef SYS_memfd_create
+	Descriptor = (int)syscall(SYS_memfd_create, "epoch-rxd", 0);
+#endif
 	
-	if (!TestDescriptor)
-	{
-		EmulWall("Epoch: " CONSOLE_COLOR_RED "ERROR: " CONSOLE_ENDCOLOR
-				"Unable to read \"" EPOCH_BINARY_PATH "\"! Cannot reexec!", false);
+	if (Descriptor == -1) return -1;
 	
-		MemBusKey = MEMKEY;
-		
-		if (!InitMemBus(true))
+	while (Written < State->Size)
+	{
+		if ((Result = write(Descriptor, State->Blob + Written, State->Size - Written)) <= 0)
 		{
-			SpitError("ReexecuteEpoch(): Failed to restart membus after failed reexec!");
+			close(Descriptor);
+			return -1;
 		}
 		
-		MemBus_Write(MEMBUS_CODE_FAILURE " " MEMBUS_CODE_RXD, true);
-		return;
+		Written += Result;
 	}
-	else
+	
+	return Descriptor;
+}
+
+static rStatus RXD_RestoreState(void)
+{ /*Maps the memfd the old image left us and puts it all back.*/
+	const char *EnvValue = getenv(RXD_STATE_ENVVAR);
+	const unsigned char *Blob = NULL, *Worker = NULL;
+	unsigned long Header[2], Version = 0;
+	struct _RXDObject Object;
+	struct _RXDGlobals Globals;
+	struct stat FileStat;
+	rStatus RetVal = SUCCESS;
+	ObjTable *CurObj = NULL;
+	int Descriptor;
+	
+	if (!EnvValue || !AllNumeric(EnvValue)) return FAILURE;
+	
+	Descriptor = atoi(EnvValue);
+	unsetenv(RXD_STATE_ENVVAR);
+	
+	if (fstat(Descriptor, &FileStat) != 0 || FileStat.st_size < (off_t)(sizeof RXD_STATE_MAGIC - 1 + sizeof(long)) ||
+		(Blob = mmap(NULL, FileStat.st_size, PROT_READ, MAP_PRIVATE, Descriptor, 0)) == MAP_FAILED)
 	{
-		fclose(TestDescriptor);
+		close(Descriptor);
+		return FAILURE;
 	}
 	
-	if ((PID = fork()) == -1)
+	close(Descriptor); /*The mapping keeps it alive.*/
+	
+	memcpy(&Version, Blob + sizeof RXD_STATE_MAGIC - 1, sizeof(long));
+	
+	if (memcmp(Blob, RXD_STATE_MAGIC, sizeof RXD_STATE_MAGIC - 1) != 0 || Version != RXD_STATE_VERSION)
 	{
-		EmulWall("Epoch: " CONSOLE_COLOR_RED "ERROR: " CONSOLE_ENDCOLOR
-				"Unable to fork! Aborting reexecution.", false);
-				
-		MemBusKey = MEMKEY;
-		
-		if (!InitMemBus(true)) /*Bring back the membus.*/
-		{
-			SpitError("ReexecuteEpoch(): Failed to restart membus after failed reexec!");
-		}
-		
-		MemBus_Write(MEMBUS_CODE_FAILURE " " MEMBUS_CODE_RXD, true);
-		return;
+		munmap((void*)Blob, FileStat.st_size);
+		return FAILURE;
 	}
 	
-	/*Handle us if we are the original process first.*/
-	if (PID > 0)
+	for (Worker = Blob + sizeof RXD_STATE_MAGIC - 1 + sizeof(long); ; )
 	{
-		WriteLogLine(CONSOLE_COLOR_YELLOW "Re-executing Epoch..." CONSOLE_ENDCOLOR, true);
+		const unsigned char *Data = NULL;
 		
-		while (shmget(MEMKEY + 1, MEMBUS_SIZE, 0660) == -1) usleep(100);
+		Worker = Blob + ((Worker - Blob + sizeof(long) - 1) & ~(sizeof(long) - 1));
 		
-		/**Execute the new binary.**/ /*We pass the custom args to tell us we are re-executing.*/
-		execlp(EPOCH_BINARY_PATH, "!rxd", "REEXEC", NULL);
+		if (Worker + sizeof Header > Blob + FileStat.st_size)
+		{
+			RetVal = FAILURE;
+			break;
+		}
 		
-		/*Not supposed to be here.*/
-		EmulWall(CONSOLE_COLOR_RED "ERROR: " CONSOLE_ENDCOLOR
-				"Failed to execute \"" EPOCH_BINARY_PATH "\"! Cannot reexec!", false);
-				
-		WriteLogLine(CONSOLE_COLOR_RED "Reexecution failed." CONSOLE_ENDCOLOR, true);
-		kill(PID, SIGKILL); /*Kill the failed child.*/
+		memcpy(Header, Worker, sizeof Header);
+		Data = Worker + sizeof Header;
 		
-		if (shmget(MEMKEY + 1, MEMBUS_SIZE, 0660) != -1)
+		if (Header[1] > (unsigned long)(Blob + FileStat.st_size - Data))
 		{
-			ShutdownMemBus(true);
+			RetVal = FAILURE;
+			break;
 		}
 		
-		MemBusKey = MEMKEY;
+		Worker = Data + Header[1];
+		
+		if (Header[0] == RXD_REC_END) break;
 		
-		if (!InitMemBus(true))
+		switch (Header[0])
 		{
-			SpitError("ReexecuteEpoch(): Failed to restart membus after failed reexec!");
+			case RXD_REC_OBJECT:
+			{
+				if (Header[1] <= sizeof Object || Data[Header[1] - 1] != '\0')
+				{
+					RetVal = WARNING;
+					break;
+				}
+				
+				memcpy(&Object, Data, sizeof Object);
+				
+				if ((CurObj = LookupObjectInTable((const char*)Data + sizeof Object)))
+				{ /*Objects that left the config while we were away are simply forgotten.*/
+					CurObj->ObjectPID = Object.ObjectPID;
+					CurObj->StartedSince = Object.StartedSince;
+					CurObj->Started = Object.Started;
+					CurObj->Opts.AutoRestart = Object.AutoRestart;
+				}
+				break;
+			}
+			case RXD_REC_HALTPARAMS:
+				if (Header[1] == sizeof HaltParams) memcpy((void*)&HaltParams, Data, sizeof HaltParams);
+				else RetVal = WARNING;
+				break;
+			case RXD_REC_GLOBALS:
+				if (Header[1] == sizeof Globals)
+				{
+					memcpy(&Globals, Data, sizeof Globals);
+					EnableLogging = Globals.EnableLogging;
+					DisableCAD = Globals.DisableCAD;
+				}
+				else RetVal = WARNING;
+				break;
+			case RXD_REC_RUNLEVEL:
+				snprintf(CurRunlevel, sizeof CurRunlevel, "%.*s", (int)Header[1], (const char*)Data);
+				break;
+			case RXD_REC_MEMLOG:
+				{ /*Older versions put a NUL on the end.*/
+					unsigned long Length = Header[1];
+					
+					while (Length > 0 && ((const char*)Data)[Length - 1] == '\0') --Length;
+					MemLog_Append((const char*)Data, Length);
+				}
+				break;
+			case RXD_REC_JOBCOUNTER:
+			case RXD_REC_JOB:
+				if (!Jobs_RestoreState(Header[0], Data, Header[1])) RetVal = WARNING;
+				break;
+			case RXD_REC_EVENTS:
+			case RXD_REC_SUBSCRIBER:
+				if (!Events_RestoreState(Header[0], Data, Header[1])) RetVal = WARNING;
+				break;
+			case RXD_REC_CAPTURE:
+				if (!Capture_RestoreState(Data, Header[1])) RetVal = WARNING;
+				break;
+			case RXD_REC_TAIL:
+				Tail_RestoreState(Data, Header[1]); /*Nobody's hurt if one doesn't make it.*/
+				break;
+			case RXD_REC_SYSLOG:
+				if (!Syslog_RestoreState(Data, Header[1])) RetVal = WARNING;
+				break;
+			default: /*Newer than us, maybe. Skip it.*/
+				break;
 		}
-		
-		MemBus_Write(MEMBUS_CODE_FAILURE " " MEMBUS_CODE_RXD, true);
-		return;
 	}
 	
-	/**The child is responsible for sending us our data.**/
+	munmap((void*)Blob, FileStat.st_size);
+	
+	/*The segment outlived the exec, lock and all, so whoever asked for this still holds it.*/
 	if (!InitMemBus(true))
 	{
-		EmulWall("Epoch: " CONSOLE_COLOR_RED "ERROR: " CONSOLE_ENDCOLOR
-				"Re-exec: Child unable to start modified membus. Child terminating.", false);
-		exit(1);
+		SpitWarning("Cannot restart membus after re-exec. System is otherwise operational.");
 	}
 	
-	while (!HandleMemBusPings())
-	{ /*Wait for the re-executed parent process to connect to receive it's config.*/
-		static unsigned long Counter = 0;
+	return RetVal;
+}
+
+static Bool RXD_LegacyNext(char *InBuf)
+{ /*The next message from the old child, as long as it doesn't go quiet on us for ten seconds.*/
+	unsigned long Inc = 0;
 	
-		usleep(1000); /*0.001 seconds.*/
-		
-		if (Counter == 0) ++Counter;
-		else if (Counter >= 10000) /*Sleep ten seconds.*/
+	for (; !MemBus_LegacyBinRead(InBuf, MEMBUS_MSGSIZE); ++Inc)
+	{
+		if (Inc == 100000) return false;
+		usleep(100);
+	}
+	
+	InBuf[MEMBUS_MSGSIZE - 1] = '\0';
+	return true;
+}
+
+static rStatus RXD_LegacyReceive(void)
+{ /*An Epoch from before the state memfd exec'd us. It left a child on MEMKEY + 1 to hand us it's state
+	* a message at a time, same as it would've to itself. We take what it gives and tell it to go away.*/
+	char InBuf[MEMBUS_MSGSIZE];
+	const unsigned long RXDLength = sizeof MEMBUS_CODE_RXD, OptsLength = sizeof MEMBUS_CODE_RXD_OPTS;
+	unsigned long TLength = 0, Inc = 0;
+	ObjTable *CurObj = NULL;
+	pid_t ChildPID = 0;
+	rStatus RetVal = SUCCESS;
+	
+	if (!MemBus_LegacyConnect(MEMKEY + 1))
+	{
+		if (!InitMemBus(true)) SpitWarning("Cannot restart membus after re-exec. System is otherwise operational.");
+		return FAILURE;
+	}
+	
+	/*It greets us with just it's PID.*/
+	if (!RXD_LegacyNext(InBuf)) goto Lost;
+	memcpy(&ChildPID, InBuf, sizeof(pid_t));
+	
+	if (!RXD_LegacyNext(InBuf)) goto Lost;
+	
+	while (!strcmp(InBuf, MEMBUS_CODE_RXD))
+	{ /*The object ID, then the PID, Started and StartedSince, packed.*/
+		if ((CurObj = LookupObjectInTable(InBuf + RXDLength)) != NULL &&
+			RXDLength + (TLength = strlen(InBuf + RXDLength) + 1) + sizeof(long) * 2 + sizeof(Bool) <= sizeof InBuf)
 		{
-			/*Quietly exit.*/
-			SpitError("Host process not responding for reexec data exchange. Child exiting.");
-			ShutdownMemBus(true);
-			
-			exit(1);
+			memcpy(&CurObj->ObjectPID, InBuf + RXDLength + TLength, sizeof(long));
+			memcpy(&CurObj->Started, InBuf + RXDLength + TLength + sizeof(long), sizeof(Bool));
+			memcpy(&CurObj->StartedSince, InBuf + RXDLength + TLength + sizeof(long) + sizeof(Bool), sizeof(long));
 		}
+		
+		if (!RXD_LegacyNext(InBuf)) goto Lost;
 	}
 	
-	/*Send our PID. This doubles as a greeting.*/
-	PID = getpid();
-	MemBus_BinWrite(&PID, sizeof(pid_t), true);
+	/*HaltParams is all longs, and hasn't changed.*/
+	memcpy((void*)&HaltParams, InBuf + OptsLength, sizeof HaltParams);
+	
+	if (!RXD_LegacyNext(InBuf)) goto Lost;
+	EnableLogging = (Bool)InBuf[OptsLength];
 	
-	strncpy(OutBuf, MCode, MCodeLength); /*We only need to do this once per MCode change, since we never wipe OutBuf.*/
+	if (!RXD_LegacyNext(InBuf)) goto Lost;
+	snprintf(CurRunlevel, sizeof CurRunlevel, "%s", InBuf + OptsLength);
 	
-	/*PIDs and started states.
-	 * It doesn't matter if they are done eating the PID,
-	 * MemBus_*Write() blocks until they're done with the first message.*/
-	for (; Worker->Next; Worker = Worker->Next)
+	MemBus_LegacyWrite(MEMBUS_CODE_RXD_OPTS); /*Tell the child it can quit.*/
+	for (; !MemBus_LegacyEaten() && Inc < 100000; ++Inc) usleep(100);
+	goto Done;
+	
+Lost: /*Whatever we got is kept, the rest went with the child.*/
+	RetVal = WARNING;
+	
+Done:
+	MemBus_LegacyDisconnect();
+	
+	if (RetVal == SUCCESS && ChildPID > 0) waitpid(ChildPID, NULL, 0);
+	
+	/*The old membus went away with the old image, so this one's new.*/
+	if (!InitMemBus(true))
+	{
+		SpitWarning("Cannot restart membus after re-exec. System is otherwise operational.");
+	}
+	
+	return RetVal;
+}
+
+void RecoverFromReexec(Bool ViaMemBus)
+{ /*This is called when we are reexecuted from ReexecuteEpoch() to pick our state back up.*/
+	rStatus RestoreStatus;
+	Bool Legacy = false;
+	
+	if (!InitConfig())
 	{
-		unsigned long TLength = 0;
-		strncpy(OutBuf + MCodeLength, Worker->ObjectID, (TLength = strlen(Worker->ObjectID) + 1));
+		EmulWall("Epoch: "CONSOLE_COLOR_RED "ERROR: " CONSOLE_ENDCOLOR
+		"Cannot reload configuration for re-exec!", false);
+		EmergencyShell();
+	}
+	
+	/*For one release, we can still take over from an Epoch that doesn't know about the memfd.*/
+	Legacy = !getenv(RXD_STATE_ENVVAR) && MemBus_LegacyPresent(MEMKEY + 1);
+	
+	if ((RestoreStatus = (Legacy ? RXD_LegacyReceive() : RXD_RestoreState())) == FAILURE)
+	{ /*We still have the config, so carry on, but we no longer know what's running.*/
+		EmulWall("Epoch: "CONSOLE_COLOR_RED "ERROR: " CONSOLE_ENDCOLOR
+				"Re-executed without saved state! Object states are lost.", false);
 		
-		memcpy(OutBuf + MCodeLength + TLength, &Worker->ObjectPID, sizeof(long));
-		memcpy(OutBuf + sizeof(long) + TLength + MCodeLength, &Worker->Started, sizeof(Bool));
-		memcpy(OutBuf + sizeof(long) + sizeof(Bool) + TLength + MCodeLength, &Worker->StartedSince, sizeof(long));
+		if (!BusRunning) InitMemBus(true);
+	}
+	else if (RestoreStatus == WARNING)
+	{
+		SpitWarning("Some saved state was damaged and was not restored after re-exec.");
+	}
+	
+	/*Reset environment variables.*/
+	setenv("USER", ENVVAR_USER, true);
+	setenv("PATH", ENVVAR_PATH, true);
+	setenv("HOME", ENVVAR_HOME, true);
+	setenv("SHELL", ENVVAR_SHELL, true);
+	
+	/*A client that got an old Epoch to do this is on a membus that's gone. It'll see ours come up.*/
+	if (ViaMemBus && BusRunning && !Legacy) /*Client probably wants confirmation.*/
+	{
+		MemBus_Write((RestoreStatus == FAILURE ? MEMBUS_CODE_WARNING " " MEMBUS_CODE_RXD :
+					MEMBUS_CODE_ACKNOWLEDGED " " MEMBUS_CODE_RXD), true);
+	}
 		
-		MemBus_BinWrite(OutBuf, sizeof OutBuf, true);
+	FinaliseLogStartup(false); /*Bring back logging.*/
+	LogInMemory = false;
+	
+	WriteLogLine(CONSOLE_COLOR_GREEN "Re-executed Epoch.\nNow using " VERSIONSTRING
+				"\nCompiled " __DATE__ " " __TIME__ "." CONSOLE_ENDCOLOR, true);
+				
+	PrimaryLoop(); /*Does everything until the end of time.*/
+}
+
+void ReexecuteEpoch(void)
+{ /*Used when Epoch needs to be restarted after we already booted.
+	* Our state goes over in a memfd, so there's no helper process and the membus stays where it is.*/
+	struct _RXDState State;
+	char EnvBuf[64];
+	int StateDescriptor = -1;
+	
+	if (access(EPOCH_BINARY_PATH, R_OK | X_OK) != 0)
+	{
+		EmulWall("Epoch: " CONSOLE_COLOR_RED "ERROR: " CONSOLE_ENDCOLOR
+				"Unable to read \"" EPOCH_BINARY_PATH "\"! Cannot reexec!", false);
+		
+		unsetenv("EPOCHRXDMEMBUS");
+		MemBus_Write(MEMBUS_CODE_FAILURE " " MEMBUS_CODE_RXD, true);
+		return;
 	}
 	
-	/*We change to a new code to mark the end of our loop.*/
-	strncpy(OutBuf, (MCode = MEMBUS_CODE_RXD_OPTS), (MCodeLength = strlen(MEMBUS_CODE_RXD_OPTS) + 1));
+	memset(&State, 0, sizeof State);
+	RXD_SaveState(&State);
 	
-	/*HaltParams, we're lazy and just write the whole structure.*/
-	memcpy(OutBuf + MCodeLength + (HPS++ * sizeof(long)), (void*)&HaltParams.HaltMode, sizeof HaltParams);
-	memcpy(OutBuf + MCodeLength + (HPS++ * sizeof(long)), (void*)&HaltParams.TargetHour, sizeof HaltParams);
-	memcpy(OutBuf + MCodeLength + (HPS++ * sizeof(long)), (void*)&HaltParams.TargetMin, sizeof HaltParams);
-	memcpy(OutBuf + MCodeLength + (HPS++ * sizeof(long)), (void*)&HaltParams.TargetSec, sizeof HaltParams);
-	memcpy(OutBuf + MCodeLength + (HPS++ * sizeof(long)), (void*)&HaltParams.TargetMonth, sizeof HaltParams);
-	memcpy(OutBuf + MCodeLength + (HPS++ * sizeof(long)), (void*)&HaltParams.TargetDay, sizeof HaltParams);
-	memcpy(OutBuf + MCodeLength + (HPS++ * sizeof(long)), (void*)&HaltParams.TargetYear, sizeof HaltParams);
-	memcpy(OutBuf + MCodeLength + (HPS++ * sizeof(long)), (void*)&HaltParams.JobID, sizeof HaltParams);
+	if (State.Failed || (StateDescriptor = RXD_CreateMemfd(&State)) == -1)
+	{
+		EmulWall("Epoch: " CONSOLE_COLOR_RED "ERROR: " CONSOLE_ENDCOLOR
+				"Unable to save state for reexec! Aborting reexecution.", false);
+		
+		RXD_Discard(&State);
+		unsetenv("EPOCHRXDMEMBUS");
+		MemBus_Write(MEMBUS_CODE_FAILURE " " MEMBUS_CODE_RXD, true);
+		return;
+	}
 	
-	MemBus_BinWrite(OutBuf, sizeof HaltParams + MCodeLength, true);
+	snprintf(EnvBuf, sizeof EnvBuf, "%d", StateDescriptor);
+	setenv(RXD_STATE_ENVVAR, EnvBuf, true);
 	
-	/*Misc. global options. We don't include all because only some are used after initial boot.*/
-	*(OutBuf + MCodeLength) = (char)EnableLogging;
-	MemBus_BinWrite(OutBuf, MCodeLength + 1, true);
+	WriteLogLine(CONSOLE_COLOR_YELLOW "Re-executing Epoch..." CONSOLE_ENDCOLOR, true);
+	Log_Shutdown(); /*The new image opens it again.*/
+	fflush(NULL);
 	
-	/*The current runlevel is very important.*/
-	strncpy(OutBuf + MCodeLength, CurRunlevel, strlen(CurRunlevel) + 1);
-	MemBus_BinWrite(OutBuf, sizeof OutBuf, true);
+	/**Execute the new binary.**/ /*We pass the custom args to tell us we are re-executing.*/
+	execlp(EPOCH_BINARY_PATH, "!rxd", "REEXEC", NULL);
 	
-	while (!MemBus_Read(OutBuf, true)) usleep(100); /*Wait for the main process to say we can quit.*/
-	ShutdownMemBus(true); /*Nothing is deleted until the new process releases the lock, don't worry.*/
-	ShutdownConfig();
+	/*Not supposed to be here.*/
+	EmulWall(CONSOLE_COLOR_RED "ERROR: " CONSOLE_ENDCOLOR
+			"Failed to execute \"" EPOCH_BINARY_PATH "\"! Cannot reexec!", false);
+			
+	WriteLogLine(CONSOLE_COLOR_RED "Reexecution failed." CONSOLE_ENDCOLOR, true);
 	
-	exit(0);
+	close(StateDescriptor);
+	RXD_Discard(&State);
+	unsetenv(RXD_STATE_ENVVAR);
+	unsetenv("EPOCHRXDMEMBUS");
+	
+	MemBus_Write(MEMBUS_CODE_FAILURE " " MEMBUS_CODE_RXD, true);
 }
 
 void PerformExec(const char *Cmd)
@@ -615,31 +868,31 @@ void PerformPivotRoot(const char *NewRoot, const char *OldRootDir)
 
 void FinaliseLogStartup(Bool BlankLog)
 {
-	if (MemLogBuffer != NULL)
+	if (MemLog.Head != NULL)
 	{ /*Switch logging out of memory mode and write it's memory buffer to disk.*/		
 		if (EnableLogging)
 		{
-			FILE *Descriptor = fopen(LOGDIR LOGFILE_NAME, (BlankLog ? "w" : "a"));
-
 			LogInMemory = false;
 
-			if (!Descriptor)
+			if (!Log_Open(BlankLog))
 			{
 				SpitWarning("Cannot record logs to disk. Shutting down logging.");
 				EnableLogging = false;
 			}
 			else
-			{
-				fwrite(MemLogBuffer, 1, strlen(MemLogBuffer), Descriptor);
-				fflush(Descriptor);
-				fclose(Descriptor);
+			{ /*Anything from before a config reload goes first.*/
+				Log_Flush();
+				MemLog_WriteOut();
 			}
 			
 		}
 		
-		free(MemLogBuffer); /*Release the memory anyways.*/
-		MemLogBuffer = NULL;
+		MemLog_Release(); /*Release the memory anyways.*/
 	}
+	
+	/*The log store follows the config, so a reload can turn it on or off.*/
+	if (EnableLogging && LogStoreEnabled) LogStore_Open();
+	else LogStore_Close();
 }
 
 void LaunchBootup(void)
@@ -771,6 +1024,8 @@ void LaunchShutdown(signed long Signal)
 	snprintf(MsgBuf, sizeof MsgBuf, "System is going down for %s NOW!", HType);
 	EmulWall(MsgBuf, false);
 	
+	Capture_Shutdown(); /*The last of what objects printed goes in before we stop logging.*/
+	
 	if (!BlankLogOnBoot) /*No point in doing it if it's just going to be erased.*/
 	{
 		WriteLogLine(LogMsg, true);
@@ -778,6 +1033,7 @@ void LaunchShutdown(signed long Signal)
 	
 
 	EnableLogging = false; /*Prevent any additional log entries.*/
+	Log_Shutdown(); /*And write out the ones we have.*/
 	
 	/*Kill any running jobs.*/
 	if (CurrentTask.Set)
@@ -800,6 +1056,9 @@ void LaunchShutdown(signed long Signal)
 		CurrentTask.PID = 0;
 	}
 	
+	Jobs_Shutdown(); /*And the ones we run in the background.*/
+	Events_Shutdown();
+	Syslog_Shutdown();
 	
 	if (!ShutdownMemBus(true))
 	{ /*Shutdown membus first, so no other signals will reach us.*/
@@ -821,6 +1080,8 @@ void LaunchShutdown(signed long Signal)
 		EmergencyShell();
 	}
 	
+	KillAll_Run(); /*Whatever the objects left behind.*/
+	
 	ShutdownConfig();
 	
 	
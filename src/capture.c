@@ -0,0 +1,341 @@
+/*This code is part of the Epoch Init System.
+* The Epoch Init System is maintained by Subsentient.
+* This software is public domain.
+* Please read the file UNLICENSE.TXT for more information.*/
+
+/**This file takes what objects print and puts it in the log, for "ObjectStdout CAPTURE"
+ * and "ObjectStderr CAPTURE". Each object gets a pipe per stream, and we keep the write end
+ * open ourselves, so an autorestarted service lands in the same pipe and nothing is lost between
+ * runs. The primary loop reads what's there without blocking, and each line goes into the log
+ * with a timestamp and the object ID in front. A stream that prints faster than CaptureRateLimit
+ * gets the rest of that second thrown away, and the log says how much.**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include "epoch.h"
+
+static struct _CaptureStream
+{
+	int ReadEnd;
+	int WriteEnd; /*-1 once the config doesn't want it. We still read until whoever has it lets go.*/
+	Bool IsStderr;
+	char ObjectID[MAX_DESCRIPT_SIZE];
+	
+	unsigned long WindowStart; /*The second WindowLines counts for.*/
+	unsigned long WindowLines;
+	unsigned long Suppressed; /*Lines thrown away in that second.*/
+	
+	unsigned long PartialUsed; /*We read straight into here, and what's left is a line that hasn't ended yet.*/
+	char Partial[MAX_LINE_SIZE];
+} *Streams[CAPTURE_MAX_STREAMS];
+
+struct _RXDCapture
+{ /*A stream as it goes across a reexec. The object ID, then the partial line, follow it.*/
+	int ReadEnd;
+	int WriteEnd;
+	Bool IsStderr;
+	unsigned long WindowStart;
+	unsigned long WindowLines;
+	unsigned long Suppressed;
+	unsigned long PartialUsed;
+};
+
+unsigned long CaptureRateLimit = CAPTURE_DEFAULT_RATE;
+
+static void Capture_Release(unsigned long Slot)
+{
+	struct _CaptureStream *const Stream = Streams[Slot];
+	
+	close(Stream->ReadEnd);
+	if (Stream->WriteEnd != -1) close(Stream->WriteEnd);
+	
+	free(Stream);
+	Streams[Slot] = NULL;
+}
+
+static void Capture_ReportSuppressed(struct _CaptureStream *Stream)
+{
+	char OutBuf[MAX_LINE_SIZE];
+	
+	snprintf(OutBuf, sizeof OutBuf, "CAPTURE: " CONSOLE_COLOR_YELLOW "Suppressed %lu lines of %s from \"%s\", "
+			"it went over CaptureRateLimit." CONSOLE_ENDCOLOR, Stream->Suppressed, Stream->IsStderr ? "stderr" : "stdout",
+			Stream->ObjectID);
+	WriteLogLine(OutBuf, true);
+	
+	Stream->Suppressed = 0;
+}
+
+static void Capture_Line(struct _CaptureStream *Stream, const char *Line, unsigned long Length, unsigned long Now)
+{
+	if (Length > 0 && Line[Length - 1] == '\r') --Length;
+	
+	/*Before the limit, since the last lines before a crash are the ones people want.*/
+	Tail_Append(Stream->ObjectID, Line, Length);
+	
+	if (Now != Stream->WindowStart)
+	{
+		if (Stream->Suppressed) Capture_ReportSuppressed(Stream);
+		
+		Stream->WindowStart = Now;
+		Stream->WindowLines = 0;
+	}
+	
+	if (CaptureRateLimit && Stream->WindowLines >= CaptureRateLimit)
+	{
+		++Stream->Suppressed;
+		return;
+	}
+	
+	++Stream->WindowLines;
+	
+	WriteObjectLogLine(Stream->ObjectID, Stream->IsStderr ? LOGSEV_NOTICE : LOGSEV_INFO, Line, Length);
+}
+
+static void Capture_Split(struct _CaptureStream *Stream, Bool Final, unsigned long Now)
+{ /*Logs every whole line in Partial and moves what's left to the front.
+	* A line as big as the buffer goes out in pieces, and Final sends whatever's left.*/
+	const char *Worker = Stream->Partial, *const End = Stream->Partial + Stream->PartialUsed;
+	const char *LineEnd = NULL;
+	
+	for (; (LineEnd = memchr(Worker, '\n', End - Worker)); Worker = LineEnd + 1)
+	{
+		Capture_Line(Stream, Worker, LineEnd - Worker, Now);
+	}
+	
+	if (Worker < End && (Final || (Worker == Stream->Partial && Stream->PartialUsed == sizeof Stream->Partial)))
+	{
+		Capture_Line(Stream, Worker, End - Worker, Now);
+		Worker = End;
+	}
+	
+	Stream->PartialUsed = End - Worker;
+	
+	if (Stream->PartialUsed && Worker != Stream->Partial) memmove(Stream->Partial, Worker, Stream->PartialUsed);
+}
+
+static void Capture_Read(unsigned long Slot, unsigned long Now)
+{ /*Up to CAPTURE_READ_BUDGET, so one service can't keep us in here. The rest waits for next time.*/
+	struct _CaptureStream *const Stream = Streams[Slot];
+	unsigned long Taken = 0;
+	long Got;
+	
+	while (Taken < CAPTURE_READ_BUDGET)
+	{
+		Got = read(Stream->ReadEnd, Stream->Partial + Stream->PartialUsed, sizeof Stream->Partial - Stream->PartialUsed);
+		
+		if (Got == -1)
+		{
+			if (errno == EINTR) continue;
+			return; /*Nothing more right now.*/
+		}
+		
+		if (Got == 0)
+		{ /*Every writer is gone. That only happens after Capture_Prune() gave up our end.*/
+			Capture_Split(Stream, true, Now);
+			if (Stream->Suppressed) Capture_ReportSuppressed(Stream);
+			Capture_Release(Slot);
+			return;
+		}
+		
+		Taken += Got;
+		Stream->PartialUsed += Got;
+		Capture_Split(Stream, false, Now);
+	}
+}
+
+int Capture_Descriptor(const ObjTable *InObj, Bool IsStderr)
+{ /*The write end for the object's stdout or stderr, made the first time we're asked. -1 if we can't.
+	* Call this before (v)fork() so the child only has to dup2() it.*/
+	struct _CaptureStream *Stream = NULL;
+	unsigned long Inc = 0, Free = CAPTURE_MAX_STREAMS;
+	int Pipe[2];
+	
+	for (; Inc < CAPTURE_MAX_STREAMS; ++Inc)
+	{
+		if (!Streams[Inc])
+		{
+			if (Free == CAPTURE_MAX_STREAMS) Free = Inc;
+			continue;
+		}
+		
+		if (Streams[Inc]->WriteEnd != -1 && Streams[Inc]->IsStderr == IsStderr &&
+			!strcmp(Streams[Inc]->ObjectID, InObj->ObjectID))
+		{
+			return Streams[Inc]->WriteEnd;
+		}
+	}
+	
+	if (Free == CAPTURE_MAX_STREAMS)
+	{
+		WriteLogLine("CAPTURE: " CONSOLE_COLOR_YELLOW "Too many captured streams, not capturing output for this one."
+					CONSOLE_ENDCOLOR, true);
+		return -1;
+	}
+	
+	if (!(Stream = malloc(sizeof(struct _CaptureStream)))) return -1;
+	
+	if (pipe(Pipe) == -1)
+	{
+		free(Stream);
+		return -1;
+	}
+	
+	/*Only we read, and never wait on it. The object gets a normal blocking pipe.*/
+	fcntl(Pipe[0], F_SETFL, fcntl(Pipe[0], F_GETFL) | O_NONBLOCK);
+	fcntl(Pipe[0], F_SETFD, FD_CLOEXEC);
+	fcntl(Pipe[1], F_SETFD, FD_CLOEXEC);
+	
+	memset(Stream, 0, sizeof(struct _CaptureStream));
+	Stream->ReadEnd = Pipe[0];
+	Stream->WriteEnd = Pipe[1];
+	Stream->IsStderr = IsStderr;
+	snprintf(Stream->ObjectID, sizeof Stream->ObjectID, "%s", InObj->ObjectID);
+	
+	Streams[Free] = Stream;
+	
+	return Stream->WriteEnd;
+}
+
+void Capture_Service(int Timeout)
+{ /*One poll() for all the streams. Timeout is in milliseconds, and the primary loop uses zero.*/
+	struct pollfd Polls[CAPTURE_MAX_STREAMS];
+	unsigned long Slots[CAPTURE_MAX_STREAMS];
+	unsigned long Inc = 0, NumPolls = 0;
+	const unsigned long Now = time(NULL);
+	
+	for (; Inc < CAPTURE_MAX_STREAMS; ++Inc)
+	{
+		if (!Streams[Inc]) continue;
+		
+		/*Quiet since they went over the limit, so they won't get a line in to trigger the note.*/
+		if (Streams[Inc]->Suppressed && Streams[Inc]->WindowStart != Now) Capture_ReportSuppressed(Streams[Inc]);
+		
+		Polls[NumPolls].fd = Streams[Inc]->ReadEnd;
+		Polls[NumPolls].events = POLLIN;
+		Polls[NumPolls].revents = 0;
+		Slots[NumPolls++] = Inc;
+	}
+	
+	if (!NumPolls)
+	{
+		if (Timeout > 0) usleep(Timeout * 1000);
+		return;
+	}
+	
+	if (poll(Polls, NumPolls, Timeout) <= 0) return;
+	
+	for (Inc = 0; Inc < NumPolls; ++Inc)
+	{
+		if (Polls[Inc].revents) Capture_Read(Slots[Inc], Now);
+	}
+}
+
+void Capture_Prune(void)
+{ /*After a config reload. We close our end of anything the object doesn't capture anymore,
+	* and Capture_Read() lets go of it once the object has too.*/
+	const ObjTable *CurObj = NULL;
+	unsigned long Inc = 0;
+	
+	for (; Inc < CAPTURE_MAX_STREAMS; ++Inc)
+	{
+		struct _CaptureStream *const Stream = Streams[Inc];
+		
+		if (!Stream || Stream->WriteEnd == -1) continue;
+		
+		if ((CurObj = LookupObjectInTable(Stream->ObjectID)) &&
+			(Stream->IsStderr ? CurObj->Opts.CaptureStderr : CurObj->Opts.CaptureStdout))
+		{
+			continue;
+		}
+		
+		close(Stream->WriteEnd);
+		Stream->WriteEnd = -1;
+	}
+}
+
+void Capture_Shutdown(void)
+{ /*Get in what's left, including lines without an end, and close it all.*/
+	unsigned long Inc = 0;
+	
+	Capture_Service(0);
+	
+	for (; Inc < CAPTURE_MAX_STREAMS; ++Inc)
+	{
+		if (!Streams[Inc]) continue;
+		
+		Capture_Split(Streams[Inc], true, time(NULL));
+		if (Streams[Inc]->Suppressed) Capture_ReportSuppressed(Streams[Inc]);
+		Capture_Release(Inc);
+	}
+}
+
+void Capture_SaveState(struct _RXDState *State)
+{ /*For reexec. Both ends go over, so objects never notice.*/
+	struct _RXDCapture Rec;
+	unsigned long Inc = 0;
+	
+	for (; Inc < CAPTURE_MAX_STREAMS; ++Inc)
+	{
+		const struct _CaptureStream *const Stream = Streams[Inc];
+		
+		if (!Stream || (Rec.ReadEnd = RXD_AddDescriptor(State, Stream->ReadEnd)) == -1) continue;
+		
+		Rec.WriteEnd = Stream->WriteEnd == -1 ? -1 : RXD_AddDescriptor(State, Stream->WriteEnd);
+		Rec.IsStderr = Stream->IsStderr;
+		Rec.WindowStart = Stream->WindowStart;
+		Rec.WindowLines = Stream->WindowLines;
+		Rec.Suppressed = Stream->Suppressed;
+		Rec.PartialUsed = Stream->PartialUsed;
+		
+		RXD_Append(State, RXD_REC_CAPTURE, &Rec, sizeof Rec);
+		RXD_Extend(State, Stream->ObjectID, strlen(Stream->ObjectID) + 1);
+		RXD_Extend(State, Stream->Partial, Stream->PartialUsed);
+	}
+}
+
+rStatus Capture_RestoreState(const void *Data, unsigned long Length)
+{
+	struct _CaptureStream *Stream = NULL;
+	struct _RXDCapture Rec;
+	const char *ObjectID = (const char*)Data + sizeof Rec, *IDEnd = NULL;
+	unsigned long Inc = 0;
+	
+	if (Length < sizeof Rec) return FAILURE;
+	
+	memcpy(&Rec, Data, sizeof Rec);
+	
+	for (; Inc < CAPTURE_MAX_STREAMS && Streams[Inc]; ++Inc);
+	
+	if (Inc == CAPTURE_MAX_STREAMS || !(IDEnd = memchr(ObjectID, '\0', Length - sizeof Rec)) ||
+		IDEnd - ObjectID >= MAX_DESCRIPT_SIZE || Rec.PartialUsed > MAX_LINE_SIZE ||
+		(const char*)Data + Length - (IDEnd + 1) != (long)Rec.PartialUsed ||
+		!(Stream = malloc(sizeof(struct _CaptureStream))))
+	{
+		close(Rec.ReadEnd);
+		if (Rec.WriteEnd != -1) close(Rec.WriteEnd);
+		return FAILURE;
+	}
+	
+	Stream->ReadEnd = Rec.ReadEnd;
+	Stream->WriteEnd = Rec.WriteEnd;
+	Stream->IsStderr = Rec.IsStderr;
+	Stream->WindowStart = Rec.WindowStart;
+	Stream->WindowLines = Rec.WindowLines;
+	Stream->Suppressed = Rec.Suppressed;
+	Stream->PartialUsed = Rec.PartialUsed;
+	memcpy(Stream->ObjectID, ObjectID, IDEnd - ObjectID + 1);
+	memcpy(Stream->Partial, IDEnd + 1, Rec.PartialUsed);
+	
+	fcntl(Stream->ReadEnd, F_SETFD, FD_CLOEXEC);
+	if (Stream->WriteEnd != -1) fcntl(Stream->WriteEnd, F_SETFD, FD_CLOEXEC);
+	
+	Streams[Inc] = Stream;
+	
+	return SUCCESS;
+}
@@ -18,69 +18,132 @@
 
 #define CONFIGWARNTXT "CONFIG: " CONSOLE_COLOR_YELLOW "WARNING: " CONSOLE_ENDCOLOR
 
-/*We want the only interface for this to be LookupObjectInTable().*/
+/*We want the only interface for this to be LookupObjectInTable().
+ * Objects sit in one array in config file order, so full-table passes just walk memory.*/
 ObjTable *ObjectTable;
+unsigned long ObjectCount;
+static unsigned long ObjectCapacity;
+
+/*Open addressed hash index on ObjectID. Each slot holds an index into ObjectTable plus one, zero is empty.*/
+static unsigned long *ObjectIndex;
+static unsigned long ObjectIndexSize; /*Always a power of two, and kept at most half full.*/
+static Bool DuplicateObjectID;
+
+/*How many objects InitConfig() only indexed, and left for Config_Materialize() and friends.*/
+static unsigned long DeferredCount;
+static struct _ConfigLex ConfigTokens; /*The lexed config they get parsed from. Released once they're all done.*/
+#define CONFIG_IDLE_BATCH 8 /*How many of those Config_MaterializeIdle() parses per call.*/
+
+/*Indices into ObjectTable in stop [0] and start [1] priority order, and in table order within a priority.
+ * GetObjectByPriority() binary searches these instead of walking the whole table.
+ * Materializing an object only marks them dirty. They're sorted again when somebody next looks.*/
+static unsigned long *PriorityPlan[2];
+static Bool PriorityPlanDirty;
+
+/*The mapped config cache, if that's where ObjectTable came from. Its strings are in here, not malloc'd.*/
+static void *ConfigImageBase;
+static unsigned long ConfigImageSize;
+
+#define CONFIGARENA_BLOCKSIZE 16384
+
+/*Everything the text parse allocates for one generation of the object table comes out of here,
+ * so ShutdownConfig() and ReloadConfig() throw it all away at once instead of string by string.*/
+struct _ConfigArenaBlock
+{
+	struct _ConfigArenaBlock *Next;
+	unsigned long Used;
+	unsigned long Size; /*The data follows this header.*/
+};
+
+static struct _ConfigArena
+{
+	struct _ConfigArenaBlock *Blocks; /*The one we're carving from is first.*/
+	char **Strings; /*Every string in the arena, open addressed by hash, so each one is only stored once.*/
+	unsigned long StringsSize; /*Always a power of two, and kept at most half full.*/
+	unsigned long StringCount;
+} ConfigArena;
 char ConfigFile[MAX_LINE_SIZE] = CONFIGDIR CONF_NAME;
 
 /*Used to allow for things like 'ObjectStartPriority Services', where Services == 3, for example.*/
 static struct _PriorityAliasTree
-{ /*Start/Stop priority alias support for grouping.*/
-	char Alias[MAX_DESCRIPT_SIZE];
+{ /*Start/Stop priority alias support for grouping. Nodes and names live in ConfigArena.*/
+	const char *Alias;
 	unsigned long Target;
 	
 	struct _PriorityAliasTree *Next;
-	struct _PriorityAliasTree *Prev;
 } *PriorityAliasTree = NULL;
 
-/*Used to allow runlevels to be inherited by other runlevels.*/
-static struct _RunlevelInheritance
-{ /*I __REVILE__ this solution.
-Epoch is just a linked list of linked lists anymore.*/
-	char Inheriter[MAX_DESCRIPT_SIZE];
-	char Inherited[MAX_DESCRIPT_SIZE];
-	
-	struct _RunlevelInheritance *Next;
-	struct _RunlevelInheritance *Prev;
-} *RunlevelInheritance = NULL;
+/*Every runlevel name in use, so objects and inheritance deal in bits instead of strings.
+ * IDs don't change during a config reload, so old and new tables can be compared bit for bit.
+ * Once the reload is over, ObjRL_Compact() drops the names nothing uses anymore.*/
+static char *RunlevelNames[MAX_RUNLEVELS];
+static unsigned long RunlevelCount;
+static unsigned char RunlevelIndex[MAX_RUNLEVELS * 2]; /*ID + 1, probed by hash. Zero is an empty slot.*/
+
+/*Row N is every runlevel that runlevel N includes: itself, what it inherits, what that inherits, and so on.*/
+static struct _RLSet RunlevelClosure[MAX_RUNLEVELS];
 
 /*Holds the system hostname.*/
 char Hostname[MAX_LINE_SIZE] = { '\0' };
 
 /*Function forward declarations for all the statics.*/
 static ObjTable *AddObjectToTable(const char *ObjectID);
-static char *NextLine(const char *InStream);
-static rStatus GetLineDelim(const char *InStream, char *OutStream);
+static Bool ObjIndex_Grow(void);
+static void FreeObjectTable(ObjTable *Table, struct _ConfigArena *Arena, const void *ImageBase, unsigned long ImageSize);
+static void *ConfigArena_Alloc(unsigned long Size, unsigned long Align);
+static char *ConfigArena_String(const char *String);
+static void ConfigArena_Release(struct _ConfigArena *Arena);
+static rStatus LoadConfig(struct _ConfigImage *Compile);
+static Bool PriorityPlan_Build(void);
+static Bool PriorityPlan_Current(void);
 static rStatus ScanConfigIntegrity(void);
+static rStatus ScanObjectIntegrity(ObjTable *Worker);
+static ObjTable *ObjIndex_Find(const char *ObjectID);
+static void Config_ParseDeferred(ObjTable *CurObj);
 static void ConfigProblem(short Type, const char *Attribute, const char *AttribVal, unsigned long LineNum);
 static unsigned long PriorityAlias_Lookup(const char *Alias);
 static void PriorityAlias_Add(const char *Alias, unsigned long Target);
 static void PriorityAlias_Shutdown(void);
+static unsigned long ObjRL_GetID(const char *InRL, Bool Create);
+static void ObjRL_Compact(void);
+static Bool ObjRL_CheckID(unsigned long ID, const ObjTable *InObj, Bool CountInherited);
 static void RLInheritance_Add(const char *Inheriter, const char *Inherited);
-static Bool RLInheritance_Check(const char *Inheriter, const char *Inherited);
-static void RLInheritance_Shutdown(void);
+static void RLInheritance_Reset(void);
+static void ConfigAttr_BuildTable(void);
+static const struct _ConfigAttribute *ConfigAttr_Lookup(const char *Name, unsigned long Length);
 
 /*Used for error handling in InitConfig() by ConfigProblem().*/
 enum { CONFIG_EMISSINGVAL = 1, CONFIG_EBADVAL, CONFIG_ETRUNCATED, CONFIG_EAFTER,
 	CONFIG_EBEFORE, CONFIG_ELARGENUM };
 
-/*Actual functions.*/
-static char *NextLine(const char *InStream)
-{
-	if (!(InStream = strstr(InStream, "\n")))
-	{
-		return NULL;
-	}
-
-	if (*(InStream + 1) == '\0')
-	{ /*End of file.*/
-		return NULL;
-	}
-
-	++InStream; /*Plus one for the newline. We want to skip past it.*/
+/*What InitConfig() checks for an attribute before handing it over.*/
+enum { CONFIGATTR_OBJECT = 1 << 0, /*Must come after an ObjectID.*/
+	CONFIGATTR_GLOBAL = 1 << 1, /*Must come before any ObjectID.*/
+	CONFIGATTR_VALUE = 1 << 2, /*Needs a value, which gets put in DelimCurr.*/
+	CONFIGATTR_GLOBALSTATE = 1 << 3, /*Sets something outside the object table, so the config cache keeps the line.*/
+	CONFIGATTR_INDEX = 1 << 4 /*Parsed even for objects whose other attributes wait for Config_Materialize().*/ };
 
-	return (char*)InStream;
-}
+/*The parser's state as InitConfig() walks the file. Attribute handlers get a pointer to this.*/
+struct _ConfigState
+{
+	const struct _ConfigLex *Lex;
+	const struct _ConfigToken *Token; /*The line we're on.*/
+	const char *CurrentAttribute;
+	unsigned long LineNum;
+	ObjTable *CurObj;
+	Bool TrueLogEnable;
+	Bool RecordGlobals; /*Set when compiling the config cache.*/
+	Bool Deferring; /*Only CONFIGATTR_INDEX attributes for objects. The rest of each is left where it is.*/
+	Bool Materializing; /*The other way around, for one object that was left, up to the next ObjectID.*/
+	char *Globals; /*The CONFIGATTR_GLOBALSTATE lines we've seen, if RecordGlobals.*/
+	unsigned long GlobalsLength;
+	char *DelimCurr; /*The current line's value, in the lexed buffer.*/
+};
+
+static void ParseConfigStream(const struct _ConfigLex *Lex, unsigned long First, struct _ConfigState *State);
+static rStatus GetLineDelim(struct _ConfigState *State);
 
+/*Actual functions.*/
 /*This function was so useful I gave it external linkage.*/
 char *WhitespaceArg(const char *InStream)
 {  /*This is used for parsing lines that need to be divided by spaces.*/
@@ -143,1306 +206,1447 @@ static void ConfigProblem(short Type, const char *Attribute, const char *AttribV
 	WriteLogLine(LogBuffer, true);
 }
 
-rStatus InitConfig(void)
-{ /*Set aside storage for the table.*/
-	FILE *Descriptor = NULL;
-	struct stat FileStat;
-	char *ConfigStream = NULL, *Worker = NULL;
-	ObjTable *CurObj = NULL, *ObjWorker = NULL;
-	char DelimCurr[MAX_LINE_SIZE] = { '\0' };
-	unsigned long LineNum = 1;
-	const char *CurrentAttribute = NULL;
-	Bool LongComment = false;
-	Bool TrueLogEnable = EnableLogging;
-	Bool PrevLogInMemory = LogInMemory;
-	char ErrBuf[MAX_LINE_SIZE];
-	
-	EnableLogging = true; /*To temporarily turn on the logging system.*/
-	LogInMemory = true;
-	
-	/*Get the file size of the config file.*/
-	if (stat(ConfigFile, &FileStat) != 0)
-	{ /*Failure?*/
-		SpitError("Failed to obtain information about configuration file.\nDoes it exist?");
-		return FAILURE;
+static void ConfigAttr_DisableCAD(struct _ConfigState *State)
+{ /*Should we disable instant reboots on CTRL-ALT-DEL?*/
+	if (!strcmp(State->DelimCurr, "true"))
+	{
+		DisableCAD = true;
+	}
+	else if (!strcmp(State->DelimCurr, "false"))
+	{
+		DisableCAD = false;
 	}
 	else
-	{ /*No? Use the file size to allocate space in memory, since a char is a byte big.
-	* If it's not a byte on your platform, your OS is not UNIX, and Epoch was not designed for you.*/
-		ConfigStream = malloc(FileStat.st_size + 1);
+	{				
+		DisableCAD = true;
+		
+		ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, State->DelimCurr, State->LineNum);
 	}
+}
 
-	if (!(Descriptor = fopen(ConfigFile, "r"))) /*Open the configuration file.*/
+static void ConfigAttr_BlankLogOnBoot(struct _ConfigState *State)
+{ /*Should the log only hold the current boot cycle's logs?*/
+	if (!strcmp(State->DelimCurr, "true"))
 	{
-		snprintf(ErrBuf, sizeof ErrBuf, "Unable to open configuration file \"%s\"! Permissions?", ConfigFile);
-		SpitError(ErrBuf);
-		EmergencyShell();
+		BlankLogOnBoot = true;
+	}
+	else if (!strcmp(State->DelimCurr, "false"))
+	{
+		BlankLogOnBoot = false;
+	}
+	else
+	{				
+		BlankLogOnBoot = false;
+		
+		ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+	}
+}
+
+static void ConfigAttr_LogSync(struct _ConfigState *State)
+{ /*How hard we try to get log lines onto the disk. "none" leaves it to the kernel,
+	* "batch" fsyncs whenever a batch gets written, and "line" writes and fsyncs every line.*/
+	if (!strcmp(State->DelimCurr, "none"))
+	{
+		LogSyncPolicy = LOGSYNC_NONE;
+	}
+	else if (!strcmp(State->DelimCurr, "batch"))
+	{
+		LogSyncPolicy = LOGSYNC_BATCH;
+	}
+	else if (!strcmp(State->DelimCurr, "line"))
+	{
+		LogSyncPolicy = LOGSYNC_LINE;
+	}
+	else
+	{
+		LogSyncPolicy = LOGSYNC_NONE;
+		
+		ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+	}
+}
+
+static void ConfigAttr_LogRotateSize(struct _ConfigState *State)
+{ /*Rotate system.log when it gets to this many KiB. 0 turns that off.*/
+	if (!AllNumeric(State->DelimCurr))
+	{
+		LogRotateSize = 0;
+		
+		ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+		return;
 	}
 	
-	/*Read the file into memory. I don't really trust fread(), but oh well.
-	 * People will whine if I use a loop instead.*/
-	fread(ConfigStream, 1, FileStat.st_size, Descriptor);
-	fclose(Descriptor); /*Close the file.*/
+	LogRotateSize = strtoul(State->DelimCurr, NULL, 10) * 1024;
+}
 
-	ConfigStream[FileStat.st_size] = '\0'; /*Null terminate.*/
+static void ConfigAttr_LogRotateAge(struct _ConfigState *State)
+{ /*Rotate system.log when we've been writing it for this many hours. 0 turns that off.*/
+	if (!AllNumeric(State->DelimCurr))
+	{
+		LogRotateAge = 0;
+		
+		ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+		return;
+	}
 	
-	Worker = ConfigStream;
+	LogRotateAge = strtoul(State->DelimCurr, NULL, 10) * 60 * 60;
+}
+
+static void ConfigAttr_LogRotateKeep(struct _ConfigState *State)
+{ /*How many rotated logs we keep before deleting the oldest.*/
+	if (!AllNumeric(State->DelimCurr))
+	{
+		LogRotateKeep = LOGROTATE_DEFAULT_KEEP;
+		
+		ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+		return;
+	}
 	
-	/*Check for non-ASCII characters.*/
-	while (*(unsigned char*)Worker++ != '\0')
+	LogRotateKeep = strtoul(State->DelimCurr, NULL, 10);
+}
+
+static void ConfigAttr_CaptureRateLimit(struct _ConfigState *State)
+{ /*Lines per second we log from each captured stream. Zero means no limit.*/
+	if (!AllNumeric(State->DelimCurr))
 	{
-		if ((*(unsigned char*)Worker & 128) == 128)
-		{ /*Check for a sign bit or >= 128. Works for one's complement systems
-			too if we have signed char by default, but who uses one's complement?*/
-			SpitError("Non-ASCII characters detected in configuration file!\n"
-						"Epoch does not support Unicode or the like!");
-			EmergencyShell();
-			break;
-		}
+		CaptureRateLimit = CAPTURE_DEFAULT_RATE;
+		
+		ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+		return;
 	}
 	
-	Worker = ConfigStream;
+	CaptureRateLimit = strtoul(State->DelimCurr, NULL, 10);
+}
+
+static void ConfigAttr_ShutdownKillTimeout(struct _ConfigState *State)
+{ /*Seconds processes left at shutdown get to exit after SIGTERM, before SIGKILL. Zero skips all that.*/
+	if (!AllNumeric(State->DelimCurr))
+	{
+		ShutdownKillTimeout = KILLALL_DEFAULT_TIMEOUT;
+		
+		ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+		return;
+	}
 	
-	/*Empty file?*/
-	if ((*Worker == '\n' && *(Worker + 1) == '\0') || *Worker == '\0')
+	ShutdownKillTimeout = strtoul(State->DelimCurr, NULL, 10);
+}
+
+static void ConfigAttr_TailBufferSize(struct _ConfigState *State)
+{ /*In KiB, of recent output "epoch tail" keeps for each object. Zero turns it off.*/
+	if (!AllNumeric(State->DelimCurr))
 	{
-		SpitError("Seems that the configuration file is empty or corrupted.");
-		free(ConfigStream);
-		return FAILURE;
+		TailBufferSize = TAIL_DEFAULT_SIZE;
+		
+		ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+		return;
 	}
 	
-	do /*This loop does most of the parsing.*/
+	TailBufferSize = strtoul(State->DelimCurr, NULL, 10) * 1024;
+}
+
+static void ConfigAttr_TailMemoryLimit(struct _ConfigState *State)
+{ /*In KiB, for all of them together.*/
+	if (!AllNumeric(State->DelimCurr))
 	{
+		TailMemoryLimit = TAIL_DEFAULT_LIMIT;
 		
-		/*Allow whitespace to precede a line in case people want to create a block-styled appearance.*/
-		while (*Worker == ' ' || *Worker == '\t') ++Worker;
+		ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+		return;
+	}
+	
+	TailMemoryLimit = strtoul(State->DelimCurr, NULL, 10) * 1024;
+}
+
+static void ConfigAttr_SyslogReceiver(struct _ConfigState *State)
+{ /*Should we take syslog messages on /dev/log ourselves? See syslog.c.*/
+	if (!strcmp(State->DelimCurr, "true"))
+	{
+		SyslogReceiver = true;
+	}
+	else if (!strcmp(State->DelimCurr, "false"))
+	{
+		SyslogReceiver = false;
+	}
+	else
+	{
+		SyslogReceiver = false;
 		
-		/**Multi-line comment support: Multi-line comments are created in the following way:
-		 * >!> stuff
-		 * stuff
-		 * stuff stuff
-		 * stuffy stuff
-		 * <!< stuff
-		 * stuff
-		 * 
-		 * It is not recognized to place a multi-line comment beginner or terminator anywhere but the beginning
-		 * of the line. As such, one may place do things like "ObjectID >!>" to create an object with ID ">!>". **/
+		ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+	}
+}
 
-		if (!strncmp(Worker, "<!<", strlen("<!<")))
-		{ /*It's probably not good to have stray multi-line comment terminators around.*/
-			if (!LongComment)
-			{
-				snprintf(ErrBuf, MAX_LINE_SIZE, CONFIGWARNTXT "Stray multi-line comment terminator on line %lu\n", LineNum);
-				SpitWarning(ErrBuf);
-				WriteLogLine(ErrBuf, true);
-				continue;
-			}
-			LongComment = false;
-			
-			/*Allow next line to begin right ater the terminator on the same line.*/
-			Worker += strlen("<!<");
-			while (*Worker == ' ' || *Worker == '\t') ++Worker;
-		}
-		else if (LongComment)
-		{
-			continue;
-		}
-		else if (!strncmp(Worker, ">!>", strlen(">!>")))
-		{
-			LongComment = true;
-			continue;
-		}
+static void ConfigAttr_SyslogSeverity(struct _ConfigState *State)
+{ /*The least severe syslog messages we keep, by name or number. "info" drops just debug.*/
+	if (!Syslog_ParseSeverity(State->DelimCurr, &SyslogSeverity))
+	{
+		SyslogSeverity = LOGSEV_INFO;
 		
-		/**Single-line comments are created by placing "#" at the beginning of the line. Placing them
-		 * anywhere else has no effect and as such '#' may be used in commands and object IDs and descriptions.**/
-		if (*Worker == '\n')
-		{ /*Empty line.*/
-			continue;
-		}
-		else if (*Worker == '#')
-		{ /*Line is just a comment.*/
-			continue;
-		}
+		ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+	}
+}
+
+static void ConfigAttr_SyslogFacilities(struct _ConfigState *State)
+{ /*Which facilities we keep, like "daemon auth local0", or "all".*/
+	if (!Syslog_ParseFacilities(State->DelimCurr, &SyslogFacilities))
+	{
+		SyslogFacilities = SYSLOG_ALL_FACILITIES;
 		
-		/**Global configuration begins here.**/
-		if (!strncmp(Worker, (CurrentAttribute = "DisableCAD"), strlen("DisableCAD")))
-		{ /*Should we disable instant reboots on CTRL-ALT-DEL?*/
-			
-			if (!GetLineDelim(Worker, DelimCurr))
-			{
-				ConfigProblem(CONFIG_EMISSINGVAL, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
+		ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+	}
+}
 
-			if (!strcmp(DelimCurr, "true"))
-			{
-				DisableCAD = true;
-			}
-			else if (!strcmp(DelimCurr, "false"))
-			{
-				DisableCAD = false;
-			}
-			else
-			{				
-				DisableCAD = true;
-				
-				ConfigProblem(CONFIG_EBADVAL, CurrentAttribute, DelimCurr, LineNum);
-			}
+static void ConfigAttr_SyslogRateLimit(struct _ConfigState *State)
+{ /*Messages per second we take from each program. Zero means no limit.*/
+	if (!AllNumeric(State->DelimCurr))
+	{
+		SyslogRateLimit = SYSLOG_DEFAULT_RATE;
+		
+		ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+		return;
+	}
+	
+	SyslogRateLimit = strtoul(State->DelimCurr, NULL, 10);
+}
 
-			continue;
-		}
-		else if (!strncmp(Worker, (CurrentAttribute = "BlankLogOnBoot"), strlen("BlankLogOnBoot")))
-		{ /*Should the log only hold the current boot cycle's logs?*/
+static void ConfigAttr_LogStore(struct _ConfigState *State)
+{ /*Should log lines also go into the structured log store, for "epoch log"?*/
+	if (!strcmp(State->DelimCurr, "true"))
+	{
+		LogStoreEnabled = true;
+	}
+	else if (!strcmp(State->DelimCurr, "false"))
+	{
+		LogStoreEnabled = false;
+	}
+	else
+	{
+		LogStoreEnabled = false;
+		
+		ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+	}
+}
 
-			if (!GetLineDelim(Worker, DelimCurr))
-			{
-				ConfigProblem(CONFIG_EMISSINGVAL, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
+static void ConfigAttr_MemLogLimit(struct _ConfigState *State)
+{ /*KiB of log we keep in memory until the disk is writable. 0 keeps all of it.*/
+	if (!AllNumeric(State->DelimCurr))
+	{
+		MemLog.Limit = MEMLOG_DEFAULT_LIMIT;
+		
+		ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+		return;
+	}
+	
+	MemLog.Limit = strtoul(State->DelimCurr, NULL, 10) * 1024;
+}
 
-			if (!strcmp(DelimCurr, "true"))
-			{
-				BlankLogOnBoot = true;
-			}
-			else if (!strcmp(DelimCurr, "false"))
-			{
-				BlankLogOnBoot = false;
-			}
-			else
-			{				
-				BlankLogOnBoot = false;
-				
-				ConfigProblem(CONFIG_EBADVAL, CurrentAttribute, DelimCurr, LineNum);
-			}
+static void ConfigAttr_EnableLogging(struct _ConfigState *State)
+{
+	if (!strcmp(State->DelimCurr, "true"))
+	{
+		State->TrueLogEnable = true;
+	}
+	else if (!strcmp(State->DelimCurr, "false"))
+	{
+		State->TrueLogEnable = false;
+	}
+	else
+	{
+		
+		State->TrueLogEnable = false;
+		
+		ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+	}
+}
 
-			continue;
-		}
-		else if (!strncmp(Worker, (CurrentAttribute = "EnableLogging"), strlen("EnableLogging")))
-		{
-			if (!GetLineDelim(Worker, DelimCurr))
-			{
-				ConfigProblem(CONFIG_EMISSINGVAL, CurrentAttribute, NULL, LineNum);
+static void ConfigAttr_RunlevelInherits(struct _ConfigState *State)
+{
+	char Inheriter[MAX_DESCRIPT_SIZE], Inherited[MAX_DESCRIPT_SIZE];
+	const char *TWorker = State->DelimCurr;
+	unsigned long TInc = 0;
+	
+	for (; *TWorker != ' ' && *TWorker != '\t' && *TWorker != '\0' && TInc < MAX_DESCRIPT_SIZE - 1; ++TInc, ++TWorker)
+	{
+		Inheriter[TInc] = *TWorker;
+	}
+	Inheriter[TInc] = '\0';
+	
+	if (*TWorker == '\0')
+	{
+		ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+		return;
+	}
+	
+	TWorker = WhitespaceArg(TWorker);
+	
+	if (strstr(TWorker, " ") || strstr(TWorker, "\t"))
+	{
+		ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+		return;
+	}
+	
+	snprintf(Inherited, MAX_DESCRIPT_SIZE, "%s", TWorker);
+	
+	RLInheritance_Add(Inheriter, Inherited);
+}
 
-				continue;
-			}
-			
-			if (!strcmp(DelimCurr, "true"))
-			{
-				TrueLogEnable = true;
-			}
-			else if (!strcmp(DelimCurr, "false"))
-			{
-				TrueLogEnable = false;
-			}
-			else
+static void ConfigAttr_DefinePriority(struct _ConfigState *State)
+{
+	char Alias[MAX_DESCRIPT_SIZE] = { '\0' };
+	unsigned long Target = 0, TInc = 0;
+	const char *TWorker = State->DelimCurr;
+	
+	for (; *TWorker != ' ' && *TWorker != '\t' &&
+		*TWorker != '\0' && TInc < MAX_DESCRIPT_SIZE -1; ++TInc, ++TWorker)
+	{ /*Copy in the identifier.*/
+		Alias[TInc] = *TWorker;
+	}
+	Alias[TInc] = '\0';
+	
+	if (*TWorker == '\0')
+	{
+		ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+		return;
+	}
+	
+	TWorker = WhitespaceArg(TWorker); /*I abuse this delightful little function. It was meant for do-while loops.*/
+	
+	if (!AllNumeric(TWorker))
+	{
+		ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+		return;
+	}
+	
+	Target = atol(TWorker);
+	
+	PriorityAlias_Add(Alias, Target); /*Now add it to the linked list.*/
+}
+
+static void ConfigAttr_AlignStatusReports(struct _ConfigState *State)
+{ /*Deprecated.*/
+	char ErrBuf[MAX_LINE_SIZE];
+	
+	snprintf(ErrBuf, sizeof ErrBuf, CONFIGWARNTXT "Attribute AlignStatusReports is deprecated and no longer has any effect.\n"
+			"%s line %lu", ConfigFile, State->LineNum);
+	SpitWarning(ErrBuf);
+	WriteLogLine(ErrBuf, true);
+}
+
+/*This will mount /dev, /proc, /sys, /dev/pts, and /dev/shm on boot time, upon request.*/
+static void ConfigAttr_MountVirtual(struct _ConfigState *State)
+{
+	const char *TWorker = State->DelimCurr;
+	unsigned long Inc = 0;
+	char CurArg[MAX_DESCRIPT_SIZE];
+	const char *VirtualID[2][5] = { { "procfs", "sysfs", "devfs", "devpts", "devshm" },
+									{ "procfs+", "sysfs+", "devfs+", "devpts+", "devshm+" } };
+	
+	do
+	{ /*Load in all the arguments in the line.*/
+		Bool FoundSomething = false;
+		
+		for (Inc = 0; TWorker[Inc] != ' ' && TWorker[Inc] != '\t' && TWorker[Inc] != '\n' &&
+			TWorker[Inc] != '\0' && Inc < (MAX_DESCRIPT_SIZE - 1); ++Inc)
+		{ /*Copy in the argument for this line.*/
+			CurArg[Inc] = TWorker[Inc];
+		}
+		CurArg[Inc] = '\0';
+		
+		
+		for (Inc = 0; Inc < 5; ++Inc)
+		{ /*Search through the argument to see what it matches.*/
+			if (!strncmp(VirtualID[0][Inc], CurArg, strlen(VirtualID[0][Inc])))
 			{
-				
-				TrueLogEnable = false;
-				
-				ConfigProblem(CONFIG_EBADVAL, CurrentAttribute, DelimCurr, LineNum);
+				AutoMountOpts[Inc] = (!strcmp(VirtualID[1][Inc], CurArg) ? 2 : true);
+				FoundSomething = true;
+				break;
 			}
+		}
+
+		if (!FoundSomething)
+		{ /*If it doesn't match anything, that's bad.*/
+			ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, State->DelimCurr, State->LineNum);
 			
 			continue;
 		}
-		else if (!strncmp(Worker, (CurrentAttribute = "RunlevelInherits"), strlen("RunlevelInherits")))
-		{
-			char Inheriter[MAX_DESCRIPT_SIZE], Inherited[MAX_DESCRIPT_SIZE];
-			const char *TWorker = DelimCurr;
-			unsigned long TInc = 0;
-			
-			if (!GetLineDelim(Worker, DelimCurr))
-			{
-				ConfigProblem(CONFIG_EAFTER, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			for (; *TWorker != ' ' && *TWorker != '\t' && *TWorker != '\0' && TInc < MAX_DESCRIPT_SIZE - 1; ++TInc, ++TWorker)
-			{
-				Inheriter[TInc] = *TWorker;
-			}
-			Inheriter[TInc] = '\0';
 			
-			if (*TWorker == '\0')
-			{
-				ConfigProblem(CONFIG_EBADVAL, CurrentAttribute, DelimCurr, LineNum);
-				continue;
-			}
-			
-			TWorker = WhitespaceArg(TWorker);
-			
-			if (strstr(TWorker, " ") || strstr(TWorker, "\t"))
-			{
-				ConfigProblem(CONFIG_EBADVAL, CurrentAttribute, DelimCurr, LineNum);
-				continue;
-			}
-			
-			snprintf(Inherited, MAX_DESCRIPT_SIZE, "%s", TWorker);
-			
-			RLInheritance_Add(Inheriter, Inherited);
-			
-			continue;
-		}
-		else if (!strncmp(Worker, (CurrentAttribute = "DefinePriority"), strlen("DefinePriority")))
+	} while ((TWorker = WhitespaceArg(TWorker)));
+	
+	if ((strlen(State->DelimCurr) + 1) >= MAX_LINE_SIZE)
+	{
+		ConfigProblem(CONFIG_ETRUNCATED, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+	}
+}
+
+static void ConfigAttr_BootBannerText(struct _ConfigState *State)
+{ /*The text shown at boot up as a kind of greeter, before we start executing objects. Can be disabled, off by default.*/
+	if (!strcmp(State->DelimCurr, "NONE")) /*So, they decided to explicitly opt out of banner display. Ok.*/
+	{
+		BootBanner.BannerText[0] = '\0';
+		BootBanner.BannerColor[0] = '\0';
+		BootBanner.ShowBanner = false; /*Should already be false, but to prevent possible bugs...*/
+		return;
+	}
+	snprintf(BootBanner.BannerText, MAX_LINE_SIZE, "%s", State->DelimCurr);
+	
+	BootBanner.ShowBanner = true;
+	
+	if ((strlen(State->DelimCurr) + 1) >= MAX_DESCRIPT_SIZE)
+	{
+		ConfigProblem(CONFIG_ETRUNCATED, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+	}
+}
+
+static void ConfigAttr_BootBannerColor(struct _ConfigState *State)
+{ /*Color for boot banner.*/
+	if (!strcmp(State->DelimCurr, "NONE")) /*They don't want a color.*/
+	{
+		BootBanner.BannerColor[0] = '\0';
+		return;
+	}
+	
+	SetBannerColor(State->DelimCurr); /*Function to be found elsewhere will do this for us, otherwise this loop would be even bigger.*/
+}
+
+static void ConfigAttr_DefaultRunlevel(struct _ConfigState *State)
+{
+	if (CurRunlevel[0] != 0)
+	{ /*If the runlevel has already been set, don't set it again.
+		* This prevents a rather nasty bug.*/
+		return;
+	}
+	
+	if (State->CurObj != NULL)
+	{ /*What the warning says. It'd get all weird if we allowed that.*/
+		ConfigProblem(CONFIG_EAFTER, State->CurrentAttribute, NULL, State->LineNum);
+		return;
+	}
+	
+	if (!GetLineDelim(State))
+	{
+		ConfigProblem(CONFIG_EMISSINGVAL, State->CurrentAttribute, NULL, State->LineNum);
+		return;
+	}	
+	
+	snprintf(CurRunlevel, MAX_DESCRIPT_SIZE, "%s", State->DelimCurr);
+}
+
+static void ConfigAttr_Hostname(struct _ConfigState *State)
+{
+	char ErrBuf[MAX_LINE_SIZE];
+	
+	if (!strncmp(State->DelimCurr, "FILE", strlen("FILE")))
+	{
+		FILE *TDesc;
+		unsigned long Inc = 0;
+		int TChar;
+		const char *TW = State->DelimCurr;
+		char THostname[MAX_LINE_SIZE];
+		
+		TW += strlen("FILE");
+		
+		for (; *TW == ' ' || *TW == '\t'; ++TW);
+		
+		if (!(TDesc = fopen(TW, "r")))
 		{
-			char Alias[MAX_DESCRIPT_SIZE] = { '\0' };
-			unsigned long Target = 0, TInc = 0;
-			const char *TWorker = DelimCurr;
-			
-			if (CurObj != NULL)
-			{ /*We can't allow this in object-local options, because then this may not be properly defined.*/
-				ConfigProblem(CONFIG_EAFTER, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			if (!GetLineDelim(Worker, DelimCurr))
-			{
-				ConfigProblem(CONFIG_EMISSINGVAL, CurrentAttribute, NULL, LineNum);
-				
-				continue;
-			}
-			
-			for (; *TWorker != ' ' && *TWorker != '\t' &&
-				*TWorker != '\0' && TInc < MAX_DESCRIPT_SIZE -1; ++TInc, ++TWorker)
-			{ /*Copy in the identifier.*/
-				Alias[TInc] = *TWorker;
-			}
-			Alias[TInc] = '\0';
-			
-			if (*TWorker == '\0')
-			{
-				ConfigProblem(CONFIG_EBADVAL, CurrentAttribute, DelimCurr, LineNum);
-				continue;
-			}
-			
-			TWorker = WhitespaceArg(TWorker); /*I abuse this delightful little function. It was meant for do-while loops.*/
-			
-			if (!AllNumeric(TWorker))
-			{
-				ConfigProblem(CONFIG_EBADVAL, CurrentAttribute, DelimCurr, LineNum);
-				continue;
-			}
-			
-			Target = atol(TWorker);
-			
-			PriorityAlias_Add(Alias, Target); /*Now add it to the linked list.*/
-			
-			continue;
-		}
-		else if (!strncmp(Worker, (CurrentAttribute = "AlignStatusReports"), strlen("AlignStatusReports")))
-		{ /*Deprecated.*/
-			snprintf(ErrBuf, sizeof ErrBuf, CONFIGWARNTXT "Attribute AlignStatusReports is deprecated and no longer has any effect.\n"
-					"%s line %lu", ConfigFile, LineNum);
+			snprintf(ErrBuf, sizeof ErrBuf, "Failed to set hostname from file \"%s\".\n", TW);
 			SpitWarning(ErrBuf);
 			WriteLogLine(ErrBuf, true);
-			continue;
+			return;
+		}
+		
+		for (Inc = 0; (TChar = getc(TDesc)) != EOF && Inc < MAX_LINE_SIZE - 1; ++Inc)
+		{ /*There is a reason for this. Just trust me.*/
+			*(unsigned char*)&THostname[Inc] = (unsigned char)TChar;
 		}
-		/*This will mount /dev, /proc, /sys, /dev/pts, and /dev/shm on boot time, upon request.*/
-		else if (!strncmp(Worker, (CurrentAttribute = "MountVirtual"), strlen("MountVirtual")))
+		THostname[Inc] = '\0';
+		
+		/*Skip past spaces, tabs, and newlines.*/
+		for (TW = THostname; *TW == '\n' ||
+			*TW == ' ' || *TW == '\t'; ++TW);
+		
+		/*Copy into the real hostname from our new offset.*/
+		for (Inc = 0; TW[Inc] != '\0' && TW[Inc] != '\n'; ++Inc)
 		{
-			const char *TWorker = DelimCurr;
-			unsigned long Inc = 0;
-			char CurArg[MAX_DESCRIPT_SIZE];
-			const char *VirtualID[2][5] = { { "procfs", "sysfs", "devfs", "devpts", "devshm" },
-											{ "procfs+", "sysfs+", "devfs+", "devpts+", "devshm+" } };
-			
-			if (!GetLineDelim(Worker, DelimCurr))
-			{
-				ConfigProblem(CONFIG_EMISSINGVAL, CurrentAttribute, NULL, LineNum);
+			Hostname[Inc] = TW[Inc];
+		}
+		Hostname[Inc] = '\0';
+		
+		fclose(TDesc);
+	}
+	else
+	{	
+		snprintf(Hostname, MAX_LINE_SIZE, "%s", State->DelimCurr);
+	}
+	
+						
+	/*Check for spaces and tabs in the actual hostname.*/
+	if (strstr(Hostname, " ") != NULL || strstr(Hostname, "\t") != NULL)
+	{
+		const char *const ErrString = "Tabs and/or spaces in hostname file. Cannot set hostname.";
+		SpitWarning((const char*)ErrString);
+		WriteLogLine((const char*)ErrString, true);
+		*Hostname = '\0'; /*Set the hostname back to nothing.*/
+		return;
+	}
+	
+	if ((strlen(State->DelimCurr) + 1) >= MAX_LINE_SIZE)
+	{
+		ConfigProblem(CONFIG_ETRUNCATED, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+	}
+}
 
-				continue;
-			}
-			
-			do
-			{ /*Load in all the arguments in the line.*/
-				Bool FoundSomething = false;
-				
-				for (Inc = 0; TWorker[Inc] != ' ' && TWorker[Inc] != '\t' && TWorker[Inc] != '\n' &&
-					TWorker[Inc] != '\0' && Inc < (MAX_DESCRIPT_SIZE - 1); ++Inc)
-				{ /*Copy in the argument for this line.*/
-					CurArg[Inc] = TWorker[Inc];
-				}
-				CurArg[Inc] = '\0';
-				
-				
-				for (Inc = 0; Inc < 5; ++Inc)
-				{ /*Search through the argument to see what it matches.*/
-					if (!strncmp(VirtualID[0][Inc], CurArg, strlen(VirtualID[0][Inc])))
-					{
-						AutoMountOpts[Inc] = (!strcmp(VirtualID[1][Inc], CurArg) ? 2 : true);
-						FoundSomething = true;
-						break;
-					}
-				}
+static void ConfigAttr_ObjectID(struct _ConfigState *State)
+{ /*ASCII value used to identify this object internally, and also a kind of short name for it.*/
+	char *Temp = NULL;
+	char ErrBuf[MAX_LINE_SIZE];
+	
+	if ((Temp = strpbrk(State->DelimCurr, " \t")) != NULL) /*We cannot allow whitespace.*/
+	{
+		snprintf(ErrBuf, sizeof ErrBuf, CONFIGWARNTXT "ObjectIDs may not contain whitespace! Truncating up to occurence of whitespace\n"
+				"Line %lu in %s.", State->LineNum, ConfigFile);
+		SpitWarning(ErrBuf);
+		WriteLogLine(ErrBuf, true);
+		*Temp = '\0';
+	}
+	
+	if (strlen(State->DelimCurr) >= MAX_DESCRIPT_SIZE)
+	{ /*Chop it off to prevent overflow.*/
+		State->DelimCurr[MAX_DESCRIPT_SIZE - 1] = '\0';
+	}
+	
+	State->CurObj = AddObjectToTable(State->DelimCurr); /*Sets this as our current object.*/
+	
+	if (State->Deferring && State->CurObj && State->Token + 1 < State->Lex->Tokens + State->Lex->TokenCount)
+	{ /*Everything up to the next ObjectID, for Config_ParseDeferred().*/
+		State->CurObj->ConfigDeferred = State->Token + 1 - State->Lex->Tokens;
+		++DeferredCount;
+	}
 
-				if (!FoundSomething)
-				{ /*If it doesn't match anything, that's bad.*/
-					ConfigProblem(CONFIG_EBADVAL, CurrentAttribute, DelimCurr, LineNum);
-					
-					continue;
-				}
-					
-			} while ((TWorker = WhitespaceArg(TWorker)));
-			
-			if ((strlen(DelimCurr) + 1) >= MAX_LINE_SIZE)
-			{
-				ConfigProblem(CONFIG_ETRUNCATED, CurrentAttribute, DelimCurr, LineNum);
-			}
-			
-			continue;
+	if ((strlen(State->DelimCurr) + 1) >= MAX_DESCRIPT_SIZE)
+	{
+		ConfigProblem(CONFIG_ETRUNCATED, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+	}
+}
+
+static void ConfigAttr_ObjectWorkingDirectory(struct _ConfigState *State)
+{
+	State->CurObj->ObjectWorkingDirectory = ConfigArena_String(State->DelimCurr);
+}
+
+static void ConfigAttr_ObjectEnabled(struct _ConfigState *State)
+{
+	if (!strcmp(State->DelimCurr, "true"))
+	{
+		State->CurObj->Enabled = true;
+	}
+	else if (!strcmp(State->DelimCurr, "false"))
+	{
+		State->CurObj->Enabled = false;
+	}
+	else
+	{
+		ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+	}
+}
+
+static void ConfigAttr_ObjectOptions(struct _ConfigState *State)
+{
+	const char *TWorker = State->DelimCurr;
+	unsigned long Inc;
+	char CurArg[MAX_DESCRIPT_SIZE];
+	
+	if ((strlen(State->DelimCurr) + 1) >= MAX_LINE_SIZE)
+	{
+		ConfigProblem(CONFIG_ETRUNCATED, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+	}
+	
+	do
+	{
+		
+		for (Inc = 0; TWorker[Inc] != ' ' && TWorker[Inc] != '\t' && TWorker[Inc] != '\n'
+			&& TWorker[Inc] != '\0' && Inc < (MAX_DESCRIPT_SIZE - 1); ++Inc)
+		{
+			CurArg[Inc] = TWorker[Inc];
 		}
-		/*Now we get into the actual attribute tags.*/
-		else if (!strncmp(Worker, (CurrentAttribute = "BootBannerText"), strlen("BootBannerText")))
-		{ /*The text shown at boot up as a kind of greeter, before we start executing objects. Can be disabled, off by default.*/
-			if (!GetLineDelim(Worker, DelimCurr))
-			{
-				ConfigProblem(CONFIG_EMISSINGVAL, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			if (!strcmp(DelimCurr, "NONE")) /*So, they decided to explicitly opt out of banner display. Ok.*/
-			{
-				BootBanner.BannerText[0] = '\0';
-				BootBanner.BannerColor[0] = '\0';
-				BootBanner.ShowBanner = false; /*Should already be false, but to prevent possible bugs...*/
-				continue;
-			}
-			snprintf(BootBanner.BannerText, MAX_LINE_SIZE, "%s", DelimCurr);
-			
-			BootBanner.ShowBanner = true;
-			
-			if ((strlen(DelimCurr) + 1) >= MAX_DESCRIPT_SIZE)
-			{
-				ConfigProblem(CONFIG_ETRUNCATED, CurrentAttribute, DelimCurr, LineNum);
-			}
-			continue;
+		CurArg[Inc] = '\0';
+		
+		
+		if (!strcmp(CurArg, "HALTONLY"))
+		{ /*Allow entries that execute on shutdown only.*/
+			State->CurObj->Started = true;
+			State->CurObj->Opts.Persistent = true;
+			State->CurObj->Opts.HaltCmdOnly = true;
 		}
-		else if (!strncmp(Worker, (CurrentAttribute = "BootBannerColor"), strlen("BootBannerColor")))
-		{ /*Color for boot banner.*/
-			if (!GetLineDelim(Worker, DelimCurr))
-			{
-				ConfigProblem(CONFIG_EMISSINGVAL, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			if (!strcmp(DelimCurr, "NONE")) /*They don't want a color.*/
-			{
-				BootBanner.BannerColor[0] = '\0';
-				continue;
-			}
-			
-			SetBannerColor(DelimCurr); /*Function to be found elsewhere will do this for us, otherwise this loop would be even bigger.*/
-			continue;
+		else if (!strcmp(CurArg, "PERSISTENT"))
+		{
+			State->CurObj->Opts.Persistent = true;
 		}
-		else if (!strncmp(Worker, (CurrentAttribute = "DefaultRunlevel"), strlen("DefaultRunlevel")))
+		else if (!strcmp(CurArg, "FORK"))
 		{
-			if (CurRunlevel[0] != 0)
-			{ /*If the runlevel has already been set, don't set it again.
-				* This prevents a rather nasty bug.*/
-				continue;
-			}
+	#ifndef NOMMU
+			State->CurObj->Opts.Fork = true;
+	#else
+			char ErrBuf[MAX_LINE_SIZE];
 			
-			if (CurObj != NULL)
-			{ /*What the warning says. It'd get all weird if we allowed that.*/
-				ConfigProblem(CONFIG_EAFTER, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			if (!GetLineDelim(Worker, DelimCurr))
-			{
-				ConfigProblem(CONFIG_EMISSINGVAL, CurrentAttribute, NULL, LineNum);
-				continue;
-			}	
-			
-			snprintf(CurRunlevel, MAX_DESCRIPT_SIZE, "%s", DelimCurr);
-			
-			continue;
+			snprintf(ErrBuf, sizeof ErrBuf, CONFIGWARNTXT "Object \"%s\" has specified the FORK option,\n"
+					"but this is not supported on NOMMU builds.", State->CurObj->ObjectID);
+			SpitWarning(ErrBuf);
+			WriteLogLine(ErrBuf, true);
+	#endif /*NOMMU*/
 		}
-		else if (!strncmp(Worker, (CurrentAttribute = "Hostname"), strlen("Hostname")))
+		else if (!strcmp(CurArg, "EXEC"))
 		{
-			if (CurObj != NULL)
-			{ /*What the warning says. It'd get all weird if we allowed that.*/
-				ConfigProblem(CONFIG_EAFTER, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			if (!GetLineDelim(Worker, DelimCurr))
-			{
-				ConfigProblem(CONFIG_EMISSINGVAL, CurrentAttribute, NULL, LineNum);
-				continue;
-
-			}
-			
-			if (!strncmp(DelimCurr, "FILE", strlen("FILE")))
-			{
-				FILE *TDesc;
-				unsigned long Inc = 0;
-				int TChar;
-				const char *TW = DelimCurr;
-				char THostname[MAX_LINE_SIZE];
-				
-				TW += strlen("FILE");
-				
-				for (; *TW == ' ' || *TW == '\t'; ++TW);
-				
-				if (!(TDesc = fopen(TW, "r")))
-				{
-					snprintf(ErrBuf, sizeof ErrBuf, "Failed to set hostname from file \"%s\".\n", TW);
-					SpitWarning(ErrBuf);
-					WriteLogLine(ErrBuf, true);
-					continue;
-				}
-				
-				for (Inc = 0; (TChar = getc(TDesc)) != EOF && Inc < MAX_LINE_SIZE - 1; ++Inc)
-				{ /*There is a reason for this. Just trust me.*/
-					*(unsigned char*)&THostname[Inc] = (unsigned char)TChar;
-				}
-				THostname[Inc] = '\0';
-				
-				/*Skip past spaces, tabs, and newlines.*/
-				for (TW = THostname; *TW == '\n' ||
-					*TW == ' ' || *TW == '\t'; ++TW);
-				
-				/*Copy into the real hostname from our new offset.*/
-				for (Inc = 0; TW[Inc] != '\0' && TW[Inc] != '\n'; ++Inc)
-				{
-					Hostname[Inc] = TW[Inc];
-				}
-				Hostname[Inc] = '\0';
+			State->CurObj->Opts.Exec = true;
+		}
+		else if (!strcmp(CurArg, "PIVOT"))
+		{
+			State->CurObj->Opts.PivotRoot = true;
+		}
+		else if (!strcmp(CurArg, "RAWDESCRIPTION"))
+		{
+			State->CurObj->Opts.RawDescription = true;
+		}
+		else if (!strcmp(CurArg, "SERVICE"))
+		{
+			State->CurObj->Opts.IsService = true;
+		}
+		else if (!strcmp(CurArg, "AUTORESTART"))
+		{
+			State->CurObj->Opts.AutoRestart = true;
+		}
+		else if (!strcmp(CurArg, "FORCESHELL"))
+		{
+			#ifndef NOSHELL
+				State->CurObj->Opts.ForceShell = true;
+			#else
+				char ErrBuf[MAX_LINE_SIZE];
 				
-				fclose(TDesc);
-			}
-			else
-			{	
-				snprintf(Hostname, MAX_LINE_SIZE, "%s", DelimCurr);
-			}
+				snprintf(ErrBuf, sizeof ErrBuf, CONFIGWARNTXT "Object %s has the option FORCESHELL set,\n"
+						"but Epoch was compiled without shell support.\n"
+						"Ignoring.", State->CurObj->ObjectID);
+				SpitWarning(ErrBuf);
+				WriteLogLine(ErrBuf, true);
+			#endif
+		}
+		else if (!strncmp(CurArg, "NOSTOPWAIT", strlen("STOPTIMEOUT")))
+		{
+			State->CurObj->Opts.NoStopWait = true;
+		}
+		else if (!strncmp(CurArg, "STOPTIMEOUT", strlen("STOPTIMEOUT")))
+		{
+			const char *TWorker = CurArg + strlen("STOPTIMEOUT");
 			
-								
-			/*Check for spaces and tabs in the actual hostname.*/
-			if (strstr(Hostname, " ") != NULL || strstr(Hostname, "\t") != NULL)
+			if (*TWorker != '=' || *(TWorker + 1) == '\0')
 			{
-				const char *const ErrString = "Tabs and/or spaces in hostname file. Cannot set hostname.";
-				SpitWarning((const char*)ErrString);
-				WriteLogLine((const char*)ErrString, true);
-				*Hostname = '\0'; /*Set the hostname back to nothing.*/
+				ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, CurArg, State->LineNum);
 				continue;
 			}
+			++TWorker;
 			
-			if ((strlen(DelimCurr) + 1) >= MAX_LINE_SIZE)
+			if (!AllNumeric(TWorker))
 			{
-				ConfigProblem(CONFIG_ETRUNCATED, CurrentAttribute, DelimCurr, LineNum);
+				ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, CurArg, State->LineNum);
+				continue;
 			}
 			
-			continue;
+			State->CurObj->Opts.StopTimeout = atol(TWorker);
 		}
-		else if (!strncmp(Worker, (CurrentAttribute = "ObjectID"), strlen("ObjectID")))
-		{ /*ASCII value used to identify this object internally, and also a kind of short name for it.*/
-			char *Temp = NULL;
+		else if (!strncmp(CurArg, "TERMSIGNAL", strlen("TERMSIGNAL")))
+		{
+			const char *TWorker = CurArg + strlen("TERMSIGNAL");
 			
-			if (!GetLineDelim(Worker, DelimCurr))
+			if (*TWorker != '=' || *(TWorker + 1) == '\0')
 			{
-				ConfigProblem(CONFIG_EMISSINGVAL, CurrentAttribute, NULL, LineNum);
+				ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, CurArg, State->LineNum);
 				continue;
 			}
-
-			if ((Temp = strpbrk(DelimCurr, " \t")) != NULL) /*We cannot allow whitespace.*/
-			{
-				snprintf(ErrBuf, sizeof ErrBuf, CONFIGWARNTXT "ObjectIDs may not contain whitespace! Truncating up to occurence of whitespace\n"
-						"Line %lu in %s.", LineNum, ConfigFile);
-				SpitWarning(ErrBuf);
-				WriteLogLine(ErrBuf, true);
-				*Temp = '\0';
-			}
 			
-			DelimCurr[MAX_DESCRIPT_SIZE - 1] = '\0'; /*Chop it off to prevent overflow.*/
+			++TWorker;
 			
-			CurObj = AddObjectToTable(DelimCurr); /*Sets this as our current object.*/
+			if (AllNumeric(TWorker))
+			{
+				if (atoi(TWorker) > 255)
+				{
+					ConfigProblem(CONFIG_ELARGENUM, CurArg, NULL, State->LineNum);
+				}
 
-			if ((strlen(DelimCurr) + 1) >= MAX_DESCRIPT_SIZE)
+				State->CurObj->TermSignal = atoi(TWorker);
+			}
+			else if (!strcmp("SIGTERM", TWorker))
 			{
-				ConfigProblem(CONFIG_ETRUNCATED, CurrentAttribute, DelimCurr, LineNum);
+				State->CurObj->TermSignal = SIGTERM;
 			}
-
-			continue;
-		}
-		else if (!strncmp(Worker, (CurrentAttribute = "ObjectWorkingDirectory"), strlen("ObjectWorkingDirectory")))
-		{
-			if (!CurObj)
+			else if (!strcmp("SIGKILL", TWorker))
 			{
-				ConfigProblem(CONFIG_EBEFORE, CurrentAttribute, NULL, LineNum);
-				continue;
+				State->CurObj->TermSignal = SIGKILL;
 			}
-			
-			if (!GetLineDelim(Worker, DelimCurr))
+			else if (!strcmp("SIGHUP", TWorker))
 			{
-				ConfigProblem(CONFIG_EMISSINGVAL, CurrentAttribute, NULL, LineNum);
-				continue;
+				State->CurObj->TermSignal = SIGKILL;
 			}
-			
-			if (CurObj->ObjectWorkingDirectory != NULL)
+			else if (!strcmp("SIGINT", TWorker))
 			{
-				free(CurObj->ObjectWorkingDirectory);
+				State->CurObj->TermSignal = SIGINT;
 			}
-			
-			CurObj->ObjectWorkingDirectory = malloc(strlen(DelimCurr) + 1);
-			
-			strncpy(CurObj->ObjectWorkingDirectory, DelimCurr, strlen(DelimCurr) + 1);	
-		}
-		else if (!strncmp(Worker, (CurrentAttribute = "ObjectEnabled"), strlen("ObjectEnabled")))
-		{
-			if (!CurObj)
+			else if (!strcmp("SIGABRT", TWorker))
 			{
-
-				ConfigProblem(CONFIG_EBEFORE, CurrentAttribute, NULL, LineNum);
-				continue;
+				State->CurObj->TermSignal = SIGABRT;
 			}
-			
-			if (!GetLineDelim(Worker, DelimCurr))
+			else if (!strcmp("SIGQUIT", TWorker))
 			{
-				ConfigProblem(CONFIG_EMISSINGVAL, CurrentAttribute, NULL, LineNum);
-				continue;
+				State->CurObj->TermSignal = SIGQUIT;
 			}
-			
-			if (!strcmp(DelimCurr, "true"))
+			else if (!strcmp("SIGUSR1", TWorker))
 			{
-				CurObj->Enabled = true;
+				State->CurObj->TermSignal = SIGUSR1;
 			}
-			else if (!strcmp(DelimCurr, "false"))
+			else if (!strcmp("SIGUSR2", TWorker))
 			{
-				CurObj->Enabled = false;
+				State->CurObj->TermSignal = SIGUSR2;
 			}
 			else
 			{
-				ConfigProblem(CONFIG_EBADVAL, CurrentAttribute, DelimCurr, LineNum);
+				ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, TWorker, State->LineNum);
+				continue;
 			}
-			
-			continue;
 		}
-		else if (!strncmp(Worker, (CurrentAttribute = "ObjectOptions"), strlen("ObjectOptions")))
+		else
 		{
-			const char *TWorker = DelimCurr;
-			unsigned long Inc;
-			char CurArg[MAX_DESCRIPT_SIZE];
-			
-			if (!CurObj)
-			{
-				ConfigProblem(CONFIG_EBEFORE, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			if (!GetLineDelim(Worker, DelimCurr))
-			{
-				ConfigProblem(CONFIG_EMISSINGVAL, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			if ((strlen(DelimCurr) + 1) >= MAX_LINE_SIZE)
-			{
-				ConfigProblem(CONFIG_ETRUNCATED, CurrentAttribute, DelimCurr, LineNum);
-			}
-			
-			do
-			{
-				
-				for (Inc = 0; TWorker[Inc] != ' ' && TWorker[Inc] != '\t' && TWorker[Inc] != '\n'
-					&& TWorker[Inc] != '\0' && Inc < (MAX_DESCRIPT_SIZE - 1); ++Inc)
-				{
-					CurArg[Inc] = TWorker[Inc];
-				}
-				CurArg[Inc] = '\0';
-				
-				
-				if (!strcmp(CurArg, "HALTONLY"))
-				{ /*Allow entries that execute on shutdown only.*/
-					CurObj->Started = true;
-					CurObj->Opts.Persistent = true;
-					CurObj->Opts.HaltCmdOnly = true;
-				}
-				else if (!strcmp(CurArg, "PERSISTENT"))
-				{
-					CurObj->Opts.Persistent = true;
-				}
-				else if (!strcmp(CurArg, "FORK"))
-				{
-			#ifndef NOMMU
-					CurObj->Opts.Fork = true;
-			#else
-					snprintf(ErrBuf, sizeof ErrBuf, CONFIGWARNTXT "Object \"%s\" has specified the FORK option,\n"
-							"but this is not supported on NOMMU builds.", CurObj->ObjectID);
-					SpitWarning(ErrBuf);
-					WriteLogLine(ErrBuf, true);
-			#endif /*NOMMU*/
-				}
-				else if (!strcmp(CurArg, "EXEC"))
-				{
-					CurObj->Opts.Exec = true;
-				}
-				else if (!strcmp(CurArg, "PIVOT"))
-				{
-					CurObj->Opts.PivotRoot = true;
-				}
-				else if (!strcmp(CurArg, "RAWDESCRIPTION"))
-				{
-					CurObj->Opts.RawDescription = true;
-				}
-				else if (!strcmp(CurArg, "SERVICE"))
-				{
-					CurObj->Opts.IsService = true;
-				}
-				else if (!strcmp(CurArg, "AUTORESTART"))
-				{
-					CurObj->Opts.AutoRestart = true;
-				}
-				else if (!strcmp(CurArg, "FORCESHELL"))
-				{
-					#ifndef NOSHELL
-						CurObj->Opts.ForceShell = true;
-					#else
-						snprintf(ErrBuf, sizeof ErrBuf, CONFIGWARNTXT "Object %s has the option FORCESHELL set,\n"
-								"but Epoch was compiled without shell support.\n"
-								"Ignoring.", CurObj->ObjectID);
-						SpitWarning(ErrBuf);
-						WriteLogLine(ErrBuf, true);
-					#endif
-				}
-				else if (!strncmp(CurArg, "NOSTOPWAIT", strlen("STOPTIMEOUT")))
-				{
-					CurObj->Opts.NoStopWait = true;
-				}
-				else if (!strncmp(CurArg, "STOPTIMEOUT", strlen("STOPTIMEOUT")))
-				{
-					const char *TWorker = CurArg + strlen("STOPTIMEOUT");
-					
-					if (*TWorker != '=' || *(TWorker + 1) == '\0')
-					{
-						ConfigProblem(CONFIG_EBADVAL, CurrentAttribute, CurArg, LineNum);
-						continue;
-					}
-					++TWorker;
-					
-					if (!AllNumeric(TWorker))
-					{
-						ConfigProblem(CONFIG_EBADVAL, CurrentAttribute, CurArg, LineNum);
-						continue;
-					}
-					
-					CurObj->Opts.StopTimeout = atol(TWorker);
-				}
-				else if (!strncmp(CurArg, "TERMSIGNAL", strlen("TERMSIGNAL")))
-				{
-					const char *TWorker = CurArg + strlen("TERMSIGNAL");
-					
-					if (*TWorker != '=' || *(TWorker + 1) == '\0')
-					{
-						ConfigProblem(CONFIG_EBADVAL, CurrentAttribute, CurArg, LineNum);
-						continue;
-					}
-					
-					++TWorker;
-					
-					if (AllNumeric(TWorker))
-					{
-						if (atoi(TWorker) > 255)
-						{
-							ConfigProblem(CONFIG_ELARGENUM, CurArg, NULL, LineNum);
-						}
-
-						CurObj->TermSignal = atoi(TWorker);
-					}
-					else if (!strcmp("SIGTERM", TWorker))
-					{
-						CurObj->TermSignal = SIGTERM;
-					}
-					else if (!strcmp("SIGKILL", TWorker))
-					{
-						CurObj->TermSignal = SIGKILL;
-					}
-					else if (!strcmp("SIGHUP", TWorker))
-					{
-						CurObj->TermSignal = SIGKILL;
-					}
-					else if (!strcmp("SIGINT", TWorker))
-					{
-						CurObj->TermSignal = SIGINT;
-					}
-					else if (!strcmp("SIGABRT", TWorker))
-					{
-						CurObj->TermSignal = SIGABRT;
-					}
-					else if (!strcmp("SIGQUIT", TWorker))
-					{
-						CurObj->TermSignal = SIGQUIT;
-					}
-					else if (!strcmp("SIGUSR1", TWorker))
-					{
-						CurObj->TermSignal = SIGUSR1;
-					}
-					else if (!strcmp("SIGUSR2", TWorker))
-					{
-						CurObj->TermSignal = SIGUSR2;
-					}
-					else
-					{
-						ConfigProblem(CONFIG_EBADVAL, CurrentAttribute, TWorker, LineNum);
-						continue;
-					}
-				}
-				else
-				{
-					ConfigProblem(CONFIG_EBADVAL, CurrentAttribute, CurArg, LineNum);
-					break;
-				}
-			} while ((TWorker = WhitespaceArg(TWorker)));
-			
-			continue;
+			ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, CurArg, State->LineNum);
+			break;
 		}
-		else if (!strncmp(Worker, (CurrentAttribute = "ObjectDescription"), strlen("ObjectDescription")))
-		{ /*It's description.*/
-			if (!CurObj)
-			{
-				ConfigProblem(CONFIG_EBEFORE, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			if (!GetLineDelim(Worker, DelimCurr))
-			{
-				ConfigProblem(CONFIG_EMISSINGVAL, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			if (CurObj->ObjectDescription != NULL) free(CurObj->ObjectDescription);
-			
-			DelimCurr[MAX_DESCRIPT_SIZE - 1] = '\0'; /*Chop it off to prevent overflow.*/
+	} while ((TWorker = WhitespaceArg(TWorker)));
+}
 
-			CurObj->ObjectDescription = malloc(strlen(DelimCurr) + 1);
-			strncpy(CurObj->ObjectDescription, DelimCurr, strlen(DelimCurr) + 1);
-			
-			if ((strlen(DelimCurr) + 1) >= MAX_DESCRIPT_SIZE)
-			{
-				ConfigProblem(CONFIG_ETRUNCATED, CurrentAttribute, DelimCurr, LineNum);
-			}
+static void ConfigAttr_ObjectDescription(struct _ConfigState *State)
+{ /*It's description.*/
+	if (strlen(State->DelimCurr) >= MAX_DESCRIPT_SIZE)
+	{ /*Chop it off to prevent overflow.*/
+		State->DelimCurr[MAX_DESCRIPT_SIZE - 1] = '\0';
+	}
 
-			continue;
-		}
-		else if (!strncmp(Worker, (CurrentAttribute = "ObjectStartCommand"), strlen("ObjectStartCommand")))
-		{ /*What we execute to start it.*/
-			if (!CurObj)
-			{
-				ConfigProblem(CONFIG_EBEFORE, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			if (!GetLineDelim(Worker, DelimCurr))
-			{
-				ConfigProblem(CONFIG_EMISSINGVAL, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			if (CurObj->ObjectStartCommand) free(CurObj->ObjectStartCommand);
+	State->CurObj->ObjectDescription = ConfigArena_String(State->DelimCurr);
+	
+	if ((strlen(State->DelimCurr) + 1) >= MAX_DESCRIPT_SIZE)
+	{
+		ConfigProblem(CONFIG_ETRUNCATED, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+	}
+}
 
-			CurObj->ObjectStartCommand = malloc(strlen(DelimCurr) + 1);
-			strncpy(CurObj->ObjectStartCommand, DelimCurr, strlen(DelimCurr) + 1);
+static void ConfigAttr_ObjectStartCommand(struct _ConfigState *State)
+{ /*What we execute to start it.*/
+	State->CurObj->ObjectStartCommand = ConfigArena_String(State->DelimCurr);
 
-			if ((strlen(DelimCurr) + 1) >= MAX_LINE_SIZE)
-			{
-				ConfigProblem(CONFIG_ETRUNCATED, CurrentAttribute, DelimCurr, LineNum);
-			}
+	if ((strlen(State->DelimCurr) + 1) >= MAX_LINE_SIZE)
+	{
+		ConfigProblem(CONFIG_ETRUNCATED, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+	}
+}
+
+static void ConfigAttr_ObjectPrestartCommand(struct _ConfigState *State)
+{
+	State->CurObj->ObjectPrestartCommand = ConfigArena_String(State->DelimCurr);
+	
+	if (strlen(State->DelimCurr) + 1 >= MAX_LINE_SIZE)
+	{
+		ConfigProblem(CONFIG_ETRUNCATED, State->CurrentAttribute, NULL, State->LineNum);
+	}
+}
+
+static void ConfigAttr_ObjectReloadCommand(struct _ConfigState *State)
+{
+	if (!strncmp(State->DelimCurr, "SIGNAL", strlen("SIGNAL")))
+	{
+		const char *Tag = "SIGNAL";
+		const char *TWorker = &State->DelimCurr[strlen(Tag)];
+		
+		if (!strcmp(State->DelimCurr, Tag) ||
+			(TWorker[0] != ' ' && 
+			TWorker[0] != '\t')) /*No arg. Bad.*/
+		{
+			char TBuf[MAX_LINE_SIZE];
 			
-			continue;
+			snprintf(TBuf, sizeof TBuf, "Object \"%s\"'s reload command has 'SIGNAL' specified,\n"
+					"but syntax is not valid.", State->CurObj->ObjectID);
+			WriteLogLine(TBuf, true);
+			SpitWarning(TBuf);
+			return;
 		}
-		else if (!strncmp(Worker, (CurrentAttribute = "ObjectPrestartCommand"), strlen("ObjectPrestartCommand")))
+		
+		TWorker = WhitespaceArg(TWorker);
+		
+		if (AllNumeric(TWorker))
 		{
-			if (!CurObj)
+			if (atoi(TWorker) > 255)
 			{
-				ConfigProblem(CONFIG_EBEFORE, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			if (!GetLineDelim(Worker, DelimCurr))
-			{
-				ConfigProblem(CONFIG_EMISSINGVAL, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			if (CurObj->ObjectPrestartCommand) free(CurObj->ObjectPrestartCommand);
-			
-			CurObj->ObjectPrestartCommand = malloc(strlen(DelimCurr) + 1);
-			strncpy(CurObj->ObjectPrestartCommand, DelimCurr, strlen(DelimCurr) + 1);
-			
-			if (strlen(DelimCurr) + 1 >= MAX_LINE_SIZE)
-			{
-				ConfigProblem(CONFIG_ETRUNCATED, CurrentAttribute, NULL, LineNum);
-				continue;
+				ConfigProblem(CONFIG_ELARGENUM, State->CurrentAttribute, NULL, State->LineNum);
 			}
+			State->CurObj->ReloadCommandSignal = (unsigned char)atoi(TWorker);
 		}
-		else if (!strncmp(Worker, (CurrentAttribute = "ObjectReloadCommand"), strlen("ObjectReloadCommand")))
+		else if (!strcmp("SIGTERM", TWorker))
 		{
-			if (!CurObj)
-			{
-				ConfigProblem(CONFIG_EBEFORE, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			if (!GetLineDelim(Worker, DelimCurr))
-			{
-				ConfigProblem(CONFIG_EMISSINGVAL, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-
-			
-			if (!strncmp(DelimCurr, "SIGNAL", strlen("SIGNAL")))
-			{
-				const char *Tag = "SIGNAL";
-				const char *TWorker = &DelimCurr[strlen(Tag)];
-				
-				if (!strcmp(DelimCurr, Tag) ||
-					(TWorker[0] != ' ' && 
-					TWorker[0] != '\t')) /*No arg. Bad.*/
-				{
-					char TBuf[MAX_LINE_SIZE];
-					
-					snprintf(TBuf, sizeof TBuf, "Object \"%s\"'s reload command has 'SIGNAL' specified,\n"
-							"but syntax is not valid.", CurObj->ObjectID);
-					WriteLogLine(TBuf, true);
-					SpitWarning(TBuf);
-					continue;
-				}
-				
-				TWorker = WhitespaceArg(TWorker);
-				
-				if (AllNumeric(TWorker))
-				{
-					if (atoi(TWorker) > 255)
-					{
-						ConfigProblem(CONFIG_ELARGENUM, CurrentAttribute, NULL, LineNum);
-					}
-					CurObj->ReloadCommandSignal = (unsigned char)atoi(TWorker);
-				}
-				else if (!strcmp("SIGTERM", TWorker))
-				{
-					CurObj->ReloadCommandSignal = SIGTERM;
-				}
-				else if (!strcmp("SIGKILL", TWorker))
-				{
-					CurObj->ReloadCommandSignal = SIGKILL;
-				}
-				else if (!strcmp("SIGHUP", TWorker))
-				{
-					CurObj->ReloadCommandSignal = SIGKILL;
-				}
-				else if (!strcmp("SIGINT", TWorker))
-				{
-					CurObj->ReloadCommandSignal = SIGINT;
-				}
-				else if (!strcmp("SIGABRT", TWorker))
-				{
-					CurObj->ReloadCommandSignal = SIGABRT;
-				}
-				else if (!strcmp("SIGQUIT", TWorker))
-				{
-					CurObj->ReloadCommandSignal = SIGQUIT;
-				}
-				else if (!strcmp("SIGUSR1", TWorker))
-				{
-					CurObj->ReloadCommandSignal = SIGUSR1;
-				}
-				else if (!strcmp("SIGUSR2", TWorker))
-				{
-					CurObj->ReloadCommandSignal = SIGUSR2;
-				}
-				else
-				{
-					char TBuf[MAX_LINE_SIZE];
-					
-					snprintf(TBuf, sizeof TBuf, CONFIGWARNTXT
-							"ObjectReloadCommand starts with SIGNAL, but the argument to SIGNAL\n"
-							"is invalid. Object \"%s\" in %s line %lu", CurObj->ObjectID, ConfigFile, LineNum);
-					SpitWarning(TBuf);
-					WriteLogLine(TBuf, true);
-					continue;
-				}
-			}
-			else
-			{
-				if (CurObj->ObjectReloadCommand) free(CurObj->ObjectReloadCommand);
-				
-				CurObj->ObjectReloadCommand = malloc(strlen(DelimCurr) + 1);
-				strncpy(CurObj->ObjectReloadCommand, DelimCurr, strlen(DelimCurr) + 1);
-			}
-			
-			if (strlen(DelimCurr) + 1 >= MAX_LINE_SIZE)
-			{
-				ConfigProblem(CONFIG_ETRUNCATED, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			continue;
+			State->CurObj->ReloadCommandSignal = SIGTERM;
 		}
-		else if (!strncmp(Worker, (CurrentAttribute = "ObjectStopCommand"), strlen("ObjectStopCommand")))
-		{ /*If it's "PID", then we know that we need to kill the process ID only. If it's "NONE", well, self explanitory.*/
-			if (!CurObj)
-			{
-				ConfigProblem(CONFIG_EBEFORE, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
+		else if (!strcmp("SIGKILL", TWorker))
+		{
+			State->CurObj->ReloadCommandSignal = SIGKILL;
+		}
+		else if (!strcmp("SIGHUP", TWorker))
+		{
+			State->CurObj->ReloadCommandSignal = SIGKILL;
+		}
+		else if (!strcmp("SIGINT", TWorker))
+		{
+			State->CurObj->ReloadCommandSignal = SIGINT;
+		}
+		else if (!strcmp("SIGABRT", TWorker))
+		{
+			State->CurObj->ReloadCommandSignal = SIGABRT;
+		}
+		else if (!strcmp("SIGQUIT", TWorker))
+		{
+			State->CurObj->ReloadCommandSignal = SIGQUIT;
+		}
+		else if (!strcmp("SIGUSR1", TWorker))
+		{
+			State->CurObj->ReloadCommandSignal = SIGUSR1;
+		}
+		else if (!strcmp("SIGUSR2", TWorker))
+		{
+			State->CurObj->ReloadCommandSignal = SIGUSR2;
+		}
+		else
+		{
+			char TBuf[MAX_LINE_SIZE];
 			
-			if (!GetLineDelim(Worker, DelimCurr))
-			{
-				ConfigProblem(CONFIG_EMISSINGVAL, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
+			snprintf(TBuf, sizeof TBuf, CONFIGWARNTXT
+					"ObjectReloadCommand starts with SIGNAL, but the argument to SIGNAL\n"
+					"is invalid. Object \"%s\" in %s line %lu", State->CurObj->ObjectID, ConfigFile, State->LineNum);
+			SpitWarning(TBuf);
+			WriteLogLine(TBuf, true);
+			return;
+		}
+	}
+	else
+	{
+		State->CurObj->ObjectReloadCommand = ConfigArena_String(State->DelimCurr);
+	}
+	
+	if (strlen(State->DelimCurr) + 1 >= MAX_LINE_SIZE)
+	{
+		ConfigProblem(CONFIG_ETRUNCATED, State->CurrentAttribute, NULL, State->LineNum);
+	}
+}
 
-			if (!strncmp(DelimCurr, "PIDFILE", strlen("PIDFILE")))
-			{ /*They want us to kill a PID file on exit.*/
-				const char *Worker = DelimCurr;
-				
-				CurObj->Opts.StopMode = STOP_PIDFILE;
-				
-				if (*(Worker += strlen("PIDFILE")) != '\0')
-				{ /*It used to be that this was the only way to specify a PID file.*/
+static void ConfigAttr_ObjectStopCommand(struct _ConfigState *State)
+{ /*If it's "PID", then we know that we need to kill the process ID only. If it's "NONE", well, self explanitory.*/
+	if (!strncmp(State->DelimCurr, "PIDFILE", strlen("PIDFILE")))
+	{ /*They want us to kill a PID file on exit.*/
+		const char *Worker = State->DelimCurr;
+		
+		State->CurObj->Opts.StopMode = STOP_PIDFILE;
+		
+		if (*(Worker += strlen("PIDFILE")) != '\0')
+		{ /*It used to be that this was the only way to specify a PID file.*/
                                 
-					while (*Worker == ' ' || *Worker == '\t')
-					{ /*Skip past all spaces and tabs.*/
-						++Worker;
-					}
-					
-					if (*Worker != '\0')
-					{
-						CurObj->ObjectPIDFile = malloc(strlen(Worker) + 1);
-						strncpy(CurObj->ObjectPIDFile, Worker, strlen(Worker) + 1);
-						
-						CurObj->Opts.HasPIDFile = true;
-					}
-				}
-			}
-			else if (!strncmp(DelimCurr, "PID", strlen("PID")))
-			{
-				CurObj->Opts.StopMode = STOP_PID;
-			}
-			else if (!strncmp(DelimCurr, "NONE", strlen("NONE")))
-			{
-				CurObj->Opts.StopMode = STOP_NONE;
-			}
-			else
-			{
-				CurObj->Opts.StopMode = STOP_COMMAND;
-				
-				if (CurObj->ObjectStopCommand) free(CurObj->ObjectStopCommand);
-				CurObj->ObjectStopCommand = malloc(strlen(DelimCurr) + 1);
-				strncpy(CurObj->ObjectStopCommand, DelimCurr, strlen(DelimCurr) + 1);
+			while (*Worker == ' ' || *Worker == '\t')
+			{ /*Skip past all spaces and tabs.*/
+				++Worker;
 			}
 			
-			if ((strlen(DelimCurr) + 1) >= MAX_LINE_SIZE)
+			if (*Worker != '\0')
 			{
-				ConfigProblem(CONFIG_ETRUNCATED, CurrentAttribute, DelimCurr, LineNum);
+				State->CurObj->ObjectPIDFile = ConfigArena_String(Worker);
+				
+				State->CurObj->Opts.HasPIDFile = true;
 			}
-			
-			continue;
 		}
-		else if (!strncmp(Worker, (CurrentAttribute = "ObjectStartPriority"), strlen("ObjectStartPriority")))
+	}
+	else if (!strncmp(State->DelimCurr, "PID", strlen("PID")))
+	{
+		State->CurObj->Opts.StopMode = STOP_PID;
+	}
+	else if (!strncmp(State->DelimCurr, "NONE", strlen("NONE")))
+	{
+		State->CurObj->Opts.StopMode = STOP_NONE;
+	}
+	else
+	{
+		State->CurObj->Opts.StopMode = STOP_COMMAND;
+		
+		State->CurObj->ObjectStopCommand = ConfigArena_String(State->DelimCurr);
+	}
+	
+	if ((strlen(State->DelimCurr) + 1) >= MAX_LINE_SIZE)
+	{
+		ConfigProblem(CONFIG_ETRUNCATED, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+	}
+}
+
+static void ConfigAttr_ObjectStartPriority(struct _ConfigState *State)
+{
+	/*The order in which this item is started. If it is disabled in this runlevel, the next object in line is executed, IF
+	 * and only IF it is enabled. If not, the one after that and so on.*/
+	
+	if (!AllNumeric(State->DelimCurr)) /*Make sure we are getting a number, not Shakespeare.*/
+	{ /*No number? We're probably looking at an alias.*/
+		unsigned long TmpTarget = 0;
+		
+		if (!(TmpTarget = PriorityAlias_Lookup(State->DelimCurr)))
 		{
-			/*The order in which this item is started. If it is disabled in this runlevel, the next object in line is executed, IF
-			 * and only IF it is enabled. If not, the one after that and so on.*/
-			
-			if (!CurObj)
-			{
-				ConfigProblem(CONFIG_EBEFORE, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			if (!GetLineDelim(Worker, DelimCurr))
-			{
-				ConfigProblem(CONFIG_EMISSINGVAL, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			if (!AllNumeric(DelimCurr)) /*Make sure we are getting a number, not Shakespeare.*/
-			{ /*No number? We're probably looking at an alias.*/
-				unsigned long TmpTarget = 0;
-				
-				if (!(TmpTarget = PriorityAlias_Lookup(DelimCurr)))
-				{
-					ConfigProblem(CONFIG_EBADVAL, CurrentAttribute, DelimCurr, LineNum);
-					continue;
-				}
-				
-				CurObj->ObjectStartPriority = TmpTarget;
-				continue;
-			}
-			
-			CurObj->ObjectStartPriority = atol(DelimCurr);
-			
-			if (strlen(DelimCurr) >= 8)
-			{ /*An eight digit number is too high.*/
-				ConfigProblem(CONFIG_ELARGENUM, CurrentAttribute, NULL, LineNum);
-			}
-			
-			continue;
+			ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+			return;
 		}
-		else if (!strncmp(Worker, (CurrentAttribute = "ObjectStopPriority"), strlen("ObjectStopPriority")))
+		
+		State->CurObj->ObjectStartPriority = TmpTarget;
+		return;
+	}
+	
+	State->CurObj->ObjectStartPriority = atol(State->DelimCurr);
+	
+	if (strlen(State->DelimCurr) >= 8)
+	{ /*An eight digit number is too high.*/
+		ConfigProblem(CONFIG_ELARGENUM, State->CurrentAttribute, NULL, State->LineNum);
+	}
+}
+
+static void ConfigAttr_ObjectStopPriority(struct _ConfigState *State)
+{
+	/*Same as above, but used for when the object is being shut down.*/
+	if (!AllNumeric(State->DelimCurr))
+	{
+		unsigned long TmpTarget = 0;
+		
+		if (!(TmpTarget = PriorityAlias_Lookup(State->DelimCurr)))
 		{
-			/*Same as above, but used for when the object is being shut down.*/
-			if (!CurObj)
-			{
-				ConfigProblem(CONFIG_EBEFORE, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			if (!GetLineDelim(Worker, DelimCurr))
-			{
-				ConfigProblem(CONFIG_EMISSINGVAL, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			if (!AllNumeric(DelimCurr))
-			{
-				unsigned long TmpTarget = 0;
-				
-				if (!(TmpTarget = PriorityAlias_Lookup(DelimCurr)))
-				{
-					ConfigProblem(CONFIG_EBADVAL, CurrentAttribute, DelimCurr, LineNum);
-					continue;
-				}
-				
-				CurObj->ObjectStopPriority = TmpTarget;
-				continue;
-			}
-			
-			CurObj->ObjectStopPriority = atol(DelimCurr);
-			
-			if (strlen(DelimCurr) >= 8)
-			{ /*An eight digit number is too high.*/
-				ConfigProblem(CONFIG_ELARGENUM, CurrentAttribute, NULL, LineNum);
-			}
-			
-			continue;
+			ConfigProblem(CONFIG_EBADVAL, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+			return;
 		}
-		else if (!strncmp(Worker, (CurrentAttribute = "ObjectPIDFile"), strlen("ObjectPIDFile")))
-		{ /*This really needs to be specified if Opts.StopMode is STOP_PIDFILE, or we'll reset the object to STOP_PID.*/
-			if (!CurObj)
-			{
-				ConfigProblem(CONFIG_EBEFORE, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			if (!GetLineDelim(Worker, DelimCurr))
-			{
-				ConfigProblem(CONFIG_EMISSINGVAL, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			if (CurObj->ObjectPIDFile) free(CurObj->ObjectPIDFile);
-			
-			CurObj->ObjectPIDFile = malloc(strlen(DelimCurr) + 1);
-			strncpy(CurObj->ObjectPIDFile, DelimCurr, strlen(DelimCurr) + 1);
-			
-			CurObj->Opts.HasPIDFile = true;
-			
-			if ((strlen(DelimCurr) + 1) >= MAX_LINE_SIZE)
-			{
-				ConfigProblem(CONFIG_ETRUNCATED, CurrentAttribute, DelimCurr, LineNum);
-			}
-			
-			continue;
+		
+		State->CurObj->ObjectStopPriority = TmpTarget;
+		return;
+	}
+	
+	State->CurObj->ObjectStopPriority = atol(State->DelimCurr);
+	
+	if (strlen(State->DelimCurr) >= 8)
+	{ /*An eight digit number is too high.*/
+		ConfigProblem(CONFIG_ELARGENUM, State->CurrentAttribute, NULL, State->LineNum);
+	}
+}
+
+static void ConfigAttr_ObjectPIDFile(struct _ConfigState *State)
+{ /*This really needs to be specified if Opts.StopMode is STOP_PIDFILE, or we'll reset the object to STOP_PID.*/
+	State->CurObj->ObjectPIDFile = ConfigArena_String(State->DelimCurr);
+	
+	State->CurObj->Opts.HasPIDFile = true;
+	
+	if ((strlen(State->DelimCurr) + 1) >= MAX_LINE_SIZE)
+	{
+		ConfigProblem(CONFIG_ETRUNCATED, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+	}
+}
+
+static void ConfigAttr_ObjectUser(struct _ConfigState *State)
+{
+	struct passwd *UserStruct = NULL;
+	char ErrBuf[MAX_LINE_SIZE];
+	
+	if (!(UserStruct = getpwnam(State->DelimCurr)))
+	{ /*getpwnam_r() is more trouble than it's worth in single-threaded Epoch.*/
+		snprintf(ErrBuf, sizeof ErrBuf, CONFIGWARNTXT
+				"Unable to lookup requested USER \"%s\" for object \"%s\".\n"
+				"Line %lu in %s", State->DelimCurr, State->CurObj->ObjectID, State->LineNum, ConfigFile);
+		WriteLogLine(ErrBuf, true);
+		SpitWarning(ErrBuf);
+		return;
+	}
+	
+	State->CurObj->UserID = (unsigned long)UserStruct->pw_uid;
+	
+	if ((strlen(State->DelimCurr) + 1) >= MAX_LINE_SIZE)
+	{
+		ConfigProblem(CONFIG_ETRUNCATED, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+	}
+}
+
+static void ConfigAttr_ObjectGroup(struct _ConfigState *State)
+{
+	struct group *GroupStruct = NULL;
+	char ErrBuf[MAX_LINE_SIZE];
+	
+	if (!(GroupStruct = getgrnam(State->DelimCurr)))
+	{ /*getpwnam_r() is more trouble than it's worth in single-threaded Epoch.*/
+		snprintf(ErrBuf, sizeof ErrBuf, CONFIGWARNTXT
+				"Unable to lookup requested GROUP \"%s\" for object \"%s\".\n"
+				"Line %lu in %s", State->DelimCurr, State->CurObj->ObjectID, State->LineNum, ConfigFile);
+		WriteLogLine(ErrBuf, true);
+		SpitWarning(ErrBuf);
+		return;
+	}
+	
+	State->CurObj->GroupID = (unsigned long)GroupStruct->gr_gid;
+	
+	if ((strlen(State->DelimCurr) + 1) >= MAX_LINE_SIZE)
+	{
+		ConfigProblem(CONFIG_ETRUNCATED, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+	}
+}
+
+static void ConfigAttr_ObjectStdout(struct _ConfigState *State)
+{
+	State->CurObj->Opts.CaptureStdout = false;
+	
+	if (!strcmp(State->DelimCurr, "CAPTURE"))
+	{ /*Through a pipe to the log. See capture.c.*/
+		State->CurObj->ObjectStdout = NULL;
+		State->CurObj->Opts.CaptureStdout = true;
+	}
+	else if (!strcmp(State->DelimCurr, "LOG"))
+	{
+		State->CurObj->ObjectStdout = ConfigArena_String(LOGDIR LOGFILE_NAME);
+	}
+	else
+	{
+		State->CurObj->ObjectStdout = ConfigArena_String(State->DelimCurr);
+		
+		if ((strlen(State->DelimCurr) + 1) >= MAX_LINE_SIZE)
+		{
+			ConfigProblem(CONFIG_ETRUNCATED, State->CurrentAttribute, State->DelimCurr, State->LineNum);
 		}
-		else if (!strncmp(Worker, (CurrentAttribute = "ObjectUser"), strlen("ObjectUser")))
+	}
+}
+
+static void ConfigAttr_ObjectStderr(struct _ConfigState *State)
+{
+	State->CurObj->Opts.CaptureStderr = false;
+	
+	if (!strcmp(State->DelimCurr, "CAPTURE"))
+	{ /*Through a pipe to the log. See capture.c.*/
+		State->CurObj->ObjectStderr = NULL;
+		State->CurObj->Opts.CaptureStderr = true;
+	}
+	else if (!strcmp(State->DelimCurr, "LOG"))
+	{
+		State->CurObj->ObjectStderr = ConfigArena_String(LOGDIR LOGFILE_NAME);
+	}
+	else
+	{
+		State->CurObj->ObjectStderr = ConfigArena_String(State->DelimCurr);
+		
+		if ((strlen(State->DelimCurr) + 1) >= MAX_LINE_SIZE)
 		{
-			struct passwd *UserStruct = NULL;
-			
-			if (CurObj == NULL)
-			{
-				ConfigProblem(CONFIG_EBEFORE, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			if (!GetLineDelim(Worker, DelimCurr))
-			{
-				ConfigProblem(CONFIG_EMISSINGVAL, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			if (!(UserStruct = getpwnam(DelimCurr)))
-			{ /*getpwnam_r() is more trouble than it's worth in single-threaded Epoch.*/
-				snprintf(ErrBuf, sizeof ErrBuf, CONFIGWARNTXT
-						"Unable to lookup requested USER \"%s\" for object \"%s\".\n"
-						"Line %lu in %s", DelimCurr, CurObj->ObjectID, LineNum, ConfigFile);
-				WriteLogLine(ErrBuf, true);
-				SpitWarning(ErrBuf);
-				continue;
-			}
-			
-			CurObj->UserID = (unsigned long)UserStruct->pw_uid;
-			
-			if ((strlen(DelimCurr) + 1) >= MAX_LINE_SIZE)
-			{
-				ConfigProblem(CONFIG_ETRUNCATED, CurrentAttribute, DelimCurr, LineNum);
-			}
-			
-			continue;
+			ConfigProblem(CONFIG_ETRUNCATED, State->CurrentAttribute, State->DelimCurr, State->LineNum);
 		}
-		else if (!strncmp(Worker, (CurrentAttribute = "ObjectGroup"), strlen("ObjectGroup")))
+	}
+}
+
+static void ConfigAttr_ObjectRunlevels(struct _ConfigState *State)
+{ /*Runlevel.*/
+	char *TWorker;
+	char TRL[MAX_DESCRIPT_SIZE], *TRL2;
+	char ErrBuf[MAX_LINE_SIZE];
+	
+	if (!State->CurObj)
+	{
+		ConfigProblem(CONFIG_EBEFORE, State->CurrentAttribute, NULL, State->LineNum);
+		return;
+	}
+	
+	if (ObjRL_CountRunlevels(State->CurObj) != 0)
+	{ /*We cannot have multiple runlevel attributes because it messes up config file editing.*/
+		snprintf(ErrBuf, sizeof ErrBuf, CONFIGWARNTXT "Object %s has more than one ObjectRunlevels line.\n"
+				"This is not advised because the config file editing code is not smart enough\n"
+				"to handle multiple lines. You should put the additional runlevels on the same line.\n"
+				"Line %lu in %s",
+				State->CurObj->ObjectID, State->LineNum, ConfigFile);
+		SpitWarning(ErrBuf);
+		WriteLogLine(ErrBuf, true);
+	}
+	
+	if (!GetLineDelim(State))
+	{
+		ConfigProblem(CONFIG_EMISSINGVAL, State->CurrentAttribute, NULL, State->LineNum);
+		return;
+	}
+	
+	TWorker = State->DelimCurr;
+	
+	do
+	{
+		for (TRL2 = TRL; *TWorker != ' ' && *TWorker != '\t' && *TWorker != '\n' && *TWorker != '\0'; ++TWorker, ++TRL2)
 		{
-			struct group *GroupStruct = NULL;
-			
-			if (CurObj == NULL)
-			{
-				ConfigProblem(CONFIG_EBEFORE, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
+			*TRL2 = *TWorker;
+		}
+		*TRL2 = '\0';
+		
+		ObjRL_AddRunlevel(TRL, State->CurObj);
+		
+	} while ((TWorker = WhitespaceArg(TWorker)));
+	
+	if ((strlen(State->DelimCurr) + 1) >= MAX_LINE_SIZE)
+	{
+		ConfigProblem(CONFIG_ETRUNCATED, State->CurrentAttribute, State->DelimCurr, State->LineNum);
+	}
+}
+
+/*Every attribute InitConfig() knows, and what it needs checked before its handler runs.*/
+static const struct _ConfigAttribute
+{
+	const char *Name;
+	unsigned char Flags;
+	void (*Handler)(struct _ConfigState *State);
+} ConfigAttributes[] =
+{
+	{ "DisableCAD", CONFIGATTR_VALUE | CONFIGATTR_GLOBALSTATE, ConfigAttr_DisableCAD },
+	{ "BlankLogOnBoot", CONFIGATTR_VALUE | CONFIGATTR_GLOBALSTATE, ConfigAttr_BlankLogOnBoot },
+	{ "EnableLogging", CONFIGATTR_VALUE | CONFIGATTR_GLOBALSTATE, ConfigAttr_EnableLogging },
+	{ "LogSync", CONFIGATTR_VALUE | CONFIGATTR_GLOBALSTATE, ConfigAttr_LogSync },
+	{ "MemLogLimit", CONFIGATTR_VALUE | CONFIGATTR_GLOBALSTATE, ConfigAttr_MemLogLimit },
+	{ "LogStore", CONFIGATTR_VALUE | CONFIGATTR_GLOBALSTATE, ConfigAttr_LogStore },
+	{ "LogRotateSize", CONFIGATTR_VALUE | CONFIGATTR_GLOBALSTATE, ConfigAttr_LogRotateSize },
+	{ "LogRotateAge", CONFIGATTR_VALUE | CONFIGATTR_GLOBALSTATE, ConfigAttr_LogRotateAge },
+	{ "LogRotateKeep", CONFIGATTR_VALUE | CONFIGATTR_GLOBALSTATE, ConfigAttr_LogRotateKeep },
+	{ "CaptureRateLimit", CONFIGATTR_VALUE | CONFIGATTR_GLOBALSTATE, ConfigAttr_CaptureRateLimit },
+	{ "TailBufferSize", CONFIGATTR_VALUE | CONFIGATTR_GLOBALSTATE, ConfigAttr_TailBufferSize },
+	{ "TailMemoryLimit", CONFIGATTR_VALUE | CONFIGATTR_GLOBALSTATE, ConfigAttr_TailMemoryLimit },
+	{ "SyslogReceiver", CONFIGATTR_VALUE | CONFIGATTR_GLOBALSTATE, ConfigAttr_SyslogReceiver },
+	{ "SyslogSeverity", CONFIGATTR_VALUE | CONFIGATTR_GLOBALSTATE, ConfigAttr_SyslogSeverity },
+	{ "SyslogFacilities", CONFIGATTR_VALUE | CONFIGATTR_GLOBALSTATE, ConfigAttr_SyslogFacilities },
+	{ "SyslogRateLimit", CONFIGATTR_VALUE | CONFIGATTR_GLOBALSTATE, ConfigAttr_SyslogRateLimit },
+	{ "ShutdownKillTimeout", CONFIGATTR_VALUE | CONFIGATTR_GLOBALSTATE, ConfigAttr_ShutdownKillTimeout },
+	{ "RunlevelInherits", CONFIGATTR_VALUE | CONFIGATTR_GLOBALSTATE, ConfigAttr_RunlevelInherits },
+	{ "DefinePriority", CONFIGATTR_GLOBAL | CONFIGATTR_VALUE, ConfigAttr_DefinePriority },
+	{ "AlignStatusReports", 0, ConfigAttr_AlignStatusReports },
+	{ "MountVirtual", CONFIGATTR_VALUE | CONFIGATTR_GLOBALSTATE, ConfigAttr_MountVirtual },
+	{ "BootBannerText", CONFIGATTR_VALUE | CONFIGATTR_GLOBALSTATE, ConfigAttr_BootBannerText },
+	{ "BootBannerColor", CONFIGATTR_VALUE | CONFIGATTR_GLOBALSTATE, ConfigAttr_BootBannerColor },
+	{ "DefaultRunlevel", CONFIGATTR_GLOBALSTATE, ConfigAttr_DefaultRunlevel },
+	{ "Hostname", CONFIGATTR_GLOBAL | CONFIGATTR_VALUE | CONFIGATTR_GLOBALSTATE, ConfigAttr_Hostname },
+	{ "ObjectID", CONFIGATTR_VALUE | CONFIGATTR_INDEX, ConfigAttr_ObjectID },
+	{ "ObjectWorkingDirectory", CONFIGATTR_OBJECT | CONFIGATTR_VALUE, ConfigAttr_ObjectWorkingDirectory },
+	{ "ObjectEnabled", CONFIGATTR_OBJECT | CONFIGATTR_VALUE | CONFIGATTR_INDEX, ConfigAttr_ObjectEnabled },
+	{ "ObjectOptions", CONFIGATTR_OBJECT | CONFIGATTR_VALUE | CONFIGATTR_INDEX, ConfigAttr_ObjectOptions },
+	{ "ObjectDescription", CONFIGATTR_OBJECT | CONFIGATTR_VALUE, ConfigAttr_ObjectDescription },
+	{ "ObjectStartCommand", CONFIGATTR_OBJECT | CONFIGATTR_VALUE, ConfigAttr_ObjectStartCommand },
+	{ "ObjectPrestartCommand", CONFIGATTR_OBJECT | CONFIGATTR_VALUE, ConfigAttr_ObjectPrestartCommand },
+	{ "ObjectReloadCommand", CONFIGATTR_OBJECT | CONFIGATTR_VALUE, ConfigAttr_ObjectReloadCommand },
+	{ "ObjectStopCommand", CONFIGATTR_OBJECT | CONFIGATTR_VALUE, ConfigAttr_ObjectStopCommand },
+	{ "ObjectStartPriority", CONFIGATTR_OBJECT | CONFIGATTR_VALUE, ConfigAttr_ObjectStartPriority },
+	{ "ObjectStopPriority", CONFIGATTR_OBJECT | CONFIGATTR_VALUE, ConfigAttr_ObjectStopPriority },
+	{ "ObjectPIDFile", CONFIGATTR_OBJECT | CONFIGATTR_VALUE, ConfigAttr_ObjectPIDFile },
+	{ "ObjectUser", CONFIGATTR_OBJECT | CONFIGATTR_VALUE, ConfigAttr_ObjectUser },
+	{ "ObjectGroup", CONFIGATTR_OBJECT | CONFIGATTR_VALUE, ConfigAttr_ObjectGroup },
+	{ "ObjectStdout", CONFIGATTR_OBJECT | CONFIGATTR_VALUE, ConfigAttr_ObjectStdout },
+	{ "ObjectStderr", CONFIGATTR_OBJECT | CONFIGATTR_VALUE, ConfigAttr_ObjectStderr },
+	{ "ObjectRunlevels", CONFIGATTR_INDEX, ConfigAttr_ObjectRunlevels }
+};
+
+#define CONFIGATTR_COUNT (sizeof ConfigAttributes / sizeof *ConfigAttributes)
+
+/*Attribute names go through a perfect hash on the whole first word of the line.
+ * ConfigAttr_BuildTable() looks for a seed that gives every name its own slot,
+ * so finding an attribute costs one hash and one compare wherever it is in the table above.*/
+#define CONFIGATTR_HASH_BITS 8
+#define CONFIGATTR_HASH_SIZE (1 << CONFIGATTR_HASH_BITS)
+#define CONFIGATTR_SLOT(Hash, Seed) (((((Hash) ^ (Seed)) * 2654435761UL) & 0xFFFFFFFFUL) >> (32 - CONFIGATTR_HASH_BITS))
+static unsigned char ConfigAttrTable[CONFIGATTR_HASH_SIZE]; /*Index into ConfigAttributes plus one, zero is empty.*/
+static unsigned long ConfigAttrSeed;
+
+static void ConfigAttr_BuildTable(void)
+{
+	unsigned long Inc, Slot, Collisions;
+	
+	for (ConfigAttrSeed = 0; ; ++ConfigAttrSeed)
+	{
+		memset(ConfigAttrTable, 0, sizeof ConfigAttrTable);
+		
+		for (Inc = 0, Collisions = 0; Inc < CONFIGATTR_COUNT; ++Inc)
+		{
+			const char *Name = ConfigAttributes[Inc].Name;
 			
-			if (!GetLineDelim(Worker, DelimCurr))
-			{
-				ConfigProblem(CONFIG_EMISSINGVAL, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
+			for (Slot = CONFIGATTR_SLOT(HashBytes(Name, strlen(Name)), ConfigAttrSeed);
+				ConfigAttrTable[Slot]; Slot = (Slot + 1) & (CONFIGATTR_HASH_SIZE - 1)) ++Collisions;
 			
-			if (!(GroupStruct = getgrnam(DelimCurr)))
-			{ /*getpwnam_r() is more trouble than it's worth in single-threaded Epoch.*/
-				snprintf(ErrBuf, sizeof ErrBuf, CONFIGWARNTXT
-						"Unable to lookup requested GROUP \"%s\" for object \"%s\".\n"
-						"Line %lu in %s", DelimCurr, CurObj->ObjectID, LineNum, ConfigFile);
-				WriteLogLine(ErrBuf, true);
-				SpitWarning(ErrBuf);
-				continue;
-			}
+			ConfigAttrTable[Slot] = (unsigned char)(Inc + 1);
+		}
+		
+		/*If we somehow never find a perfect seed, probing still gets us there.*/
+		if (!Collisions || ConfigAttrSeed == 4096) break;
+	}
+}
+
+static const struct _ConfigAttribute *ConfigAttr_Lookup(const char *Name, unsigned long Length)
+{
+	unsigned long Slot = CONFIGATTR_SLOT(HashBytes(Name, Length), ConfigAttrSeed);
+	
+	for (; ConfigAttrTable[Slot]; Slot = (Slot + 1) & (CONFIGATTR_HASH_SIZE - 1))
+	{
+		const struct _ConfigAttribute *Attribute = ConfigAttributes + ConfigAttrTable[Slot] - 1;
+		
+		if (!strncmp(Attribute->Name, Name, Length) && Attribute->Name[Length] == '\0')
+		{
+			return Attribute;
+		}
+	}
+	
+	return NULL;
+}
+
+static void ParseConfigStream(const struct _ConfigLex *Lex, unsigned long First, struct _ConfigState *State)
+{ /*Runs every token from First on through its attribute's handler.*/
+	const struct _ConfigToken *Token = Lex->Tokens + First;
+	const struct _ConfigAttribute *Attribute = NULL;
+	char ErrBuf[MAX_LINE_SIZE];
+	
+	State->Lex = Lex;
+	
+	for (; Token < Lex->Tokens + Lex->TokenCount; ++Token)
+	{
+		State->Token = Token;
+		State->LineNum = Token->LineNum;
+		
+		if (Token->Type == CONFIGTOKEN_STRAYEND)
+		{ /*It's probably not good to have stray multi-line comment terminators around.*/
+			if (State->Materializing) continue; /*Already warned about this the first time through.*/
 			
-			CurObj->GroupID = (unsigned long)GroupStruct->gr_gid;
+			snprintf(ErrBuf, MAX_LINE_SIZE, CONFIGWARNTXT "Stray multi-line comment terminator on line %lu\n", State->LineNum);
+			SpitWarning(ErrBuf);
+			WriteLogLine(ErrBuf, true);
+			continue;
+		}
+		
+		/*The attribute name runs up to the first whitespace or '=', and must match exactly.*/
+		if (!(Attribute = ConfigAttr_Lookup(Lex->Buffer + Token->Name, Token->NameLength)))
+		{ /*No big deal.*/
+			if (State->Materializing) continue;
 			
-			if ((strlen(DelimCurr) + 1) >= MAX_LINE_SIZE)
-			{
-				ConfigProblem(CONFIG_ETRUNCATED, CurrentAttribute, DelimCurr, LineNum);
-			}
+			snprintf(ErrBuf, sizeof ErrBuf, CONFIGWARNTXT "Unidentified attribute in %s on line %lu.", ConfigFile, State->LineNum);
+			SpitWarning(ErrBuf);
+			WriteLogLine(ErrBuf, true);
 			continue;
 		}
-		else if (!strncmp(Worker, (CurrentAttribute = "ObjectStdout"), strlen("ObjectStdout")))
-		{
-			if (CurObj == NULL)
-			{
-				ConfigProblem(CONFIG_EBEFORE, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			if (!GetLineDelim(Worker, DelimCurr))
-			{
-				ConfigProblem(CONFIG_EMISSINGVAL, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			if (CurObj->ObjectStdout) free(CurObj->ObjectStdout);
+		
+		State->CurrentAttribute = Attribute->Name;
+		State->DelimCurr = Token->Value ? Lex->Buffer + Token->Value : NULL;
+		
+		if (State->Materializing)
+		{ /*The index pass already did everything else, and complained about anything wrong with it.*/
+			if (Attribute->Handler == ConfigAttr_ObjectID) break;
 			
-			if (!strcmp(DelimCurr, "LOG"))
-			{
-				const char *LogPath = LOGDIR LOGFILE_NAME;
-				CurObj->ObjectStdout = malloc(strlen(LogPath) + 1);
-
-				strncpy(CurObj->ObjectStdout, LOGDIR LOGFILE_NAME, strlen(LogPath) + 1);
-			}
-			else
-			{
-				CurObj->ObjectStdout = malloc(strlen(DelimCurr) + 1);
-				strncpy(CurObj->ObjectStdout, DelimCurr, strlen(DelimCurr) + 1);
-				
-				if ((strlen(DelimCurr) + 1) >= MAX_LINE_SIZE)
-				{
-					ConfigProblem(CONFIG_ETRUNCATED, CurrentAttribute, DelimCurr, LineNum);
-				}
-			}
+			if (!(Attribute->Flags & CONFIGATTR_OBJECT) || (Attribute->Flags & CONFIGATTR_INDEX)) continue;
+		}
+		
+		if ((Attribute->Flags & CONFIGATTR_OBJECT) && !State->CurObj)
+		{
+			ConfigProblem(CONFIG_EBEFORE, State->CurrentAttribute, NULL, State->LineNum);
 			continue;
 		}
-		else if (!strncmp(Worker, (CurrentAttribute = "ObjectStderr"), strlen("ObjectStderr")))
+		
+		if ((Attribute->Flags & CONFIGATTR_GLOBAL) && State->CurObj)
+		{ /*What the warning says. It'd get all weird if we allowed that.*/
+			ConfigProblem(CONFIG_EAFTER, State->CurrentAttribute, NULL, State->LineNum);
+			continue;
+		}
+		
+		if (State->Deferring && (Attribute->Flags & CONFIGATTR_OBJECT) && !(Attribute->Flags & CONFIGATTR_INDEX))
+		{ /*Config_ParseDeferred() gets this one.*/
+			continue;
+		}
+		
+		if ((Attribute->Flags & CONFIGATTR_VALUE) && !GetLineDelim(State))
 		{
-			if (CurObj == NULL)
-			{
-				ConfigProblem(CONFIG_EBEFORE, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			if (!GetLineDelim(Worker, DelimCurr))
-			{
-				ConfigProblem(CONFIG_EMISSINGVAL, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			if (CurObj->ObjectStderr) free(CurObj->ObjectStderr);
-			
-			if (!strcmp(DelimCurr, "LOG"))
-			{
-				const char *LogPath = LOGDIR LOGFILE_NAME;
-				CurObj->ObjectStderr = malloc(strlen(LogPath) + 1);
-
-				strncpy(CurObj->ObjectStderr, LOGDIR LOGFILE_NAME, strlen(LogPath) + 1);
-			}
-			else
-			{
-				CurObj->ObjectStderr = malloc(strlen(DelimCurr) + 1);
-				strncpy(CurObj->ObjectStderr, DelimCurr, strlen(DelimCurr) + 1);
-				
-				if ((strlen(DelimCurr) + 1) >= MAX_LINE_SIZE)
-				{
-					ConfigProblem(CONFIG_ETRUNCATED, CurrentAttribute, DelimCurr, LineNum);
-				}
-			}
+			ConfigProblem(CONFIG_EMISSINGVAL, State->CurrentAttribute, NULL, State->LineNum);
 			continue;
 		}
-		else if (!strncmp(Worker, (CurrentAttribute = "ObjectRunlevels"), strlen("ObjectRunlevels")))
-		{ /*Runlevel.*/
-			char *TWorker;
-			char TRL[MAX_DESCRIPT_SIZE], *TRL2;
-			
-			if (!CurObj)
-			{
-				ConfigProblem(CONFIG_EBEFORE, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			if (CurObj->ObjectRunlevels != NULL)
-			{ /*We cannot have multiple runlevel attributes because it messes up config file editing.*/
-				snprintf(ErrBuf, sizeof ErrBuf, CONFIGWARNTXT "Object %s has more than one ObjectRunlevels line.\n"
-						"This is not advised because the config file editing code is not smart enough\n"
-						"to handle multiple lines. You should put the additional runlevels on the same line.\n"
-						"Line %lu in %s",
-						CurObj->ObjectID, LineNum, ConfigFile);
-				SpitWarning(ErrBuf);
-				WriteLogLine(ErrBuf, true);
-			}
-			
-			if (!GetLineDelim(Worker, DelimCurr))
-			{
-				ConfigProblem(CONFIG_EMISSINGVAL, CurrentAttribute, NULL, LineNum);
-				continue;
-			}
-			
-			TWorker = DelimCurr;
+		
+		Attribute->Handler(State);
+		
+		if (State->RecordGlobals && (Attribute->Flags & CONFIGATTR_GLOBALSTATE))
+		{ /*Keep the line for the config cache, put back together from the name and value.*/
+			const unsigned long Length = Token->NameLength + (Token->Value ? strlen(Lex->Buffer + Token->Value) + 1 : 0);
+			char *NewGlobals = realloc(State->Globals, State->GlobalsLength + Length + 2);
 			
-			do
+			if (NewGlobals)
 			{
-				for (TRL2 = TRL; *TWorker != ' ' && *TWorker != '\t' && *TWorker != '\n' && *TWorker != '\0'; ++TWorker, ++TRL2)
+				memcpy(NewGlobals + State->GlobalsLength, Lex->Buffer + Token->Name, Token->NameLength);
+				
+				if (Token->Value)
 				{
-					*TRL2 = *TWorker;
+					NewGlobals[State->GlobalsLength + Token->NameLength] = ' ';
+					memcpy(NewGlobals + State->GlobalsLength + Token->NameLength + 1, Lex->Buffer + Token->Value, Length - Token->NameLength - 1);
 				}
-				*TRL2 = '\0';
 				
-				ObjRL_AddRunlevel(TRL, CurObj);
-				
-			} while ((TWorker = WhitespaceArg(TWorker)));
+				NewGlobals[State->GlobalsLength + Length] = '\n';
+				NewGlobals[State->GlobalsLength + Length + 1] = '\0';
+				State->Globals = NewGlobals;
+				State->GlobalsLength += Length + 1;
+			}
+		}
+	}
+}
+
+rStatus InitConfig(void)
+{
+	return LoadConfig(NULL);
+}
+
+rStatus CompileConfig(void)
+{ /*Parses epoch.conf the slow way, then saves the result as the binary cache InitConfig() looks for.*/
+	struct _ConfigImage Image;
+	rStatus RetVal;
+	
+	memset(&Image, 0, sizeof Image);
+	
+	if (!LoadConfig(&Image))
+	{
+		free((void*)Image.Globals);
+		return FAILURE;
+	}
+	
+	Image.Index = ObjectIndex;
+	Image.IndexSize = ObjectIndexSize;
+	Image.Plan[0] = PriorityPlan[0];
+	Image.Plan[1] = PriorityPlan[1];
+	
+	RetVal = ConfigCache_Write(&Image);
+	
+	free((void*)Image.Globals);
+	ShutdownConfig();
+	
+	return RetVal;
+}
+
+static rStatus LoadConfig(struct _ConfigImage *Compile)
+{ /*Set aside storage for the table. If Compile isn't NULL, we skip the cache and fill it in for CompileConfig().*/
+	FILE *Descriptor = NULL;
+	struct stat FileStat;
+	char *ConfigStream = NULL, *Worker = NULL, *Kept = NULL;
+	struct _ConfigLex Lex;
+	ObjTable *ObjWorker = NULL;
+	struct _ConfigState State;
+	struct _ConfigImage Image;
+	unsigned long SourceHash;
+	static Bool AttrTableBuilt = false;
+	Bool PrevLogInMemory = LogInMemory;
+	char ErrBuf[MAX_LINE_SIZE];
+	
+	memset(&State, 0, sizeof State);
+	State.TrueLogEnable = EnableLogging;
+	State.RecordGlobals = (Compile != NULL);
+	
+	EnableLogging = true; /*To temporarily turn on the logging system.*/
+	LogInMemory = true;
+	DuplicateObjectID = false;
+	
+	if (!AttrTableBuilt)
+	{
+		ConfigAttr_BuildTable();
+		AttrTableBuilt = true;
+	}
+	
+	/*Get the file size of the config file.*/
+	if (stat(ConfigFile, &FileStat) != 0)
+	{ /*Failure?*/
+		SpitError("Failed to obtain information about configuration file.\nDoes it exist?");
+		return FAILURE;
+	}
+	else
+	{ /*No? Use the file size to allocate space in memory, since a char is a byte big.
+	* If it's not a byte on your platform, your OS is not UNIX, and Epoch was not designed for you.*/
+		ConfigStream = malloc(FileStat.st_size + 1);
+	}
+
+	if (!(Descriptor = fopen(ConfigFile, "r"))) /*Open the configuration file.*/
+	{
+		snprintf(ErrBuf, sizeof ErrBuf, "Unable to open configuration file \"%s\"! Permissions?", ConfigFile);
+		SpitError(ErrBuf);
+		EmergencyShell();
+	}
+	
+	/*Read the file into memory. I don't really trust fread(), but oh well.
+	 * People will whine if I use a loop instead.*/
+	fread(ConfigStream, 1, FileStat.st_size, Descriptor);
+	fclose(Descriptor); /*Close the file.*/
+
+	ConfigStream[FileStat.st_size] = '\0'; /*Null terminate.*/
+	
+	SourceHash = HashBytes(ConfigStream, FileStat.st_size);
+	
+	if (Compile)
+	{
+		Compile->SourceHash = SourceHash;
+		Compile->SourceLength = FileStat.st_size;
+	}
+	else if (ConfigCache_Load(SourceHash, FileStat.st_size, &Image))
+	{ /*Somebody ran "epoch compileconfig" on this exact file, so we can skip all the work below.*/
+		ObjectCapacity = ObjectCount;
+		ObjectIndex = Image.Index;
+		ObjectIndexSize = Image.IndexSize;
+		PriorityPlan[0] = Image.Plan[0];
+		PriorityPlan[1] = Image.Plan[1];
+		ConfigImageBase = Image.Base;
+		ConfigImageSize = Image.Size;
+		
+		/*Global options aren't in the table, and some, like Hostname FILE, need doing again anyway.
+		 * ConfigLex() writes to its buffer and the cache is mapped read only, so copy them over the text we're done with.*/
+		if (Image.GlobalsLength <= (unsigned long)FileStat.st_size)
+		{
+			memcpy(ConfigStream, Image.Globals, Image.GlobalsLength);
+			ConfigStream[Image.GlobalsLength] = '\0';
 			
-			if ((strlen(DelimCurr) + 1) >= MAX_LINE_SIZE)
+			if (ConfigLex(ConfigStream, Image.GlobalsLength, &Lex, false))
 			{
-				ConfigProblem(CONFIG_ETRUNCATED, CurrentAttribute, DelimCurr, LineNum);
+				ParseConfigStream(&Lex, 0, &State);
+				ConfigLex_Release(&Lex);
 			}
-			
-			continue;
-
-		}
-		else
-		{ /*No big deal.*/
-			snprintf(ErrBuf, sizeof ErrBuf, CONFIGWARNTXT "Unidentified attribute in %s on line %lu.", ConfigFile, LineNum);
-			SpitWarning(ErrBuf);
-			WriteLogLine(ErrBuf, true);
-			continue;
 		}
-	} while (++LineNum, (Worker = NextLine(Worker)));
+		
+		Overlay_Load(); /*Enables and runlevels changed at runtime go on top.*/
+		
+		free(ConfigStream);
+		LogInMemory = PrevLogInMemory;
+		EnableLogging = State.TrueLogEnable;
+		
+		return SUCCESS;
+	}
+	
+	Worker = ConfigStream;
+	
+	/*Empty file?*/
+	if ((*Worker == '\n' && *(Worker + 1) == '\0') || *Worker == '\0')
+	{
+		SpitError("Seems that the configuration file is empty or corrupted.");
+		free(ConfigStream);
+		return FAILURE;
+	}
+	
+	/*ConfigLex() cuts the values out in place, so it gets a copy that lasts as long as the table does.
+	 * Objects only get indexed here, and ScanConfigIntegrity() parses the ones the boot runlevel needs.
+	 * The rest get parsed later out of the same tokens. The config cache wants everything, so it doesn't get this.*/
+	if ((Kept = ConfigArena_Alloc(FileStat.st_size + 1, 1)))
+	{
+		memcpy(Kept, ConfigStream, FileStat.st_size + 1);
+		State.Deferring = !Compile;
+	}
+	
+	if (!ConfigLex(Kept ? Kept : ConfigStream, FileStat.st_size, &ConfigTokens, false))
+	{
+		SpitError("LoadConfig(): Out of memory!");
+		ShutdownConfig();
+		free(ConfigStream);
+		return FAILURE;
+	}
+	
+	if (ConfigTokens.HighBit)
+	{ /*Check for a sign bit or >= 128.*/
+		SpitError("Non-ASCII characters detected in configuration file!\n"
+					"Epoch does not support Unicode or the like!");
+		EmergencyShell();
+	}
 	
-	for (ObjWorker = ObjectTable; ObjWorker->Next; ObjWorker = ObjWorker->Next)
+	ParseConfigStream(&ConfigTokens, 0, &State);
+	
+	for (ObjWorker = ObjectTable; ObjWorker < ObjectTable + ObjectCount; ++ObjWorker)
 	{
 		/*We don't need to specify a description, but if we neglect to, use the ObjectID.*/
 		if (ObjWorker->ObjectDescription == NULL)
@@ -1452,15 +1656,13 @@ rStatus InitConfig(void)
 	}
 	
 	/*This is harmless, but it's bad form and could indicate human error in writing the config file.*/
-	if (LongComment)
+	if (ConfigTokens.OpenComment)
 	{
 		snprintf(ErrBuf, sizeof ErrBuf, CONFIGWARNTXT "No comment terminator at end of configuration file.");
 		SpitWarning(ErrBuf);
 		WriteLogLine(ErrBuf, true);
 	}
 	
-	PriorityAlias_Shutdown(); /*We don't need to keep this in memory.*/
-	
 	switch (ScanConfigIntegrity())
 	{
 		case SUCCESS:
@@ -1483,6 +1685,7 @@ rStatus InitConfig(void)
 			
 			ShutdownConfig();
 			free(ConfigStream);
+			free(State.Globals);
 			
 			return FAILURE;
 		}
@@ -1492,308 +1695,132 @@ rStatus InitConfig(void)
 			WriteLogLine(WarnTxt, true);
 			SpitWarning(WarnTxt);
 			break;
-
-		}
-	}
-		
-	free(ConfigStream); /*Release ConfigStream, since we only use the object table now.*/
-	LogInMemory = PrevLogInMemory;
-	EnableLogging = TrueLogEnable;
-	
-	return SUCCESS;
-}
-
-static rStatus GetLineDelim(const char *InStream, char *OutStream)
-{
-	unsigned long cOffset, Inc = 0;
-
-	/*Jump to the first tab or space. If we get a newline or null, problem.*/
-	while (InStream[Inc] != '\t' && InStream[Inc] != ' ' && InStream[Inc] != '=' &&
-			InStream[Inc] != '\n' && InStream[Inc] != '\0') ++Inc;
-
-	/*Hit a null or newline before tab or space. ***BAD!!!*** */
-	if (InStream[Inc] == '\0' || InStream[Inc] == '\n')
-	{
-		char TmpBuf[1024];
-		char ObjectInQuestion[1024];
-		unsigned long IncT = 0;
-
-		for (; InStream[IncT] != '\0' && InStream[IncT] != '\n'; ++IncT)
-		{
-			ObjectInQuestion[IncT] = InStream[IncT];
-		}
-		ObjectInQuestion[IncT] = '\0';
-
-		snprintf(TmpBuf, 1024, "No parameter for attribute \"%s\" in %s.", ObjectInQuestion, ConfigFile);
-
-		SpitError(TmpBuf);
-
-		return FAILURE;
-	}
-	
-	if (InStream[Inc] == '=')
-	{ /*We give the choice of using whitespace or using an equals sign. It's only nice.*/
-		++Inc;
-	}
-	else
-	{
-		/*Continue until we are past all tabs and spaces.*/
-		while (InStream[Inc] == ' ' || InStream[Inc] == '\t') ++Inc;
-	}
-
-	cOffset = Inc; /*Store this offset.*/
-
-	/*Copy over the argument to the parameter. Quit whining about the loop copy.*/
-	for (Inc = 0; InStream[Inc + cOffset] != '\n' && InStream[Inc + cOffset] != '\0' && Inc < MAX_LINE_SIZE - 1; ++Inc)
-	{
-		OutStream[Inc] = InStream[Inc + cOffset];
-	}
-	OutStream[Inc] = '\0';
-	
-	for (--Inc; Inc + 1 > 0 && (OutStream[Inc] == ' ' || OutStream[Inc] == '\t'); --Inc)
-	{
-		OutStream[Inc] = '\0';
-	}
-
-	return SUCCESS;
-}
-
-rStatus EditConfigValue(const char *ObjectID, const char *Attribute, const char *Value)
-{ /*Looks up the attribute for the passed ID and replaces the value for that attribute.*/
-	char *MasterStream = NULL, *HalfTwo = NULL;
-	char *NewValue = NULL, *Worker = NULL, *Stopper = NULL, *LineArm = NULL;
-	char LineWorkerR[MAX_LINE_SIZE];
-	FILE *Descriptor = NULL;
-	char *WhiteSpace = NULL, *LineWorker = NULL;
-	struct stat FileStat;
-	unsigned long Inc = 0, Inc2 = 0, LineNum = 1;
-	unsigned long NumWhiteSpaces = 0;
-	Bool PresentHalfTwo = false;
-	
-	if (stat(ConfigFile, &FileStat) != 0)
-	{
-		SpitError("EditConfigValue(): Failed to stat config file. Does the file exist?");
-		return FAILURE;
-	}
-	
-	if ((Descriptor = fopen(ConfigFile, "r")) == NULL)
-	{
-		SpitError("EditConfigValue(): Failed to open config file. Are permissions correct?");
-		return FAILURE;
-	}
-	
-	MasterStream = malloc(FileStat.st_size + 1);
-	
-	/*Read in the file.*/
-	fread(MasterStream, 1, FileStat.st_size, Descriptor);
-	MasterStream[FileStat.st_size] = '\0';
-	
-	/*We don't need this anymore.*/
-	fclose(Descriptor);
-	
-	if (*MasterStream == '\0')
-	{
-		free(MasterStream);
-		return FAILURE;
-	}
-
-	/*Erase the newlines at the end of the file so we don't need to mess with them later.*/
-	for (; MasterStream[Inc2] != '\0'; ++Inc2);
-	
-	for (; MasterStream[Inc2] == '\n'; --Inc2)
-	{
-		MasterStream[Inc2] = '\0';
-	}
-	
-	/*Find the object ID of our object in config.*/
-	LineArm = MasterStream; do
-	{
-		for (Inc = 0; LineArm[Inc] != '\n' && LineArm[Inc] != '\0'; ++Inc)
-		{
-			LineWorkerR[Inc] = LineArm[Inc];
-		}
-		LineWorkerR[Inc] = '\0';
-		
-		/*Skip past any whitespace at the beginning of the line.*/
-		for (Inc2 = 0; LineWorkerR[Inc2] == ' ' || LineWorkerR[Inc2] == '\t'; ++Inc2);
-		
-		LineWorker = &LineWorkerR[Inc2];
-		
-		if (strncmp(LineWorker, "ObjectID", strlen("ObjectID")) != 0)
-		{ /*Not ObjectID?*/
-			continue;
-		}
-		
-		/*Assume we found an ObjectID beyond here.*/
-		
-		/*Get to the beginning of the whitespace. We use Inc2 as a marker for it's beginning*/
-		for (Inc2 = 0; LineWorker[Inc2] != ' ' && LineWorker[Inc2] != '\t' &&
-			LineWorker[Inc2] != '=' && LineWorker[Inc2] != '\0' && LineWorker[Inc2] != '\n'; ++Inc2);
-		
-		if (LineWorker[Inc2] == '=')
-		{ /* We allow both spaces and whitespace as the delimiter.*/
-			NumWhiteSpaces = 1;
-		}
-		else
-		{ /*Count the number of whitespaces.*/
-			for (NumWhiteSpaces = 0 ; LineWorker[NumWhiteSpaces + Inc2] == ' ' ||
-				LineWorker[NumWhiteSpaces + Inc2] == '\t'; ++NumWhiteSpaces);
-		}
-			
-		if (LineWorker[NumWhiteSpaces + Inc2] == '\0' ||
-			LineWorker[NumWhiteSpaces + Inc2] == '\n')
-		{ /*Malformed config lines cannot be edited.*/
-			free(MasterStream);
-			return FAILURE;
-		}
-		
-		if (strcmp(&LineWorker[NumWhiteSpaces + Inc2], ObjectID) != 0)
-		{ /*Not the ObjectID we were looking for?*/
-			continue;
-		}
-		
-		/*We found it! Save the pointer.*/
-		Worker = LineArm + Inc2 + NumWhiteSpaces + strlen(ObjectID);
-	} while (++LineNum, (LineArm = NextLine(LineArm)));
-	
-	if (Worker == NULL)
-	{ /*If we didn't find it.*/
-		free(MasterStream);
-		return FAILURE;
+
+		}
 	}
 	
-	/*Do not accidentally jump to a different object's attribute of the same name.*/
-	if ((Stopper = strstr(Worker, "ObjectID")) != NULL)
+	/*Objects we haven't parsed yet might still want these.*/
+	if (!DeferredCount)
 	{
-		*Stopper = '\0';
-	}
-	
-	if (!(Worker = strstr(Worker, Attribute)) || (Worker > &LineArm[0] && *(Worker - 1) == '#'))
-	{ /*Doesn't exist for that object? We also ignore comments.*/
-		free(MasterStream);
-		return FAILURE;
+		PriorityAlias_Shutdown();
+		ConfigLex_Release(&ConfigTokens);
 	}
-	
-	if (Stopper) *Stopper = 'O'; /*set back, use capital O.*/
-	
-	/*Null-terminate half one.*/
-	*Worker++ = '\0';
-	
-	/*Jump to the whitespace.*/
-	for (Inc = 0; Worker[Inc] != ' ' && Worker[Inc] != '\t' &&
-		Worker[Inc] != '=' && Worker[Inc] != '\n' && Worker[Inc] != '\0'; ++Inc);
 		
-	if (Worker[Inc] == '\n' || Worker[Inc] == '\0')
-	{ /*Malformed line. Can't edit it.*/
-		free(MasterStream);
+	if (!PriorityPlan_Build())
+	{
+		SpitError("LoadConfig(): Out of memory!");
+		ShutdownConfig();
+		free(ConfigStream);
+		free(State.Globals);
+		
 		return FAILURE;
 	}
 	
-	if (Worker[Inc] == '=')
+	if (Compile)
 	{
-		NumWhiteSpaces = 1;
-		Worker += Inc;
+		Compile->Globals = State.Globals ? State.Globals : calloc(1, 1);
+		Compile->GlobalsLength = State.GlobalsLength;
 	}
 	else
-	{ /*Count the whitespace.*/
-		for (NumWhiteSpaces = 0, Worker += Inc; Worker[NumWhiteSpaces] == ' ' ||
-			Worker[NumWhiteSpaces] == '\t'; ++NumWhiteSpaces);
+	{ /*The cache gets what's in epoch.conf, so this only goes on when we're actually using the table.*/
+		Overlay_Load();
 	}
 	
-	WhiteSpace = malloc(NumWhiteSpaces + 1);
+	free(ConfigStream); /*Release ConfigStream, since we only use the object table now.*/
+	LogInMemory = PrevLogInMemory;
+	EnableLogging = State.TrueLogEnable;
+	
+	return SUCCESS;
+}
+
+static rStatus GetLineDelim(struct _ConfigState *State)
+{ /*Points DelimCurr at the current line's value. ConfigLex() already found it and NUL terminated it.*/
+	char TmpBuf[1024];
 	
-	/*Save the whitespace while incrementing Worker to the value of this line at the same time.*/
-	for (Inc2 = 0; *Worker == '=' || *Worker == ' ' || *Worker == '\t'; ++Inc2, ++Worker)
+	if (State->Token->Value)
 	{
-		WhiteSpace[Inc2] = *Worker;
+		State->DelimCurr = State->Lex->Buffer + State->Token->Value;
+		return SUCCESS;
 	}
-	WhiteSpace[Inc2] = '\0';
-	
-	/*Jump past the newline on the end of this line.*/
-	for (; *Worker != '\n' && *Worker != '\0'; ++Worker);
 	
-	if (*Worker != '\0')
-	{ /*There is more beyond this line.*/
-		PresentHalfTwo = true;
-		HalfTwo = malloc(strlen(Worker) + 1);
-		
-		strncpy(HalfTwo, Worker, strlen(Worker) + 1); /*Plus one to copy the null terminator.*/
-		
-	}
+	/*Hit a null or newline before tab or space. ***BAD!!!*** */
+	snprintf(TmpBuf, sizeof TmpBuf, "No parameter for attribute \"%.*s\" in %s.",
+			(int)(State->Token->NameLength < 512 ? State->Token->NameLength : 512), State->Lex->Buffer + State->Token->Name, ConfigFile);
 	
-	/*Set up the new value.*/
-	NewValue = malloc(strlen(Attribute) + NumWhiteSpaces + strlen(Value) + 1);
-	snprintf(NewValue, (strlen(Attribute) + NumWhiteSpaces + strlen(Value) + 1),
-			"%s%s%s", Attribute, WhiteSpace, Value);
+	SpitError(TmpBuf);
 	
-	/*Wwe copied the whitespace back into the new value, so release it's memory now.*/
-	free(WhiteSpace);
+	return FAILURE;
+}
+
+static Bool ObjIndex_Grow(void)
+{ /*Doubles the hash index and puts everything back in it.*/
+	unsigned long NewSize = ObjectIndexSize ? ObjectIndexSize * 2 : 64, *NewIndex = NULL, Inc = 0, Slot;
 	
-	/*Reallocate MasterStream to accomodate the new data.*/
-	MasterStream = realloc(MasterStream, strlen(MasterStream) + strlen(NewValue) +
-							(PresentHalfTwo ? strlen(HalfTwo) : 0) + 1);
-							
-	/*Copy in the new string.*/
-	snprintf( (MasterStream + strlen(MasterStream)), (strlen(MasterStream) +
-				strlen(NewValue) +(PresentHalfTwo ? strlen(HalfTwo) : 0) + 1),
-				"%s%s", NewValue, (PresentHalfTwo ? HalfTwo : ""));
-				
-	/*Release the other variables now that we don't need them.*/
-	free(NewValue);
-	free(HalfTwo);
+	if (!(NewIndex = calloc(NewSize, sizeof(long)))) return false;
 	
-	/*Write the configuration back to disk.*/
-	Descriptor = fopen(ConfigFile, "w");
-	fwrite(MasterStream, 1, strlen(MasterStream), Descriptor);
-	fclose(Descriptor);
+	for (; Inc < ObjectCount; ++Inc)
+	{
+		Slot = HashBytes(ObjectTable[Inc].ObjectID, strlen(ObjectTable[Inc].ObjectID)) & (NewSize - 1);
+		
+		while (NewIndex[Slot]) Slot = (Slot + 1) & (NewSize - 1);
+		
+		NewIndex[Slot] = Inc + 1;
+	}
 	
-	/*Release MasterStream.*/
-	free(MasterStream);
+	free(ObjectIndex);
+	ObjectIndex = NewIndex;
+	ObjectIndexSize = NewSize;
 	
-	return SUCCESS;
+	return true;
 }
 
-/*Adds an object to the table and, if the first run, sets up the table.*/
+/*Adds an object to the table and, if the first run, sets up the table.
+ * This can move the table, so don't hang onto pointers into it across calls.*/
 static ObjTable *AddObjectToTable(const char *ObjectID)
 {
-	ObjTable *Worker = ObjectTable, *Next, *Prev;
+	ObjTable *Worker = NULL;
+	unsigned long Slot;
+	Bool Duplicate = false;
 	
-	/*See, we actually allocate two cells initially. The base and it's node.
-	 * We always keep a free one open. This is just more convenient.*/
-	if (ObjectTable == NULL)
-	{
-		ObjectTable = malloc(sizeof(ObjTable));
-		ObjectTable->Prev = NULL;
-		ObjectTable->Next = NULL;
-
-		Worker = ObjectTable;
+	if (ObjIndex_Find(ObjectID))
+	{ /*It still gets a slot so its attributes have somewhere to go, but ScanConfigIntegrity() fails the config.*/
+		char TmpBuf[MAX_LINE_SIZE];
+		
+		snprintf(TmpBuf, sizeof TmpBuf, "Two objects in configuration with ObjectID \"%s\".", ObjectID);
+		SpitError(TmpBuf);
+		DuplicateObjectID = Duplicate = true;
 	}
 	
-	for (; Worker->Next; Worker = Worker->Next)
+	if (ObjectCount == ObjectCapacity)
 	{
-		if (!strcmp(ObjectID, Worker->ObjectID))
-		{ /*Do not allow duplicate entries.*/
-			return Worker;
+		unsigned long NewCapacity = ObjectCapacity ? ObjectCapacity * 2 : 32;
+		
+		if (!(Worker = realloc(ObjectTable, sizeof(ObjTable) * NewCapacity)))
+		{
+			SpitError("AddObjectToTable(): Out of memory!");
+			return NULL;
 		}
+		
+		ObjectTable = Worker;
+		ObjectCapacity = NewCapacity;
 	}
-
-	Worker->Next = malloc(sizeof(ObjTable));
-	Worker->Next->Next = NULL;
-	Worker->Next->Prev = Worker;
-
-	/*These are the only two variables inside that we need to save before we wipe.*/
-	Next = Worker->Next;
-	Prev = Worker->Prev;
 	
-	memset(Worker, 0, sizeof(ObjTable)); /*Set everything that is going to be zero to zero.*/
+	if ((ObjectCount + 1) * 2 > ObjectIndexSize && !ObjIndex_Grow())
+	{
+		SpitError("AddObjectToTable(): Out of memory!");
+		return NULL;
+	}
 	
-	Worker->Next = Next;
-	Worker->Prev = Prev;
+	Worker = ObjectTable + ObjectCount;
+	memset(Worker, 0, sizeof(ObjTable)); /*Set everything that is going to be zero to zero.*/
 	
 	/*This is the first thing that must ever be initialized, because it's how we tell objects apart.*/
-	/*This and all things like it are dynamically allocated to provide aggressive memory savings.*/
-	Worker->ObjectID = malloc(strlen(ObjectID) + 1);
-	strncpy(Worker->ObjectID, ObjectID, strlen(ObjectID) + 1);
+	/*This and all things like it come from ConfigArena, and are shared with any other string that's the same.*/
+	if (!(Worker->ObjectID = ConfigArena_String(ObjectID)))
+	{
+		SpitError("AddObjectToTable(): Out of memory!");
+		return NULL;
+	}
 	
 	/*Initialize these to their default values. Used to test integrity before execution begins.*/
 	Worker->TermSignal = SIGTERM; /*This can be changed via config.*/
@@ -1802,18 +1829,151 @@ static ObjTable *AddObjectToTable(const char *ObjectID)
 						Bool is just signed char.*/
 	Worker->Opts.StopTimeout = 10; /*Ten seconds by default.*/
 	
+	if (!Duplicate)
+	{
+		for (Slot = HashBytes(ObjectID, strlen(ObjectID)) & (ObjectIndexSize - 1); ObjectIndex[Slot];
+			Slot = (Slot + 1) & (ObjectIndexSize - 1));
+		
+		ObjectIndex[Slot] = ObjectCount + 1;
+	}
+	
+	++ObjectCount;
+	
 	return Worker;
 }
 
+static rStatus ScanObjectIntegrity(ObjTable *Worker)
+{ /*The checks that need the whole object. Objects InitConfig() put off get these when they're parsed.*/
+#define IntegrityWarn(msg) WriteLogLine(msg, true), SpitWarning(msg)
+	char TmpBuf[1024];
+	rStatus RetState = SUCCESS;
+	
+	if (Worker->ObjectStartCommand == NULL && Worker->ObjectStopCommand == NULL && Worker->Opts.StopMode == STOP_COMMAND)
+	{
+		snprintf(TmpBuf, 1024, "Object %s has neither ObjectStopCommand nor ObjectStartCommand attributes.", Worker->ObjectID);
+		SpitError(TmpBuf);
+		RetState = FAILURE;
+	}
+	
+	if (!Worker->Opts.HaltCmdOnly && Worker->ObjectStartCommand == NULL)
+	{
+		snprintf(TmpBuf, 1024, "Object %s has no attribute ObjectStartCommand\nand is not set to HALTONLY.\n"
+				"Disabling.", Worker->ObjectID);
+		IntegrityWarn(TmpBuf);
+		Worker->Opts.Exec = false; /*Just in case.*/
+		Worker->Opts.PivotRoot = false;
+		Worker->Enabled = false;
+		Worker->Started = false;
+		RetState = WARNING;
+	}
+	
+	if (Worker->Opts.HasPIDFile && Worker->Opts.StopMode == STOP_PID)
+	{
+		snprintf(TmpBuf, 1024, "Object \"%s\" is set to stop via tracked PID,\n"
+				"but a PID file has been specified! Switching to STOP_PIDFILE from STOP_PID.", Worker->ObjectID);
+		IntegrityWarn(TmpBuf);
+		Worker->Opts.StopMode = STOP_PIDFILE;
+		RetState = WARNING;
+	}
+	
+	if (Worker->Opts.PivotRoot && Worker->Opts.Exec)
+	{ /*What?*/
+		snprintf(TmpBuf, 1024, "Object \"%s\" has both EXEC and PIVOT options set!\n"
+				"This makes no sense. Disabling the object.", Worker->ObjectID);
+		IntegrityWarn(TmpBuf);
+		Worker->Enabled = false;
+		RetState = WARNING;
+	}
+
+	if (!Worker->Opts.HasPIDFile && Worker->Opts.StopMode == STOP_PIDFILE)
+	{
+		snprintf(TmpBuf, 1024, "Object \"%s\" is set to stop via PID File,\n"
+				"but no PID File attribute specified! Switching to STOP_PID.", Worker->ObjectID);
+		IntegrityWarn(TmpBuf);
+		Worker->Opts.StopMode = STOP_PID;
+		RetState = WARNING;
+	}
+	
+	if (Worker->Opts.StopMode != STOP_COMMAND && Worker->Opts.HaltCmdOnly)
+	{ /*We put this here instead of InitConfig() because we can't really do anything but disable.*/
+		snprintf(TmpBuf, 1024, "Object \"%s\" has HALTONLY set,\n"
+				"but stop method is not a command!\nDisabling.", Worker->ObjectID);
+		IntegrityWarn(TmpBuf);
+		Worker->Enabled = false;
+		Worker->Started = false;
+		Worker->Opts.StopMode = STOP_NONE;
+		RetState = WARNING;
+	}
+	
+	if (Worker->Opts.PivotRoot && Worker->Opts.HaltCmdOnly)
+	{
+		snprintf(TmpBuf, 1024, "Object \"%s\" has the PIVOT option set,\n"
+				"but has HALTONLY set as well. Disabling object.", Worker->ObjectID);
+		IntegrityWarn(TmpBuf);
+		Worker->Enabled = false;
+		Worker->Started = false;
+		Worker->Opts.PivotRoot = false;
+		RetState = WARNING;
+	}
+	
+	if (Worker->Opts.Exec && Worker->Opts.HaltCmdOnly)
+	{
+		snprintf(TmpBuf, 1024, "Object \"%s\" has the EXEC option set,\n"
+				"but has HALTONLY set as well. Disabling object.", Worker->ObjectID);
+		IntegrityWarn(TmpBuf);
+		Worker->Opts.Exec = false;
+		Worker->Enabled = false;
+		Worker->Started = false;
+		RetState = WARNING;
+	}
+	
+	if (Worker->Opts.NoStopWait && Worker->Opts.StopTimeout != 10)
+	{ /*Why are you setting a stop timeout and then turning off the thing that uses your new value?*/
+		snprintf(TmpBuf, 1024, "Object \"%s\" has both NOSTOPWAIT and STOPTIMEOUT options set.\n"
+				"This doesn't seem very useful.", Worker->ObjectID);
+		IntegrityWarn(TmpBuf);
+		RetState = WARNING;
+	}
+		
+	
+	if (Worker->Opts.PivotRoot && Worker->Opts.StopMode != STOP_NONE)
+	{
+		snprintf(TmpBuf, 1024, "Object \"%s\" has the PIVOT option set,\n"
+				"but ObjectStopCommand is not NONE. Setting to NONE.", Worker->ObjectID);
+		IntegrityWarn(TmpBuf);
+		
+		Worker->Opts.StopMode = STOP_NONE;
+		Worker->ObjectStopPriority = 0;
+		
+		Worker->ObjectStopCommand = NULL;
+		
+		RetState = WARNING;
+	}
+	
+	if (Worker->Opts.PivotRoot && Worker->Opts.HasPIDFile)
+	{
+		snprintf(TmpBuf, 1024, "Object \"%s\" has the PIVOT option set,\n"
+				"but a PID file has been specified. Unsetting PID file attribute.", Worker->ObjectID);
+		IntegrityWarn(TmpBuf);
+		
+		Worker->Opts.HasPIDFile = false;
+		
+		Worker->ObjectPIDFile = NULL;
+		
+		RetState = WARNING;
+	}
+	
+	return RetState;
+}
+
 static rStatus ScanConfigIntegrity(void)
 { /*Here we check common mistakes and problems.*/
-#define IntegrityWarn(msg) WriteLogLine(msg, true), SpitWarning(msg)
-	ObjTable *Worker = ObjectTable, *TOffender;
+	ObjTable *Worker = ObjectTable;
 	char TmpBuf[1024];
 	rStatus RetState = SUCCESS;
 	static Bool WasRunBefore = false;
 	
-	if (ObjectTable == NULL)
+	if (ObjectCount == 0)
 	{ /*This can happen if configuration is filled with trash and nothing valid.*/
 		SpitError("No objects found in configuration or invalid configuration.");
 		return FAILURE;
@@ -1878,55 +2038,24 @@ static rStatus ScanConfigIntegrity(void)
 			
 	}
 	
-	for (; Worker->Next != NULL; Worker = Worker->Next)
-	{		
-		if (Worker->ObjectStartCommand == NULL && Worker->ObjectStopCommand == NULL && Worker->Opts.StopMode == STOP_COMMAND)
-		{
-			snprintf(TmpBuf, 1024, "Object %s has neither ObjectStopCommand nor ObjectStartCommand attributes.", Worker->ObjectID);
-			SpitError(TmpBuf);
-			RetState = FAILURE;
-		}
-		
-		if (!Worker->Opts.HaltCmdOnly && Worker->ObjectStartCommand == NULL)
-		{
-			snprintf(TmpBuf, 1024, "Object %s has no attribute ObjectStartCommand\nand is not set to HALTONLY.\n"
-					"Disabling.", Worker->ObjectID);
-			IntegrityWarn(TmpBuf);
-			Worker->Opts.Exec = false; /*Just in case.*/
-			Worker->Opts.PivotRoot = false;
-			Worker->Enabled = false;
-			Worker->Started = false;
-			RetState = WARNING;
-		}
-		
-		if (Worker->Opts.HasPIDFile && Worker->Opts.StopMode == STOP_PID)
-		{
-			snprintf(TmpBuf, 1024, "Object \"%s\" is set to stop via tracked PID,\n"
-					"but a PID file has been specified! Switching to STOP_PIDFILE from STOP_PID.", Worker->ObjectID);
-			IntegrityWarn(TmpBuf);
-			Worker->Opts.StopMode = STOP_PIDFILE;
-			RetState = WARNING;
-		}
-		
-		if (Worker->Opts.PivotRoot && Worker->Opts.Exec)
-		{ /*What?*/
-			snprintf(TmpBuf, 1024, "Object \"%s\" has both EXEC and PIVOT options set!\n"
-					"This makes no sense. Disabling the object.", Worker->ObjectID);
-			IntegrityWarn(TmpBuf);
-			Worker->Enabled = false;
-			RetState = WARNING;
-		}
-
-		if (!Worker->Opts.HasPIDFile && Worker->Opts.StopMode == STOP_PIDFILE)
+	if (DuplicateObjectID)
+	{ /*Already reported, as AddObjectToTable() found them.*/
+		RetState = FAILURE;
+	}
+	
+	/*Now that we know which runlevel we're going to, parse the objects it needs, and the ones a shutdown needs.
+	 * Everything else waits for Config_Materialize().*/
+	for (; Worker < ObjectTable + ObjectCount; ++Worker)
+	{
+		if (Worker->ConfigDeferred && (Worker->Opts.HaltCmdOnly || ObjRL_CheckRunlevel(CurRunlevel, Worker, true)))
 		{
-			snprintf(TmpBuf, 1024, "Object \"%s\" is set to stop via PID File,\n"
-					"but no PID File attribute specified! Switching to STOP_PID.", Worker->ObjectID);
-			IntegrityWarn(TmpBuf);
-			Worker->Opts.StopMode = STOP_PID;
-			RetState = WARNING;
+			Config_ParseDeferred(Worker);
 		}
-		
-		if (Worker->ObjectRunlevels == NULL && !Worker->Opts.HaltCmdOnly)
+	}
+	
+	for (Worker = ObjectTable; Worker < ObjectTable + ObjectCount; ++Worker)
+	{
+		if (ObjRL_CountRunlevels(Worker) == 0 && !Worker->Opts.HaltCmdOnly)
 		{
 			snprintf(TmpBuf, 1024, "Object \"%s\" has no attribute ObjectRunlevels.", Worker->ObjectID);
 			SpitError(TmpBuf);
@@ -1940,96 +2069,21 @@ static rStatus ScanConfigIntegrity(void)
 			RetState = FAILURE;
 		}
 		
-		if (Worker->Opts.StopMode != STOP_COMMAND && Worker->Opts.HaltCmdOnly)
-		{ /*We put this here instead of InitConfig() because we can't really do anything but disable.*/
-			snprintf(TmpBuf, 1024, "Object \"%s\" has HALTONLY set,\n"
-					"but stop method is not a command!\nDisabling.", Worker->ObjectID);
-			IntegrityWarn(TmpBuf);
-			Worker->Enabled = false;
-			Worker->Started = false;
-			Worker->Opts.StopMode = STOP_NONE;
-			RetState = WARNING;
-		}
-		
-		if (Worker->Opts.PivotRoot && Worker->Opts.HaltCmdOnly)
-		{
-			snprintf(TmpBuf, 1024, "Object \"%s\" has the PIVOT option set,\n"
-					"but has HALTONLY set as well. Disabling object.", Worker->ObjectID);
-			IntegrityWarn(TmpBuf);
-			Worker->Enabled = false;
-			Worker->Started = false;
-			Worker->Opts.PivotRoot = false;
-			RetState = WARNING;
-		}
-		
-		if (Worker->Opts.Exec && Worker->Opts.HaltCmdOnly)
-		{
-			snprintf(TmpBuf, 1024, "Object \"%s\" has the EXEC option set,\n"
-					"but has HALTONLY set as well. Disabling object.", Worker->ObjectID);
-			IntegrityWarn(TmpBuf);
-			Worker->Opts.Exec = false;
-			Worker->Enabled = false;
-			Worker->Started = false;
-			RetState = WARNING;
-		}
-		
-		if (Worker->Opts.NoStopWait && Worker->Opts.StopTimeout != 10)
-		{ /*Why are you setting a stop timeout and then turning off the thing that uses your new value?*/
-			snprintf(TmpBuf, 1024, "Object \"%s\" has both NOSTOPWAIT and STOPTIMEOUT options set.\n"
-					"This doesn't seem very useful.", Worker->ObjectID);
-			IntegrityWarn(TmpBuf);
-			RetState = WARNING;
-		}
-			
-		
-		if (Worker->Opts.PivotRoot && Worker->Opts.StopMode != STOP_NONE)
-		{
-			snprintf(TmpBuf, 1024, "Object \"%s\" has the PIVOT option set,\n"
-					"but ObjectStopCommand is not NONE. Setting to NONE.", Worker->ObjectID);
-			IntegrityWarn(TmpBuf);
-			
-			Worker->Opts.StopMode = STOP_NONE;
-			Worker->ObjectStopPriority = 0;
-			
-			if (Worker->ObjectStopCommand)
-			{
-				free(Worker->ObjectStopCommand);
-				Worker->ObjectStopCommand = NULL;
-			}
-			
-			RetState = WARNING;
-		}
-		
-		if (Worker->Opts.PivotRoot && Worker->Opts.HasPIDFile)
-		{
-			snprintf(TmpBuf, 1024, "Object \"%s\" has the PIVOT option set,\n"
-					"but a PID file has been specified. Unsetting PID file attribute.", Worker->ObjectID);
-			IntegrityWarn(TmpBuf);
-			
-			Worker->Opts.HasPIDFile = false;
-			
-			if (Worker->ObjectPIDFile)
-			{
-				free(Worker->ObjectPIDFile);
-				Worker->ObjectPIDFile = NULL;
-			}
-			
-			RetState = WARNING;
-		}
+		if (Worker->ConfigDeferred) continue;
 		
-		/*Check for duplicate ObjectIDs.*/
-		for (TOffender = ObjectTable; TOffender->Next != NULL; TOffender = TOffender->Next)
+		switch (ScanObjectIntegrity(Worker))
 		{
-			if (!strcmp(Worker->ObjectID, TOffender->ObjectID) && Worker != TOffender)
-			{
-				snprintf(TmpBuf, 1024, "Two objects in configuration with ObjectID \"%s\".", Worker->ObjectID);
-				SpitError(TmpBuf);
+			case FAILURE:
 				RetState = FAILURE;
-			}			
+				break;
+			case WARNING:
+				if (RetState == SUCCESS) RetState = WARNING;
+				break;
+			default:
+				break;
 		}
 	}
-			
-			
+	
 	WasRunBefore = true;
 	
 	return RetState;
@@ -2039,16 +2093,28 @@ static rStatus ScanConfigIntegrity(void)
  * because while we don't want other places adding to the table, we do want read
  * access to the table.*/
 ObjTable *LookupObjectInTable(const char *ObjectID)
-{
-	ObjTable *Worker = ObjectTable;
+{ /*Anything we hand out is parsed all the way.*/
+	ObjTable *const Worker = ObjIndex_Find(ObjectID);
+	
+	if (Worker && Worker->ConfigDeferred) Config_Materialize(Worker);
+	
+	return Worker;
+}
 
-	if (!ObjectTable)
+static ObjTable *ObjIndex_Find(const char *ObjectID)
+{
+	unsigned long Slot;
+	
+	if (!ObjectIndexSize)
 	{
 		return NULL;
 	}
 	
-	for (; Worker->Next; Worker = Worker->Next)
+	for (Slot = HashBytes(ObjectID, strlen(ObjectID)) & (ObjectIndexSize - 1); ObjectIndex[Slot];
+		Slot = (Slot + 1) & (ObjectIndexSize - 1))
 	{
+		ObjTable *const Worker = ObjectTable + ObjectIndex[Slot] - 1;
+		
 		if (!strcmp(Worker->ObjectID, ObjectID))
 		{
 			return Worker;
@@ -2058,208 +2124,340 @@ ObjTable *LookupObjectInTable(const char *ObjectID)
 	return NULL;
 }
 
+static void Config_ParseDeferred(ObjTable *CurObj)
+{ /*Runs the attributes the index pass left, from the line after the ObjectID up to the next one.*/
+	struct _ConfigState State;
+	const unsigned long First = CurObj->ConfigDeferred;
+	
+	if (!First) return;
+	
+	memset(&State, 0, sizeof State);
+	State.Materializing = true;
+	State.CurObj = CurObj;
+	State.TrueLogEnable = EnableLogging;
+	
+	CurObj->ConfigDeferred = 0;
+	
+	ParseConfigStream(&ConfigTokens, First, &State);
+	
+	if (--DeferredCount == 0)
+	{ /*That was the last one.*/
+		PriorityAlias_Shutdown();
+		ConfigLex_Release(&ConfigTokens);
+	}
+}
+
+static void Config_CheckDeferred(ObjTable *CurObj)
+{ /*Parse it, then check it over the way ScanConfigIntegrity() would have at boot.*/
+	char ErrBuf[MAX_LINE_SIZE];
+	
+	Config_ParseDeferred(CurObj);
+	
+	if (ScanObjectIntegrity(CurObj) == FAILURE)
+	{ /*Too late to fail the whole config over it.*/
+		snprintf(ErrBuf, sizeof ErrBuf, "Object \"%s\" has configuration errors. Disabling it.", CurObj->ObjectID);
+		SpitError(ErrBuf);
+		WriteLogLine(ErrBuf, true);
+		CurObj->Enabled = false;
+	}
+}
+
+rStatus Config_Materialize(ObjTable *CurObj)
+{ /*Only does anything for objects InitConfig() put off.*/
+	if (!CurObj->ConfigDeferred) return SUCCESS;
+	
+	Config_CheckDeferred(CurObj);
+	
+	/*Its priorities weren't known before. Callers that go one object at a time would sort the table for every one.*/
+	PriorityPlanDirty = true;
+	
+	return SUCCESS;
+}
+
+rStatus Config_MaterializeRunlevel(const char *InRL)
+{ /*Everything InRL needs, so it can be switched to. NULL for everything there is.*/
+	ObjTable *Worker = ObjectTable;
+	Bool Changed = false;
+	
+	for (; DeferredCount && Worker < ObjectTable + ObjectCount; ++Worker)
+	{
+		if (Worker->ConfigDeferred && (!InRL || ObjRL_CheckRunlevel(InRL, Worker, true)))
+		{
+			Config_CheckDeferred(Worker);
+			Changed = true;
+		}
+	}
+	
+	if (Changed) PriorityPlanDirty = true;
+	
+	return SUCCESS;
+}
+
+Bool Config_MaterializeIdle(void)
+{ /*Called by the primary loop when nothing else is going on. A few objects at a time, so we stay responsive.
+	* Returns true while there's still some left.*/
+	ObjTable *Worker = ObjectTable;
+	unsigned long Done = 0;
+	
+	for (; Done < CONFIG_IDLE_BATCH && DeferredCount && Worker < ObjectTable + ObjectCount; ++Worker)
+	{
+		if (!Worker->ConfigDeferred) continue;
+		
+		Config_CheckDeferred(Worker);
+		++Done;
+	}
+	
+	if (Done) PriorityPlanDirty = true;
+	
+	return DeferredCount != 0;
+}
+
 /*Get the max priority number we need to scan.*/
 unsigned long GetHighestPriority(Bool WantStartPriority)
 {
-	ObjTable *Worker = ObjectTable;
+	ObjTable *Worker = NULL;
 	unsigned long CurHighest = 0;
-	unsigned long TempNum;
 	
-	if (!ObjectTable)
+	if (!ObjectCount || !PriorityPlan_Current())
 	{
 		return 0;
 	}
 	
-	for (; Worker->Next; Worker = Worker->Next)
+	/*The plan is sorted, so the highest is at the end.*/
+	Worker = ObjectTable + PriorityPlan[WantStartPriority != 0][ObjectCount - 1];
+	CurHighest = (WantStartPriority ? Worker->ObjectStartPriority : Worker->ObjectStopPriority);
+	
+	return CurHighest;
+}
+
+/*Functions for runlevel management.*/
+static unsigned long ObjRL_GetID(const char *InRL, Bool Create)
+{ /*Returns MAX_RUNLEVELS if we don't know InRL and weren't asked to add it, or if there's no room left.*/
+	const unsigned long Length = strlen(InRL);
+	unsigned long Slot = HashBytes(InRL, Length) % sizeof RunlevelIndex;
+	char ErrBuf[MAX_LINE_SIZE];
+	
+	for (; RunlevelIndex[Slot] != 0; Slot = (Slot + 1) % sizeof RunlevelIndex)
 	{
-		TempNum = (WantStartPriority ? Worker->ObjectStartPriority : Worker->ObjectStopPriority);
-		
-		if (TempNum > CurHighest)
+		if (!strcmp(RunlevelNames[RunlevelIndex[Slot] - 1], InRL))
 		{
-			CurHighest = TempNum;
-		}
-		else if (TempNum == 0)
-		{ /*We always skip anything with a priority of zero. That's like saying "DISABLED".*/
-			continue;
+			return RunlevelIndex[Slot] - 1;
 		}
 	}
 	
-	return CurHighest;
+	if (!Create) return MAX_RUNLEVELS;
+	
+	if (RunlevelCount == MAX_RUNLEVELS)
+	{
+		snprintf(ErrBuf, sizeof ErrBuf, "Cannot add runlevel \"%s\", there are already %d different runlevels.",
+				InRL, MAX_RUNLEVELS);
+		SpitWarning(ErrBuf);
+		WriteLogLine(ErrBuf, true);
+		return MAX_RUNLEVELS;
+	}
+	
+	if (!(RunlevelNames[RunlevelCount] = malloc(Length + 1))) return MAX_RUNLEVELS;
+	
+	memcpy(RunlevelNames[RunlevelCount], InRL, Length + 1);
+	RLSET_ADD(RunlevelClosure[RunlevelCount], RunlevelCount); /*Every runlevel includes itself.*/
+	RunlevelIndex[Slot] = (unsigned char)(RunlevelCount + 1);
+	
+	return RunlevelCount++;
 }
 
-/*Functions for runlevel management.*/
-Bool ObjRL_CheckRunlevel(const char *InRL, const ObjTable *InObj, Bool CountInherited)
-{
-	struct _RLTree *Worker = InObj->ObjectRunlevels;
-	Bool RetVal = false;
+const char *ObjRL_GetName(unsigned long ID)
+{ /*NULL past the last one, so callers can just loop until then.*/
+	return ID < RunlevelCount ? RunlevelNames[ID] : NULL;
+}
+
+static Bool ObjRL_CheckID(unsigned long ID, const ObjTable *InObj, Bool CountInherited)
+{ /*Returns 2 when it's only in there by inheritance.*/
+	unsigned long Inc = 0;
+	
+	if (ID >= RunlevelCount) return false;
 	
-	if (Worker == NULL)
+	if (RLSET_HAS(InObj->ObjectRunlevels, ID)) return true;
+	
+	if (!CountInherited) return false;
+	
+	for (; Inc < RLSET_WORDS; ++Inc)
 	{
-		return false;
+		if (InObj->ObjectRunlevels.Bits[Inc] & RunlevelClosure[ID].Bits[Inc]) return 2;
 	}
 	
-	if (CountInherited)
-	{
-		for (; Worker->Next; Worker = Worker->Next)
-		{
-			if (RLInheritance_Check(InRL, Worker->RL))
-			{
-				RetVal = 2;
-				break;
-			}
-		}
-	}
+	return false;
+}
+
+Bool ObjRL_CheckRunlevel(const char *InRL, const ObjTable *InObj, Bool CountInherited)
+{
+	return ObjRL_CheckID(ObjRL_GetID(InRL, false), InObj, CountInherited);
+}
+
+Bool ObjRL_AddRunlevel(const char *InRL, ObjTable *InObj)
+{
+	const unsigned long ID = ObjRL_GetID(InRL, true);
+	
+	if (ID == MAX_RUNLEVELS) return false;
+	
+	RLSET_ADD(InObj->ObjectRunlevels, ID);
+	return true;
+}
+
+Bool ObjRL_DelRunlevel(const char *InRL, ObjTable *InObj)
+{
+	const unsigned long ID = ObjRL_GetID(InRL, false);
+	
+	if (ID == MAX_RUNLEVELS || !RLSET_HAS(InObj->ObjectRunlevels, ID)) return false;
+	
+	RLSET_DEL(InObj->ObjectRunlevels, ID);
+	return true;
+}
+
+Bool ObjRL_ValidRunlevel(const char *InRL)
+{ /*checks if a runlevel has anything at all using it.*/
+	const ObjTable *Worker = ObjectTable;
+	const unsigned long ID = ObjRL_GetID(InRL, false);
+	
+	if (ID == MAX_RUNLEVELS) return false;
 	
-	for (Worker = InObj->ObjectRunlevels; Worker->Next != NULL; Worker = Worker->Next)
+	for (; Worker < ObjectTable + ObjectCount; ++Worker)
 	{
-		if (!strcmp(Worker->RL, InRL))
+		if (!Worker->Opts.HaltCmdOnly && ObjRL_CheckID(ID, Worker, true))
 		{
 			return true;
 		}
 	}
 	
-	return RetVal;
+	return false;
 }
-	
-void ObjRL_AddRunlevel(const char *InRL, ObjTable *InObj)
+
+void ObjRL_ClearRunlevels(ObjTable *InObj)
 {
-	struct _RLTree *Worker = InObj->ObjectRunlevels;
+	memset(&InObj->ObjectRunlevels, 0, sizeof InObj->ObjectRunlevels);
+}
+
+unsigned long ObjRL_CountRunlevels(const ObjTable *InObj)
+{
+	unsigned long ID = 0, Count = 0;
 	
-	if (InObj->ObjectRunlevels == NULL)
+	for (; ID < RunlevelCount; ++ID)
 	{
-		InObj->ObjectRunlevels = malloc(sizeof(struct _RLTree));
-		
-		InObj->ObjectRunlevels->Prev = NULL;
-		InObj->ObjectRunlevels->Next = NULL;
-		Worker = InObj->ObjectRunlevels;
+		if (RLSET_HAS(InObj->ObjectRunlevels, ID)) ++Count;
 	}
 	
-	while (Worker->Next != NULL) Worker = Worker->Next;
+	return Count;
+}
+
+static void ObjRL_Remap(struct _RLSet *Set, const unsigned char *Map)
+{ /*Map is the new ID plus one for every old one, or zero if it's gone.*/
+	struct _RLSet NewSet;
+	unsigned long ID = 0;
 	
-	Worker->Next = malloc(sizeof(struct _RLTree));
-	Worker->Next->Next = NULL;
-	Worker->Next->Prev = Worker;
+	memset(&NewSet, 0, sizeof NewSet);
+	
+	for (; ID < RunlevelCount; ++ID)
+	{
+		if (RLSET_HAS(*Set, ID) && Map[ID]) RLSET_ADD(NewSet, Map[ID] - 1);
+	}
 	
-	snprintf(Worker->RL, MAX_DESCRIPT_SIZE, "%s", InRL);
+	*Set = NewSet;
 }
 
-Bool ObjRL_DelRunlevel(const char *InRL, ObjTable *InObj)
-{
-	struct _RLTree *Worker = InObj->ObjectRunlevels;
+static void ObjRL_Compact(void)
+{ /*Forgets runlevels no object, inheritance line or the current runlevel uses, and renumbers the rest.
+	* Without this, every name a failed reload or a typo ever brought in would hold a slot until reboot.*/
+	unsigned char Map[MAX_RUNLEVELS];
+	struct _RLSet Used;
+	ObjTable *Worker = NULL;
+	unsigned long ID = 0, Other, Inc, Slot, NewCount = 0;
+	
+	memset(&Used, 0, sizeof Used);
 	
-	if (Worker == NULL)
+	for (Worker = ObjectTable; Worker < ObjectTable + ObjectCount; ++Worker)
 	{
-		return false;
+		for (Inc = 0; Inc < RLSET_WORDS; ++Inc) Used.Bits[Inc] |= Worker->ObjectRunlevels.Bits[Inc];
 	}
 	
-	for (; Worker->Next; Worker = Worker->Next)
+	for (ID = 0; ID < RunlevelCount; ++ID)
 	{
-		if (!strcmp(InRL, Worker->RL))
+		for (Other = 0; Other < RunlevelCount; ++Other)
 		{
-			if (Worker == InObj->ObjectRunlevels)
-			{ /*If it's the first node*/
-				
-				if (InObj->ObjectRunlevels->Next->Next != NULL)
-				{ /*Are there other runlevels enabled, or just us?*/
-					InObj->ObjectRunlevels->Next->Prev = NULL;
-					InObj->ObjectRunlevels = InObj->ObjectRunlevels->Next;
-					free(Worker);
-				}
-				else
-				{ /*Apparently just us.*/
-					ObjRL_ShutdownRunlevels(InObj);
-				}
-				
-				return true;
-			}
-				
-			/*Otherwise, do this.*/
-			Worker->Prev->Next = Worker->Next;
-			Worker->Next->Prev = Worker->Prev;	
-				
-			free(Worker);
+			if (Other == ID || !RLSET_HAS(RunlevelClosure[ID], Other)) continue;
 			
-			return true;
+			RLSET_ADD(Used, ID);
+			RLSET_ADD(Used, Other);
 		}
 	}
 	
-	return false;
-}
-
-Bool ObjRL_ValidRunlevel(const char *InRL)
-{ /*checks if a runlevel has anything at all using it.*/
-	const ObjTable *Worker = ObjectTable;
-	Bool ValidRL = false;
+	if ((ID = ObjRL_GetID(CurRunlevel, false)) != MAX_RUNLEVELS) RLSET_ADD(Used, ID);
+	
+	for (ID = 0; ID < RunlevelCount; ++ID)
+	{
+		Map[ID] = RLSET_HAS(Used, ID) ? (unsigned char)(++NewCount) : 0;
+	}
+	
+	if (NewCount == RunlevelCount) return;
+	
+	for (Worker = ObjectTable; Worker < ObjectTable + ObjectCount; ++Worker)
+	{
+		ObjRL_Remap(&Worker->ObjectRunlevels, Map);
+	}
 	
-	for (; Worker->Next; Worker = Worker->Next)
+	memset(RunlevelIndex, 0, sizeof RunlevelIndex);
+	
+	for (ID = 0; ID < RunlevelCount; ++ID)
 	{
-		if (!Worker->Opts.HaltCmdOnly && ObjRL_CheckRunlevel(InRL, Worker, true))
+		if (!Map[ID])
 		{
-			ValidRL = true;
-			break;
+			free(RunlevelNames[ID]);
+			continue;
 		}
+		
+		/*Map only ever moves things down, so nothing we still need gets overwritten.*/
+		RunlevelNames[Map[ID] - 1] = RunlevelNames[ID];
+		ObjRL_Remap(&RunlevelClosure[ID], Map);
+		RunlevelClosure[Map[ID] - 1] = RunlevelClosure[ID];
+		
+		for (Slot = HashBytes(RunlevelNames[ID], strlen(RunlevelNames[ID])) % sizeof RunlevelIndex;
+			RunlevelIndex[Slot] != 0; Slot = (Slot + 1) % sizeof RunlevelIndex);
+		
+		RunlevelIndex[Slot] = Map[ID];
 	}
 	
-	return ValidRL;
-}
-
-void ObjRL_ShutdownRunlevels(ObjTable *InObj)
-{
-	struct _RLTree *Worker = InObj->ObjectRunlevels, *NDel;
-	
-	for (; Worker != NULL; Worker = NDel)
+	for (ID = NewCount; ID < RunlevelCount; ++ID)
 	{
-		NDel = Worker->Next;
-		free(Worker);
+		RunlevelNames[ID] = NULL;
+		memset(&RunlevelClosure[ID], 0, sizeof(struct _RLSet));
 	}
 	
-	InObj->ObjectRunlevels = NULL;
+	RunlevelCount = NewCount;
 }
 
 static void PriorityAlias_Add(const char *Alias, unsigned long Target)
 { /*This code should be simple enough. Just routine linked list stuff.*/
 	struct _PriorityAliasTree *Worker = PriorityAliasTree;
 	
-	if (!PriorityAliasTree)
+	for (; Worker; Worker = Worker->Next)
 	{
-		PriorityAliasTree = malloc(sizeof(struct _PriorityAliasTree));
-		PriorityAliasTree->Next = NULL;
-		PriorityAliasTree->Prev = NULL;
-		Worker = PriorityAliasTree;
-	}
-	else
-	{ /*If we are the first node, it's not possible for the object to already exist.*/
-		for (; Worker->Next; Worker = Worker->Next)
+		if (!strcmp(Worker->Alias, Alias))
 		{
-			if (!strcmp(Worker->Alias, Alias))
-			{
-				return;
-			}
+			return;
 		}
 	}
 	
-	Worker->Next = malloc(sizeof(struct _PriorityAliasTree));
-	Worker->Next->Next = NULL;
-	Worker->Next->Prev = Worker;
+	if (!(Worker = ConfigArena_Alloc(sizeof(struct _PriorityAliasTree), sizeof(void*))) ||
+		!(Worker->Alias = ConfigArena_String(Alias)))
+	{
+		return;
+	}
 	
-	strncpy(Worker->Alias, Alias, strlen(Alias) + 1);
 	Worker->Target = Target;
+	Worker->Next = PriorityAliasTree;
+	PriorityAliasTree = Worker;
 }
 
 static void PriorityAlias_Shutdown(void)
-{
-	struct _PriorityAliasTree *Worker = PriorityAliasTree, *TmpFree = NULL;
-	
-	if (!PriorityAliasTree) return;
-	
-	while (Worker != NULL)
-	{
-		TmpFree = Worker;
-		Worker = Worker->Next;
-		
-		free(TmpFree);
-	}
-	
+{ /*The nodes go away with the arena.*/
 	PriorityAliasTree = NULL;
 }
 
@@ -2267,9 +2465,7 @@ static unsigned long PriorityAlias_Lookup(const char *Alias)
 { /*Return 0 if we cannot find anything.*/
 	struct _PriorityAliasTree *Worker = PriorityAliasTree;
 	
-	if (!Worker) return 0;
-	
-	for (; Worker->Next; Worker = Worker->Next)
+	for (; Worker; Worker = Worker->Next)
 	{
 		if (!strcmp(Worker->Alias, Alias))
 		{
@@ -2281,75 +2477,126 @@ static unsigned long PriorityAlias_Lookup(const char *Alias)
 }
 
 static void RLInheritance_Add(const char *Inheriter, const char *Inherited)
-{
-	struct _RunlevelInheritance *Worker = RunlevelInheritance;
+{ /*Whatever includes Inheriter now includes everything Inherited does, so the closure stays transitive.*/
+	const unsigned long InheriterID = ObjRL_GetID(Inheriter, true), InheritedID = ObjRL_GetID(Inherited, true);
+	unsigned long ID = 0, Inc;
 	
-	if (!Worker)
+	if (InheriterID == MAX_RUNLEVELS || InheritedID == MAX_RUNLEVELS) return;
+	
+	for (; ID < RunlevelCount; ++ID)
 	{
-		RunlevelInheritance = malloc(sizeof(struct _RunlevelInheritance));
-		memset(RunlevelInheritance, 0, sizeof(struct _RunlevelInheritance));
+		if (!RLSET_HAS(RunlevelClosure[ID], InheriterID)) continue;
 		
-		Worker = RunlevelInheritance;
+		for (Inc = 0; Inc < RLSET_WORDS; ++Inc)
+		{
+			RunlevelClosure[ID].Bits[Inc] |= RunlevelClosure[InheritedID].Bits[Inc];
+		}
 	}
+}
+
+static void RLInheritance_Reset(void)
+{ /*Back to every runlevel including only itself. The names stay, so IDs don't move.*/
+	unsigned long ID = 0;
 	
-	while (Worker->Next) Worker = Worker->Next;
-	
-	Worker->Next = malloc(sizeof(struct _RunlevelInheritance));
-	memset(Worker->Next, 0, sizeof(struct _RunlevelInheritance));
+	memset(RunlevelClosure, 0, sizeof RunlevelClosure);
 	
-	Worker->Next->Prev = Worker;
+	for (; ID < RunlevelCount; ++ID)
+	{
+		RLSET_ADD(RunlevelClosure[ID], ID);
+	}
+}
+
+/*Which priority PriorityPlan_Compare() sorts on, since qsort() won't pass it along.*/
+static Bool PlanWantStart;
+
+#define PLAN_PRIORITY(Index, WantStart) ((WantStart) ? ObjectTable[Index].ObjectStartPriority : ObjectTable[Index].ObjectStopPriority)
+
+static int PriorityPlan_Compare(const void *First_, const void *Second_)
+{ /*By priority, then by position in the table, so ties run in config file order like they always have.*/
+	const unsigned long First = *(const unsigned long*)First_, Second = *(const unsigned long*)Second_;
+	const unsigned long FirstPrio = PLAN_PRIORITY(First, PlanWantStart), SecondPrio = PLAN_PRIORITY(Second, PlanWantStart);
 	
-	strncpy(Worker->Inheriter, Inheriter, strlen(Inheriter) + 1);
-	strncpy(Worker->Inherited, Inherited, strlen(Inherited) + 1);
+	if (FirstPrio != SecondPrio) return FirstPrio < SecondPrio ? -1 : 1;
 	
+	return First < Second ? -1 : (First > Second);
 }
 
-static Bool RLInheritance_Check(const char *Inheriter, const char *Inherited)
-{ /*Check if Inheriter inherits inherited.*/
-	struct _RunlevelInheritance *Worker = RunlevelInheritance;
-	
-	if (!Worker) return false;
+static Bool PriorityPlan_Build(void)
+{
+	unsigned long Inc = 0, Mode = 0;
 	
-	for (; Worker->Next != NULL; Worker = Worker->Next)
+	for (; Mode < 2; ++Mode)
 	{
-		if (!strcmp(Inheriter, Worker->Inheriter) && !strcmp(Inherited, Worker->Inherited))
+		free(PriorityPlan[Mode]);
+		
+		if (!(PriorityPlan[Mode] = malloc(sizeof(unsigned long) * (ObjectCount ? ObjectCount : 1))))
 		{
-			return true;
+			free(PriorityPlan[0]);
+			PriorityPlan[0] = NULL;
+			PriorityPlanDirty = true;
+			return false;
 		}
+		
+		for (Inc = 0; Inc < ObjectCount; ++Inc) PriorityPlan[Mode][Inc] = Inc;
+		
+		PlanWantStart = (Bool)Mode;
+		qsort(PriorityPlan[Mode], ObjectCount, sizeof(unsigned long), PriorityPlan_Compare);
 	}
 	
-	return false;
+	PriorityPlanDirty = false;
+	return true;
 }
 
-static void RLInheritance_Shutdown(void)
-{
-	struct _RunlevelInheritance *Worker = RunlevelInheritance, *TDel = NULL;
+static Bool PriorityPlan_Current(void)
+{ /*Sorts them again if anything was materialized since.*/
+	if (!PriorityPlanDirty && PriorityPlan[0] && PriorityPlan[1]) return true;
 	
-	for (; Worker != NULL; Worker = TDel)
+	if (!PriorityPlan_Build())
 	{
-		TDel = Worker->Next;
-		free(Worker);
+		SpitError("PriorityPlan_Current(): Out of memory!");
+		return false;
 	}
 	
-	RunlevelInheritance = NULL;
+	return true;
 }
 
 ObjTable *GetObjectByPriority(const char *ObjectRunlevel, ObjTable *LastNode, Bool WantStartPriority, unsigned long ObjectPriority)
 { /*The primary lookup function to be used when executing commands.*/
-	ObjTable *Worker = LastNode ? LastNode->Next : ObjectTable;
-	unsigned long WorkerPriority = 0;
+	const unsigned long *Plan = NULL;
+	const unsigned long After = LastNode ? LastNode - ObjectTable + 1 : 0; /*Plus one so zero means "from the start".*/
+	unsigned long Lower = 0, Upper = ObjectCount, Middle, MiddlePrio;
+	const unsigned long RunlevelID = ObjectRunlevel ? ObjRL_GetID(ObjectRunlevel, false) : MAX_RUNLEVELS;
+	ObjTable *Worker = NULL;
 	
-	if (!ObjectTable)
+	if (!ObjectCount || !PriorityPlan_Current())
 	{
 		return (void*)-1; /*Error.*/
 	}
 	
-	for (; Worker->Next != NULL; Worker = Worker->Next)
+	Plan = PriorityPlan[WantStartPriority != 0];
+	
+	/*Find the first entry that comes after LastNode at this priority.*/
+	while (Lower < Upper)
+	{
+		Middle = Lower + (Upper - Lower) / 2;
+		MiddlePrio = PLAN_PRIORITY(Plan[Middle], WantStartPriority);
+		
+		if (MiddlePrio < ObjectPriority || (MiddlePrio == ObjectPriority && Plan[Middle] + 1 <= After))
+		{
+			Lower = Middle + 1;
+		}
+		else
+		{
+			Upper = Middle;
+		}
+	}
+	
+	for (; Lower < ObjectCount && PLAN_PRIORITY(Plan[Lower], WantStartPriority) == ObjectPriority; ++Lower)
 	{
-		WorkerPriority = (WantStartPriority ? Worker->ObjectStartPriority : Worker->ObjectStopPriority);
+		Worker = ObjectTable + Plan[Lower];
 		
-		if ((ObjectRunlevel == NULL || ((WantStartPriority || !Worker->Opts.HaltCmdOnly) &&
-			ObjRL_CheckRunlevel(ObjectRunlevel, Worker, true))) && WorkerPriority == ObjectPriority)
+		if (ObjectRunlevel == NULL || ((WantStartPriority || !Worker->Opts.HaltCmdOnly) &&
+			ObjRL_CheckID(RunlevelID, Worker, true)))
 		{
 			return Worker;
 		}
@@ -2358,137 +2605,273 @@ ObjTable *GetObjectByPriority(const char *ObjectRunlevel, ObjTable *LastNode, Bo
 	return NULL;
 }
 
-void ShutdownConfig(void)
-{
-	ObjTable *Worker = ObjectTable, *Temp;
+static void *ConfigArena_Alloc(unsigned long Size, unsigned long Align)
+{ /*Align must be a power of two. Nothing from here is ever freed on its own.*/
+	struct _ConfigArenaBlock *Block = ConfigArena.Blocks, *NewBlock = NULL;
+	unsigned long Offset = Block ? (Block->Used + Align - 1) & ~(Align - 1) : 0;
+	const Bool Oversize = Size > CONFIGARENA_BLOCKSIZE / 4;
+	
+	if (Block && Offset + Size <= Block->Size)
+	{
+		Block->Used = Offset + Size;
+		return (char*)(Block + 1) + Offset;
+	}
+	
+	if (!(NewBlock = malloc(sizeof(struct _ConfigArenaBlock) + (Oversize ? Size : CONFIGARENA_BLOCKSIZE))))
+	{
+		return NULL;
+	}
+	
+	NewBlock->Used = Size;
+	NewBlock->Size = Oversize ? Size : CONFIGARENA_BLOCKSIZE;
+	
+	if (Oversize && Block)
+	{ /*Goes behind the current block, so what's left in that one still gets used.*/
+		NewBlock->Next = Block->Next;
+		Block->Next = NewBlock;
+	}
+	else
+	{
+		NewBlock->Next = Block;
+		ConfigArena.Blocks = NewBlock;
+	}
+	
+	return NewBlock + 1;
+}
 
-	for (; Worker != NULL; Worker = Temp)
+static Bool ConfigArena_GrowStrings(void)
+{ /*Doubles the string index and puts everything back in it.*/
+	const unsigned long NewSize = ConfigArena.StringsSize ? ConfigArena.StringsSize * 2 : 256;
+	char **NewStrings = calloc(NewSize, sizeof(char*));
+	unsigned long Inc = 0, Slot;
+	
+	if (!NewStrings) return false;
+	
+	for (; Inc < ConfigArena.StringsSize; ++Inc)
 	{
-		if (Worker->Next)
-		{
-			if (Worker->ObjectID) free(Worker->ObjectID);
-			
-			if (Worker->ObjectDescription &&
-				Worker->ObjectDescription != Worker->ObjectID) free(Worker->ObjectDescription);
-				
-			if (Worker->ObjectStartCommand) free(Worker->ObjectStartCommand);
-			if (Worker->ObjectStopCommand) free(Worker->ObjectStopCommand);
-			if (Worker->ObjectReloadCommand) free(Worker->ObjectReloadCommand);
-			if (Worker->ObjectPrestartCommand) free(Worker->ObjectPrestartCommand);
-			if (Worker->ObjectPIDFile) free(Worker->ObjectPIDFile);
-			if (Worker->ObjectWorkingDirectory) free(Worker->ObjectWorkingDirectory);
-			if (Worker->ObjectStdout) free(Worker->ObjectStdout);
-			if (Worker->ObjectStderr) free(Worker->ObjectStderr);
-			
-			ObjRL_ShutdownRunlevels(Worker);
-		}
+		if (!ConfigArena.Strings[Inc]) continue;
+		
+		Slot = HashBytes(ConfigArena.Strings[Inc], strlen(ConfigArena.Strings[Inc])) & (NewSize - 1);
+		
+		while (NewStrings[Slot]) Slot = (Slot + 1) & (NewSize - 1);
 		
-		Temp = Worker->Next;
+		NewStrings[Slot] = ConfigArena.Strings[Inc];
+	}
+	
+	free(ConfigArena.Strings);
+	ConfigArena.Strings = NewStrings;
+	ConfigArena.StringsSize = NewSize;
+	
+	return true;
+}
+
+static char *ConfigArena_String(const char *String)
+{ /*The same text always gets the same pointer back, so what this returns must never be written to.*/
+	const unsigned long Length = strlen(String);
+	unsigned long Slot;
+	char *Copy = NULL;
+	
+	if ((ConfigArena.StringCount + 1) * 2 > ConfigArena.StringsSize && !ConfigArena_GrowStrings())
+	{
+		return NULL;
+	}
+	
+	for (Slot = HashBytes(String, Length) & (ConfigArena.StringsSize - 1); ConfigArena.Strings[Slot];
+		Slot = (Slot + 1) & (ConfigArena.StringsSize - 1))
+	{
+		if (!strcmp(ConfigArena.Strings[Slot], String)) return ConfigArena.Strings[Slot];
+	}
+	
+	if (!(Copy = ConfigArena_Alloc(Length + 1, 1))) return NULL;
+	
+	memcpy(Copy, String, Length + 1);
+	++ConfigArena.StringCount;
+	
+	return (ConfigArena.Strings[Slot] = Copy);
+}
+
+static void ConfigArena_Release(struct _ConfigArena *Arena)
+{
+	struct _ConfigArenaBlock *Worker = Arena->Blocks, *Next = NULL;
+	
+	for (; Worker != NULL; Worker = Next)
+	{
+		Next = Worker->Next;
 		free(Worker);
 	}
 	
-	RLInheritance_Shutdown();
+	free(Arena->Strings);
+	memset(Arena, 0, sizeof(struct _ConfigArena));
+}
+
+static void FreeObjectTable(ObjTable *Table, struct _ConfigArena *Arena, const void *ImageBase, unsigned long ImageSize)
+{ /*If the table came from the config cache, ImageBase is the mapping its strings live in. Otherwise they're in Arena.*/
+	free(Table);
+	ConfigArena_Release(Arena);
+	
+	if (ImageBase) ConfigCache_Release((void*)ImageBase, ImageSize);
+}
+
+void ShutdownConfig(void)
+{
+	FreeObjectTable(ObjectTable, &ConfigArena, ConfigImageBase, ConfigImageSize);
+	free(ObjectIndex);
+	free(PriorityPlan[0]);
+	free(PriorityPlan[1]);
+	
+	RLInheritance_Reset();
+	PriorityAlias_Shutdown(); /*It was in the arena.*/
+	ConfigLex_Release(&ConfigTokens);
 	ObjectTable = NULL;
+	ObjectIndex = NULL;
+	PriorityPlan[0] = PriorityPlan[1] = NULL;
+	PriorityPlanDirty = false;
+	ConfigImageBase = NULL;
+	ObjectCount = ObjectCapacity = ObjectIndexSize = ConfigImageSize = DeferredCount = 0;
 }
 
-rStatus ReloadConfig(void)
-{ /*This function is somewhat hard to read, but it does the job well.*/
-	ObjTable *Worker = ObjectTable;
-	ObjTable *TRoot = malloc(sizeof(ObjTable)), *SWorker = TRoot, *Temp = NULL;
-	struct _RLTree *RLTemp1 = NULL, *RLTemp2 = NULL;
-	Bool GlobalOpts[3], ConfigOK = true;
-	struct _RunlevelInheritance *RLIRoot = NULL, *RLIWorker[2] = { NULL };
-	char RunlevelBackup[MAX_DESCRIPT_SIZE];
-	void *TempPtr = NULL, *TempPtr2 = NULL;
+static Bool ConfigDiff_StrDiffers(const char *First, const char *Second)
+{
+	if (!First || !Second) return First != Second;
 	
-	WriteLogLine("CONFIG: Reloading configuration.\n", true);
-	WriteLogLine("CONFIG: Backing up current configuration.", true);
+	return strcmp(First, Second) != 0;
+}
+
+static unsigned char ConfigDiff_Compare(const ObjTable *Old, const ObjTable *New)
+{ /*Returns the CONFIGCHANGE_* flags for an object that's in both tables.*/
+	unsigned char Changes = 0;
+	
+	if (ConfigDiff_StrDiffers(Old->ObjectStartCommand, New->ObjectStartCommand) ||
+		ConfigDiff_StrDiffers(Old->ObjectPrestartCommand, New->ObjectPrestartCommand) ||
+		ConfigDiff_StrDiffers(Old->ObjectStopCommand, New->ObjectStopCommand) ||
+		ConfigDiff_StrDiffers(Old->ObjectPIDFile, New->ObjectPIDFile) ||
+		ConfigDiff_StrDiffers(Old->ObjectWorkingDirectory, New->ObjectWorkingDirectory) ||
+		ConfigDiff_StrDiffers(Old->ObjectStdout, New->ObjectStdout) ||
+		ConfigDiff_StrDiffers(Old->ObjectStderr, New->ObjectStderr) ||
+		Old->Opts.CaptureStdout != New->Opts.CaptureStdout || Old->Opts.CaptureStderr != New->Opts.CaptureStderr ||
+		Old->Opts.StopMode != New->Opts.StopMode || Old->Opts.IsService != New->Opts.IsService ||
+		Old->Opts.ForceShell != New->Opts.ForceShell || Old->Opts.PivotRoot != New->Opts.PivotRoot ||
+#ifndef NOMMU
+		Old->Opts.Fork != New->Opts.Fork ||
+#endif
+		Old->Opts.Exec != New->Opts.Exec)
+	{
+		Changes |= CONFIGCHANGE_COMMANDS;
+	}
 	
-	/*Backup the current runlevel.*/
-	snprintf(RunlevelBackup, MAX_DESCRIPT_SIZE, "%s", CurRunlevel);
+	if (Old->UserID != New->UserID || Old->GroupID != New->GroupID)
+	{
+		Changes |= CONFIGCHANGE_CREDENTIALS;
+	}
 	
-	for (; Worker->Next != NULL; Worker = Worker->Next, SWorker = SWorker->Next)
+	if (Old->Enabled != New->Enabled)
 	{
-		*SWorker = *Worker; /*Direct as-a-unit copy of the main list node to the backup list node.*/
-		SWorker->Prev = TempPtr;
-		SWorker->Next = malloc(sizeof(ObjTable));
-		SWorker->Next->Next = NULL;
-		TempPtr = SWorker;
-		
-		/*Backup the dynamically allocated strings.*/
-		SWorker->ObjectID = Worker->ObjectID;
-		Worker->ObjectID = NULL;
-		
-		SWorker->ObjectDescription = Worker->ObjectDescription;
-		Worker->ObjectDescription = NULL;
-		
-		SWorker->ObjectStartCommand = Worker->ObjectStartCommand;
-		Worker->ObjectStartCommand = NULL;
-		
-		SWorker->ObjectStopCommand = Worker->ObjectStopCommand;
-		Worker->ObjectStopCommand = NULL;
-		
-		SWorker->ObjectPrestartCommand = Worker->ObjectPrestartCommand;
-		Worker->ObjectPrestartCommand = NULL;
-		
-		SWorker->ObjectReloadCommand = Worker->ObjectReloadCommand;
-		Worker->ObjectReloadCommand = NULL;
-		
-		SWorker->ObjectPIDFile = Worker->ObjectPIDFile;
-		Worker->ObjectPIDFile = NULL;
-		
-		SWorker->ObjectWorkingDirectory = Worker->ObjectWorkingDirectory;
-		Worker->ObjectWorkingDirectory = NULL;
-		
-		SWorker->ObjectStdout = Worker->ObjectStdout;
-		Worker->ObjectStdout = NULL;
-		
-		SWorker->ObjectStderr = Worker->ObjectStderr;
-		Worker->ObjectStderr = NULL;
-		
-		if (!Worker->ObjectRunlevels)
-		{
-			continue;
-		}
-		
-		RLTemp2 = SWorker->ObjectRunlevels = malloc(sizeof(struct _RLTree));
-		
-		TempPtr2 = NULL;
-		for (RLTemp1 = Worker->ObjectRunlevels; RLTemp1->Next; RLTemp1 = RLTemp1->Next)
-		{
-			*RLTemp2 = *RLTemp1;
-			RLTemp2->Prev = TempPtr2;
-			RLTemp2->Next = malloc(sizeof(struct _RLTree));
-			RLTemp2->Next->Next = NULL;
-			TempPtr2 = RLTemp2;
-			
-			RLTemp2 = RLTemp2->Next;
-		}
+		Changes |= CONFIGCHANGE_ENABLED;
 	}
+	
+	/*Runlevel IDs survive the reload, so the bits mean the same thing in both.*/
+	if (memcmp(&Old->ObjectRunlevels, &New->ObjectRunlevels, sizeof Old->ObjectRunlevels) != 0)
+	{
+		Changes |= CONFIGCHANGE_RUNLEVELS;
+	}
+	
+	return Changes;
+}
+
+static Bool ConfigDiff_ShouldRun(const ObjTable *CurObj)
+{ /*Would a runlevel switch to the current runlevel start this?*/
+	return CurObj->Enabled && !CurObj->Opts.HaltCmdOnly && CurObj->ObjectStartPriority > 0 &&
+			ObjRL_CheckRunlevel(CurRunlevel, CurObj, true);
+}
 
-	/*Back up the runlevel inheritance table.*/
-	if (RunlevelInheritance != NULL)
+static void ConfigDiff_StopRemoved(ObjTable *CurObj)
+{ /*The object is about to be freed, so no job can track this. We just send the stop and let the primary loop reap it.*/
+	unsigned long TargetPID = 0;
+	Bool ShellDissolves;
+	
+	switch (CurObj->Opts.StopMode)
 	{
-		RLIRoot = RLIWorker[1] = malloc(sizeof(struct _RunlevelInheritance));
-		memset(RLIWorker[1], 0, sizeof(struct _RunlevelInheritance));
-		TempPtr = NULL;
-		
-		for (RLIWorker[0] = RunlevelInheritance; RLIWorker[0]->Next; RLIWorker[0] = RLIWorker[0]->Next)
-		{
-			*RLIWorker[1] = *RLIWorker[0];
-			RLIWorker[1]->Prev = TempPtr;
-			TempPtr = RLIWorker[1];
-			RLIWorker[1]->Next = malloc(sizeof(struct _RunlevelInheritance));
-			memset(RLIWorker[1]->Next, 0, sizeof(struct _RunlevelInheritance));
-			
-			RLIWorker[1] = RLIWorker[1]->Next;
-		}
+		case STOP_COMMAND:
+			if (CurObj->ObjectStopCommand) LaunchObjectCommand(CurObj, CurObj->ObjectStopCommand, OBJCMD_STOP, &ShellDissolves);
+			return;
+		case STOP_PID:
+			TargetPID = CurObj->ObjectPID;
+			break;
+		case STOP_PIDFILE:
+			TargetPID = ReadPIDFile(CurObj);
+			break;
+		default:
+			return;
 	}
 	
-	WriteLogLine("CONFIG: Shutting down configuration.", true);
+	if (TargetPID) kill(TargetPID, CurObj->TermSignal);
+}
+
+static void ConfigDiff_Add(struct _ConfigDiff **Diff, unsigned long *DiffCount, const char *ObjectID,
+							unsigned char Changes, unsigned char Action)
+{
+	struct _ConfigDiff *NewDiff = realloc(*Diff, sizeof(struct _ConfigDiff) * (*DiffCount + 1));
+	char TmpBuf[MAX_LINE_SIZE];
+	
+	if (!NewDiff) return;
 	
-	/*Actually do the reload of the config.*/
-	ShutdownConfig();
+	*Diff = NewDiff;
+	NewDiff += (*DiffCount)++;
+	
+	snprintf(NewDiff->ObjectID, sizeof NewDiff->ObjectID, "%s", ObjectID);
+	NewDiff->Changes = Changes;
+	NewDiff->Action = Action;
+	
+	snprintf(TmpBuf, sizeof TmpBuf, "CONFIG: Object \"%s\"%s%s%s%s%s%s.", ObjectID,
+			(Changes & CONFIGCHANGE_ADDED ? " added" : ""), (Changes & CONFIGCHANGE_REMOVED ? " removed" : ""),
+			(Changes & CONFIGCHANGE_COMMANDS ? " commands changed" : ""),
+			(Changes & CONFIGCHANGE_CREDENTIALS ? " credentials changed" : ""),
+			(Changes & CONFIGCHANGE_RUNLEVELS ? " runlevels changed" : ""),
+			(Changes & CONFIGCHANGE_ENABLED ? " enabled state changed" : ""));
+	WriteLogLine(TmpBuf, true);
+}
+
+rStatus ReloadConfig(unsigned long *ApplyJobID)
+{ /*The new config is parsed while the old table is put aside, and only thrown away once the new one checks out.
+	* If ApplyJobID isn't NULL, we also stop what went away and start, stop or restart what changed,
+	* and it gets the ID of the batch job doing that, or zero if there was nothing to do.*/
+	ObjTable *Worker = NULL, *SWorker = NULL;
+	ObjTable *TRoot = ObjectTable; /*The old table is kept whole as the backup.*/
+	unsigned long TCount = ObjectCount, TCapacity = ObjectCapacity, *TIndex = ObjectIndex, TIndexSize = ObjectIndexSize;
+	unsigned long *TPlan[2], TImageSize = ConfigImageSize;
+	void *TImageBase = ConfigImageBase;
+	Bool TPlanDirty;
+	struct _ConfigArena TArena = ConfigArena;
+	struct _RLSet TClosure[MAX_RUNLEVELS];
+	unsigned long TRunlevelCount = RunlevelCount;
+	struct _ConfigDiff *Diff = NULL;
+	unsigned long DiffCount = 0;
+	unsigned char Changes = 0, Action = 0;
+	Bool GlobalOpts[2];
+	char RunlevelBackup[MAX_DESCRIPT_SIZE];
+	
+	if (ApplyJobID) *ApplyJobID = 0;
+	
+	WriteLogLine("CONFIG: Reloading configuration.\n", true);
+	
+	/*Comparing against objects we never parsed wouldn't tell us much.*/
+	Config_MaterializeRunlevel(NULL);
+	
+	/*Backup the current runlevel.*/
+	snprintf(RunlevelBackup, MAX_DESCRIPT_SIZE, "%s", CurRunlevel);
+	
+	/*Take everything away from ShutdownConfig() and InitConfig(), so the new config gets built beside it.*/
+	TPlan[0] = PriorityPlan[0];
+	TPlan[1] = PriorityPlan[1];
+	TPlanDirty = PriorityPlanDirty;
+	ObjectTable = NULL;
+	ObjectIndex = NULL;
+	PriorityPlan[0] = PriorityPlan[1] = NULL;
+	ConfigImageBase = NULL;
+	memset(&ConfigArena, 0, sizeof ConfigArena);
+	memcpy(TClosure, RunlevelClosure, sizeof TClosure);
+	RLInheritance_Reset();
+	ObjectCount = ObjectCapacity = ObjectIndexSize = ConfigImageSize = 0;
 	
 	/*Do this to prevent some weird options from being changeable by a config reload.*/
 	GlobalOpts[0] = EnableLogging;
@@ -2506,66 +2889,112 @@ rStatus ReloadConfig(void)
 		
 		ShutdownConfig();
 		
-		ObjectTable = TRoot; /*Point ObjectTable to our new, identical copy of the old tree.*/
-		RunlevelInheritance = RLIRoot; /*Restore runlevel inheritance.*/
+		/*Put the old table back exactly as it was.*/
+		ObjectTable = TRoot;
+		ObjectCount = TCount;
+		ObjectCapacity = TCapacity;
+		ObjectIndex = TIndex;
+		ObjectIndexSize = TIndexSize;
+		PriorityPlan[0] = TPlan[0];
+		PriorityPlan[1] = TPlan[1];
+		PriorityPlanDirty = TPlanDirty;
+		ConfigImageBase = TImageBase;
+		ConfigImageSize = TImageSize;
+		ConfigArena = TArena;
+		
+		/*Restore runlevel inheritance. Names the failed parse brought in just include themselves.*/
+		memcpy(RunlevelClosure, TClosure, sizeof RunlevelClosure);
+		for (; TRunlevelCount < RunlevelCount; ++TRunlevelCount) RLSET_ADD(RunlevelClosure[TRunlevelCount], TRunlevelCount);
+		ObjRL_Compact(); /*And then forget them.*/
 		
 		/*Restore current runlevel*/
 		snprintf(CurRunlevel, MAX_DESCRIPT_SIZE, "%s", RunlevelBackup);
 		
-		ConfigOK = false;
+		EnableLogging = GlobalOpts[0];
+		DisableCAD = GlobalOpts[1];
 		
 		FinaliseLogStartup(false); /*Write any logs to disk.*/
+		return FAILURE;
 	}
 	
+	Config_MaterializeRunlevel(NULL);
+	
 	/*And then restore those options to their previous states.*/
 	EnableLogging = GlobalOpts[0];
 	DisableCAD = GlobalOpts[1];
 	
-	if (!ConfigOK) return ConfigOK;
+	Capture_Prune(); /*Let go of pipes the new config doesn't want.*/
 	
 	WriteLogLine("CONFIG: Restoring object statuses and deleting backup configuration.", true);
 	
-	for (SWorker = TRoot; SWorker != NULL; SWorker = Temp)
+	for (SWorker = TRoot; SWorker < TRoot + TCount; ++SWorker)
 	{ /*Add back the Started states, so we don't forget to stop services, etc.*/
-		
-		if (SWorker->Next)
+		if (!(Worker = LookupObjectInTable(SWorker->ObjectID)))
 		{
-			if ((Worker = LookupObjectInTable(SWorker->ObjectID)))
-			{
-				Worker->Started = SWorker->Started;
-				Worker->ObjectPID = SWorker->ObjectPID;
-				Worker->StartedSince = SWorker->StartedSince;
-			}
+			if (SWorker->Started && ApplyJobID) ConfigDiff_StopRemoved(SWorker);
 			
-			ObjRL_ShutdownRunlevels(SWorker);
-			
-			if (SWorker->ObjectID) free(SWorker->ObjectID);
-			if (SWorker->ObjectDescription &&
-				SWorker->ObjectDescription != SWorker->ObjectID) free(SWorker->ObjectDescription);
-			if (SWorker->ObjectStartCommand) free(SWorker->ObjectStartCommand);
-			if (SWorker->ObjectStopCommand) free(SWorker->ObjectStopCommand);
-			if (SWorker->ObjectReloadCommand) free(SWorker->ObjectReloadCommand);
-			if (SWorker->ObjectPrestartCommand) free(SWorker->ObjectPrestartCommand);
-			if (SWorker->ObjectPIDFile) free(SWorker->ObjectPIDFile);
-			if (SWorker->ObjectWorkingDirectory) free(SWorker->ObjectWorkingDirectory);
-			if (SWorker->ObjectStdout) free(SWorker->ObjectStdout);
-			if (SWorker->ObjectStderr) free(SWorker->ObjectStderr);
+			ConfigDiff_Add(&Diff, &DiffCount, SWorker->ObjectID, CONFIGCHANGE_REMOVED, RELOADACT_NONE);
+			continue;
+		}
+		
+		Worker->Started = SWorker->Started;
+		Worker->ObjectPID = SWorker->ObjectPID;
+		Worker->StartedSince = SWorker->StartedSince;
+		
+		if (!(Changes = ConfigDiff_Compare(SWorker, Worker))) continue;
+		
+		if (Worker->Started)
+		{
+			Action = !ConfigDiff_ShouldRun(Worker) ? RELOADACT_STOP :
+					(Changes & (CONFIGCHANGE_COMMANDS | CONFIGCHANGE_CREDENTIALS)) ? RELOADACT_RESTART : RELOADACT_NONE;
+		}
+		else
+		{ /*Only start it if it's newly meant to be running, not just because it stopped at some point.*/
+			Action = (Changes & (CONFIGCHANGE_RUNLEVELS | CONFIGCHANGE_ENABLED)) && ConfigDiff_ShouldRun(Worker) ?
+					RELOADACT_START : RELOADACT_NONE;
+		}
+		
+		ConfigDiff_Add(&Diff, &DiffCount, Worker->ObjectID, Changes, Action);
+	}
+	
+	/*Anything the old index doesn't know is new. Borrow the old index to check.*/
+	for (Worker = ObjectTable; Worker < ObjectTable + ObjectCount; ++Worker)
+	{
+		unsigned long Slot = 0;
+		
+		if (TIndexSize)
+		{
+			for (Slot = HashBytes(Worker->ObjectID, strlen(Worker->ObjectID)) & (TIndexSize - 1);
+				TIndex[Slot] && strcmp(TRoot[TIndex[Slot] - 1].ObjectID, Worker->ObjectID) != 0;
+				Slot = (Slot + 1) & (TIndexSize - 1));
 		}
 		
-		Temp = SWorker->Next;
-		free(SWorker);
+		if (!TIndexSize || !TIndex[Slot])
+		{
+			ConfigDiff_Add(&Diff, &DiffCount, Worker->ObjectID, CONFIGCHANGE_ADDED,
+							ConfigDiff_ShouldRun(Worker) ? RELOADACT_START : RELOADACT_NONE);
+		}
 	}
 	
-	/*Release the runlevel inheritance table.*/
-	for (; RLIRoot != NULL; RLIRoot = RLIWorker[0])
+	FreeObjectTable(TRoot, &TArena, TImageBase, TImageSize);
+	free(TIndex);
+	free(TPlan[0]);
+	free(TPlan[1]);
+	
+	ObjRL_Compact(); /*Nothing compares against the old IDs anymore.*/
+	
+	if (ApplyJobID && DiffCount)
 	{
-		RLIWorker[0] = RLIRoot->Next;
-		free(RLIRoot);
+		*ApplyJobID = Jobs_CreateApply(Diff, DiffCount);
 	}
 	
+	free(Diff);
+	
 	WriteLogLine("CONFIG: " CONSOLE_COLOR_GREEN "Configuration reload successful." CONSOLE_ENDCOLOR, true);
 	puts(CONSOLE_COLOR_GREEN "Epoch: Configuration reloaded." CONSOLE_ENDCOLOR);
 	
+	Events_Emit(EVENT_CONFIGRELOAD, NULL, 0);
+	
 	FinaliseLogStartup(false); /*Clean up logs in memory.*/
 	
 	return SUCCESS;
@@ -0,0 +1,430 @@
+/*This code is part of the Epoch Init System.
+* The Epoch Init System is maintained by Subsentient.
+* This software is public domain.
+* Please read the file UNLICENSE.TXT for more information.*/
+
+/**This file reads and writes the binary config cache made by "epoch compileconfig".
+ * It's the object table after parsing and integrity checks, with offsets instead
+ * of pointers, so InitConfig() can map it and skip the text parse entirely.
+ * It's keyed by a hash of epoch.conf, so a stale one just gets ignored.**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "epoch.h"
+
+#define CONFIGCACHE_MAGIC "EPOCHCFG"
+#define CONFIGCACHE_VERSION 3
+
+struct _ConfigCacheHeader
+{ /*Every offset is from the start of the file, and every section starts aligned to a long.*/
+	char Magic[8];
+	unsigned long Version;
+	unsigned long Layout; /*sizeof(ObjTable), since the records embed one.*/
+	unsigned long SourceHash; /*HashBytes() of epoch.conf.*/
+	unsigned long SourceLength;
+	unsigned long ImageSize;
+	unsigned long Checksum; /*HashBytes() of everything after this header.*/
+	
+	unsigned long ObjectCount, ObjectsOffset;
+	unsigned long IndexSize, IndexOffset; /*A copy of config.c's hash index.*/
+	unsigned long PlanOffset[2]; /*ObjectTable indices in stop and start priority order.*/
+	unsigned long RunlevelCount, RunlevelsOffset; /*String table offsets, one per runlevel name.*/
+	unsigned long RunlevelWords, BitsetsOffset; /*Each object gets RunlevelWords longs of membership bits.*/
+	unsigned long StringsLength, StringsOffset;
+	unsigned long Globals, GlobalsLength; /*Global config lines, as a string table offset.*/
+};
+
+/*The string members of ObjTable. In the image, each is an offset into the string table, zero meaning NULL.*/
+static const size_t StringFields[] = { offsetof(ObjTable, ObjectID), offsetof(ObjTable, ObjectDescription),
+										offsetof(ObjTable, ObjectStartCommand), offsetof(ObjTable, ObjectPrestartCommand),
+										offsetof(ObjTable, ObjectStopCommand), offsetof(ObjTable, ObjectReloadCommand),
+										offsetof(ObjTable, ObjectPIDFile), offsetof(ObjTable, ObjectWorkingDirectory),
+										offsetof(ObjTable, ObjectStderr), offsetof(ObjTable, ObjectStdout) };
+
+#define CONFIGCACHE_STRINGS (sizeof StringFields / sizeof *StringFields)
+#define OBJSTRING(Obj, Field) (*(char**)((char*)(Obj) + StringFields[Field]))
+#define CACHE_ALIGN(Size) (((Size) + sizeof(long) - 1) & ~(sizeof(long) - 1))
+
+struct _ConfigCacheObject
+{
+	ObjTable Object; /*Pointers are zeroed. Strings below stand in for them.*/
+	unsigned long Strings[CONFIGCACHE_STRINGS];
+};
+
+struct _CacheBuffer
+{
+	char *Data;
+	unsigned long Size;
+	unsigned long Capacity;
+	Bool Failed;
+};
+
+static unsigned long CacheBuffer_Add(struct _CacheBuffer *Buffer, const void *Data, unsigned long Length)
+{ /*Returns the offset it went in at.*/
+	const unsigned long Offset = Buffer->Size;
+	char *NewData = NULL;
+	
+	if (Buffer->Failed) return 0;
+	
+	if (Buffer->Size + Length > Buffer->Capacity)
+	{
+		unsigned long NewCapacity = Buffer->Capacity ? Buffer->Capacity : 4096;
+		
+		while (NewCapacity < Buffer->Size + Length) NewCapacity *= 2;
+		
+		if (!(NewData = realloc(Buffer->Data, NewCapacity)))
+		{
+			Buffer->Failed = true;
+			return 0;
+		}
+		
+		memset(NewData + Buffer->Capacity, 0, NewCapacity - Buffer->Capacity);
+		Buffer->Data = NewData;
+		Buffer->Capacity = NewCapacity;
+	}
+	
+	if (Data) memcpy(Buffer->Data + Buffer->Size, Data, Length);
+	Buffer->Size += Length;
+	
+	return Offset;
+}
+
+static unsigned long CacheBuffer_Align(struct _CacheBuffer *Buffer)
+{
+	CacheBuffer_Add(Buffer, NULL, CACHE_ALIGN(Buffer->Size) - Buffer->Size);
+	return Buffer->Size;
+}
+
+static void ConfigCache_Path(char *Out, unsigned long OutSize)
+{
+	snprintf(Out, OutSize, "%s" CONFIGCACHE_SUFFIX, ConfigFile);
+}
+
+rStatus ConfigCache_Write(const struct _ConfigImage *Image)
+{ /*Writes out whatever is in ObjectTable now. Only makes sense right after a text parse.*/
+	struct _CacheBuffer Strings = { NULL }, Out = { NULL };
+	struct _ConfigCacheHeader Header;
+	struct _ConfigCacheObject Record;
+	unsigned long *Runlevels = NULL, *Bitsets = NULL, Inc, Inc2, Words, ID;
+	unsigned long RunlevelCount = 0, RunlevelCapacity = 0;
+	char CachePath[MAX_LINE_SIZE], TempPath[MAX_LINE_SIZE + 8];
+	const ObjTable *Worker = NULL;
+	const char *RLName = NULL;
+	int Descriptor;
+	rStatus RetVal = FAILURE;
+	
+	memset(&Header, 0, sizeof Header);
+	
+	CacheBuffer_Add(&Strings, "", 1); /*So that no string gets offset zero.*/
+	
+	/*Gather every runlevel name in use. Our IDs aren't the ones whoever loads this will have, so they go by name.*/
+	for (Worker = ObjectTable; Worker < ObjectTable + ObjectCount; ++Worker)
+	{
+		for (ID = 0; (RLName = ObjRL_GetName(ID)); ++ID)
+		{
+			if (!RLSET_HAS(Worker->ObjectRunlevels, ID)) continue;
+			
+			for (Inc = 0; Inc < RunlevelCount && strcmp(Strings.Data + Runlevels[Inc], RLName) != 0; ++Inc);
+			
+			if (Inc < RunlevelCount) continue;
+			
+			if (RunlevelCount == RunlevelCapacity)
+			{
+				unsigned long *NewRunlevels = realloc(Runlevels, sizeof(long) * (RunlevelCapacity += 16));
+				
+				if (!NewRunlevels) goto End;
+				Runlevels = NewRunlevels;
+			}
+			
+			Runlevels[RunlevelCount++] = CacheBuffer_Add(&Strings, RLName, strlen(RLName) + 1);
+		}
+	}
+	
+	Words = (RunlevelCount + sizeof(long) * 8 - 1) / (sizeof(long) * 8);
+	
+	if (ObjectCount && Words && !(Bitsets = calloc(ObjectCount * Words, sizeof(long)))) goto End;
+	
+	Header.ObjectsOffset = CacheBuffer_Add(&Out, NULL, sizeof Header);
+	Header.ObjectsOffset = CacheBuffer_Align(&Out);
+	
+	for (Worker = ObjectTable; Worker < ObjectTable + ObjectCount; ++Worker)
+	{
+		Record.Object = *Worker;
+		ObjRL_ClearRunlevels(&Record.Object);
+		
+		for (Inc = 0; Inc < CONFIGCACHE_STRINGS; ++Inc)
+		{
+			const char *String = OBJSTRING(Worker, Inc);
+			
+			OBJSTRING(&Record.Object, Inc) = NULL;
+			
+			if (!String)
+			{
+				Record.Strings[Inc] = 0;
+			}
+			else if (Inc > 0 && String == Worker->ObjectID)
+			{ /*The description defaults to the ObjectID itself.*/
+				Record.Strings[Inc] = Record.Strings[0];
+			}
+			else
+			{
+				Record.Strings[Inc] = CacheBuffer_Add(&Strings, String, strlen(String) + 1);
+			}
+		}
+		
+		for (ID = 0; (RLName = ObjRL_GetName(ID)); ++ID)
+		{
+			if (!RLSET_HAS(Worker->ObjectRunlevels, ID)) continue;
+			
+			for (Inc = 0; strcmp(Strings.Data + Runlevels[Inc], RLName) != 0; ++Inc);
+			
+			Bitsets[(Worker - ObjectTable) * Words + Inc / (sizeof(long) * 8)] |= 1UL << (Inc % (sizeof(long) * 8));
+		}
+		
+		CacheBuffer_Add(&Out, &Record, sizeof Record);
+	}
+	
+	Header.ObjectCount = ObjectCount;
+	Header.IndexSize = Image->IndexSize;
+	Header.IndexOffset = CacheBuffer_Add(&Out, Image->Index, sizeof(long) * Image->IndexSize);
+	
+	for (Inc = 0; Inc < 2; ++Inc)
+	{
+		Header.PlanOffset[Inc] = CacheBuffer_Add(&Out, Image->Plan[Inc], sizeof(long) * ObjectCount);
+	}
+	
+	Header.RunlevelCount = RunlevelCount;
+	Header.RunlevelsOffset = CacheBuffer_Add(&Out, Runlevels, sizeof(long) * RunlevelCount);
+	Header.RunlevelWords = Words;
+	Header.BitsetsOffset = CacheBuffer_Add(&Out, Bitsets, sizeof(long) * Words * ObjectCount);
+	
+	Header.Globals = CacheBuffer_Add(&Strings, Image->Globals, Image->GlobalsLength);
+	Header.GlobalsLength = Image->GlobalsLength;
+	CacheBuffer_Add(&Strings, "", 1);
+	
+	Header.StringsLength = Strings.Size;
+	Header.StringsOffset = CacheBuffer_Add(&Out, Strings.Data, Strings.Size);
+	CacheBuffer_Align(&Out);
+	
+	if (Out.Failed || Strings.Failed) goto End;
+	
+	memcpy(Header.Magic, CONFIGCACHE_MAGIC, sizeof Header.Magic);
+	Header.Version = CONFIGCACHE_VERSION;
+	Header.Layout = sizeof(ObjTable);
+	Header.SourceHash = Image->SourceHash;
+	Header.SourceLength = Image->SourceLength;
+	Header.ImageSize = Out.Size;
+	Header.Checksum = HashBytes(Out.Data + sizeof Header, Out.Size - sizeof Header);
+	memcpy(Out.Data, &Header, sizeof Header);
+	
+	/*Write it beside the real one and rename it over, so a crash never leaves half a cache.*/
+	ConfigCache_Path(CachePath, sizeof CachePath);
+	snprintf(TempPath, sizeof TempPath, "%s.new", CachePath);
+	
+	if ((Descriptor = open(TempPath, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) goto End;
+	
+	for (Inc = 0; Inc < Out.Size; Inc += Inc2)
+	{
+		long Written = write(Descriptor, Out.Data + Inc, Out.Size - Inc);
+		
+		if (Written <= 0) break;
+		Inc2 = Written;
+	}
+	
+	if (Inc != Out.Size || fsync(Descriptor) != 0)
+	{
+		close(Descriptor);
+		unlink(TempPath);
+		goto End;
+	}
+	
+	close(Descriptor);
+	
+	if (rename(TempPath, CachePath) != 0)
+	{
+		unlink(TempPath);
+		goto End;
+	}
+	
+	RetVal = SUCCESS;
+	
+End:
+	free(Out.Data);
+	free(Strings.Data);
+	free(Runlevels);
+	free(Bitsets);
+	
+	return RetVal;
+}
+
+static Bool ConfigCache_Validate(const char *Base, unsigned long Size)
+{ /*Everything we'll follow has to land inside the file. We'd rather parse text than trust a bad cache.*/
+	const struct _ConfigCacheHeader *Header = (const void*)Base;
+	const struct _ConfigCacheObject *Records = (const void*)(Base + Header->ObjectsOffset);
+	const unsigned long *Index = (const void*)(Base + Header->IndexOffset);
+	const unsigned long *Runlevels = (const void*)(Base + Header->RunlevelsOffset);
+	unsigned long Inc, Inc2;
+	
+#define SECTION_OK(Offset, Length) ((Offset) % sizeof(long) == 0 && (Offset) <= Size && (Length) <= Size - (Offset))
+	if (Header->ImageSize != Size || Header->ObjectCount > Size / sizeof(struct _ConfigCacheObject) ||
+		Header->IndexSize > Size / sizeof(long) || Header->RunlevelCount > Size / sizeof(long) ||
+		Header->RunlevelWords > Size / sizeof(long) ||
+		!SECTION_OK(Header->ObjectsOffset, sizeof(struct _ConfigCacheObject) * Header->ObjectCount) ||
+		!SECTION_OK(Header->IndexOffset, sizeof(long) * Header->IndexSize) ||
+		!SECTION_OK(Header->PlanOffset[0], sizeof(long) * Header->ObjectCount) ||
+		!SECTION_OK(Header->PlanOffset[1], sizeof(long) * Header->ObjectCount) ||
+		!SECTION_OK(Header->RunlevelsOffset, sizeof(long) * Header->RunlevelCount) ||
+		(Header->ObjectCount && Header->RunlevelWords > Size / sizeof(long) / Header->ObjectCount) ||
+		!SECTION_OK(Header->BitsetsOffset, sizeof(long) * Header->RunlevelWords * Header->ObjectCount) ||
+		Header->StringsOffset > Size || Header->StringsLength == 0 || Header->StringsLength > Size - Header->StringsOffset ||
+		Base[Header->StringsOffset + Header->StringsLength - 1] != '\0' ||
+		Header->Globals >= Header->StringsLength || Header->GlobalsLength >= Header->StringsLength - Header->Globals ||
+		Header->RunlevelCount > Header->RunlevelWords * sizeof(long) * 8 ||
+		(Header->IndexSize & (Header->IndexSize - 1)) != 0 || Header->IndexSize < Header->ObjectCount)
+	{
+		return false;
+	}
+#undef SECTION_OK
+	
+	for (Inc = 0; Inc < Header->ObjectCount; ++Inc)
+	{
+		for (Inc2 = 0; Inc2 < CONFIGCACHE_STRINGS; ++Inc2)
+		{
+			if (Records[Inc].Strings[Inc2] >= Header->StringsLength) return false;
+		}
+		
+		if (!Records[Inc].Strings[0]) return false; /*Everything has an ObjectID.*/
+		
+		for (Inc2 = 0; Inc2 < 2; ++Inc2)
+		{
+			if (((const unsigned long*)(Base + Header->PlanOffset[Inc2]))[Inc] >= Header->ObjectCount) return false;
+		}
+	}
+	
+	for (Inc = 0; Inc < Header->IndexSize; ++Inc)
+	{
+		if (Index[Inc] > Header->ObjectCount) return false;
+	}
+	
+	for (Inc = 0; Inc < Header->RunlevelCount; ++Inc)
+	{
+		if (Runlevels[Inc] >= Header->StringsLength) return false;
+	}
+	
+	return true;
+}
+
+Bool ConfigCache_Load(unsigned long SourceHash, unsigned long SourceLength, struct _ConfigImage *Out)
+{ /*On success ObjectTable is filled in, and Out has the rest. The strings point into the mapping, so keep it.*/
+	char CachePath[MAX_LINE_SIZE];
+	const struct _ConfigCacheHeader *Header = NULL;
+	const struct _ConfigCacheObject *Records = NULL;
+	const unsigned long *Runlevels = NULL, *Bitsets = NULL;
+	const char *Strings = NULL;
+	struct stat FileStat;
+	ObjTable *Table = NULL;
+	char *Base = NULL;
+	unsigned long Inc, Inc2;
+	int Descriptor;
+	
+	memset(Out, 0, sizeof(struct _ConfigImage));
+	ConfigCache_Path(CachePath, sizeof CachePath);
+	
+	if ((Descriptor = open(CachePath, O_RDONLY)) == -1) return false; /*Nobody compiled one. That's fine.*/
+	
+	if (fstat(Descriptor, &FileStat) != 0 || FileStat.st_size < (off_t)sizeof(struct _ConfigCacheHeader) ||
+		(Base = mmap(NULL, FileStat.st_size, PROT_READ, MAP_PRIVATE, Descriptor, 0)) == MAP_FAILED)
+	{
+		close(Descriptor);
+		return false;
+	}
+	
+	close(Descriptor);
+	Header = (const void*)Base;
+	
+	if (memcmp(Header->Magic, CONFIGCACHE_MAGIC, sizeof Header->Magic) != 0 || Header->Version != CONFIGCACHE_VERSION ||
+		Header->Layout != sizeof(ObjTable) || Header->SourceHash != SourceHash || Header->SourceLength != SourceLength)
+	{ /*Made by a different Epoch, or for a different epoch.conf.*/
+		WriteLogLine("CONFIG: Binary config cache is out of date, parsing " CONF_NAME " instead.", true);
+		munmap(Base, FileStat.st_size);
+		return false;
+	}
+	
+	if (!ConfigCache_Validate(Base, FileStat.st_size) ||
+		Header->Checksum != HashBytes(Base + sizeof(struct _ConfigCacheHeader), FileStat.st_size - sizeof(struct _ConfigCacheHeader)))
+	{
+		WriteLogLine("CONFIG: " CONSOLE_COLOR_YELLOW "Binary config cache is corrupt, ignoring it." CONSOLE_ENDCOLOR, true);
+		munmap(Base, FileStat.st_size);
+		return false;
+	}
+	
+	Out->IndexSize = Header->IndexSize;
+	
+	if ((Header->ObjectCount && !(Table = malloc(sizeof(ObjTable) * Header->ObjectCount))) ||
+		!(Out->Index = malloc(sizeof(long) * (Header->IndexSize ? Header->IndexSize : 1))) ||
+		!(Out->Plan[0] = malloc(sizeof(long) * (Header->ObjectCount + 1))) ||
+		!(Out->Plan[1] = malloc(sizeof(long) * (Header->ObjectCount + 1))))
+	{
+		free(Table);
+		free(Out->Index);
+		free(Out->Plan[0]);
+		munmap(Base, FileStat.st_size);
+		memset(Out, 0, sizeof(struct _ConfigImage));
+		return false;
+	}
+	
+	memcpy(Out->Index, Base + Header->IndexOffset, sizeof(long) * Header->IndexSize);
+	memcpy(Out->Plan[0], Base + Header->PlanOffset[0], sizeof(long) * Header->ObjectCount);
+	memcpy(Out->Plan[1], Base + Header->PlanOffset[1], sizeof(long) * Header->ObjectCount);
+	
+	Records = (const void*)(Base + Header->ObjectsOffset);
+	Runlevels = (const void*)(Base + Header->RunlevelsOffset);
+	Bitsets = (const void*)(Base + Header->BitsetsOffset);
+	Strings = Base + Header->StringsOffset;
+	
+	for (Inc = 0; Inc < Header->ObjectCount; ++Inc)
+	{
+		ObjTable *const Worker = Table + Inc;
+		
+		*Worker = Records[Inc].Object;
+		Worker->ConfigDeferred = 0; /*The cache is compiled whole.*/
+		ObjRL_ClearRunlevels(Worker);
+		
+		for (Inc2 = 0; Inc2 < CONFIGCACHE_STRINGS; ++Inc2)
+		{
+			OBJSTRING(Worker, Inc2) = Records[Inc].Strings[Inc2] ? (char*)Strings + Records[Inc].Strings[Inc2] : NULL;
+		}
+		
+		for (Inc2 = 0; Inc2 < Header->RunlevelCount; ++Inc2)
+		{
+			if (Bitsets[Inc * Header->RunlevelWords + Inc2 / (sizeof(long) * 8)] & (1UL << (Inc2 % (sizeof(long) * 8))))
+			{
+				ObjRL_AddRunlevel(Strings + Runlevels[Inc2], Worker);
+			}
+		}
+	}
+	
+	ObjectTable = Table;
+	ObjectCount = Header->ObjectCount;
+	
+	Out->Base = Base;
+	Out->Size = FileStat.st_size;
+	Out->Globals = Strings + Header->Globals;
+	Out->GlobalsLength = Header->GlobalsLength;
+	Out->SourceHash = SourceHash;
+	Out->SourceLength = SourceLength;
+	
+	return true;
+}
+
+void ConfigCache_Release(void *Base, unsigned long Size)
+{
+	if (Base) munmap(Base, Size);
+}
@@ -0,0 +1,282 @@
+/*This code is part of the Epoch Init System.
+* The Epoch Init System is maintained by Subsentient.
+* This software is public domain.
+* Please read the file UNLICENSE.TXT for more information.*/
+
+/**The lexer for epoch.conf. One pass over the file marks every line end, every separator
+ * and any byte with the high bit set in a pair of bitmaps, sixteen bytes at a time with SSE2 or NEON
+ * when the compiler gives us those. Then we walk the bitmaps a line at a time and hand back
+ * one token per attribute line. Values are NUL terminated right where they sit in the buffer,
+ * so the attribute handlers read them from there instead of from a copy.**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define CONFIGLEX_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define CONFIGLEX_NEON
+#endif
+#include "epoch.h"
+
+#define LEX_WORDBITS (sizeof(unsigned long) * 8)
+#define LEX_BLOCK 16
+
+#if defined(CONFIGLEX_SSE2)
+const char *const ConfigLexVector = "sse2";
+#elif defined(CONFIGLEX_NEON)
+const char *const ConfigLexVector = "neon";
+#else
+const char *const ConfigLexVector = "scalar";
+#endif
+
+struct _LexMasks
+{
+	unsigned long *Ends; /*'\n' and '\0'. A line stops at either.*/
+	unsigned long *Seps; /*' ', '\t' and '=', anything that ends an attribute name.*/
+	unsigned long Words;
+	Bool HighBit;
+};
+
+static void ConfigLex_ClassifyScalar(const unsigned char *Buffer, unsigned long Start, unsigned long Length, struct _LexMasks *Masks)
+{ /*Also finishes off whatever the vector versions leave over.*/
+	unsigned char High = 0;
+	
+	for (; Start < Length; ++Start)
+	{
+		const unsigned char Byte = Buffer[Start];
+		const unsigned long Bit = 1UL << (Start % LEX_WORDBITS);
+		
+		if (Byte == '\n' || Byte == '\0') Masks->Ends[Start / LEX_WORDBITS] |= Bit;
+		else if (Byte == ' ' || Byte == '\t' || Byte == '=') Masks->Seps[Start / LEX_WORDBITS] |= Bit;
+		
+		High |= Byte;
+	}
+	
+	if (High & 0x80) Masks->HighBit = true;
+}
+
+#if defined(CONFIGLEX_SSE2)
+static unsigned long ConfigLex_ClassifyVector(const unsigned char *Buffer, unsigned long Length, struct _LexMasks *Masks)
+{ /*Returns how far it got. LEX_BLOCK always divides LEX_WORDBITS, so a block never straddles two words.*/
+	const __m128i Newline = _mm_set1_epi8('\n'), Zero = _mm_setzero_si128();
+	const __m128i Space = _mm_set1_epi8(' '), Tab = _mm_set1_epi8('\t'), Equals = _mm_set1_epi8('=');
+	__m128i High = _mm_setzero_si128();
+	unsigned long Inc = 0;
+	
+	for (; Inc + LEX_BLOCK <= Length; Inc += LEX_BLOCK)
+	{
+		const __m128i Block = _mm_loadu_si128((const __m128i*)(Buffer + Inc));
+		const unsigned long Ends = (unsigned long)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(Block, Newline),
+																				_mm_cmpeq_epi8(Block, Zero)));
+		const unsigned long Seps = (unsigned long)_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(Block, Space),
+																				_mm_cmpeq_epi8(Block, Tab)), _mm_cmpeq_epi8(Block, Equals)));
+		
+		Masks->Ends[Inc / LEX_WORDBITS] |= Ends << (Inc % LEX_WORDBITS);
+		Masks->Seps[Inc / LEX_WORDBITS] |= Seps << (Inc % LEX_WORDBITS);
+		High = _mm_or_si128(High, Block);
+	}
+	
+	if (_mm_movemask_epi8(High)) Masks->HighBit = true;
+	
+	return Inc;
+}
+#elif defined(CONFIGLEX_NEON)
+static unsigned long ConfigLex_NeonMask(uint8x16_t Matches)
+{ /*NEON has no movemask, so weigh each lane by its bit and add the halves up.*/
+	static const uint8_t Weights[LEX_BLOCK] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+	const uint8x16_t Bits = vandq_u8(Matches, vld1q_u8(Weights));
+	
+	return (unsigned long)vaddv_u8(vget_low_u8(Bits)) | ((unsigned long)vaddv_u8(vget_high_u8(Bits)) << 8);
+}
+
+static unsigned long ConfigLex_ClassifyVector(const unsigned char *Buffer, unsigned long Length, struct _LexMasks *Masks)
+{ /*Returns how far it got. LEX_BLOCK always divides LEX_WORDBITS, so a block never straddles two words.*/
+	const uint8x16_t Newline = vdupq_n_u8('\n'), Zero = vdupq_n_u8(0);
+	const uint8x16_t Space = vdupq_n_u8(' '), Tab = vdupq_n_u8('\t'), Equals = vdupq_n_u8('=');
+	uint8x16_t High = vdupq_n_u8(0);
+	unsigned long Inc = 0;
+	
+	for (; Inc + LEX_BLOCK <= Length; Inc += LEX_BLOCK)
+	{
+		const uint8x16_t Block = vld1q_u8(Buffer + Inc);
+		const unsigned long Ends = ConfigLex_NeonMask(vorrq_u8(vceqq_u8(Block, Newline), vceqq_u8(Block, Zero)));
+		const unsigned long Seps = ConfigLex_NeonMask(vorrq_u8(vorrq_u8(vceqq_u8(Block, Space), vceqq_u8(Block, Tab)),
+																vceqq_u8(Block, Equals)));
+		
+		Masks->Ends[Inc / LEX_WORDBITS] |= Ends << (Inc % LEX_WORDBITS);
+		Masks->Seps[Inc / LEX_WORDBITS] |= Seps << (Inc % LEX_WORDBITS);
+		High = vorrq_u8(High, Block);
+	}
+	
+	if (vmaxvq_u8(High) & 0x80) Masks->HighBit = true;
+	
+	return Inc;
+}
+#endif
+
+static unsigned long ConfigLex_LowBit(unsigned long Bits)
+{ /*Bits is never zero.*/
+#ifdef __GNUC__
+	return __builtin_ctzl(Bits);
+#else
+	unsigned long Bit = 0;
+	
+	for (; !(Bits & 1); Bits >>= 1) ++Bit;
+	
+	return Bit;
+#endif
+}
+
+static unsigned long ConfigLex_Next(const unsigned long *Mask, unsigned long Words, unsigned long Pos)
+{ /*The first set bit at or after Pos, or Words * LEX_WORDBITS if there's none.*/
+	unsigned long Word = Pos / LEX_WORDBITS, Bits;
+	
+	if (Word >= Words) return Words * LEX_WORDBITS;
+	
+	for (Bits = Mask[Word] & (~0UL << (Pos % LEX_WORDBITS)); !Bits; Bits = Mask[Word])
+	{
+		if (++Word == Words) return Words * LEX_WORDBITS;
+	}
+	
+	return Word * LEX_WORDBITS + ConfigLex_LowBit(Bits);
+}
+
+static struct _ConfigToken *ConfigLex_Add(struct _ConfigLex *Out, unsigned long *Capacity)
+{
+	struct _ConfigToken *NewTokens = NULL;
+	
+	if (Out->TokenCount == *Capacity)
+	{
+		if (!(NewTokens = realloc(Out->Tokens, sizeof(struct _ConfigToken) * *Capacity * 2))) return NULL;
+		
+		Out->Tokens = NewTokens;
+		*Capacity *= 2;
+	}
+	
+	memset(Out->Tokens + Out->TokenCount, 0, sizeof(struct _ConfigToken));
+	
+	return Out->Tokens + Out->TokenCount++;
+}
+
+rStatus ConfigLex(char *Buffer, unsigned long Length, struct _ConfigLex *Out, Bool Scalar)
+{ /*Buffer must have a NUL at Length. Scalar skips the vector code, for epochbench to compare against.*/
+	struct _LexMasks Masks;
+	struct _ConfigToken *Token = NULL;
+	unsigned long Capacity = Length / 32 + 16, LineStart = 0, LineEnd, NameEnd, Worker, ValueEnd, LineNum = 1;
+	Bool LastLine = false, OutOfMemory = false;
+	
+	memset(Out, 0, sizeof(struct _ConfigLex));
+	memset(&Masks, 0, sizeof Masks);
+	Out->Buffer = Buffer;
+	
+	/*The NUL at Length gets classified too, so the last line always has an end.*/
+	Masks.Words = (Length + 1 + LEX_WORDBITS - 1) / LEX_WORDBITS;
+	
+	if (!(Masks.Ends = calloc(Masks.Words * 2, sizeof(long))) ||
+		!(Out->Tokens = malloc(sizeof(struct _ConfigToken) * Capacity)))
+	{
+		free(Masks.Ends);
+		return FAILURE;
+	}
+	
+	Masks.Seps = Masks.Ends + Masks.Words;
+	
+#if defined(CONFIGLEX_SSE2) || defined(CONFIGLEX_NEON)
+	if (!Scalar) Worker = ConfigLex_ClassifyVector((const unsigned char*)Buffer, Length + 1, &Masks);
+	else Worker = 0;
+#else
+	Worker = 0;
+#endif
+	ConfigLex_ClassifyScalar((const unsigned char*)Buffer, Worker, Length + 1, &Masks);
+	
+	Out->HighBit = Masks.HighBit;
+	
+	for (; !LastLine; LineStart = LineEnd + 1, ++LineNum)
+	{
+		LineEnd = ConfigLex_Next(Masks.Ends, Masks.Words, LineStart);
+		LastLine = (Buffer[LineEnd] == '\0');
+		
+		/*Allow whitespace to precede a line in case people want to create a block-styled appearance.*/
+		for (Worker = LineStart; Buffer[Worker] == ' ' || Buffer[Worker] == '\t'; ++Worker);
+		
+		/**Multi-line comments run from a line starting with >!> to a line starting with <!<.
+		 * Whatever's after the <!< on that line is read as a line of its own.**/
+		if (!strncmp(Buffer + Worker, "<!<", strlen("<!<")))
+		{
+			if (!Out->OpenComment)
+			{ /*ParseConfigStream() warns about these, so it's in order with everything else.*/
+				if (!(Token = ConfigLex_Add(Out, &Capacity)))
+				{
+					OutOfMemory = true;
+					break;
+				}
+				
+				Token->Type = CONFIGTOKEN_STRAYEND;
+				Token->Name = Worker;
+				Token->LineNum = LineNum;
+				continue;
+			}
+			
+			Out->OpenComment = false;
+			
+			for (Worker += strlen("<!<"); Buffer[Worker] == ' ' || Buffer[Worker] == '\t'; ++Worker);
+		}
+		else if (Out->OpenComment)
+		{
+			continue;
+		}
+		else if (!strncmp(Buffer + Worker, ">!>", strlen(">!>")))
+		{
+			Out->OpenComment = true;
+			continue;
+		}
+		
+		/*Empty line, or a single-line comment.*/
+		if (Worker == LineEnd || Buffer[Worker] == '#') continue;
+		
+		if (!(Token = ConfigLex_Add(Out, &Capacity)))
+		{
+			OutOfMemory = true;
+			break;
+		}
+		
+		if ((NameEnd = ConfigLex_Next(Masks.Seps, Masks.Words, Worker)) > LineEnd) NameEnd = LineEnd;
+		
+		Token->Type = CONFIGTOKEN_ATTRIBUTE;
+		Token->Name = Worker;
+		Token->NameLength = NameEnd - Worker;
+		Token->LineNum = LineNum;
+		
+		if (NameEnd == LineEnd) continue; /*No value at all, which is different from an empty one.*/
+		
+		/*We give the choice of using whitespace or using an equals sign. It's only nice.*/
+		if (Buffer[NameEnd] == '=') Worker = NameEnd + 1;
+		else for (Worker = NameEnd; Buffer[Worker] == ' ' || Buffer[Worker] == '\t'; ++Worker);
+		
+		ValueEnd = LineEnd - Worker > MAX_LINE_SIZE - 1 ? Worker + MAX_LINE_SIZE - 1 : LineEnd;
+		
+		while (ValueEnd > Worker && (Buffer[ValueEnd - 1] == ' ' || Buffer[ValueEnd - 1] == '\t')) --ValueEnd;
+		
+		Buffer[ValueEnd] = '\0';
+		Token->Value = Worker;
+	}
+	
+	free(Masks.Ends);
+	
+	if (OutOfMemory)
+	{
+		ConfigLex_Release(Out);
+		return FAILURE;
+	}
+	
+	return SUCCESS;
+}
+
+void ConfigLex_Release(struct _ConfigLex *Lex)
+{
+	free(Lex->Tokens);
+	memset(Lex, 0, sizeof(struct _ConfigLex));
+}
@@ -14,6 +14,7 @@
 /*Limits and stuff.*/
 #define MAX_DESCRIPT_SIZE 384
 #define MAX_LINE_SIZE 2048
+#define MAX_RUNLEVELS 64 /*Distinct runlevel names we can track. Each object gets one bit per.*/
 
 /*Configuration.*/
 
@@ -35,7 +36,19 @@
 #endif
 
 #define CONF_NAME "epoch.conf"
+#define CONFIGCACHE_SUFFIX ".cache" /*Appended to the config file's path for "epoch compileconfig".*/
+#define OVERLAY_SUFFIX ".state" /*Appended to the config file's path for the runtime state journal.*/
+#define OVERLAY_COMPACT_AT 128 /*Records in the state journal before we rewrite it.*/
 #define LOGFILE_NAME "system.log"
+#define LOG_BUFFER_SIZE 16384 /*Bytes of log lines we hold before writing them out.*/
+#define LOG_FLUSH_INTERVAL 1 /*Most seconds a log line waits to be written.*/
+#define LOGROTATE_DEFAULT_KEEP 5 /*Rotated system.logs kept, unless LogRotateKeep says otherwise.*/
+#define LOGSTORE_DIR LOGDIR "epochlog/" /*Where the structured log store keeps its segments.*/
+#define LOGSTORE_SEGMENT_SIZE (1024 * 1024) /*A segment gets sealed and indexed once it's this big.*/
+#define LOGSTORE_MAX_SEGMENTS 64 /*Oldest ones past this get deleted.*/
+#define LOGSTORE_MARK_SPACING 16384 /*Bytes between seek points in a segment's index.*/
+#define MEMLOG_PAGE_SIZE 4096 /*The in-memory boot log grows a page of this many bytes at a time.*/
+#define MEMLOG_DEFAULT_LIMIT (256 * 1024) /*Bytes it may hold before the oldest page goes. MemLogLimit changes it.*/
 
 /*Environment variables.*/
 #ifndef ENVVAR_HOME
@@ -86,7 +99,7 @@
 /*The key for the shared memory bus and related stuff.*/
 #define MEMKEY (('E' + 'P' + 'O' + 'C' + 'H') + ('W'+'h'+'i'+'t'+'e' + 'R'+'a'+'t')) * 7 /*Cool, right?*/
 
-#define MEMBUS_SIZE 4096 + sizeof(long) * 2
+#define MEMBUS_SIZE 4096 /*The server and client halves. Each is a status byte, then up to MEMBUS_MSGSIZE.*/
 #define MEMBUS_MSGSIZE 2047
 
 /*The codes that are sent over the bus.*/
@@ -117,7 +130,6 @@
 #define MEMBUS_CODE_OBJENABLE "OBJENABLE"
 #define MEMBUS_CODE_OBJDISABLE "OBJDISABLE"
 #define MEMBUS_CODE_OBJRELOAD "OBJRELOAD"
-#define MEMBUS_CODE_OBJRLS "OBJRLS" /*Generic way to detect if we are using one of the OBJRLS commands below.*/
 #define MEMBUS_CODE_OBJRLS_CHECK "OBJRLS_CHECK"
 #define MEMBUS_CODE_OBJRLS_ADD "OBJRLS_ADD"
 #define MEMBUS_CODE_OBJRLS_DEL "OBJRLS_DEL"
@@ -127,9 +139,62 @@
 #define MEMBUS_CODE_SENDPID "SENDPID"
 #define MEMBUS_CODE_LSOBJS "LSOBJS"
 #define MEMBUS_CODE_RXD "RXD"
-#define MEMBUS_CODE_RXD_OPTS "ORXD"
+#define MEMBUS_CODE_RXD_OPTS "ORXD" /*Only spoken by Epochs from before the RXD state memfd.*/
+#define MEMBUS_CODE_JOBSTAT "JOBSTAT"
+#define MEMBUS_CODE_JOBWAIT "JOBWAIT"
+#define MEMBUS_CODE_JOBCANCEL "JOBCANCEL"
+#define MEMBUS_CODE_JOBLIST "JOBLIST"
+#define MEMBUS_CODE_TAIL "TAIL"
+#define MEMBUS_CODE_BATCH "BATCH"
+#define MEMBUS_CODE_PENDING "PENDING"
+#define MEMBUS_CODE_CANCELLED "CANCELLED"
 
 #define MEMBUS_LSOBJS_VERSION "V2"
+
+/*The framed binary protocol. The magic byte has the high bit set, so it can never begin a text request.
+ * A frame is the magic, the opcode, the payload length (short), and the request ID (long),
+ * followed by TLV arguments: type, value length (short), value.*/
+#define MEMBUS_FRAME_MAGIC 0xEB
+#define MEMBUS_FRAME_HEADSIZE (4 + sizeof(long))
+#define MEMBUS_TLV_HEADSIZE 3
+#define MEMBUS_MAX_ARGS 2
+
+/*The event stream. Event frames are laid out like membus frames, but start with their own magic,
+ * carry the event type where the opcode goes and the event's sequence number where the request ID goes.*/
+#define EVENTS_SOCKNAME "epoch-events"
+#define EVENTS_FRAME_MAGIC 0xEE
+#define EVENTS_QUEUE_SIZE 64
+#define EVENTS_MAX_SUBSCRIBERS 16
+#define EVENTS_MAX_FILTERS 64
+#define EVENTS_SUBSCRIBE_TIMEOUT 5 /*Seconds a new connection has to send its filter before we hang up.*/
+
+/*Captured object output. Each stream is a pipe we keep both ends of, so it outlives the object's process.*/
+#define CAPTURE_MAX_STREAMS 128
+#define CAPTURE_READ_BUDGET 65536 /*Most bytes we take from one stream per trip through the primary loop.*/
+#define CAPTURE_DEFAULT_RATE 100 /*Lines per second per stream, unless CaptureRateLimit says otherwise.*/
+#define TAIL_DEFAULT_SIZE (16 * 1024) /*Bytes of recent output "epoch tail" keeps per object.*/
+#define TAIL_DEFAULT_LIMIT (1024 * 1024) /*Bytes all of those together can take.*/
+
+/*The built in syslog receiver.*/
+#ifndef SYSLOG_SOCKET
+#define SYSLOG_SOCKET "/dev/log"
+#endif
+#define SYSLOG_BATCH 32 /*Datagrams per recvmmsg().*/
+#define SYSLOG_MAX_ROUNDS 8 /*recvmmsg() calls per trip through the primary loop.*/
+#define SYSLOG_MAX_DATAGRAM MAX_LINE_SIZE /*Anything longer gets cut off.*/
+#define SYSLOG_RATE_SLOTS 32 /*Programs we keep separate rate limits for at once.*/
+#define SYSLOG_DEFAULT_RATE 200 /*Messages per second per program, unless SyslogRateLimit says otherwise.*/
+#define SYSLOG_ALL_FACILITIES 0xFFFFFFul /*Facilities 0 through 23, kern through local7.*/
+
+/*The kill phase at the end of shutdown.*/
+#define KILLALL_DEFAULT_TIMEOUT 5 /*Seconds between SIGTERM and SIGKILL, unless ShutdownKillTimeout says otherwise.*/
+
+/*Reexec state handoff. The old image writes everything into a memfd that survives execve(),
+ * and tells the new one which descriptor through RXD_STATE_ENVVAR.*/
+#define RXD_STATE_MAGIC "EPOCHRXD"
+#define RXD_STATE_VERSION 1
+#define RXD_STATE_ENVVAR "EPOCHRXDSTATE"
+#define RXD_MAX_DESCRIPTORS (EVENTS_MAX_SUBSCRIBERS + 1 + CAPTURE_MAX_STREAMS * 2 + 1)
 /**Types, enums, structs and whatnot**/
 
 
@@ -145,6 +210,56 @@ enum _StopMode { STOP_NONE, STOP_COMMAND, STOP_PID, STOP_PIDFILE, STOP_INVALID }
 enum { COPT_HALTONLY = 1, COPT_PERSISTENT, COPT_FORK, COPT_SERVICE, COPT_AUTORESTART,
 		COPT_FORCESHELL, COPT_NOSTOPWAIT, COPT_STOPTIMEOUT, COPT_TERMSIGNAL,
 		COPT_RAWDESCRIPTION, COPT_PIVOTROOT, COPT_EXEC, COPT_MAX };
+
+/*Opcodes for the framed membus protocol. Keep these in the same order as MemBusCommands in membus.c.*/
+enum _MemBusOpcode { MEMBUS_OP_NONE, MEMBUS_OP_RESET, MEMBUS_OP_OBJSTART, MEMBUS_OP_OBJSTOP,
+					MEMBUS_OP_OBJENABLE, MEMBUS_OP_OBJDISABLE, MEMBUS_OP_OBJRELOAD, MEMBUS_OP_OBJRLS_CHECK,
+					MEMBUS_OP_OBJRLS_ADD, MEMBUS_OP_OBJRLS_DEL, MEMBUS_OP_RUNLEVEL, MEMBUS_OP_GETRL,
+					MEMBUS_OP_KILLOBJ, MEMBUS_OP_SENDPID, MEMBUS_OP_LSOBJS, MEMBUS_OP_RXD, MEMBUS_OP_HALT,
+					MEMBUS_OP_POWEROFF, MEMBUS_OP_REBOOT, MEMBUS_OP_ABORTHALT, MEMBUS_OP_CADON,
+					MEMBUS_OP_CADOFF, MEMBUS_OP_JOBSTAT, MEMBUS_OP_JOBWAIT, MEMBUS_OP_JOBCANCEL,
+					MEMBUS_OP_JOBLIST, MEMBUS_OP_BATCH, MEMBUS_OP_TAIL, MEMBUS_OP_MAX };
+
+/*TLV argument types. Strings are sent with their null terminator.
+ * JOBID is a long, and JOBINFO is a long job ID, the opcode, state and status bytes, then the target string.
+ * BATCHOP is the word for the batch operation, and PATTERNS the space separated globs it applies to.
+ * BATCHRESULT is a status byte followed by the object ID, one per object in the batch.*/
+enum _MemBusTLV { MEMBUS_TLV_NONE, MEMBUS_TLV_STATUS, MEMBUS_TLV_OBJECTID, MEMBUS_TLV_RUNLEVEL,
+				MEMBUS_TLV_PID, MEMBUS_TLV_TIME, MEMBUS_TLV_VALUE, MEMBUS_TLV_JOBID, MEMBUS_TLV_JOBINFO,
+				MEMBUS_TLV_BATCHOP, MEMBUS_TLV_PATTERNS, MEMBUS_TLV_BATCHRESULT, MEMBUS_TLV_OPTION, MEMBUS_TLV_MAX };
+
+/*What a BATCH request does to each object it matches.*/
+enum _ConfigChange { CONFIGCHANGE_ADDED = 1 << 0, CONFIGCHANGE_REMOVED = 1 << 1, CONFIGCHANGE_COMMANDS = 1 << 2,
+					CONFIGCHANGE_CREDENTIALS = 1 << 3, CONFIGCHANGE_RUNLEVELS = 1 << 4, CONFIGCHANGE_ENABLED = 1 << 5 };
+enum _ReloadAction { RELOADACT_NONE, RELOADACT_START, RELOADACT_STOP, RELOADACT_RESTART };
+enum _LogSync { LOGSYNC_NONE, LOGSYNC_BATCH, LOGSYNC_LINE };
+/*The same numbers syslog uses.*/
+enum _LogSeverity { LOGSEV_EMERG, LOGSEV_ALERT, LOGSEV_CRIT, LOGSEV_ERR, LOGSEV_WARNING, LOGSEV_NOTICE, LOGSEV_INFO, LOGSEV_DEBUG };
+enum _ConfigTokenType { CONFIGTOKEN_ATTRIBUTE, CONFIGTOKEN_STRAYEND };
+enum _BatchOp { BATCH_START, BATCH_STOP, BATCH_RESTART, BATCH_RELOAD, BATCH_ENABLE, BATCH_DISABLE, BATCH_MAX };
+
+/*Event types. VALUE is the PID for STARTED and READY, the raw wait() status for EXITED,
+ * and how many events were lost for DROPPED. EVENT_NONE frames are the subscribe handshake.*/
+enum _EpochEventType { EVENT_NONE, EVENT_STARTED, EVENT_READY, EVENT_EXITED, EVENT_RESTARTED,
+						EVENT_STOPPED, EVENT_RUNLEVEL, EVENT_CONFIGRELOAD, EVENT_DROPPED, EVENT_MAX };
+
+/*Reply status. The first three line up with rStatus.*/
+enum _MemBusStatus { MEMBUS_STATUS_FAILURE, MEMBUS_STATUS_OK, MEMBUS_STATUS_WARNING,
+					MEMBUS_STATUS_BADPARAM, MEMBUS_STATUS_BADREPLY, MEMBUS_STATUS_PENDING,
+					MEMBUS_STATUS_CANCELLED };
+
+/*Which of an object's commands is being run, for LaunchObjectCommand() and CompleteObjectCommand().*/
+enum _ObjCommand { OBJCMD_START, OBJCMD_PRESTART, OBJCMD_STOP, OBJCMD_RELOAD };
+
+/*Where a job is in its state machine. See jobs.c.*/
+enum _JobState { JOBSTATE_QUEUED, JOBSTATE_PRESTART, JOBSTATE_START, JOBSTATE_PIDFILEWAIT,
+				JOBSTATE_STOPCMD, JOBSTATE_STOPWAIT, JOBSTATE_RELOAD, JOBSTATE_RLSTOP,
+				JOBSTATE_RLSTART, JOBSTATE_BATCH, JOBSTATE_DONE };
+
+/*Records in the reexec state. Each is a long type and a long length, then the data, padded to a long.*/
+enum _RXDRecord { RXD_REC_END, RXD_REC_OBJECT, RXD_REC_HALTPARAMS, RXD_REC_GLOBALS, RXD_REC_RUNLEVEL,
+				RXD_REC_MEMLOG, RXD_REC_JOBCOUNTER, RXD_REC_JOB, RXD_REC_EVENTS,
+				RXD_REC_SUBSCRIBER, RXD_REC_CAPTURE, RXD_REC_TAIL, RXD_REC_SYSLOG, RXD_REC_MAX };
 		
 /*Trinary return values for functions.*/
 typedef enum { FAILURE, SUCCESS, WARNING } rStatus;
@@ -153,36 +268,27 @@ typedef enum { FAILURE, SUCCESS, WARNING } rStatus;
 typedef enum { BOOT_NEUTRAL, BOOT_BOOTUP, BOOT_SHUTDOWN } BootMode;
 
 /**Structures go here.**/
-struct _RLTree
-{ /*Runlevel linked list.*/
-	char RL[MAX_DESCRIPT_SIZE];
-	
-	struct _RLTree *Prev;
-	struct _RLTree *Next;
+#define RLSET_WORDS ((MAX_RUNLEVELS + sizeof(long) * 8 - 1) / (sizeof(long) * 8))
+#define RLSET_HAS(Set, ID) ((Set).Bits[(ID) / (sizeof(long) * 8)] & (1UL << ((ID) % (sizeof(long) * 8))))
+#define RLSET_ADD(Set, ID) ((Set).Bits[(ID) / (sizeof(long) * 8)] |= (1UL << ((ID) % (sizeof(long) * 8))))
+#define RLSET_DEL(Set, ID) ((Set).Bits[(ID) / (sizeof(long) * 8)] &= ~(1UL << ((ID) % (sizeof(long) * 8))))
+
+struct _RLSet
+{ /*Runlevel membership. Bit N is the runlevel ObjRL_GetName(N) returns.*/
+	unsigned long Bits[RLSET_WORDS];
 };
 	
 typedef struct _EpochObjectTable
-{
-	unsigned long ObjectStartPriority;
-	unsigned long ObjectStopPriority;
+{ /*These live in one array, indexed by hash on ObjectID. See config.c.
+	* The fields the primary loop and priority scans touch come first, so they share cache lines.*/
 	unsigned long ObjectPID; /*The process ID, used for shutting down.*/
-	unsigned long UserID; /*The user ID we run this as. Zero, of course, is root and we need do nothing.*/
-	unsigned long GroupID; /*Same as above, but with groups.*/
 	unsigned long StartedSince; /*The time in UNIX seconds since it was started.*/
-	char *ObjectID; /*The ASCII ID given to this item by whoever configured Epoch.*/
-	char *ObjectDescription; /*The description of the object.*/
-	char *ObjectStartCommand; /*The command to be executed.*/
-	char *ObjectPrestartCommand; /*Run before ObjectStartCommand, if it exists.*/
-	char *ObjectStopCommand; /*How to shut it down.*/
-	char *ObjectReloadCommand; /*Used to reload an object without starting/stopping. Most services don't have this.*/
-	char *ObjectPIDFile; /*PID file location.*/
-	char *ObjectWorkingDirectory; /*The working directory the object chdirs to before execution.*/
-	char *ObjectStderr; /*A file that stderr redirects to.*/
-	char *ObjectStdout; /*A file that stdout redirects to.*/
-	unsigned char TermSignal; /*The signal we send to an object if it's stop mode is PID or PIDFILE.*/
-	unsigned char ReloadCommandSignal; /*If the reload command sends a signal, this works.*/
+	unsigned long ObjectStartPriority;
+	unsigned long ObjectStopPriority;
 	Bool Enabled;
 	Bool Started;
+	unsigned char TermSignal; /*The signal we send to an object if it's stop mode is PID or PIDFILE.*/
+	unsigned char ReloadCommandSignal; /*If the reload command sends a signal, this works.*/
 	
 	struct 
 	{
@@ -200,15 +306,36 @@ typedef struct _EpochObjectTable
 		unsigned int NoStopWait : 1; /*Used to tell us not to wait for an object to actually quit.*/
 		unsigned int PivotRoot : 1; /*Says that ObjectStartCommand is actually used to pivot_root. See actions.c.*/
 		unsigned int Exec : 1; /*Says that we are gerbils.*/
+		unsigned int CaptureStdout : 1; /*ObjectStdout CAPTURE. Output goes through a pipe to the log, see capture.c.*/
+		unsigned int CaptureStderr : 1; /*Same for ObjectStderr.*/
 #ifndef NOMMU
 		unsigned int Fork : 1; /*Essentially do the same thing (with an Epoch twist) as Command& in sh.*/
 #endif
 	} Opts;
 	
-	struct _RLTree *ObjectRunlevels; /*Dynamically allocated, needless to say.*/
+	char *ObjectID; /*The ASCII ID given to this item by whoever configured Epoch.*/
+	struct _RLSet ObjectRunlevels; /*Bits for interned runlevel names. See ObjRL_GetName().*/
+	
+	/*Cold. Only looked at when we actually run the object, or print it.*/
+	unsigned long UserID; /*The user ID we run this as. Zero, of course, is root and we need do nothing.*/
+	unsigned long GroupID; /*Same as above, but with groups.*/
+	char *ObjectDescription; /*The description of the object.*/
+	char *ObjectStartCommand; /*The command to be executed.*/
+	char *ObjectPrestartCommand; /*Run before ObjectStartCommand, if it exists.*/
+	char *ObjectStopCommand; /*How to shut it down.*/
+	char *ObjectReloadCommand; /*Used to reload an object without starting/stopping. Most services don't have this.*/
+	char *ObjectPIDFile; /*PID file location.*/
+	char *ObjectWorkingDirectory; /*The working directory the object chdirs to before execution.*/
+	char *ObjectStderr; /*A file that stderr redirects to.*/
+	char *ObjectStdout; /*A file that stdout redirects to.*/
+	
+	/*What epoch.conf says, before the state overlay. See overlay.c.*/
+	Bool ConfigEnabled;
+	unsigned long ConfigRunlevels; /*A hash of the runlevel list.*/
 	
-	struct _EpochObjectTable *Prev;
-	struct _EpochObjectTable *Next;
+	/*Set when InitConfig() only read the ObjectID, ObjectEnabled, ObjectOptions and ObjectRunlevels lines.
+	 * The token the rest of them start at in the kept config. Zero once Config_Materialize() has parsed them.*/
+	unsigned long ConfigDeferred;
 } ObjTable;
 
 struct _BootBanner
@@ -218,6 +345,23 @@ struct _BootBanner
 	char BannerColor[64];
 };
 
+struct _MemLogPage
+{
+	struct _MemLogPage *Next;
+	unsigned long Used;
+	unsigned long Lines;
+	char Data[MEMLOG_PAGE_SIZE];
+};
+
+struct _MemLog
+{ /*Log lines from before we can write to disk. Limit is in bytes, 0 for no limit.*/
+	struct _MemLogPage *Head, *Tail;
+	unsigned long Pages;
+	unsigned long Size;
+	unsigned long Limit;
+	unsigned long DroppedLines, DroppedBytes;
+};
+
 struct _HaltParams
 {
 	signed long HaltMode;
@@ -241,8 +385,9 @@ struct _CTask
 struct _MemBusInterface
 {
 	void *Root;
+	void *Lock; /*A robust pthread_mutex_t in the segment. See membus.c.*/
 	unsigned long *LockPID;
-	unsigned long *LockTime;
+	unsigned long *LockSerial;
 	
 	struct
 	{
@@ -252,9 +397,128 @@ struct _MemBusInterface
 	} Server, Client;
 };
 
+struct _MemBusRequest
+{ /*A decoded membus request, whichever protocol it came in over.*/
+	unsigned char Opcode;
+	Bool Binary;
+	unsigned long RequestID;
+	const char *Args[MEMBUS_MAX_ARGS]; /*NULL if not given.*/
+	char Text[MEMBUS_MSGSIZE]; /*The original text request, echoed back in text replies.*/
+	char ArgBuf[MEMBUS_MSGSIZE];
+};
+
+struct _BatchEntry
+{ /*One object in a batch job.*/
+	char ObjectID[MAX_DESCRIPT_SIZE];
+	unsigned long Priority[2]; /*Stop, then start priority.*/
+	unsigned long SubJobID;
+	unsigned char Stage; /*0 still needs stopping, 1 still needs starting (or reloading), 2 done.*/
+	unsigned char Status;
+	Bool StartAfterStop; /*For restarts. Goes on to stage 1 if the stop worked.*/
+};
+
+struct _ConfigDiff
+{ /*One object that changed in a config reload, and what ReloadConfig() thinks should happen to it.*/
+	char ObjectID[MAX_DESCRIPT_SIZE];
+	unsigned char Changes; /*CONFIGCHANGE_* flags.*/
+	unsigned char Action; /*enum _ReloadAction*/
+};
+
+struct _EpochJob
+{ /*A start, stop, reload or runlevel switch that runs across many passes of the primary loop.*/
+	unsigned long JobID;
+	unsigned long ParentJobID; /*Set for the per-object jobs a runlevel job spawns.*/
+	unsigned char Opcode; /*The membus opcode that asked for this.*/
+	unsigned char State;
+	unsigned char Status; /*MEMBUS_STATUS_PENDING until we are done.*/
+	char Target[MAX_DESCRIPT_SIZE]; /*Object ID, or runlevel. We never hold pointers into the object table.*/
+	
+	unsigned long ChildPID; /*The command we are waiting on, if any.*/
+	int RawExitStatus;
+	Bool ChildExited;
+	Bool ShellDissolves;
+	rStatus PrestartStatus;
+	rStatus Result; /*What we'll report if nothing else goes wrong.*/
+	
+	unsigned long WaitPID; /*The PID we wait to die when stopping. Zero means check the object itself.*/
+	unsigned long Deadline;
+	Bool SavedAutoRestart;
+	Bool Stopping;
+	Bool PrintStatus;
+	Bool Cancelled;
+	unsigned long Finished;
+	char StatusReport[MAX_DESCRIPT_SIZE + 16]; /*What we print to the console, if PrintStatus is set.*/
+	
+	/*Runlevel jobs walk the priorities one object at a time.*/
+	unsigned long Priority;
+	unsigned long SubJobID;
+	char LastObjectID[MAX_DESCRIPT_SIZE];
+	
+	/*Batch jobs run one priority at a time, everything within a priority at once.*/
+	unsigned char BatchOp;
+	unsigned long BatchCount;
+	struct _BatchEntry *Batch;
+	
+	struct
+	{ /*A client waiting on the result. Only answered if they still hold the membus.*/
+		Bool Set;
+		Bool Binary;
+		unsigned char Opcode;
+		unsigned long RequestID;
+		unsigned long LockSerial; /*Which client session it was.*/
+		char Text[MEMBUS_MSGSIZE];
+	} Waiter;
+	
+	struct _EpochJob *Next;
+};
+
+struct _ConfigToken
+{ /*One line of epoch.conf that says something. Offsets are into the buffer ConfigLex() was given.*/
+	unsigned char Type; /*enum _ConfigTokenType*/
+	unsigned long Name; /*Where the attribute name starts.*/
+	unsigned long NameLength;
+	unsigned long Value; /*NUL terminated in place. Zero if the line has no value at all.*/
+	unsigned long LineNum;
+};
+
+struct _ConfigLex
+{
+	char *Buffer;
+	struct _ConfigToken *Tokens;
+	unsigned long TokenCount;
+	Bool HighBit; /*Something in there isn't ASCII.*/
+	Bool OpenComment; /*A >!> that never got its <!<.*/
+};
+
+struct _ConfigImage
+{ /*The parts of a config outside ObjectTable, passed between config.c and configcache.c.*/
+	void *Base; /*The mapped cache file. Object strings point into it.*/
+	unsigned long Size;
+	unsigned long SourceHash; /*HashBytes() and length of the epoch.conf it came from.*/
+	unsigned long SourceLength;
+	unsigned long *Index; /*config.c's hash index on ObjectID.*/
+	unsigned long IndexSize;
+	unsigned long *Plan[2]; /*ObjectTable indices in stop and start priority order.*/
+	const char *Globals; /*The config lines that set global options. These get parsed as normal.*/
+	unsigned long GlobalsLength;
+};
+
+struct _RXDState
+{ /*The reexec state while we build it. Descriptors are dups without close-on-exec, so they get through.*/
+	unsigned char *Blob;
+	unsigned long Size;
+	unsigned long Capacity;
+	unsigned long LastRecord; /*Offset of the record RXD_Extend() adds to. Zero before the first one.*/
+	Bool Failed;
+	int Descriptors[RXD_MAX_DESCRIPTORS];
+	unsigned long NumDescriptors;
+};
+
 /**Globals go here.**/
 
 extern ObjTable *ObjectTable;
+extern unsigned long ObjectCount;
+extern struct _EpochJob *JobList;
 extern struct _BootBanner BootBanner;
 extern char CurRunlevel[MAX_DESCRIPT_SIZE];
 extern struct _MemBusInterface MemBus;
@@ -265,7 +529,9 @@ extern Bool AutoMountOpts[5];
 extern Bool EnableLogging;
 extern Bool LogInMemory;
 extern Bool BlankLogOnBoot;
-extern char *MemLogBuffer;
+extern struct _MemLog MemLog;
+extern unsigned char LogSyncPolicy;
+extern unsigned long LogRotateSize, LogRotateAge, LogRotateKeep;
 extern struct _CTask CurrentTask;
 extern BootMode CurrentBootMode;
 extern signed long MemBusKey;
@@ -274,45 +540,136 @@ extern char ConfigFile[MAX_LINE_SIZE];
 
 /**Function forward declarations.*/
 
+/*capture.c*/
+extern unsigned long CaptureRateLimit;
+extern int Capture_Descriptor(const ObjTable *InObj, Bool IsStderr);
+extern void Capture_Service(int Timeout);
+extern void Capture_Prune(void);
+extern void Capture_Shutdown(void);
+extern void Capture_SaveState(struct _RXDState *State);
+extern rStatus Capture_RestoreState(const void *Data, unsigned long Length);
+
 /*config.c*/
 extern rStatus InitConfig(void);
 extern void ShutdownConfig(void);
-extern rStatus ReloadConfig(void);
+extern rStatus ReloadConfig(unsigned long *ApplyJobID);
 extern ObjTable *LookupObjectInTable(const char *ObjectID);
 extern ObjTable *GetObjectByPriority(const char *ObjectRunlevel, ObjTable *LastNode,
 									Bool WantStartPriority, unsigned long ObjectPriority);
 extern unsigned long GetHighestPriority(Bool WantStartPriority);
-extern rStatus EditConfigValue(const char *ObjectID, const char *Attribute, const char *Value);
-extern void ObjRL_AddRunlevel(const char *InRL, ObjTable *InObj);
+extern rStatus Config_Materialize(ObjTable *CurObj);
+extern rStatus Config_MaterializeRunlevel(const char *InRL);
+extern Bool Config_MaterializeIdle(void);
+extern Bool ObjRL_AddRunlevel(const char *InRL, ObjTable *InObj);
 extern Bool ObjRL_CheckRunlevel(const char *InRL, const ObjTable *InObj, Bool CountInherited);
 extern Bool ObjRL_DelRunlevel(const char *InRL, ObjTable *InObj);
 extern Bool ObjRL_ValidRunlevel(const char *InRL);
-extern void ObjRL_ShutdownRunlevels(ObjTable *InObj);
+extern void ObjRL_ClearRunlevels(ObjTable *InObj);
+extern unsigned long ObjRL_CountRunlevels(const ObjTable *InObj);
+extern const char *ObjRL_GetName(unsigned long ID);
 extern char *WhitespaceArg(const char *InStream);
+extern rStatus CompileConfig(void);
+
+/*configcache.c*/
+extern rStatus ConfigCache_Write(const struct _ConfigImage *Image);
+extern Bool ConfigCache_Load(unsigned long SourceHash, unsigned long SourceLength, struct _ConfigImage *Out);
+extern void ConfigCache_Release(void *Base, unsigned long Size);
+
+/*configlex.c*/
+extern const char *const ConfigLexVector;
+extern rStatus ConfigLex(char *Buffer, unsigned long Length, struct _ConfigLex *Out, Bool Scalar);
+extern void ConfigLex_Release(struct _ConfigLex *Lex);
+
+/*logrotate.c*/
+extern void LogRotate_Spawn(void);
+
+/*logstore.c*/
+extern Bool LogStoreEnabled;
+extern Bool LogStore_Open(void);
+extern void LogStore_Add(const char *ObjectID, unsigned char Severity, const char *Message, unsigned long MessageLength);
+extern void LogStore_Flush(void);
+extern void LogStore_Close(void);
+extern void LogStore_ForkChild(void);
+extern rStatus LogStore_Query(const char *ObjectID, long Boot);
+
+/*overlay.c*/
+extern void Overlay_Load(void);
+extern rStatus Overlay_SaveEnabled(const ObjTable *CurObj);
+extern rStatus Overlay_SaveRunlevels(const ObjTable *CurObj);
 
 /*parse.c*/
 extern rStatus ProcessConfigObject(ObjTable *CurObj, Bool IsStartingMode, Bool PrintStatus);
 extern rStatus RunAllObjects(Bool IsStartingMode);
-extern rStatus SwitchRunlevels(const char *Runlevel);
 extern rStatus ProcessReloadCommand(ObjTable *CurObj, Bool PrintStatus);
+extern unsigned long LaunchObjectCommand(ObjTable *InObj, const char *CurCmd, unsigned char CmdKind, Bool *ShellDissolvesOut);
+extern rStatus CompleteObjectCommand(ObjTable *InObj, unsigned char CmdKind, unsigned long LaunchPID,
+									int RawExitStatus, Bool ShellDissolves);
+extern Bool FileUsable(const char *FileName);
+
+/*procscan.c*/
+extern void ProcScan_Hold(void);
+extern void ProcScan_Invalidate(void);
+extern void ProcScan_Unhold(void);
+extern rStatus ProcScan_Snapshot(void);
+extern unsigned long ProcScan_Count(void);
+extern unsigned long ProcScan_Entry(unsigned long Index, const char **CmdLine, unsigned long *Length);
+extern unsigned long ProcScan_Find(const char *Prefix, unsigned long MinPID);
+
+/*jobs.c*/
+extern unsigned long Jobs_Create(unsigned char Opcode, const char *Target, unsigned long ParentJobID);
+extern unsigned long Jobs_CreateBatch(unsigned char BatchOp, const char *Patterns);
+extern unsigned long Jobs_CreateApply(const struct _ConfigDiff *Diff, unsigned long DiffCount);
+extern unsigned char Jobs_BatchOpLookup(const char *Name);
+extern const char *Jobs_BatchOpName(unsigned char BatchOp);
+extern struct _EpochJob *Jobs_Lookup(unsigned long JobID);
+extern Bool Jobs_Cancel(unsigned long JobID);
+extern Bool Jobs_ChildExited(unsigned long PID, int RawExitStatus);
+extern Bool Jobs_ObjectBusy(const char *ObjectID);
+extern Bool Jobs_Running(void);
+extern void Jobs_SetWaiter(struct _EpochJob *Job, const struct _MemBusRequest *Req);
+extern void Jobs_Service(void);
+extern void Jobs_Shutdown(void);
+extern const char *Jobs_StateName(unsigned char State);
+extern void Jobs_SaveState(struct _RXDState *State);
+extern rStatus Jobs_RestoreState(unsigned char Type, const void *Data, unsigned long Length);
+
+/*events.c*/
+extern rStatus Events_Init(void);
+extern void Events_Shutdown(void);
+extern void Events_Emit(unsigned char Type, const char *Subject, long Value);
+extern void Events_Service(void);
+extern int Events_Connect(const char **ObjectIDs, unsigned long NumObjectIDs);
+extern const char *Events_TypeName(unsigned char Type);
+extern void Events_SaveState(struct _RXDState *State);
+extern rStatus Events_RestoreState(unsigned char Type, const void *Data, unsigned long Length);
 
 /*actions.c*/
 extern void LaunchBootup(void);
 extern void LaunchShutdown(signed long Signal);
+extern void PrimaryLoop(void);
 extern void EmergencyShell(void);
 extern void ReexecuteEpoch(void);
 extern void RecoverFromReexec(Bool ViaMemBus);
+extern void RXD_Append(struct _RXDState *State, unsigned char Type, const void *Data, unsigned long Length);
+extern void RXD_Extend(struct _RXDState *State, const void *Data, unsigned long Length);
+extern int RXD_AddDescriptor(struct _RXDState *State, int Descriptor);
 extern void PerformPivotRoot(const char *NewRoot, const char *OldRootDir);
 extern void FinaliseLogStartup(Bool BlankLog);
 extern void PerformExec(const char *Cmd_);
 
 
 /*modes.c*/
-extern rStatus SendPowerControl(const char *MembusCode);
+extern rStatus SendPowerControl(unsigned char Opcode);
 extern rStatus EmulKillall5(unsigned long InSignal);
 extern void EmulWall(const char *InStream, Bool ShowUser);
 extern rStatus EmulShutdown(long ArgumentCount, const char **ArgStream);
-extern rStatus ObjControl(const char *ObjectID, const char *MemBusSignal);
+extern rStatus ObjControl(const char *ObjectID, unsigned char Opcode);
+extern rStatus BatchControl(unsigned char BatchOp, const char **Patterns, unsigned long NumPatterns);
+extern rStatus ReloadControl(Bool ApplyChanges);
+
+/*killall.c*/
+extern unsigned long ShutdownKillTimeout;
+extern void KillAll_Run(void);
 
 /*membus.c*/
 extern rStatus InitMemBus(Bool ServerSide);
@@ -320,10 +677,29 @@ extern rStatus MemBus_Write(const char *InStream, Bool ServerSide);
 extern Bool MemBus_Read(char *OutStream, Bool ServerSide);
 extern void ParseMemBus(void);
 extern rStatus ShutdownMemBus(Bool ServerSide);
+extern Bool MemBus_LegacyPresent(signed long Key);
+extern rStatus MemBus_LegacyConnect(signed long Key);
+extern unsigned long MemBus_LegacyBinRead(void *OutStream, unsigned long MaxOutSize);
+extern rStatus MemBus_LegacyWrite(const char *InStream);
+extern Bool MemBus_LegacyEaten(void);
+extern void MemBus_LegacyDisconnect(void);
 extern Bool HandleMemBusPings(void);
 extern Bool CheckMemBusIntegrity(void);
 extern unsigned long MemBus_BinWrite(const void *InStream_, unsigned long DataSize, Bool ServerSide);
 extern unsigned long MemBus_BinRead(void *OutStream_, unsigned long MaxOutSize, Bool ServerSide);
+extern void MemBus_FrameInit(unsigned char *Frame, unsigned char Opcode, unsigned long RequestID);
+extern unsigned long MemBus_FrameSize(const unsigned char *Frame);
+extern Bool MemBus_FrameAdd(unsigned char *Frame, unsigned char Type, const void *Value, unsigned short ValueLength);
+extern Bool MemBus_FrameAddString(unsigned char *Frame, unsigned char Type, const char *Value);
+extern const void *MemBus_FrameGet(const unsigned char *Frame, unsigned char Type,
+								unsigned long Index, unsigned short *LengthOut);
+extern const char *MemBus_FrameGetString(const unsigned char *Frame, unsigned char Type, unsigned long Index);
+extern unsigned char MemBus_Transact(unsigned char *Frame);
+extern unsigned char MemBus_WaitJob(unsigned char *Frame);
+extern void MemBus_Reply(const struct _MemBusRequest *Req, unsigned char Status);
+extern void MemBus_ReplyBatch(const struct _MemBusRequest *Req, const struct _EpochJob *Job);
+extern void MemBus_ReplyValue(const struct _MemBusRequest *Req, unsigned char Status, const char *TextReply,
+							unsigned char ValueType, const void *Value, unsigned short ValueLength);
 
 /*console.c*/
 extern void PrintBootBanner(void);
@@ -334,6 +710,25 @@ extern void SpitWarning(const char *INWarning);
 extern void SpitError(const char *INErr);
 extern void SmallError(const char *INErr);
 
+/*syslog.c*/
+extern Bool SyslogReceiver;
+extern unsigned char SyslogSeverity;
+extern unsigned long SyslogFacilities, SyslogRateLimit;
+extern Bool Syslog_ParseSeverity(const char *Name, unsigned char *Out);
+extern Bool Syslog_ParseFacilities(const char *List, unsigned long *Out);
+extern void Syslog_Service(void);
+extern void Syslog_Shutdown(void);
+extern void Syslog_SaveState(struct _RXDState *State);
+extern rStatus Syslog_RestoreState(const void *Data, unsigned long Length);
+
+/*tail.c*/
+extern unsigned long TailBufferSize, TailMemoryLimit;
+extern void Tail_Append(const char *ObjectID, const char *Line, unsigned long Length);
+extern void Tail_Exited(const char *ObjectID, int RawExitStatus);
+extern unsigned long Tail_Read(const char *ObjectID, unsigned long Offset, char *Out, unsigned long OutSize);
+extern void Tail_SaveState(struct _RXDState *State);
+extern rStatus Tail_RestoreState(const void *Data, unsigned long Length);
+
 /*utilfuncs.c*/
 extern void GetCurrentTime(char *OutHr, char *OutMin, char *OutSec, char *OutYear, char *OutMonth, char *OutDay);
 extern unsigned long DateDiff(unsigned long InHr, unsigned long InMin, unsigned long *OutMonth,
@@ -346,6 +741,17 @@ extern Bool AllNumeric(const char *InStream);
 extern Bool ObjectProcessRunning(const ObjTable *InObj);
 extern unsigned long ReadPIDFile(const ObjTable *InObj);
 extern rStatus WriteLogLine(const char *InStream, Bool AddDate);
+extern rStatus WriteObjectLogLine(const char *Source, unsigned char Severity, const char *Line, unsigned long Length);
+extern Bool Log_Open(Bool Truncate);
+extern rStatus Log_Write(const char *Data, unsigned long Length);
+extern void Log_Flush(void);
+extern void Log_Service(void);
+extern void Log_Shutdown(void);
+extern void Log_SetObject(const char *ObjectID);
+extern void MemLog_Append(const char *Data, unsigned long Length);
+extern rStatus MemLog_WriteOut(void);
+extern void MemLog_Release(void);
+extern unsigned long HashBytes(const char *InStream, unsigned long Length);
 unsigned long AdvancedPIDFind(ObjTable *InObj, Bool UpdatePID);
 
 
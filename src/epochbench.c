@@ -0,0 +1,438 @@
+/*This code is part of the Epoch Init System.
+* The Epoch Init System is maintained by Subsentient.
+* This software is public domain.
+* Please read the file UNLICENSE.TXT for more information.*/
+
+/**epochbench times the membus control plane. It runs Epoch's real primary loop
+ * in a child process on a private membus key, hands it a generated configuration
+ * with however many objects we ask for, and then hammers it with synthetic clients.
+ * Before that, it times the config lexer on the same file, vector code against scalar.
+ * Everything is printed as one JSON object per line, so it can be diffed or graphed.
+ * Build it with buildepoch.sh --benchmarks. It does not need to be PID 1 or root.**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/shm.h>
+#include <sys/wait.h>
+#include "epoch.h"
+
+#define BENCH_DEFAULT_OBJECTS "10,100,1000,10000"
+#define BENCH_DEFAULT_SAMPLES 50
+#define BENCH_DEFAULT_BUDGET 10 /*Most seconds we spend on any one latency measurement.*/
+#define BENCH_DEFAULT_DURATION 3 /*Seconds for the throughput run.*/
+#define BENCH_SERVER_TIMEOUT 10
+#define BENCH_LEX_ROUNDS 20 /*Best of this many for each ConfigLex() timing.*/
+
+static unsigned long NumSamples = BENCH_DEFAULT_SAMPLES;
+static unsigned long Budget = BENCH_DEFAULT_BUDGET;
+static unsigned long Duration = BENCH_DEFAULT_DURATION;
+static double *SampleBuf;
+static Bool ConfigOnly;
+
+static double BenchTime(void)
+{
+	struct timeval Time;
+	
+	gettimeofday(&Time, NULL);
+	
+	return Time.tv_sec + Time.tv_usec / 1000000.0;
+}
+
+static int BenchCompare(const void *A_, const void *B_)
+{
+	const double *A = A_, *B = B_;
+	
+	return *A < *B ? -1 : *A > *B;
+}
+
+static void BenchReport(const char *Bench, unsigned long NumObjects, unsigned long Count)
+{ /*Sorts the samples and prints percentiles in microseconds.*/
+	double Total = 0.0;
+	unsigned long Inc = 0;
+	
+	if (Count == 0)
+	{
+		printf("{\"bench\":\"%s\",\"objects\":%lu,\"samples\":0,\"error\":\"no successful samples\"}\n", Bench, NumObjects);
+		fflush(stdout);
+		return;
+	}
+	
+	qsort(SampleBuf, Count, sizeof(double), BenchCompare);
+	
+	for (; Inc < Count; ++Inc) Total += SampleBuf[Inc];
+	
+	printf("{\"bench\":\"%s\",\"objects\":%lu,\"samples\":%lu,\"min_us\":%.1f,\"mean_us\":%.1f,"
+			"\"p50_us\":%.1f,\"p90_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f}\n",
+			Bench, NumObjects, Count, SampleBuf[0] * 1e6, Total / Count * 1e6, SampleBuf[Count * 50 / 100] * 1e6,
+			SampleBuf[Count * 90 / 100] * 1e6, SampleBuf[Count * 99 / 100] * 1e6, SampleBuf[Count - 1] * 1e6);
+	fflush(stdout);
+}
+
+static rStatus BenchWriteConfig(const char *Path, unsigned long NumObjects)
+{
+	FILE *Descriptor = fopen(Path, "w");
+	unsigned long Inc = 0;
+	
+	if (!Descriptor) return FAILURE;
+	
+	fprintf(Descriptor, "DefaultRunlevel bench\nEnableLogging false\nDisableCAD true\n\n");
+	
+	for (; Inc < NumObjects; ++Inc)
+	{
+		fprintf(Descriptor, "ObjectID bench%lu\nObjectDescription Benchmark object %lu\n"
+				"ObjectStartCommand /bin/true\nObjectStopCommand NONE\n"
+				"ObjectStartPriority %lu\nObjectStopPriority %lu\nObjectRunlevels bench\nObjectEnabled true\n\n",
+				Inc, Inc, Inc % 10 + 1, Inc % 10 + 1);
+	}
+	
+	fclose(Descriptor);
+	return SUCCESS;
+}
+
+static double BenchLexOnce(const char *Source, char *Buffer, unsigned long Length, Bool Scalar)
+{ /*ConfigLex() writes to the buffer, so every round starts from a fresh copy. The copy isn't timed.*/
+	struct _ConfigLex Lex;
+	double Start;
+	
+	memcpy(Buffer, Source, Length + 1);
+	
+	Start = BenchTime();
+	
+	if (!ConfigLex(Buffer, Length, &Lex, Scalar)) return -1.0;
+	
+	Start = BenchTime() - Start;
+	ConfigLex_Release(&Lex);
+	
+	return Start;
+}
+
+static void BenchLex(unsigned long NumObjects, const char *ConfPath)
+{ /*Times the epoch.conf lexer on its own, with and without the vector code.*/
+	FILE *Descriptor = fopen(ConfPath, "r");
+	char *Source = NULL, *Buffer = NULL;
+	double Best[2] = { -1.0, -1.0 }, Time;
+	unsigned long Length = 0, Inc = 0;
+	
+	if (!Descriptor) return;
+	
+	fseek(Descriptor, 0, SEEK_END);
+	Length = ftell(Descriptor);
+	rewind(Descriptor);
+	
+	if (!(Source = malloc(Length + 1)) || !(Buffer = malloc(Length + 1)) || fread(Source, 1, Length, Descriptor) != Length)
+	{
+		fclose(Descriptor);
+		free(Source);
+		free(Buffer);
+		return;
+	}
+	
+	fclose(Descriptor);
+	Source[Length] = '\0';
+	
+	for (; Inc < BENCH_LEX_ROUNDS * 2; ++Inc)
+	{ /*Alternate, so neither one gets a warmer cache.*/
+		if ((Time = BenchLexOnce(Source, Buffer, Length, Inc & 1)) < 0.0) break;
+		
+		if (Best[Inc & 1] < 0.0 || Time < Best[Inc & 1]) Best[Inc & 1] = Time;
+	}
+	
+	if (Best[0] > 0.0 && Best[1] > 0.0)
+	{
+		printf("{\"bench\":\"config_lex\",\"objects\":%lu,\"bytes\":%lu,\"vector\":\"%s\",\"us\":%.1f,\"scalar_us\":%.1f,"
+				"\"mb_per_s\":%.1f,\"scalar_mb_per_s\":%.1f}\n", NumObjects, Length, ConfigLexVector, Best[0] * 1e6, Best[1] * 1e6,
+				Length / Best[0] / 1e6, Length / Best[1] / 1e6);
+		fflush(stdout);
+	}
+	
+	free(Source);
+	free(Buffer);
+}
+
+static pid_t BenchStartServer(void)
+{ /*The child becomes an Epoch that just sits in the primary loop. We become a client of it.*/
+	pid_t ServerPID = fork();
+	double Start;
+	
+	if (ServerPID == -1) return -1;
+	
+	if (ServerPID == 0)
+	{
+		freopen("/dev/null", "w", stdout); /*Keep our output machine readable.*/
+		
+		if (!InitMemBus(true)) _exit(1);
+		
+		PrimaryLoop();
+		_exit(0);
+	}
+	
+	for (Start = BenchTime(); BenchTime() - Start < BENCH_SERVER_TIMEOUT; usleep(10000))
+	{ /*Check the segment exists first, so InitMemBus() doesn't complain while we wait.*/
+		if (shmget((key_t)MemBusKey, 0, 0) != -1 && InitMemBus(false))
+		{
+			ShutdownMemBus(false);
+			return ServerPID;
+		}
+	}
+	
+	kill(ServerPID, SIGKILL);
+	waitpid(ServerPID, NULL, 0);
+	return -1;
+}
+
+static void BenchStopServer(pid_t ServerPID)
+{
+	kill(ServerPID, SIGKILL);
+	waitpid(ServerPID, NULL, 0);
+	
+	/*It never got to remove it's membus, so attach as the server just to do that.*/
+	if (InitMemBus(true)) ShutdownMemBus(true);
+}
+
+static Bool BenchGetRL(void)
+{
+	unsigned char Frame[MEMBUS_MSGSIZE];
+	
+	MemBus_FrameInit(Frame, MEMBUS_OP_GETRL, 0);
+	
+	return MemBus_Transact(Frame) == MEMBUS_STATUS_OK;
+}
+
+static Bool BenchSendPID(void)
+{
+	unsigned char Frame[MEMBUS_MSGSIZE];
+	
+	MemBus_FrameInit(Frame, MEMBUS_OP_SENDPID, 0);
+	MemBus_FrameAddString(Frame, MEMBUS_TLV_OBJECTID, "bench0");
+	
+	return MemBus_Transact(Frame) == MEMBUS_STATUS_OK;
+}
+
+static Bool BenchLSObjs(void)
+{ /*Reads the whole stream, the way "epoch status" does. Always to the end, however long that takes,
+	* since the server waits on us for every line and would still be stuck there for the next benchmark.
+	* We only give up if it goes quiet for BENCH_SERVER_TIMEOUT.*/
+	char Buf[MEMBUS_MSGSIZE];
+	double LastHeard = BenchTime();
+	
+	if (!MemBus_Write(MEMBUS_CODE_LSOBJS, false)) return false;
+	
+	while (BenchTime() - LastHeard < BENCH_SERVER_TIMEOUT)
+	{
+		if (!MemBus_BinRead(Buf, MEMBUS_MSGSIZE, false))
+		{
+			usleep(100);
+			continue;
+		}
+		
+		LastHeard = BenchTime();
+		Buf[MEMBUS_MSGSIZE - 1] = '\0';
+		
+		if (!strcmp(Buf, MEMBUS_CODE_ACKNOWLEDGED " " MEMBUS_CODE_LSOBJS)) return true;
+	}
+	
+	return false;
+}
+
+static void BenchLatency(const char *Bench, unsigned long NumObjects, Bool (*Request)(void))
+{ /*Times one round trip at a time, until we have enough samples or run out of time.
+	* Running out of time only stops new ones. Whatever's underway gets finished and counted.*/
+	unsigned long Count = 0;
+	double Start = BenchTime(), ReqStart;
+	
+	if (!InitMemBus(false))
+	{ /*Still say something, so a missing row doesn't look like a skipped one.*/
+		BenchReport(Bench, NumObjects, 0);
+		return;
+	}
+	
+	for (; Count < NumSamples && BenchTime() - Start < Budget; )
+	{
+		ReqStart = BenchTime();
+		
+		if (!Request()) break;
+		
+		SampleBuf[Count++] = BenchTime() - ReqStart;
+	}
+	
+	ShutdownMemBus(false);
+	
+	BenchReport(Bench, NumObjects, Count);
+}
+
+static void BenchConnect(unsigned long NumObjects)
+{ /*How long it takes to get the membus lock and the server's attention, then let go.*/
+	unsigned long Count = 0;
+	double Start = BenchTime(), ReqStart;
+	
+	for (; Count < NumSamples && BenchTime() - Start < Budget; )
+	{
+		ReqStart = BenchTime();
+		
+		if (!InitMemBus(false)) break;
+		
+		ShutdownMemBus(false);
+		
+		SampleBuf[Count++] = BenchTime() - ReqStart;
+	}
+	
+	BenchReport("connect", NumObjects, Count);
+}
+
+static void BenchThroughput(unsigned long NumObjects)
+{ /*As many GETRL round trips as we can push through in Duration seconds.*/
+	unsigned long Count = 0;
+	double Start, Elapsed;
+	
+	if (!InitMemBus(false))
+	{
+		printf("{\"bench\":\"throughput_getrl\",\"objects\":%lu,\"requests\":0,\"error\":\"could not connect\"}\n", NumObjects);
+		fflush(stdout);
+		return;
+	}
+	
+	for (Start = BenchTime(); (Elapsed = BenchTime() - Start) < Duration && BenchGetRL(); ++Count);
+	
+	ShutdownMemBus(false);
+	
+	printf("{\"bench\":\"throughput_getrl\",\"objects\":%lu,\"seconds\":%.3f,\"requests\":%lu,\"per_sec\":%.1f}\n",
+			NumObjects, Elapsed, Count, Count / Elapsed);
+	fflush(stdout);
+}
+
+static rStatus BenchRun(unsigned long NumObjects, const char *ConfPath)
+{
+	double Start;
+	pid_t ServerPID;
+	ObjTable *Target = NULL;
+	
+	if (!BenchWriteConfig(ConfPath, NumObjects))
+	{
+		fprintf(stderr, "epochbench: Unable to write \"%s\".\n", ConfPath);
+		return FAILURE;
+	}
+	
+	snprintf(ConfigFile, MAX_LINE_SIZE, "%s", ConfPath);
+	
+	BenchLex(NumObjects, ConfPath);
+	
+	Start = BenchTime();
+	
+	if (!InitConfig())
+	{
+		fprintf(stderr, "epochbench: Failed to load the generated configuration.\n");
+		return FAILURE;
+	}
+	
+	printf("{\"bench\":\"config_load\",\"objects\":%lu,\"us\":%.1f}\n", NumObjects, (BenchTime() - Start) * 1e6);
+	fflush(stdout);
+	
+	if (ConfigOnly)
+	{
+		ShutdownConfig();
+		return SUCCESS;
+	}
+	
+	/*Nothing actually gets started, so give SENDPID something to answer with.*/
+	if ((Target = LookupObjectInTable("bench0")))
+	{
+		Target->Started = true;
+		Target->ObjectPID = getpid();
+	}
+	
+	if ((ServerPID = BenchStartServer()) == -1)
+	{
+		fprintf(stderr, "epochbench: The server never came up.\n");
+		ShutdownConfig();
+		return FAILURE;
+	}
+	
+	BenchConnect(NumObjects);
+	BenchLatency("getrl", NumObjects, BenchGetRL);
+	BenchLatency("sendpid", NumObjects, BenchSendPID);
+	BenchLatency("lsobjs", NumObjects, BenchLSObjs);
+	BenchThroughput(NumObjects);
+	
+	BenchStopServer(ServerPID);
+	ShutdownConfig();
+	
+	return SUCCESS;
+}
+
+static void BenchUsage(const char *Name)
+{
+	fprintf(stderr, "Usage: %s [--objects n,n,...] [--samples n] [--budget secs] [--duration secs] [--configonly]\n"
+			"--configonly skips the membus benchmarks and just times loading the config.\n"
+			"Defaults are --objects " BENCH_DEFAULT_OBJECTS " --samples %d --budget %d --duration %d.\n",
+			Name, BENCH_DEFAULT_SAMPLES, BENCH_DEFAULT_BUDGET, BENCH_DEFAULT_DURATION);
+}
+
+int main(int argc, char **argv)
+{
+	char ObjectCounts[MAX_LINE_SIZE] = BENCH_DEFAULT_OBJECTS, ConfPath[MAX_LINE_SIZE], *Worker = NULL;
+	rStatus RV = SUCCESS;
+	int Inc = 1;
+	
+	for (; Inc < argc; ++Inc)
+	{
+		if (Inc + 1 < argc && !strcmp(argv[Inc], "--objects"))
+		{
+			snprintf(ObjectCounts, sizeof ObjectCounts, "%s", argv[++Inc]);
+		}
+		else if (Inc + 1 < argc && !strcmp(argv[Inc], "--samples") && AllNumeric(argv[Inc + 1]))
+		{
+			NumSamples = strtoul(argv[++Inc], NULL, 10);
+		}
+		else if (Inc + 1 < argc && !strcmp(argv[Inc], "--budget") && AllNumeric(argv[Inc + 1]))
+		{
+			Budget = strtoul(argv[++Inc], NULL, 10);
+		}
+		else if (Inc + 1 < argc && !strcmp(argv[Inc], "--duration") && AllNumeric(argv[Inc + 1]))
+		{
+			Duration = strtoul(argv[++Inc], NULL, 10);
+		}
+		else if (!strcmp(argv[Inc], "--configonly"))
+		{
+			ConfigOnly = true;
+		}
+		else
+		{
+			BenchUsage(argv[0]);
+			return 1;
+		}
+	}
+	
+	if (!NumSamples || !Budget || !Duration || !(SampleBuf = malloc(sizeof(double) * NumSamples)))
+	{
+		BenchUsage(argv[0]);
+		return 1;
+	}
+	
+	/*Never touch the real Epoch's membus or event stream.*/
+	MemBusKey = MEMKEY + 2 + getpid();
+	EnableLogging = false;
+	
+	snprintf(ConfPath, sizeof ConfPath, "/tmp/epochbench-%lu.conf", (unsigned long)getpid());
+	
+	for (Worker = strtok(ObjectCounts, ","); Worker && RV; Worker = strtok(NULL, ","))
+	{
+		if (!AllNumeric(Worker) || !strtoul(Worker, NULL, 10))
+		{
+			fprintf(stderr, "epochbench: Bad object count \"%s\".\n", Worker);
+			RV = FAILURE;
+			break;
+		}
+		
+		RV = BenchRun(strtoul(Worker, NULL, 10), ConfPath);
+	}
+	
+	remove(ConfPath);
+	free(SampleBuf);
+	
+	return RV ? 0 : 1;
+}
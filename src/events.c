@@ -0,0 +1,532 @@
+/*This code is part of the Epoch Init System.
+* The Epoch Init System is maintained by Subsentient.
+* This software is public domain.
+* Please read the file UNLICENSE.TXT for more information.*/
+
+/**This file pushes object state changes out to anyone who subscribes,
+ * so nobody has to sit there hammering LSOBJS to notice a service died.
+ * Subscribers connect to an abstract unix socket, and each one gets
+ * it's own small queue. If a subscriber can't keep up, we drop events
+ * and tell them how many, rather than ever blocking PID 1 on them.
+ * An abstract socket has no permissions, so we check who's on the other end
+ * ourselves. Same rules as the membus segment's 0660: root, our user, or our group.**/
+
+#define _GNU_SOURCE /*For struct ucred.*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "epoch.h"
+
+struct _EpochEvent
+{
+	unsigned long Sequence;
+	unsigned long Time;
+	long Value;
+	unsigned char Type;
+	char Subject[MAX_DESCRIPT_SIZE]; /*Object ID, or the runlevel for EVENT_RUNLEVEL.*/
+};
+
+static struct _EventSubscriber
+{
+	int Descriptor; /*-1 if the slot is free.*/
+	Bool Subscribed; /*False until they send us their filter.*/
+	time_t Connected; /*They get EVENTS_SUBSCRIBE_TIMEOUT seconds from this to send it.*/
+	unsigned long NumFilters;
+	char **Filters; /*Object IDs they care about. None means everything.*/
+	
+	struct _EpochEvent *Queue; /*Ring of EVENTS_QUEUE_SIZE.*/
+	unsigned long Head, Count;
+	unsigned long Dropped; /*Events we threw away since they last caught up.*/
+} Subscribers[EVENTS_MAX_SUBSCRIBERS];
+
+static int ListenDescriptor = -1;
+static unsigned long EventCounter;
+
+struct _RXDSubscriber
+{ /*A subscriber as it goes across a reexec. The queue, then the filters, follow it.*/
+	int Descriptor;
+	Bool Subscribed;
+	unsigned long NumFilters;
+	unsigned long Count;
+	unsigned long Dropped;
+};
+
+/*Prototypes.*/
+static void Events_Flush(struct _EventSubscriber *Sub);
+
+static socklen_t Events_SocketName(struct sockaddr_un *Addr)
+{ /*Abstract namespace, so there's no file to go stale, and keyed like the membus so test instances don't collide.*/
+	int Length;
+	
+	memset(Addr, 0, sizeof(struct sockaddr_un));
+	Addr->sun_family = AF_UNIX;
+	
+	Length = snprintf(Addr->sun_path + 1, sizeof Addr->sun_path - 1, EVENTS_SOCKNAME "-%lx", (unsigned long)MemBusKey);
+	
+	return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + Length);
+}
+
+static Bool Events_Trusted(int Descriptor)
+{
+	struct ucred Cred;
+	socklen_t CredLength = sizeof Cred;
+	
+	if (getsockopt(Descriptor, SOL_SOCKET, SO_PEERCRED, &Cred, &CredLength) == -1) return false;
+	
+	return Cred.uid == 0 || Cred.uid == geteuid() || Cred.gid == getegid();
+}
+
+static void Events_Drop(struct _EventSubscriber *Sub)
+{
+	unsigned long Inc = 0;
+	
+	if (Sub->Descriptor != -1) close(Sub->Descriptor);
+	
+	for (; Inc < Sub->NumFilters; ++Inc)
+	{
+		free(Sub->Filters[Inc]);
+	}
+	
+	free(Sub->Filters);
+	free(Sub->Queue);
+	
+	memset(Sub, 0, sizeof(struct _EventSubscriber));
+	Sub->Descriptor = -1;
+}
+
+rStatus Events_Init(void)
+{
+	struct sockaddr_un Addr;
+	socklen_t AddrLength = Events_SocketName(&Addr);
+	unsigned long Inc = 0;
+	
+	if (ListenDescriptor != -1) return SUCCESS;
+	
+	for (; Inc < EVENTS_MAX_SUBSCRIBERS; ++Inc)
+	{
+		memset(&Subscribers[Inc], 0, sizeof(struct _EventSubscriber));
+		Subscribers[Inc].Descriptor = -1;
+	}
+	
+	/*Close on exec, so PivotRoot and object commands don't get it. Reexec hands over dups explicitly.*/
+	if ((ListenDescriptor = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1)
+	{
+		return FAILURE;
+	}
+	
+	if (bind(ListenDescriptor, (struct sockaddr*)&Addr, AddrLength) == -1 ||
+		listen(ListenDescriptor, EVENTS_MAX_SUBSCRIBERS) == -1)
+	{
+		close(ListenDescriptor);
+		ListenDescriptor = -1;
+		return FAILURE;
+	}
+	
+	return SUCCESS;
+}
+
+void Events_Shutdown(void)
+{
+	unsigned long Inc = 0;
+	
+	if (ListenDescriptor == -1) return;
+	
+	for (; Inc < EVENTS_MAX_SUBSCRIBERS; ++Inc)
+	{
+		if (Subscribers[Inc].Descriptor != -1) Events_Drop(&Subscribers[Inc]);
+	}
+	
+	close(ListenDescriptor);
+	ListenDescriptor = -1;
+}
+
+static Bool Events_Wanted(const struct _EventSubscriber *Sub, unsigned char Type, const char *Subject)
+{
+	unsigned long Inc = 0;
+	
+	if (!Sub->Subscribed) return false;
+	
+	/*Runlevel changes and config reloads concern everybody.*/
+	if (!Sub->NumFilters || Type == EVENT_RUNLEVEL || Type == EVENT_CONFIGRELOAD) return true;
+	
+	for (; Inc < Sub->NumFilters; ++Inc)
+	{
+		if (!strcmp(Sub->Filters[Inc], Subject)) return true;
+	}
+	
+	return false;
+}
+
+void Events_Emit(unsigned char Type, const char *Subject, long Value)
+{ /*Queues an event for everybody who wants it. Never blocks.*/
+	struct _EpochEvent *Event = NULL;
+	struct _EventSubscriber *Sub = NULL;
+	unsigned long Inc = 0, Sequence;
+	
+	if (ListenDescriptor == -1) return;
+	
+	Sequence = ++EventCounter;
+	
+	for (; Inc < EVENTS_MAX_SUBSCRIBERS; ++Inc)
+	{
+		Sub = &Subscribers[Inc];
+		
+		if (Sub->Descriptor == -1 || !Events_Wanted(Sub, Type, Subject ? Subject : "")) continue;
+		
+		if (Sub->Count == EVENTS_QUEUE_SIZE)
+		{ /*Full. They hear about it once they catch up.*/
+			++Sub->Dropped;
+			continue;
+		}
+		
+		Event = &Sub->Queue[(Sub->Head + Sub->Count) % EVENTS_QUEUE_SIZE];
+		++Sub->Count;
+		
+		Event->Sequence = Sequence;
+		Event->Time = (unsigned long)time(NULL);
+		Event->Value = Value;
+		Event->Type = Type;
+		snprintf(Event->Subject, sizeof Event->Subject, "%s", Subject ? Subject : "");
+		
+		Events_Flush(Sub);
+	}
+}
+
+static Bool Events_Send(struct _EventSubscriber *Sub, unsigned char *Frame)
+{ /*Returns false if the socket is full. Hangs them up if it's broken.*/
+	if (send(Sub->Descriptor, Frame, MemBus_FrameSize(Frame), MSG_DONTWAIT | MSG_NOSIGNAL) == -1)
+	{
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+		{
+			Events_Drop(Sub);
+		}
+		
+		return false;
+	}
+	
+	return true;
+}
+
+static void Events_Flush(struct _EventSubscriber *Sub)
+{ /*Sends whatever the socket will take right now.*/
+	unsigned char Frame[MEMBUS_MSGSIZE];
+	
+	while (Sub->Descriptor != -1 && (Sub->Count || Sub->Dropped))
+	{
+		const struct _EpochEvent *Event = &Sub->Queue[Sub->Head];
+		
+		if (Sub->Dropped && Sub->Count == 0)
+		{ /*Only once everything before the gap is out, so the report lands where the gap is.*/
+			long Dropped = (long)Sub->Dropped;
+			unsigned long Now = (unsigned long)time(NULL);
+			
+			MemBus_FrameInit(Frame, EVENT_DROPPED, EventCounter);
+			Frame[0] = EVENTS_FRAME_MAGIC;
+			MemBus_FrameAdd(Frame, MEMBUS_TLV_VALUE, &Dropped, sizeof(long));
+			MemBus_FrameAdd(Frame, MEMBUS_TLV_TIME, &Now, sizeof(long));
+			
+			if (!Events_Send(Sub, Frame)) return;
+			
+			Sub->Dropped = 0;
+			continue;
+		}
+		
+		MemBus_FrameInit(Frame, Event->Type, Event->Sequence);
+		Frame[0] = EVENTS_FRAME_MAGIC;
+		
+		if (*Event->Subject)
+		{
+			MemBus_FrameAddString(Frame, (Event->Type == EVENT_RUNLEVEL ? MEMBUS_TLV_RUNLEVEL : MEMBUS_TLV_OBJECTID),
+								Event->Subject);
+		}
+		
+		MemBus_FrameAdd(Frame, MEMBUS_TLV_VALUE, &Event->Value, sizeof(long));
+		MemBus_FrameAdd(Frame, MEMBUS_TLV_TIME, &Event->Time, sizeof(long));
+		
+		if (!Events_Send(Sub, Frame)) return;
+		
+		Sub->Head = (Sub->Head + 1) % EVENTS_QUEUE_SIZE;
+		--Sub->Count;
+	}
+}
+
+static void Events_Subscribe(struct _EventSubscriber *Sub, const unsigned char *Frame)
+{ /*The first frame a client sends is the list of object IDs it wants, if any.*/
+	unsigned char Reply[MEMBUS_MSGSIZE], Status = MEMBUS_STATUS_OK;
+	const char *ObjectID = NULL;
+	unsigned long Inc = 0;
+	
+	if (Frame[0] != EVENTS_FRAME_MAGIC || Frame[1] != EVENT_NONE)
+	{
+		Status = MEMBUS_STATUS_BADPARAM;
+	}
+	else
+	{
+		while (MemBus_FrameGet(Frame, MEMBUS_TLV_OBJECTID, Sub->NumFilters, NULL)) ++Sub->NumFilters;
+		
+		if (Sub->NumFilters > EVENTS_MAX_FILTERS ||
+			(Sub->NumFilters && !(Sub->Filters = calloc(Sub->NumFilters, sizeof(char*)))) ||
+			!(Sub->Queue = malloc(sizeof(struct _EpochEvent) * EVENTS_QUEUE_SIZE)))
+		{
+			Sub->NumFilters = 0;
+			Status = MEMBUS_STATUS_FAILURE;
+		}
+		
+		for (; Status == MEMBUS_STATUS_OK && Inc < Sub->NumFilters; ++Inc)
+		{
+			if (!(ObjectID = MemBus_FrameGetString(Frame, MEMBUS_TLV_OBJECTID, Inc)) ||
+				!(Sub->Filters[Inc] = malloc(strlen(ObjectID) + 1)))
+			{
+				Status = MEMBUS_STATUS_BADPARAM;
+				break;
+			}
+			
+			strcpy(Sub->Filters[Inc], ObjectID);
+		}
+	}
+	
+	MemBus_FrameInit(Reply, EVENT_NONE, EventCounter);
+	Reply[0] = EVENTS_FRAME_MAGIC;
+	MemBus_FrameAdd(Reply, MEMBUS_TLV_STATUS, &Status, 1);
+	
+	if (!Events_Send(Sub, Reply) || Status != MEMBUS_STATUS_OK)
+	{
+		if (Sub->Descriptor != -1) Events_Drop(Sub);
+		return;
+	}
+	
+	Sub->Subscribed = true;
+}
+
+void Events_Service(void)
+{ /*Called every pass of the primary loop. Takes new subscribers, and pushes out whatever is queued.*/
+	unsigned char Frame[MEMBUS_MSGSIZE];
+	unsigned long Inc = 0;
+	ssize_t Length = 0;
+	int NewDescriptor = -1;
+	const time_t Now = time(NULL);
+	
+	if (ListenDescriptor == -1) return;
+	
+	while ((NewDescriptor = accept(ListenDescriptor, NULL, NULL)) != -1)
+	{
+		if (!Events_Trusted(NewDescriptor))
+		{ /*Not somebody who could read the membus either.*/
+			close(NewDescriptor);
+			continue;
+		}
+		
+		for (Inc = 0; Inc < EVENTS_MAX_SUBSCRIBERS && Subscribers[Inc].Descriptor != -1; ++Inc);
+		
+		if (Inc == EVENTS_MAX_SUBSCRIBERS)
+		{ /*No room. They'll see the hangup.*/
+			close(NewDescriptor);
+			continue;
+		}
+		
+		fcntl(NewDescriptor, F_SETFD, FD_CLOEXEC);
+		fcntl(NewDescriptor, F_SETFL, O_NONBLOCK);
+		Subscribers[Inc].Descriptor = NewDescriptor;
+		Subscribers[Inc].Connected = Now;
+	}
+	
+	for (Inc = 0; Inc < EVENTS_MAX_SUBSCRIBERS; ++Inc)
+	{
+		struct _EventSubscriber *const Sub = &Subscribers[Inc];
+		
+		if (Sub->Descriptor == -1) continue;
+		
+		/*Subscribers only ever talk to us once. After that, reading is how we notice they hung up.*/
+		while (Sub->Descriptor != -1 && (Length = recv(Sub->Descriptor, Frame, sizeof Frame, MSG_DONTWAIT)) != -1)
+		{
+			if (Length == 0)
+			{
+				Events_Drop(Sub);
+			}
+			else if (!Sub->Subscribed && (unsigned long)Length >= MEMBUS_FRAME_HEADSIZE &&
+					MemBus_FrameSize(Frame) <= (unsigned long)Length)
+			{
+				Events_Subscribe(Sub, Frame);
+			}
+		}
+		
+		if (Sub->Descriptor != -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+		{
+			Events_Drop(Sub);
+		}
+		
+		if (Sub->Descriptor != -1 && !Sub->Subscribed && Sub->Connected + EVENTS_SUBSCRIBE_TIMEOUT < Now)
+		{ /*Connecting and sitting there would keep a slot from somebody who wants it.*/
+			Events_Drop(Sub);
+		}
+		
+		if (Sub->Descriptor != -1) Events_Flush(Sub);
+	}
+}
+
+int Events_Connect(const char **ObjectIDs, unsigned long NumObjectIDs)
+{ /*Client side. Returns a descriptor to read event frames from, or -1.*/
+	struct sockaddr_un Addr;
+	socklen_t AddrLength = Events_SocketName(&Addr);
+	unsigned char Frame[MEMBUS_MSGSIZE];
+	const unsigned char *Status = NULL;
+	unsigned long Inc = 0;
+	int Descriptor;
+	
+	if ((Descriptor = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) == -1) return -1;
+	
+	if (connect(Descriptor, (struct sockaddr*)&Addr, AddrLength) == -1)
+	{
+		close(Descriptor);
+		return -1;
+	}
+	
+	MemBus_FrameInit(Frame, EVENT_NONE, 0);
+	Frame[0] = EVENTS_FRAME_MAGIC;
+	
+	for (; Inc < NumObjectIDs; ++Inc)
+	{
+		if (!MemBus_FrameAddString(Frame, MEMBUS_TLV_OBJECTID, ObjectIDs[Inc])) break;
+	}
+	
+	if (Inc < NumObjectIDs || send(Descriptor, Frame, MemBus_FrameSize(Frame), MSG_NOSIGNAL) == -1 ||
+		recv(Descriptor, Frame, sizeof Frame, 0) < (ssize_t)MEMBUS_FRAME_HEADSIZE ||
+		!(Status = MemBus_FrameGet(Frame, MEMBUS_TLV_STATUS, 0, NULL)) || *Status != MEMBUS_STATUS_OK)
+	{
+		close(Descriptor);
+		return -1;
+	}
+	
+	return Descriptor;
+}
+
+void Events_SaveState(struct _RXDState *State)
+{ /*For reexec. The sockets go over as descriptors, so subscribers never notice we were gone.*/
+	unsigned long Inc = 0, EvInc = 0, Saved[2];
+	struct _RXDSubscriber Rec;
+	int Descriptor;
+	
+	if (ListenDescriptor == -1 || (Descriptor = RXD_AddDescriptor(State, ListenDescriptor)) == -1) return;
+	
+	Saved[0] = (unsigned long)Descriptor;
+	Saved[1] = EventCounter;
+	RXD_Append(State, RXD_REC_EVENTS, Saved, sizeof Saved);
+	
+	for (; Inc < EVENTS_MAX_SUBSCRIBERS; ++Inc)
+	{
+		const struct _EventSubscriber *const Sub = &Subscribers[Inc];
+		
+		if (Sub->Descriptor == -1 || (Rec.Descriptor = RXD_AddDescriptor(State, Sub->Descriptor)) == -1) continue;
+		
+		Rec.Subscribed = Sub->Subscribed;
+		Rec.NumFilters = Sub->NumFilters;
+		Rec.Count = Sub->Count;
+		Rec.Dropped = Sub->Dropped;
+		
+		RXD_Append(State, RXD_REC_SUBSCRIBER, &Rec, sizeof Rec);
+		
+		for (EvInc = 0; EvInc < Sub->Count; ++EvInc)
+		{
+			RXD_Extend(State, &Sub->Queue[(Sub->Head + EvInc) % EVENTS_QUEUE_SIZE], sizeof(struct _EpochEvent));
+		}
+		
+		for (EvInc = 0; EvInc < Sub->NumFilters; ++EvInc)
+		{
+			RXD_Extend(State, Sub->Filters[EvInc], strlen(Sub->Filters[EvInc]) + 1);
+		}
+	}
+}
+
+rStatus Events_RestoreState(unsigned char Type, const void *Data, unsigned long Length)
+{
+	struct _EventSubscriber *Sub = NULL;
+	struct _RXDSubscriber Rec;
+	const char *Worker = NULL, *End = (const char*)Data + Length;
+	unsigned long Inc = 0, Saved[2];
+	
+	if (Type == RXD_REC_EVENTS)
+	{
+		if (Length != sizeof Saved) return FAILURE;
+		
+		memcpy(Saved, Data, sizeof Saved);
+		
+		for (; Inc < EVENTS_MAX_SUBSCRIBERS; ++Inc)
+		{ /*A fresh image, so there's nothing in these to free.*/
+			memset(&Subscribers[Inc], 0, sizeof(struct _EventSubscriber));
+			Subscribers[Inc].Descriptor = -1;
+		}
+		
+		ListenDescriptor = (int)Saved[0];
+		EventCounter = Saved[1];
+		fcntl(ListenDescriptor, F_SETFD, FD_CLOEXEC);
+		
+		return SUCCESS;
+	}
+	
+	if (ListenDescriptor == -1 || Length < sizeof Rec) return FAILURE;
+	
+	memcpy(&Rec, Data, sizeof Rec);
+	
+	for (; Inc < EVENTS_MAX_SUBSCRIBERS && Subscribers[Inc].Descriptor != -1; ++Inc);
+	
+	if (Inc == EVENTS_MAX_SUBSCRIBERS || Rec.Count > EVENTS_QUEUE_SIZE || Rec.NumFilters > EVENTS_MAX_FILTERS ||
+		Length < sizeof Rec + sizeof(struct _EpochEvent) * Rec.Count)
+	{
+		close(Rec.Descriptor);
+		return FAILURE;
+	}
+	
+	Sub = &Subscribers[Inc];
+	Sub->Descriptor = Rec.Descriptor;
+	Sub->Connected = time(NULL);
+	fcntl(Sub->Descriptor, F_SETFD, FD_CLOEXEC);
+	
+	if (!Rec.Subscribed) return SUCCESS; /*They'll send their filter to the new us.*/
+	
+	if (!(Sub->Queue = malloc(sizeof(struct _EpochEvent) * EVENTS_QUEUE_SIZE)) ||
+		(Rec.NumFilters && !(Sub->Filters = calloc(Rec.NumFilters, sizeof(char*)))))
+	{
+		Events_Drop(Sub);
+		return FAILURE;
+	}
+	
+	memcpy(Sub->Queue, (const char*)Data + sizeof Rec, sizeof(struct _EpochEvent) * Rec.Count);
+	Sub->Count = Rec.Count;
+	Sub->Dropped = Rec.Dropped;
+	Sub->Subscribed = true;
+	
+	Worker = (const char*)Data + sizeof Rec + sizeof(struct _EpochEvent) * Rec.Count;
+	
+	for (Inc = 0; Inc < Rec.NumFilters; ++Inc, ++Sub->NumFilters)
+	{
+		const char *Terminator = memchr(Worker, '\0', End - Worker);
+		
+		if (!Terminator || !(Sub->Filters[Inc] = malloc(Terminator - Worker + 1)))
+		{
+			Events_Drop(Sub);
+			return FAILURE;
+		}
+		
+		strcpy(Sub->Filters[Inc], Worker);
+		Worker = Terminator + 1;
+	}
+	
+	return SUCCESS;
+}
+
+const char *Events_TypeName(unsigned char Type)
+{
+	static const char *const Names[EVENT_MAX] = { "NONE", "STARTED", "READY", "EXITED", "RESTARTED",
+												"STOPPED", "RUNLEVEL", "CONFIGRELOAD", "DROPPED" };
+	
+	return Type < EVENT_MAX ? Names[Type] : "UNKNOWN";
+}
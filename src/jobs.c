@@ -0,0 +1,1118 @@
+/*This code is part of the Epoch Init System.
+* The Epoch Init System is maintained by Subsentient.
+* This software is public domain.
+* Please read the file UNLICENSE.TXT for more information.*/
+
+/**This file runs object starts, stops, reloads and runlevel switches
+ * requested over the membus as jobs. Each job is a little state machine
+ * that the primary loop steps once per pass, so a slow object can no longer
+ * freeze PID 1, it's zombie reaping, or every other membus client.**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <fnmatch.h>
+#include <sys/types.h>
+#include "epoch.h"
+
+/*How many finished jobs we keep around for JOBSTAT, and for how long.*/
+#define JOBS_MAX_FINISHED 32
+#define JOBS_FINISHED_LIFETIME 300
+
+/*Oldest first.*/
+struct _EpochJob *JobList;
+static unsigned long JobCounter;
+
+/*Prototypes.*/
+static void Jobs_Finish(struct _EpochJob *Job, unsigned char Status);
+static void Jobs_Begin(struct _EpochJob *Job);
+static void Jobs_Step(struct _EpochJob *Job);
+
+unsigned long Jobs_Create(unsigned char Opcode, const char *Target, unsigned long ParentJobID)
+{
+	struct _EpochJob *Job = calloc(1, sizeof(struct _EpochJob)), *Worker = JobList;
+	
+	if (!Job)
+	{
+		SpitError("Jobs_Create(): Out of memory!");
+		return 0;
+	}
+	
+	Job->JobID = ++JobCounter;
+	Job->ParentJobID = ParentJobID;
+	Job->Opcode = Opcode;
+	Job->State = JOBSTATE_QUEUED;
+	Job->Status = MEMBUS_STATUS_PENDING;
+	Job->PrintStatus = (ParentJobID != 0); /*Runlevel switches report to the console like they always have.*/
+	snprintf(Job->Target, sizeof Job->Target, "%s", Target);
+	
+	if (!JobList)
+	{
+		JobList = Job;
+	}
+	else
+	{
+		for (; Worker->Next; Worker = Worker->Next);
+		Worker->Next = Job;
+	}
+	
+	return Job->JobID;
+}
+
+unsigned long Jobs_CreateBatch(unsigned char BatchOp, const char *Patterns)
+{ /*Expands the space separated globs in Patterns against the object table. Returns 0 if nothing matched.*/
+	char PatBuf[MAX_LINE_SIZE], *PatList[64], *Worker = NULL, Target[MAX_DESCRIPT_SIZE];
+	unsigned long NumPatterns = 0, NumEntries = 0, Inc = 0, JobID = 0;
+	struct _BatchEntry *Entries = NULL, *Entry = NULL;
+	struct _EpochJob *Job = NULL;
+	ObjTable *TObj = ObjectTable;
+	
+	if (BatchOp >= BATCH_MAX || !ObjectTable) return 0;
+	
+	snprintf(PatBuf, sizeof PatBuf, "%s", Patterns);
+	
+	for (Worker = strtok(PatBuf, " \t"); Worker && NumPatterns < sizeof PatList / sizeof *PatList; Worker = strtok(NULL, " \t"))
+	{
+		PatList[NumPatterns++] = Worker;
+	}
+	
+	for (; NumPatterns && TObj < ObjectTable + ObjectCount; ++TObj)
+	{
+		for (Inc = 0; Inc < NumPatterns && fnmatch(PatList[Inc], TObj->ObjectID, 0) != 0; ++Inc);
+		
+		if (Inc == NumPatterns) continue;
+		
+		Config_Materialize(TObj); /*We want its priorities.*/
+		
+		if (!(Entry = realloc(Entries, sizeof(struct _BatchEntry) * (NumEntries + 1))))
+		{
+			SpitError("Jobs_CreateBatch(): Out of memory!");
+			free(Entries);
+			return 0;
+		}
+		
+		Entries = Entry;
+		Entry += NumEntries++;
+		
+		snprintf(Entry->ObjectID, sizeof Entry->ObjectID, "%s", TObj->ObjectID);
+		Entry->Priority[0] = TObj->ObjectStopPriority;
+		Entry->Priority[1] = TObj->ObjectStartPriority;
+		Entry->SubJobID = 0;
+		Entry->Status = MEMBUS_STATUS_PENDING;
+		
+		/*Only restarts and stops need a stop first, and there's no stopping something that isn't running.*/
+		Entry->Stage = (BatchOp == BATCH_STOP || (BatchOp == BATCH_RESTART && TObj->Started)) ? 0 : 1;
+		Entry->StartAfterStop = (BatchOp == BATCH_RESTART);
+	}
+	
+	snprintf(Target, sizeof Target, "%s %s", Jobs_BatchOpName(BatchOp), Patterns);
+	
+	if (!NumEntries || !(JobID = Jobs_Create(MEMBUS_OP_BATCH, Target, 0)))
+	{
+		free(Entries);
+		return 0;
+	}
+	
+	Job = Jobs_Lookup(JobID);
+	Job->BatchOp = BatchOp;
+	Job->Batch = Entries;
+	Job->BatchCount = NumEntries;
+	
+	return JobID;
+}
+
+unsigned long Jobs_CreateApply(const struct _ConfigDiff *Diff, unsigned long DiffCount)
+{ /*A batch that carries out what ReloadConfig() worked out. Each object gets started, stopped or restarted,
+	* with everything sharing a priority going at once, same as any other batch. Returns 0 if there's nothing to do.*/
+	struct _BatchEntry *Entries = NULL, *Entry = NULL;
+	unsigned long NumEntries = 0, Inc = 0, JobID = 0;
+	struct _EpochJob *Job = NULL;
+	ObjTable *TObj = NULL;
+	
+	for (; Inc < DiffCount; ++Inc)
+	{
+		if (Diff[Inc].Action == RELOADACT_NONE || !(TObj = LookupObjectInTable(Diff[Inc].ObjectID))) continue;
+		
+		if (!(Entry = realloc(Entries, sizeof(struct _BatchEntry) * (NumEntries + 1))))
+		{
+			SpitError("Jobs_CreateApply(): Out of memory!");
+			free(Entries);
+			return 0;
+		}
+		
+		Entries = Entry;
+		Entry += NumEntries++;
+		
+		snprintf(Entry->ObjectID, sizeof Entry->ObjectID, "%s", TObj->ObjectID);
+		Entry->Priority[0] = TObj->ObjectStopPriority;
+		Entry->Priority[1] = TObj->ObjectStartPriority;
+		Entry->SubJobID = 0;
+		Entry->Status = MEMBUS_STATUS_PENDING;
+		Entry->Stage = (Diff[Inc].Action == RELOADACT_START) ? 1 : 0;
+		Entry->StartAfterStop = (Diff[Inc].Action == RELOADACT_RESTART);
+	}
+	
+	if (!NumEntries || !(JobID = Jobs_Create(MEMBUS_OP_BATCH, "configreload", 0)))
+	{
+		free(Entries);
+		return 0;
+	}
+	
+	Job = Jobs_Lookup(JobID);
+	Job->BatchOp = BATCH_RESTART;
+	Job->Batch = Entries;
+	Job->BatchCount = NumEntries;
+	
+	return JobID;
+}
+
+unsigned char Jobs_BatchOpLookup(const char *Name)
+{ /*Returns BATCH_MAX if it's not one we know.*/
+	unsigned char Inc = 0;
+	
+	for (; Inc < BATCH_MAX && strcmp(Jobs_BatchOpName(Inc), Name) != 0; ++Inc);
+	
+	return Inc;
+}
+
+const char *Jobs_BatchOpName(unsigned char BatchOp)
+{
+	static const char *const BatchOpNames[BATCH_MAX] = { "start", "stop", "restart", "reload", "enable", "disable" };
+	
+	return BatchOp < BATCH_MAX ? BatchOpNames[BatchOp] : "unknown";
+}
+
+struct _EpochJob *Jobs_Lookup(unsigned long JobID)
+{
+	struct _EpochJob *Worker = JobList;
+	
+	for (; Worker; Worker = Worker->Next)
+	{
+		if (Worker->JobID == JobID) return Worker;
+	}
+	
+	return NULL;
+}
+
+const char *Jobs_StateName(unsigned char State)
+{
+	static const char *const StateNames[] = { "queued", "prestart", "starting", "waiting for PID file",
+											"stopping", "waiting for exit", "reloading", "stopping objects",
+											"starting objects", "running batch", "done" };
+	
+	return State <= JOBSTATE_DONE ? StateNames[State] : "unknown";
+}
+
+static Bool Jobs_CanBegin(const struct _EpochJob *Job)
+{ /*Jobs on the same object run in the order they were asked for, and a runlevel job runs alone.*/
+	const struct _EpochJob *Worker = JobList;
+	
+	if (Job->ParentJobID)
+	{ /*Our parent already has the floor. A batch doesn't own the objects it touches though,
+		* so don't barge in on something already working on ours.*/
+		for (; Worker; Worker = Worker->Next)
+		{
+			if (Worker != Job && Worker->JobID != Job->ParentJobID && Worker->State != JOBSTATE_DONE &&
+				Worker->State != JOBSTATE_QUEUED && !strcmp(Worker->Target, Job->Target))
+			{
+				return false;
+			}
+		}
+		
+		return true;
+	}
+	
+	for (; Worker != Job; Worker = Worker->Next)
+	{
+		if (Worker->State == JOBSTATE_DONE) continue;
+		
+		if (Worker->Opcode == MEMBUS_OP_RUNLEVEL || Job->Opcode == MEMBUS_OP_RUNLEVEL ||
+			!strcmp(Worker->Target, Job->Target))
+		{
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+Bool Jobs_ObjectBusy(const char *ObjectID)
+{ /*Used by autorestart, so it doesn't trip over a job that's in the middle of something.*/
+	const struct _EpochJob *Worker = JobList;
+	
+	for (; Worker; Worker = Worker->Next)
+	{
+		if (Worker->State == JOBSTATE_DONE || Worker->State == JOBSTATE_QUEUED) continue;
+		
+		if (Worker->Opcode == MEMBUS_OP_RUNLEVEL || !strcmp(Worker->Target, ObjectID))
+		{
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+Bool Jobs_Running(void)
+{ /*True if any job isn't finished yet.*/
+	const struct _EpochJob *Worker = JobList;
+	
+	for (; Worker; Worker = Worker->Next)
+	{
+		if (Worker->State != JOBSTATE_DONE) return true;
+	}
+	
+	return false;
+}
+
+static Bool Jobs_Launch(struct _EpochJob *Job, ObjTable *CurObj, const char *Cmd, unsigned char CmdKind, unsigned char NewState)
+{
+	Job->ChildExited = false;
+	Job->RawExitStatus = 0;
+	
+	if (!(Job->ChildPID = LaunchObjectCommand(CurObj, Cmd, CmdKind, &Job->ShellDissolves)))
+	{
+		return false;
+	}
+	
+	Job->State = NewState;
+	return true;
+}
+
+static void Jobs_FinishStart(struct _EpochJob *Job, ObjTable *CurObj)
+{
+	CurObj->Started = (Job->Result ? true : false); /*Mark the process dead or alive.*/
+	
+	if (Job->Result)
+	{
+		CurObj->StartedSince = time(NULL);
+		Events_Emit(EVENT_READY, CurObj->ObjectID, (long)CurObj->ObjectPID);
+	}
+	
+	Jobs_Finish(Job, (unsigned char)Job->Result);
+}
+
+static void Jobs_FinishStop(struct _EpochJob *Job, ObjTable *CurObj)
+{
+	if (CurObj)
+	{
+		if (Job->Result)
+		{
+			CurObj->ObjectPID = 0;
+			CurObj->Started = false;
+			CurObj->StartedSince = 0;
+			Events_Emit(EVENT_STOPPED, CurObj->ObjectID, 0);
+		}
+		
+		/*Now that the object is stopped, we should reset the autorestart to it's previous state.*/
+		CurObj->Opts.AutoRestart = Job->SavedAutoRestart;
+	}
+	
+	Jobs_Finish(Job, (unsigned char)Job->Result);
+}
+
+static void Jobs_BeginStop(struct _EpochJob *Job, ObjTable *CurObj)
+{ /*Mirrors the stop half of ProcessConfigObject().*/
+	unsigned long TargetPID = 0;
+	
+	Job->Stopping = true;
+	Job->Result = FAILURE;
+	
+	if (CurObj->Opts.HaltCmdOnly && !CurObj->ObjectStopCommand && CurObj->Opts.StopMode == STOP_COMMAND)
+	{
+		Jobs_Finish(Job, MEMBUS_STATUS_OK);
+		return;
+	}
+	
+	/*We need to do this so objects that are stopped have no chance of restarting themselves.*/
+	Job->SavedAutoRestart = CurObj->Opts.AutoRestart;
+	CurObj->Opts.AutoRestart = false;
+	
+	switch (CurObj->Opts.StopMode)
+	{
+		case STOP_COMMAND:
+			if (!Jobs_Launch(Job, CurObj, CurObj->ObjectStopCommand, OBJCMD_STOP, JOBSTATE_STOPCMD))
+			{
+				Jobs_FinishStop(Job, CurObj);
+			}
+			return;
+		case STOP_NONE:
+			Job->Result = SUCCESS; /*Just say we did it even if nothing to do.*/
+			Jobs_FinishStop(Job, CurObj);
+			return;
+		case STOP_PID:
+			TargetPID = CurObj->ObjectPID;
+			break;
+		case STOP_PIDFILE:
+			TargetPID = ReadPIDFile(CurObj);
+			break;
+		default:
+			Jobs_FinishStop(Job, CurObj);
+			return;
+	}
+	
+	if (!TargetPID || kill(TargetPID, CurObj->TermSignal) != 0)
+	{
+		Jobs_FinishStop(Job, CurObj);
+		return;
+	}
+	
+	Job->Result = SUCCESS;
+	
+	if (CurObj->Opts.NoStopWait)
+	{ /*Just quit and say everything's fine.*/
+		Jobs_FinishStop(Job, CurObj);
+		return;
+	}
+	
+	Job->WaitPID = TargetPID;
+	Job->Deadline = time(NULL) + CurObj->Opts.StopTimeout;
+	Job->State = JOBSTATE_STOPWAIT;
+}
+
+static void Jobs_BeginRunlevel(struct _EpochJob *Job)
+{
+	unsigned long NumInRunlevel = 0;
+	ObjTable *TObj = ObjectTable;
+	char TmpBuf[MAX_LINE_SIZE];
+	
+	/*Anything InitConfig() put off that we're about to need.*/
+	Config_MaterializeRunlevel(Job->Target);
+	
+	for (; TObj < ObjectTable + ObjectCount; ++TObj)
+	{ /*Check the runlevel has objects first.*/
+		if (!TObj->Opts.HaltCmdOnly && ObjRL_CheckRunlevel(Job->Target, TObj, true) &&
+			TObj->Enabled && TObj->ObjectStartPriority > 0)
+		{
+			++NumInRunlevel;
+		}
+	}
+	
+	if (NumInRunlevel == 0)
+	{
+		Jobs_Finish(Job, MEMBUS_STATUS_FAILURE);
+		return;
+	}
+	
+	snprintf(TmpBuf, sizeof TmpBuf, CONSOLE_COLOR_CYAN "Changing runlevel to \"%s\"...\n" CONSOLE_ENDCOLOR, Job->Target);
+	WriteLogLine(TmpBuf, true);
+	
+	printf("%s", TmpBuf);
+	fflush(stdout);
+	
+	Job->Priority = 1;
+	*Job->LastObjectID = '\0';
+	Job->State = JOBSTATE_RLSTOP;
+}
+
+static void Jobs_StepBatch(struct _EpochJob *Job)
+{ /*All stops go before any starts, lowest priority first, and everything sharing a priority goes at once.*/
+	struct _BatchEntry *Entry = NULL;
+	const struct _EpochJob *SubJob = NULL;
+	unsigned long Inc = 0, NumRunning = 0, NumFailed = 0, NumWarned = 0;
+	unsigned char Stage = 2;
+	unsigned long Priority = 0;
+	
+	for (Inc = 0; Inc < Job->BatchCount; ++Inc)
+	{
+		Entry = &Job->Batch[Inc];
+		
+		if (!Entry->SubJobID) continue;
+		
+		if ((SubJob = Jobs_Lookup(Entry->SubJobID)) && SubJob->State != JOBSTATE_DONE)
+		{
+			++NumRunning;
+			continue;
+		}
+		
+		Entry->Status = SubJob ? SubJob->Status : MEMBUS_STATUS_FAILURE;
+		Entry->SubJobID = 0;
+		
+		/*A restart only goes on to start what stopped, like "epoch restart" always has.*/
+		if (Entry->Stage == 0 && Entry->StartAfterStop &&
+			(Entry->Status == MEMBUS_STATUS_OK || Entry->Status == MEMBUS_STATUS_WARNING))
+		{
+			Entry->Stage = 1;
+		}
+		else
+		{
+			Entry->Stage = 2;
+		}
+	}
+	
+	if (NumRunning) return;
+	
+	for (Inc = 0; Inc < Job->BatchCount; ++Inc)
+	{ /*Find the next group.*/
+		Entry = &Job->Batch[Inc];
+		
+		if (Entry->Stage == 2) continue;
+		
+		if (Entry->Stage < Stage || (Entry->Stage == Stage && Entry->Priority[Stage] < Priority))
+		{
+			Stage = Entry->Stage;
+			Priority = (Stage < 2 ? Entry->Priority[Stage] : 0);
+		}
+	}
+	
+	if (Stage < 2 && Job->Cancelled)
+	{
+		for (Inc = 0; Inc < Job->BatchCount; ++Inc)
+		{
+			if (Job->Batch[Inc].Stage < 2) Job->Batch[Inc].Status = MEMBUS_STATUS_CANCELLED;
+		}
+		
+		Stage = 2;
+	}
+	
+	if (Stage == 2)
+	{ /*All done.*/
+		for (Inc = 0; Inc < Job->BatchCount; ++Inc)
+		{
+			if (Job->Batch[Inc].Status == MEMBUS_STATUS_WARNING) ++NumWarned;
+			else if (Job->Batch[Inc].Status != MEMBUS_STATUS_OK) ++NumFailed;
+		}
+		
+		Jobs_Finish(Job, (NumFailed ? MEMBUS_STATUS_FAILURE : NumWarned ? MEMBUS_STATUS_WARNING : MEMBUS_STATUS_OK));
+		return;
+	}
+	
+	for (Inc = 0; Inc < Job->BatchCount; ++Inc)
+	{
+		struct _EpochJob *NewJob = NULL;
+		
+		Entry = &Job->Batch[Inc];
+		
+		if (Entry->Stage != Stage || Entry->Priority[Stage] != Priority) continue;
+		
+		Entry->SubJobID = Jobs_Create((Stage == 0 ? MEMBUS_OP_OBJSTOP : Job->BatchOp == BATCH_RELOAD ?
+										MEMBUS_OP_OBJRELOAD : MEMBUS_OP_OBJSTART), Entry->ObjectID, Job->JobID);
+		
+		if (!(NewJob = Jobs_Lookup(Entry->SubJobID)))
+		{
+			Entry->SubJobID = 0;
+			Entry->Status = MEMBUS_STATUS_FAILURE;
+			Entry->Stage = 2;
+			continue;
+		}
+		
+		NewJob->PrintStatus = false; /*Somebody asked for this, so it goes in the log like any manual start or stop.*/
+	}
+}
+
+static void Jobs_BeginBatch(struct _EpochJob *Job)
+{
+	unsigned long Inc = 0;
+	
+	if (Job->BatchOp == BATCH_ENABLE || Job->BatchOp == BATCH_DISABLE)
+	{ /*These are just config edits. Nothing to wait for.*/
+		const Bool Enabling = (Job->BatchOp == BATCH_ENABLE);
+		ObjTable *CurObj = NULL;
+		
+		for (; Inc < Job->BatchCount; ++Inc)
+		{
+			struct _BatchEntry *const Entry = &Job->Batch[Inc];
+			
+			Entry->Stage = 2;
+			
+			if (!(CurObj = LookupObjectInTable(Entry->ObjectID)))
+			{
+				Entry->Status = MEMBUS_STATUS_FAILURE;
+				continue;
+			}
+			
+			CurObj->Enabled = Enabling;
+			Entry->Status = (unsigned char)Overlay_SaveEnabled(CurObj);
+		}
+	}
+	
+	Job->State = JOBSTATE_BATCH;
+	Jobs_StepBatch(Job);
+}
+
+static void Jobs_Begin(struct _EpochJob *Job)
+{
+	ObjTable *CurObj = NULL;
+	
+	if (Job->Opcode == MEMBUS_OP_RUNLEVEL)
+	{
+		Jobs_BeginRunlevel(Job);
+		return;
+	}
+	
+	if (Job->Opcode == MEMBUS_OP_BATCH)
+	{
+		Jobs_BeginBatch(Job);
+		return;
+	}
+	
+	if (!(CurObj = LookupObjectInTable(Job->Target)))
+	{
+		Jobs_Finish(Job, MEMBUS_STATUS_FAILURE);
+		return;
+	}
+	
+	if (Job->PrintStatus)
+	{
+		if (CurObj->Opts.RawDescription)
+		{
+			snprintf(Job->StatusReport, sizeof Job->StatusReport, "%s", CurObj->ObjectDescription);
+		}
+		else
+		{
+			snprintf(Job->StatusReport, sizeof Job->StatusReport, "%s %s",
+					(Job->Opcode == MEMBUS_OP_OBJSTART ? "Starting" : "Stopping"), CurObj->ObjectDescription);
+		}
+		
+		RenderStatusReport(Job->StatusReport);
+	}
+	
+	switch (Job->Opcode)
+	{
+		case MEMBUS_OP_OBJRELOAD:
+			if (!CurObj->Started || (!CurObj->ObjectReloadCommand && !CurObj->ReloadCommandSignal))
+			{
+				Jobs_Finish(Job, MEMBUS_STATUS_FAILURE);
+			}
+			else if (CurObj->ReloadCommandSignal != 0)
+			{ /*Signals are instant, no need to hang around.*/
+				Jobs_Finish(Job, (unsigned char)ProcessReloadCommand(CurObj, false));
+			}
+			else if (!Jobs_Launch(Job, CurObj, CurObj->ObjectReloadCommand, OBJCMD_RELOAD, JOBSTATE_RELOAD))
+			{
+				Jobs_Finish(Job, MEMBUS_STATUS_FAILURE);
+			}
+			return;
+		case MEMBUS_OP_OBJSTOP:
+			Jobs_BeginStop(Job, CurObj);
+			return;
+		default:
+			break;
+	}
+	
+	/*If we ask to start a HaltCmdOnly command, run the stop command instead, because that's all that we use.*/
+	if (CurObj->Opts.HaltCmdOnly)
+	{
+		Jobs_BeginStop(Job, CurObj);
+		return;
+	}
+	
+	if (CurObj->ObjectStartCommand == NULL)
+	{
+		Jobs_Finish(Job, MEMBUS_STATUS_OK);
+		return;
+	}
+	
+	if (CurObj->Opts.PivotRoot || CurObj->Opts.Exec)
+	{ /*These replace the world out from under us anyways. Nothing to gain by not blocking.*/
+		Jobs_Finish(Job, (unsigned char)ProcessConfigObject(CurObj, true, false));
+		return;
+	}
+	
+	Job->PrestartStatus = SUCCESS;
+	
+	if (!Jobs_Launch(Job, CurObj, (CurObj->ObjectPrestartCommand ? CurObj->ObjectPrestartCommand : CurObj->ObjectStartCommand),
+					(CurObj->ObjectPrestartCommand ? OBJCMD_PRESTART : OBJCMD_START),
+					(CurObj->ObjectPrestartCommand ? JOBSTATE_PRESTART : JOBSTATE_START)))
+	{
+		Jobs_Finish(Job, MEMBUS_STATUS_FAILURE);
+	}
+}
+
+static void Jobs_StepRunlevel(struct _EpochJob *Job)
+{ /*Stop everything not meant for the new runlevel, then start what is, one object at a time.*/
+	const Bool Starting = (Job->State == JOBSTATE_RLSTART);
+	ObjTable *TObj = NULL, *LastNode = NULL;
+	unsigned long MaxPriority = 0;
+	
+	if (Job->SubJobID)
+	{
+		const struct _EpochJob *SubJob = Jobs_Lookup(Job->SubJobID);
+		
+		if (SubJob && SubJob->State != JOBSTATE_DONE) return;
+		
+		Job->SubJobID = 0;
+	}
+	
+	if (Job->Cancelled)
+	{
+		Jobs_Finish(Job, MEMBUS_STATUS_CANCELLED);
+		return;
+	}
+	
+	/*If the object we left off on vanished in a config reload, rescanning the priority is harmless.*/
+	if (*Job->LastObjectID) LastNode = LookupObjectInTable(Job->LastObjectID);
+	
+	for (MaxPriority = GetHighestPriority(Starting); Job->Priority <= MaxPriority; ++Job->Priority, LastNode = NULL)
+	{
+		for (; (TObj = GetObjectByPriority(CurRunlevel, LastNode, Starting, Job->Priority)); LastNode = TObj)
+		{
+			if (TObj == (void*)-1)
+			{
+				Jobs_Finish(Job, MEMBUS_STATUS_FAILURE);
+				return;
+			}
+			
+			if (Starting ? (TObj->Enabled && !TObj->Started && !TObj->Opts.HaltCmdOnly) :
+				(TObj->Started && !TObj->Opts.Persistent && !TObj->Opts.HaltCmdOnly &&
+				!ObjRL_CheckRunlevel(Job->Target, TObj, true)))
+			{
+				snprintf(Job->LastObjectID, sizeof Job->LastObjectID, "%s", TObj->ObjectID);
+				Job->SubJobID = Jobs_Create(Starting ? MEMBUS_OP_OBJSTART : MEMBUS_OP_OBJSTOP, TObj->ObjectID, Job->JobID);
+				return;
+			}
+		}
+	}
+	
+	if (!Starting)
+	{ /*Good to go, so change us to the new runlevel.*/
+		snprintf(CurRunlevel, MAX_DESCRIPT_SIZE, "%s", Job->Target);
+		Events_Emit(EVENT_RUNLEVEL, CurRunlevel, 0);
+		
+		Job->State = JOBSTATE_RLSTART;
+		Job->Priority = 1;
+		*Job->LastObjectID = '\0';
+		return;
+	}
+	
+	Jobs_Finish(Job, MEMBUS_STATUS_OK);
+}
+
+static void Jobs_Step(struct _EpochJob *Job)
+{
+	ObjTable *CurObj = NULL;
+	
+	if (Job->State == JOBSTATE_RLSTOP || Job->State == JOBSTATE_RLSTART)
+	{
+		Jobs_StepRunlevel(Job);
+		return;
+	}
+	
+	if (Job->State == JOBSTATE_BATCH)
+	{
+		Jobs_StepBatch(Job);
+		return;
+	}
+	
+	if (Job->ChildPID && !Job->ChildExited)
+	{ /*Still waiting on a command.*/
+		return;
+	}
+	
+	if (!(CurObj = LookupObjectInTable(Job->Target)))
+	{ /*Somebody reloaded the config out from under us.*/
+		Job->ChildPID = 0;
+		Jobs_Finish(Job, MEMBUS_STATUS_FAILURE);
+		return;
+	}
+	
+	switch (Job->State)
+	{
+		case JOBSTATE_PRESTART:
+			Job->PrestartStatus = CompleteObjectCommand(CurObj, OBJCMD_PRESTART, Job->ChildPID,
+														Job->RawExitStatus, Job->ShellDissolves);
+			Job->ChildPID = 0;
+		
+			if (Job->Cancelled)
+			{
+				Jobs_Finish(Job, MEMBUS_STATUS_CANCELLED);
+			}
+			else if (!Jobs_Launch(Job, CurObj, CurObj->ObjectStartCommand, OBJCMD_START, JOBSTATE_START))
+			{
+				Jobs_Finish(Job, MEMBUS_STATUS_FAILURE);
+			}
+			break;
+		case JOBSTATE_START:
+			Job->Result = CompleteObjectCommand(CurObj, OBJCMD_START, Job->ChildPID,
+												Job->RawExitStatus, Job->ShellDissolves);
+			Job->ChildPID = 0;
+		
+			if (Job->PrestartStatus != SUCCESS && Job->Result)
+			{
+				char TBuf[MAX_LINE_SIZE];
+			
+				snprintf(TBuf, MAX_LINE_SIZE, "Prestart command %s for object \"%s\".",
+						Job->PrestartStatus ? "returned a warning" : "failed", CurObj->ObjectID);
+				WriteLogLine(TBuf, true);
+				Job->Result = WARNING;
+			}
+		
+			/*Wait for a PID file to appear if we specified one. This prevents autorestart hell.*/
+			if (Job->Result && CurObj->Opts.HasPIDFile && !Job->Cancelled)
+			{
+				Job->Deadline = time(NULL) + 10;
+				Job->State = JOBSTATE_PIDFILEWAIT;
+				break;
+			}
+		
+			Jobs_FinishStart(Job, CurObj);
+			break;
+		case JOBSTATE_PIDFILEWAIT:
+			if (FileUsable(CurObj->ObjectPIDFile) || Job->Cancelled)
+			{
+				Jobs_FinishStart(Job, CurObj);
+			}
+			else if (time(NULL) >= Job->Deadline)
+			{
+				char OutBuf[MAX_LINE_SIZE];
+			
+				snprintf(OutBuf, sizeof OutBuf,CONSOLE_COLOR_YELLOW "WARNING: " CONSOLE_ENDCOLOR
+						"Object %s was successfully started%s,\n"
+						"but it's PID file did not appear within ten seconds of start.\n"
+						"Please verify that \"%s\" exists and whether this object is starting properly.",
+						CurObj->ObjectID, (Job->Result == WARNING ? ", but with a warning" : ""),
+						CurObj->ObjectPIDFile);
+			
+				WriteLogLine(OutBuf, true);
+				Job->Result = WARNING;
+				Jobs_FinishStart(Job, CurObj);
+			}
+			break;
+		case JOBSTATE_STOPCMD:
+			Job->Result = CompleteObjectCommand(CurObj, OBJCMD_STOP, Job->ChildPID,
+												Job->RawExitStatus, Job->ShellDissolves);
+			Job->ChildPID = 0;
+		
+			if (CurObj->Opts.NoStopWait || Job->Cancelled)
+			{
+				Jobs_FinishStop(Job, CurObj);
+				break;
+			}
+		
+			Job->WaitPID = 0;
+			Job->Deadline = time(NULL) + CurObj->Opts.StopTimeout;
+			Job->State = JOBSTATE_STOPWAIT;
+			break;
+		case JOBSTATE_STOPWAIT:
+		{
+			const Bool Running = (Job->WaitPID ? kill(Job->WaitPID, 0) == 0 : ObjectProcessRunning(CurObj));
+			
+			if (!Running)
+			{
+				Jobs_FinishStop(Job, CurObj);
+			}
+			else if (Job->Cancelled)
+			{ /*Same as being aborted with Ctrl-Alt-Del.*/
+				Job->Result = WARNING;
+				Jobs_FinishStop(Job, CurObj);
+			}
+			else if (time(NULL) >= Job->Deadline)
+			{ /*A stop command that ran but didn't do the job is a warning. A signal that didn't is a failure.*/
+				Job->Result = (CurObj->Opts.StopMode == STOP_COMMAND ? WARNING : FAILURE);
+				Jobs_FinishStop(Job, CurObj);
+			}
+			break;
+		}
+		case JOBSTATE_RELOAD:
+			Job->Result = CompleteObjectCommand(CurObj, OBJCMD_RELOAD, Job->ChildPID,
+												Job->RawExitStatus, Job->ShellDissolves);
+			Job->ChildPID = 0;
+			Jobs_Finish(Job, (unsigned char)Job->Result);
+			break;
+		default:
+			break;
+	}
+}
+
+static void Jobs_Finish(struct _EpochJob *Job, unsigned char Status)
+{
+	const char *Verb = NULL;
+	char TmpBuf[MAX_LINE_SIZE];
+	
+	if (Job->Cancelled) Status = MEMBUS_STATUS_CANCELLED;
+	
+	Job->State = JOBSTATE_DONE;
+	Job->Status = Status;
+	Job->Finished = time(NULL);
+	
+	if (Job->PrintStatus)
+	{
+		CompleteStatusReport(Job->StatusReport, (Status <= MEMBUS_STATUS_WARNING ? (rStatus)Status : FAILURE), true);
+		return;
+	}
+	
+	switch (Job->Opcode)
+	{
+		case MEMBUS_OP_OBJSTART:
+			Verb = "start";
+			break;
+		case MEMBUS_OP_OBJSTOP:
+			Verb = "stop";
+			break;
+		case MEMBUS_OP_OBJRELOAD:
+			Verb = "reload";
+			break;
+		default:
+			break;
+	}
+	
+	if (Job->Opcode == MEMBUS_OP_BATCH)
+	{
+		snprintf(TmpBuf, sizeof TmpBuf, "Batch %s of %lu object%s %s%s", Job->Target, Job->BatchCount,
+				(Job->BatchCount == 1 ? "" : "s"),
+				(Status == MEMBUS_STATUS_OK || Status == MEMBUS_STATUS_WARNING ? "succeeded" :
+				Status == MEMBUS_STATUS_CANCELLED ? "was cancelled" : "had failures"),
+				(Status == MEMBUS_STATUS_WARNING ? " with warnings" : ""));
+		WriteLogLine(TmpBuf, true);
+	}
+	else if (Verb)
+	{
+		snprintf(TmpBuf, sizeof TmpBuf, "Manual %s of object %s %s%s", Verb, Job->Target,
+				(Status == MEMBUS_STATUS_OK || Status == MEMBUS_STATUS_WARNING ? "succeeded" :
+				Status == MEMBUS_STATUS_CANCELLED ? "was cancelled" : "failed"),
+				(Status == MEMBUS_STATUS_WARNING ? " with a warning" : ""));
+		WriteLogLine(TmpBuf, true);
+	}
+	else if (Status == MEMBUS_STATUS_OK)
+	{
+		snprintf(TmpBuf, sizeof TmpBuf, CONSOLE_COLOR_GREEN "Switched to runlevel \"%s\"." CONSOLE_ENDCOLOR, Job->Target);
+		puts(TmpBuf);
+		WriteLogLine(TmpBuf, true);
+	}
+	else
+	{
+		snprintf(TmpBuf, sizeof TmpBuf, "Failed to switch to runlevel \"%s\".", Job->Target);
+		SpitError(TmpBuf);
+		WriteLogLine(TmpBuf, true);
+	}
+}
+
+Bool Jobs_Cancel(unsigned long JobID)
+{ /*Cancellation kills whatever command the job is waiting on, and the job winds down on it's next step.*/
+	struct _EpochJob *Job = Jobs_Lookup(JobID);
+	unsigned long Inc = 0;
+	
+	if (!Job || Job->State == JOBSTATE_DONE) return false;
+	
+	Job->Cancelled = true;
+	
+	if (Job->State == JOBSTATE_QUEUED)
+	{
+		for (Inc = 0; Inc < Job->BatchCount; ++Inc)
+		{ /*None of it ever happened.*/
+			Job->Batch[Inc].Status = MEMBUS_STATUS_CANCELLED;
+		}
+		
+		Jobs_Finish(Job, MEMBUS_STATUS_CANCELLED);
+	}
+	else if (Job->ChildPID && !Job->ChildExited)
+	{
+		kill(Job->ChildPID, SIGKILL);
+	}
+	
+	if (Job->SubJobID) Jobs_Cancel(Job->SubJobID);
+	
+	for (Inc = 0; Inc < Job->BatchCount; ++Inc)
+	{
+		if (Job->Batch[Inc].SubJobID) Jobs_Cancel(Job->Batch[Inc].SubJobID);
+	}
+	
+	return true;
+}
+
+Bool Jobs_ChildExited(unsigned long PID, int RawExitStatus)
+{ /*Called by the reaper in the primary loop. Returns true if it was one of ours.*/
+	struct _EpochJob *Worker = JobList;
+	
+	for (; Worker; Worker = Worker->Next)
+	{
+		if (Worker->ChildPID == PID && !Worker->ChildExited && Worker->State != JOBSTATE_DONE)
+		{
+			Worker->ChildExited = true;
+			Worker->RawExitStatus = RawExitStatus;
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+void Jobs_SetWaiter(struct _EpochJob *Job, const struct _MemBusRequest *Req)
+{ /*The reply gets sent by Jobs_Service() once the job is done.*/
+	Job->Waiter.Set = true;
+	Job->Waiter.Binary = Req->Binary;
+	Job->Waiter.Opcode = Req->Opcode;
+	Job->Waiter.RequestID = Req->RequestID;
+	Job->Waiter.LockSerial = *MemBus.LockSerial;
+	snprintf(Job->Waiter.Text, sizeof Job->Waiter.Text, "%s", Req->Text);
+}
+
+static Bool Jobs_DeliverReply(struct _EpochJob *Job)
+{ /*Returns true once the waiter is dealt with, one way or another.*/
+	struct _MemBusRequest Req;
+	
+	if (!BusRunning || !*MemBus.LockPID || *MemBus.LockSerial != Job->Waiter.LockSerial)
+	{ /*They went away. Nobody to tell.*/
+		return true;
+	}
+	
+	if (*MemBus.Client.Status != MEMBUS_NOMSG)
+	{ /*They haven't eaten their last message yet. Don't block on them.*/
+		return false;
+	}
+	
+	Req.Binary = Job->Waiter.Binary;
+	Req.Opcode = Job->Waiter.Opcode;
+	Req.RequestID = Job->Waiter.RequestID;
+	snprintf(Req.Text, sizeof Req.Text, "%s", Job->Waiter.Text);
+	
+	if (Job->Opcode == MEMBUS_OP_BATCH)
+	{ /*They get everybody's result at once.*/
+		MemBus_ReplyBatch(&Req, Job);
+	}
+	else
+	{
+		MemBus_ReplyValue(&Req, Job->Status, NULL, MEMBUS_TLV_JOBID, &Job->JobID, sizeof(long));
+	}
+	
+	return true;
+}
+
+void Jobs_Service(void)
+{ /*Called every pass of the primary loop.*/
+	struct _EpochJob *Worker = JobList, *Prev = NULL, *Next = NULL;
+	unsigned long NumFinished = 0;
+	const unsigned long CurTime = time(NULL);
+	
+	for (; Worker; Worker = Worker->Next)
+	{ /*New jobs can get appended while we walk this. That's fine, they just get their first step now.*/
+		Log_SetObject(Worker->Opcode != MEMBUS_OP_RUNLEVEL && Worker->Opcode != MEMBUS_OP_BATCH ? Worker->Target : NULL);
+		
+		if (Worker->State == JOBSTATE_QUEUED)
+		{
+			if (Jobs_CanBegin(Worker)) Jobs_Begin(Worker);
+		}
+		else if (Worker->State != JOBSTATE_DONE)
+		{
+			Jobs_Step(Worker);
+		}
+		
+		if (Worker->State == JOBSTATE_DONE)
+		{
+			if (Worker->Waiter.Set && Jobs_DeliverReply(Worker))
+			{
+				Worker->Waiter.Set = false;
+			}
+			
+			++NumFinished;
+		}
+	}
+	
+	Log_SetObject(NULL);
+	
+	/*Forget the oldest finished jobs. Not ones whose parent is still running, though,
+	 * since it hasn't necessarily picked up how they went yet.*/
+	for (Worker = JobList; Worker; Worker = Next)
+	{
+		const struct _EpochJob *Parent = NULL;
+		
+		Next = Worker->Next;
+		
+		if (Worker->State == JOBSTATE_DONE && !Worker->Waiter.Set &&
+			(!Worker->ParentJobID || !(Parent = Jobs_Lookup(Worker->ParentJobID)) || Parent->State == JOBSTATE_DONE) &&
+			(NumFinished > JOBS_MAX_FINISHED || Worker->Finished + JOBS_FINISHED_LIFETIME < CurTime))
+		{
+			if (Prev) Prev->Next = Next;
+			else JobList = Next;
+			
+			free(Worker->Batch);
+			free(Worker);
+			--NumFinished;
+			continue;
+		}
+		
+		Prev = Worker;
+	}
+}
+
+void Jobs_Shutdown(void)
+{ /*We're going down. Kill anything our jobs are waiting on and forget them.*/
+	struct _EpochJob *Worker = JobList, *Next = NULL;
+	
+	for (; Worker; Worker = Next)
+	{
+		ObjTable *CurObj = NULL;
+		
+		Next = Worker->Next;
+		
+		if (Worker->State != JOBSTATE_DONE)
+		{
+			if (Worker->ChildPID && !Worker->ChildExited)
+			{
+				kill(Worker->ChildPID, SIGKILL);
+			}
+			
+			if (Worker->Stopping && (CurObj = LookupObjectInTable(Worker->Target)))
+			{ /*So the object is stopped like any other.*/
+				CurObj->Opts.AutoRestart = Worker->SavedAutoRestart;
+			}
+		}
+		
+		free(Worker->Batch);
+		free(Worker);
+	}
+	
+	JobList = NULL;
+}
+
+void Jobs_SaveState(struct _RXDState *State)
+{ /*For reexec. Each job goes over whole, with it's batch entries tacked on the end.
+	* Children we're waiting on stay our children across execve(), so the jobs just carry on.*/
+	const struct _EpochJob *Worker = JobList;
+	
+	RXD_Append(State, RXD_REC_JOBCOUNTER, &JobCounter, sizeof(long));
+	
+	for (; Worker; Worker = Worker->Next)
+	{
+		RXD_Append(State, RXD_REC_JOB, Worker, sizeof(struct _EpochJob));
+		
+		if (Worker->Batch) RXD_Extend(State, Worker->Batch, sizeof(struct _BatchEntry) * Worker->BatchCount);
+	}
+}
+
+rStatus Jobs_RestoreState(unsigned char Type, const void *Data, unsigned long Length)
+{
+	struct _EpochJob *Job = NULL, *Worker = JobList;
+	
+	if (Type == RXD_REC_JOBCOUNTER)
+	{
+		if (Length != sizeof(long)) return FAILURE;
+		
+		memcpy(&JobCounter, Data, sizeof(long));
+		return SUCCESS;
+	}
+	
+	if (Length < sizeof(struct _EpochJob) || !(Job = malloc(sizeof(struct _EpochJob)))) return FAILURE;
+	
+	memcpy(Job, Data, sizeof(struct _EpochJob));
+	Job->Next = NULL;
+	Job->Batch = NULL;
+	
+	if (Job->BatchCount)
+	{
+		if (Length != sizeof(struct _EpochJob) + sizeof(struct _BatchEntry) * Job->BatchCount ||
+			!(Job->Batch = malloc(sizeof(struct _BatchEntry) * Job->BatchCount)))
+		{
+			free(Job);
+			return FAILURE;
+		}
+		
+		memcpy(Job->Batch, (const char*)Data + sizeof(struct _EpochJob), sizeof(struct _BatchEntry) * Job->BatchCount);
+	}
+	
+	/*They were saved oldest first, so keep them that way.*/
+	if (!JobList)
+	{
+		JobList = Job;
+	}
+	else
+	{
+		for (; Worker->Next; Worker = Worker->Next);
+		Worker->Next = Job;
+	}
+	
+	return SUCCESS;
+}
@@ -0,0 +1,234 @@
+/*This code is part of the Epoch Init System.
+* The Epoch Init System is maintained by Subsentient.
+* This software is public domain.
+* Please read the file UNLICENSE.TXT for more information.*/
+
+/**This file is the last thing shutdown does before syncing and rebooting.
+ * Whatever's still running after the objects are stopped gets found in one look at /proc,
+ * sent SIGTERM all at once, and waited on together until ShutdownKillTimeout runs out.
+ * We wait on pidfds where the kernel has them, so a process leaving wakes us right away
+ * and a recycled PID can't get a signal meant for somebody else. Without them we check
+ * every so often with kill(). Anything still around at the deadline gets SIGKILL,
+ * and we say who, since something that ignores SIGTERM is worth knowing about.**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include "epoch.h"
+
+#define KILLALL_NAME_SIZE 64
+#define KILLALL_CHECK_INTERVAL 50 /*Milliseconds between kill() checks on processes with no pidfd.*/
+#define KILLALL_KILL_GRACE 1000 /*How long we reap after SIGKILL. It's quick unless something's stuck in the kernel.*/
+
+struct _KillTarget
+{
+	pid_t PID;
+	int PidFD; /*-1 if we couldn't get one.*/
+	Bool Gone;
+	char Name[KILLALL_NAME_SIZE];
+};
+
+unsigned long ShutdownKillTimeout = KILLALL_DEFAULT_TIMEOUT;
+
+static unsigned long KillAll_Now(void)
+{ /*Milliseconds, on a clock that doesn't jump.*/
+	struct timespec Mono;
+	
+	clock_gettime(CLOCK_MONOTONIC, &Mono);
+	
+	return Mono.tv_sec * 1000ul + Mono.tv_nsec / 1000000;
+}
+
+static int KillAll_OpenPidFD(pid_t PID)
+{
+#ifdef SYS_pidfd_open
+	return syscall(SYS_pidfd_open, PID, 0);
+#else
+	return -1;
+#endif
+}
+
+static void KillAll_Signal(const struct _KillTarget *Target, int Signal)
+{
+#ifdef SYS_pidfd_send_signal
+	if (Target->PidFD != -1)
+	{ /*Never fall back to the PID here. If this failed, it's gone, and the PID might not be it anymore.*/
+		syscall(SYS_pidfd_send_signal, Target->PidFD, Signal, NULL, 0);
+		return;
+	}
+#endif
+	kill(Target->PID, Signal);
+}
+
+static unsigned long KillAll_Collect(struct _KillTarget **Out)
+{ /*Everything but us and kernel threads, which have no command line.*/
+	struct _KillTarget *Targets = NULL;
+	const pid_t OurPID = getpid();
+	const char *CmdLine = NULL;
+	unsigned long Length, Inc, Name, Count = 0;
+	pid_t PID;
+	
+	ProcScan_Hold();
+	
+	if (!ProcScan_Snapshot() || !(Targets = malloc((ProcScan_Count() + 1) * sizeof(struct _KillTarget))))
+	{
+		ProcScan_Unhold();
+		*Out = NULL;
+		return 0;
+	}
+	
+	for (Inc = 0; Inc < ProcScan_Count(); ++Inc)
+	{
+		PID = ProcScan_Entry(Inc, &CmdLine, &Length);
+		
+		if (PID == 1 || PID == OurPID || Length == 0) continue;
+		
+		/*Get the pidfd now, before it has any chance of being a different process.*/
+		Targets[Count].PID = PID;
+		Targets[Count].PidFD = KillAll_OpenPidFD(PID);
+		Targets[Count].Gone = false;
+		
+		if (Length >= KILLALL_NAME_SIZE) Length = KILLALL_NAME_SIZE - 1;
+		
+		for (Name = 0; Name < Length; ++Name)
+		{ /*It goes to the console, so no newlines or escapes.*/
+			Targets[Count].Name[Name] = isprint((unsigned char)CmdLine[Name]) ? CmdLine[Name] : ' ';
+		}
+		
+		while (Length > 0 && Targets[Count].Name[Length - 1] == ' ') --Length;
+		Targets[Count].Name[Length] = '\0';
+		
+		++Count;
+	}
+	
+	ProcScan_Unhold();
+	
+	*Out = Targets;
+	return Count;
+}
+
+static unsigned long KillAll_Wait(struct _KillTarget *Targets, unsigned long Count, unsigned long Deadline)
+{ /*Waits for all of them together, until they're gone or it's Deadline. Returns how many are left.*/
+	struct pollfd *PollFDs = NULL;
+	unsigned long *PollTargets = NULL;
+	unsigned long Inc, NumPolled, Left, Now;
+	Bool Unpolled;
+	int Timeout;
+	
+	PollFDs = malloc((Count + 1) * sizeof(struct pollfd));
+	PollTargets = malloc((Count + 1) * sizeof(unsigned long));
+	
+	for (;;)
+	{
+		/*Whatever gets reparented to us has to be reaped, or it never really goes.*/
+		while (waitpid(-1, NULL, WNOHANG) > 0);
+		
+		NumPolled = Left = 0;
+		Unpolled = false;
+		
+		for (Inc = 0; Inc < Count; ++Inc)
+		{
+			if (Targets[Inc].Gone) continue;
+			
+			if (Targets[Inc].PidFD != -1 && PollFDs && PollTargets)
+			{
+				PollFDs[NumPolled].fd = Targets[Inc].PidFD;
+				PollFDs[NumPolled].events = POLLIN;
+				PollFDs[NumPolled].revents = 0;
+				PollTargets[NumPolled++] = Inc;
+			}
+			else if (kill(Targets[Inc].PID, 0) == -1 && errno == ESRCH)
+			{
+				Targets[Inc].Gone = true;
+				continue;
+			}
+			else
+			{
+				Unpolled = true;
+			}
+			
+			++Left;
+		}
+		
+		if (!Left || (Now = KillAll_Now()) >= Deadline) break;
+		
+		Timeout = Deadline - Now;
+		if (Unpolled && Timeout > KILLALL_CHECK_INTERVAL) Timeout = KILLALL_CHECK_INTERVAL;
+		
+		if (NumPolled)
+		{
+			if (poll(PollFDs, NumPolled, Timeout) <= 0) continue;
+			
+			for (Inc = 0; Inc < NumPolled; ++Inc)
+			{
+				if (PollFDs[Inc].revents) Targets[PollTargets[Inc]].Gone = true;
+			}
+		}
+		else
+		{
+			poll(NULL, 0, Timeout);
+		}
+	}
+	
+	free(PollFDs);
+	free(PollTargets);
+	
+	return Left;
+}
+
+void KillAll_Run(void)
+{ /*SIGTERM to everything left, then SIGKILL to whatever's still here at the deadline.*/
+	struct _KillTarget *Targets = NULL;
+	unsigned long Count, Inc, Left;
+	
+	if (!ShutdownKillTimeout) return;
+	
+	if (!(Count = KillAll_Collect(&Targets)))
+	{
+		free(Targets);
+		return;
+	}
+	
+	printf("Sending SIGTERM to %lu remaining processes.\n", Count);
+	
+	for (Inc = 0; Inc < Count; ++Inc)
+	{
+		KillAll_Signal(Targets + Inc, SIGTERM);
+		KillAll_Signal(Targets + Inc, SIGCONT); /*A stopped process can't act on SIGTERM.*/
+	}
+	
+	if ((Left = KillAll_Wait(Targets, Count, KillAll_Now() + ShutdownKillTimeout * 1000)))
+	{
+		printf("%s%lu processes ignored SIGTERM for %lu seconds. Sending SIGKILL to:%s\n",
+				CONSOLE_COLOR_YELLOW, Left, ShutdownKillTimeout, CONSOLE_ENDCOLOR);
+		
+		for (Inc = 0; Inc < Count; ++Inc)
+		{
+			if (Targets[Inc].Gone) continue;
+			
+			printf("  %lu %s\n", (unsigned long)Targets[Inc].PID, Targets[Inc].Name);
+			KillAll_Signal(Targets + Inc, SIGKILL);
+		}
+		
+		if ((Left = KillAll_Wait(Targets, Count, KillAll_Now() + KILLALL_KILL_GRACE)))
+		{
+			printf("%s%lu processes are still around after SIGKILL.%s\n", CONSOLE_COLOR_RED, Left, CONSOLE_ENDCOLOR);
+		}
+	}
+	
+	for (Inc = 0; Inc < Count; ++Inc)
+	{
+		if (Targets[Inc].PidFD != -1) close(Targets[Inc].PidFD);
+	}
+	
+	free(Targets);
+}
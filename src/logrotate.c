@@ -0,0 +1,303 @@
+/*This code is part of the Epoch Init System.
+* The Epoch Init System is maintained by Subsentient.
+* This software is public domain.
+* Please read the file UNLICENSE.TXT for more information.*/
+
+/**This file compresses the logs that Log_Rotate() set aside. The work happens in a child
+ * at the lowest CPU and I/O priority, so PID 1 only ever pays for a rename and a fork().
+ * The output is a standard LZ4 frame, so lz4cat reads it, but the codec is our own
+ * and needs nothing else installed.**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include "epoch.h"
+
+#define LZ4_MAGIC 0x184D2204UL
+#define LZ4_BLOCK_SIZE 65536 /*The frame descriptor below says 64 KiB blocks.*/
+#define LZ4_HASH_BITS 12
+#define LZ4_MINMATCH 4
+#define LZ4_LASTLITERALS 5 /*The format wants the last five bytes to be literals,*/
+#define LZ4_MFLIMIT 12 /*and no match to start in the last twelve.*/
+#define LZ4_BOUND(Size) ((Size) + (Size) / 255 + 16)
+#define U32(Value) ((Value) & 0xFFFFFFFFUL)
+
+static unsigned long LZ4_Read32(const unsigned char *In)
+{
+	return In[0] | (unsigned long)In[1] << 8 | (unsigned long)In[2] << 16 | (unsigned long)In[3] << 24;
+}
+
+static void LZ4_Write32(unsigned char *Out, unsigned long Value)
+{
+	Out[0] = Value & 0xFF;
+	Out[1] = (Value >> 8) & 0xFF;
+	Out[2] = (Value >> 16) & 0xFF;
+	Out[3] = (Value >> 24) & 0xFF;
+}
+
+static unsigned long XXH32(const unsigned char *In, unsigned long Length)
+{ /*Only the frame header checksum needs this, so it's the short-input path only, with seed 0.*/
+	const unsigned long Prime1 = 2654435761UL, Prime2 = 2246822519UL, Prime3 = 3266489917UL;
+	const unsigned long Prime4 = 668265263UL, Prime5 = 374761393UL;
+	unsigned long Hash = U32(Prime5 + Length);
+	
+	for (; Length >= 4; In += 4, Length -= 4)
+	{
+		Hash = U32(Hash + LZ4_Read32(In) * Prime3);
+		Hash = U32(((Hash << 17) | (Hash >> 15)) * Prime4);
+	}
+	
+	for (; Length > 0; ++In, --Length)
+	{
+		Hash = U32(Hash + *In * Prime5);
+		Hash = U32(((Hash << 11) | (Hash >> 21)) * Prime1);
+	}
+	
+	Hash ^= Hash >> 15;
+	Hash = U32(Hash * Prime2);
+	Hash ^= Hash >> 13;
+	Hash = U32(Hash * Prime3);
+	Hash ^= Hash >> 16;
+	
+	return Hash;
+}
+
+static unsigned char *LZ4_PutLength(unsigned char *Out, unsigned long Length)
+{ /*What didn't fit in the token's nibble, as a run of 255s and a remainder.*/
+	for (; Length >= 255; Length -= 255) *Out++ = 255;
+	*Out++ = (unsigned char)Length;
+	
+	return Out;
+}
+
+static unsigned long LZ4_CompressBlock(const unsigned char *In, unsigned long Length, unsigned char *Out)
+{ /*Greedy, one hash probe per position, like LZ4's fast mode. Out needs LZ4_BOUND(Length) bytes.*/
+	unsigned short Table[1 << LZ4_HASH_BITS]; /*Offsets into the block. Blocks are 64 KiB, so they fit.*/
+	const unsigned char *Worker = In, *Anchor = In, *Match = NULL;
+	const unsigned char *const MatchLimit = In + Length - LZ4_LASTLITERALS;
+	const unsigned char *const SearchLimit = In + Length - LZ4_MFLIMIT;
+	unsigned char *OutWorker = Out, *Token = NULL;
+	unsigned long Hash, Literals, MatchLength;
+	
+	memset(Table, 0, sizeof Table);
+	
+	while (Length > LZ4_MFLIMIT && Worker < SearchLimit)
+	{
+		Hash = U32(LZ4_Read32(Worker) * 2654435761UL) >> (32 - LZ4_HASH_BITS);
+		Match = In + Table[Hash];
+		Table[Hash] = (unsigned short)(Worker - In);
+		
+		if (Match >= Worker || Worker - Match > 65535 || LZ4_Read32(Match) != LZ4_Read32(Worker))
+		{
+			++Worker;
+			continue;
+		}
+		
+		/*Back up over anything before the match that matches too.*/
+		while (Worker > Anchor && Match > In && Worker[-1] == Match[-1]) --Worker, --Match;
+		
+		for (MatchLength = LZ4_MINMATCH; Worker + MatchLength < MatchLimit && Worker[MatchLength] == Match[MatchLength]; ++MatchLength);
+		
+		Literals = Worker - Anchor;
+		Token = OutWorker++;
+		*Token = (unsigned char)((Literals >= 15 ? 15 : Literals) << 4);
+		if (Literals >= 15) OutWorker = LZ4_PutLength(OutWorker, Literals - 15);
+		
+		memcpy(OutWorker, Anchor, Literals);
+		OutWorker += Literals;
+		
+		*OutWorker++ = (Worker - Match) & 0xFF;
+		*OutWorker++ = ((Worker - Match) >> 8) & 0xFF;
+		
+		*Token |= (unsigned char)(MatchLength - LZ4_MINMATCH >= 15 ? 15 : MatchLength - LZ4_MINMATCH);
+		if (MatchLength - LZ4_MINMATCH >= 15) OutWorker = LZ4_PutLength(OutWorker, MatchLength - LZ4_MINMATCH - 15);
+		
+		Worker += MatchLength;
+		Anchor = Worker;
+	}
+	
+	/*Everything left over is one last run of literals.*/
+	Literals = In + Length - Anchor;
+	*OutWorker++ = (unsigned char)((Literals >= 15 ? 15 : Literals) << 4);
+	if (Literals >= 15) OutWorker = LZ4_PutLength(OutWorker, Literals - 15);
+	
+	memcpy(OutWorker, Anchor, Literals);
+	
+	return OutWorker + Literals - Out;
+}
+
+static Bool LogRotate_WriteAll(int Descriptor, const void *Data, unsigned long Length)
+{
+	const char *Worker = Data;
+	long Ret;
+	
+	while (Length > 0)
+	{
+		if ((Ret = write(Descriptor, Worker, Length)) <= 0) return false;
+		
+		Worker += Ret;
+		Length -= Ret;
+	}
+	
+	return true;
+}
+
+static Bool LogRotate_Compress(const char *InPath, const char *OutPath)
+{ /*One LZ4 frame: magic, descriptor, then 64 KiB blocks, each stored raw if it didn't get any smaller.*/
+	static unsigned char InBlock[LZ4_BLOCK_SIZE], OutBlock[4 + LZ4_BOUND(LZ4_BLOCK_SIZE)];
+	unsigned char Header[7];
+	unsigned long Length, Compressed;
+	int InDescriptor, OutDescriptor;
+	long Ret = 0;
+	Bool WriteOK;
+	
+	if ((InDescriptor = open(InPath, O_RDONLY)) == -1) return false;
+	
+	if ((OutDescriptor = open(OutPath, O_WRONLY | O_CREAT | O_TRUNC, 0640)) == -1)
+	{
+		close(InDescriptor);
+		return false;
+	}
+	
+	LZ4_Write32(Header, LZ4_MAGIC);
+	Header[4] = 0x60; /*Version 1, independent blocks, no checksums or content size.*/
+	Header[5] = 0x40; /*64 KiB blocks.*/
+	Header[6] = (XXH32(Header + 4, 2) >> 8) & 0xFF;
+	
+	WriteOK = LogRotate_WriteAll(OutDescriptor, Header, sizeof Header);
+	
+	while (WriteOK)
+	{
+		for (Length = 0; Length < LZ4_BLOCK_SIZE && (Ret = read(InDescriptor, InBlock + Length, LZ4_BLOCK_SIZE - Length)) > 0; Length += Ret);
+		
+		if (Ret < 0) WriteOK = false;
+		if (!Length) break;
+		
+		if ((Compressed = LZ4_CompressBlock(InBlock, Length, OutBlock + 4)) < Length)
+		{
+			LZ4_Write32(OutBlock, Compressed);
+		}
+		else
+		{
+			LZ4_Write32(OutBlock, Length | 0x80000000UL);
+			memcpy(OutBlock + 4, InBlock, Compressed = Length);
+		}
+		
+		WriteOK = WriteOK && LogRotate_WriteAll(OutDescriptor, OutBlock, Compressed + 4);
+	}
+	
+	LZ4_Write32(Header, 0); /*End mark.*/
+	WriteOK = WriteOK && LogRotate_WriteAll(OutDescriptor, Header, 4) && fsync(OutDescriptor) == 0;
+	
+	close(InDescriptor);
+	close(OutDescriptor);
+	
+	return WriteOK;
+}
+
+static int LogRotate_CompareNames(const void *First, const void *Second)
+{
+	return strcmp(*(const char *const*)First, *(const char *const*)Second);
+}
+
+static void LogRotate_Work(void)
+{ /*Runs in the child. Compresses every rotated log that isn't yet, then trims them down to LogRotateKeep.*/
+	const unsigned long PrefixLength = sizeof LOGFILE_NAME "-" - 1;
+	char InPath[MAX_LINE_SIZE], OutPath[MAX_LINE_SIZE + 8], FinalPath[MAX_LINE_SIZE + 4];
+	char **Names = NULL, **NewNames = NULL;
+	unsigned long NumNames = 0, Inc, Length;
+	struct dirent *File = NULL;
+	DIR *Directory = NULL;
+	int Lock;
+	
+	/*Another one of us may still be at it. It'll have been started for older files, so wait for it, then do the rest.*/
+	if ((Lock = open(LOGDIR LOGFILE_NAME ".lock", O_WRONLY | O_CREAT, 0600)) == -1 || flock(Lock, LOCK_EX) != 0) return;
+	
+	if (!(Directory = opendir(LOGDIR))) return;
+	
+	while ((File = readdir(Directory)))
+	{
+		if (strncmp(File->d_name, LOGFILE_NAME "-", PrefixLength) != 0) continue;
+		
+		Length = strlen(File->d_name);
+		
+		if (Length > 4 && !strcmp(File->d_name + Length - 4, ".new"))
+		{ /*Left over from a compression that got cut off.*/
+			snprintf(InPath, sizeof InPath, LOGDIR "%s", File->d_name);
+			unlink(InPath);
+			continue;
+		}
+		
+		if (!(NewNames = realloc(Names, sizeof(char*) * (NumNames + 1)))) break;
+		
+		Names = NewNames;
+		if (!(Names[NumNames] = malloc(Length + 1))) break;
+		memcpy(Names[NumNames++], File->d_name, Length + 1);
+	}
+	
+	closedir(Directory);
+	
+	/*The names have the time in them, so sorted is oldest first.*/
+	if (NumNames) qsort(Names, NumNames, sizeof(char*), LogRotate_CompareNames);
+	
+	for (Inc = 0; Inc < NumNames; ++Inc)
+	{
+		Length = strlen(Names[Inc]);
+		snprintf(InPath, sizeof InPath, LOGDIR "%s", Names[Inc]);
+		
+		if (Inc + LogRotateKeep < NumNames)
+		{ /*One of the oldest. It goes either way.*/
+			unlink(InPath);
+			continue;
+		}
+		
+		if (Length > 4 && !strcmp(Names[Inc] + Length - 4, ".lz4")) continue;
+		
+		snprintf(OutPath, sizeof OutPath, "%s.lz4.new", InPath);
+		
+		if (!LogRotate_Compress(InPath, OutPath))
+		{
+			unlink(OutPath);
+			continue;
+		}
+		
+		/*The compressed one is whole before it gets its real name, and only then does the original go.*/
+		snprintf(FinalPath, sizeof FinalPath, "%s.lz4", InPath);
+		
+		if (rename(OutPath, FinalPath) == 0) unlink(InPath);
+		else unlink(OutPath);
+	}
+	
+	for (Inc = 0; Inc < NumNames; ++Inc) free(Names[Inc]);
+	free(Names);
+	close(Lock);
+}
+
+void LogRotate_Spawn(void)
+{ /*Fire and forget. The primary loop reaps it like any other child.*/
+#ifndef NOMMU
+	pid_t PID = fork();
+	
+	if (PID != 0) return;
+	
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGCHLD, SIG_DFL);
+	setpriority(PRIO_PROCESS, 0, 19);
+#ifdef SYS_ioprio_set
+	syscall(SYS_ioprio_set, 1, 0, 3 << 13); /*IOPRIO_WHO_PROCESS, ourselves, IOPRIO_CLASS_IDLE.*/
+#endif
+	
+	LogRotate_Work();
+	_exit(0);
+#endif /*Without fork() we'd be blocking PID 1 for this, so rotated logs just stay as they are.*/
+}
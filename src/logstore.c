@@ -0,0 +1,658 @@
+/*This code is part of the Epoch Init System.
+* The Epoch Init System is maintained by Subsentient.
+* This software is public domain.
+* Please read the file UNLICENSE.TXT for more information.*/
+
+/**This file is the structured log store, turned on with LogStore in epoch.conf.
+ * Alongside system.log, every log line goes into numbered, append-only segment files
+ * as a record with its boot, times, severity and object. When a segment fills up, we write
+ * out an index of which objects it has and where each boot starts in it, so "epoch log"
+ * only has to read the segments, and the parts of them, that can have what it's after.**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "epoch.h"
+
+#define LOGSTORE_MAGIC "EPOCHLOG"
+#define LOGSTORE_INDEX_MAGIC "EPOCHIDX"
+#define LOGSTORE_VERSION 1
+#define LOGSTORE_ALIGN(Size) (((Size) + sizeof(long) - 1) & ~(sizeof(long) - 1))
+
+struct _LogSegmentHeader
+{
+	char Magic[8];
+	unsigned long Version;
+	unsigned long Segment;
+};
+
+struct _LogRecordHeader
+{ /*Followed by the object ID and the message, each with a NUL, padded out to a long.*/
+	unsigned long Length; /*Of the whole record.*/
+	unsigned long BootID;
+	unsigned long BootKey; /*HashBytes() of the kernel's boot_id, so a reexec doesn't look like a new boot.*/
+	unsigned long WallTime;
+	unsigned long MonoSec, MonoNsec;
+	unsigned long ObjectHash; /*Zero for Epoch's own lines.*/
+	unsigned long Severity;
+	unsigned long ObjectLength, MessageLength;
+};
+
+struct _LogIndexHeader
+{ /*Followed by ObjectCount objects sorted by hash, then MarkCount marks in file order.*/
+	char Magic[8];
+	unsigned long Version;
+	unsigned long SegmentSize; /*If the segment's any other size, this index isn't for it.*/
+	unsigned long Records;
+	unsigned long FirstBoot, LastBoot, LastBootKey;
+	unsigned long FirstWall, LastWall, LastMono;
+	unsigned long ObjectCount, MarkCount;
+	unsigned long Checksum; /*HashBytes() of everything after this header.*/
+};
+
+struct _LogIndexObject
+{
+	unsigned long Hash;
+	unsigned long Records;
+	unsigned long FirstOffset;
+};
+
+struct _LogIndexMark
+{ /*Every boot gets one where it starts, and there's one every LOGSTORE_MARK_SPACING bytes besides.*/
+	unsigned long Offset;
+	unsigned long BootID;
+	unsigned long WallTime;
+};
+
+struct _LogIndex
+{
+	struct _LogIndexHeader Header;
+	struct _LogIndexObject *Objects;
+	struct _LogIndexMark *Marks;
+	unsigned long ObjectCapacity, MarkCapacity;
+};
+
+Bool LogStoreEnabled;
+
+static struct
+{
+	Bool Open;
+	int Descriptor; /*-1 between a segment filling up and the next record.*/
+	unsigned long Segment;
+	unsigned long Size; /*Of the current segment, counting what's still in Pending.*/
+	unsigned long BootID, BootKey;
+	struct _LogIndex Index;
+	char Pending[LOG_BUFFER_SIZE];
+	unsigned long PendingUsed;
+} LogStore = { false, -1 };
+
+static void LogStore_Path(char *Out, unsigned long OutSize, unsigned long Segment, const char *Extension)
+{
+	snprintf(Out, OutSize, LOGSTORE_DIR "%08lu.%s", Segment, Extension);
+}
+
+static Bool LogStore_ListSegments(unsigned long *First, unsigned long *Last)
+{ /*False if there aren't any.*/
+	DIR *Directory = NULL;
+	struct dirent *File = NULL;
+	unsigned long Segment;
+	char Extension[4];
+	Bool Found = false;
+	
+	if (!(Directory = opendir(LOGSTORE_DIR))) return false;
+	
+	while ((File = readdir(Directory)))
+	{
+		if (sscanf(File->d_name, "%lu.%3s", &Segment, Extension) != 2 || strcmp(Extension, "seg") != 0 || !Segment) continue;
+		
+		if (!Found || Segment < *First) *First = Segment;
+		if (!Found || Segment > *Last) *Last = Segment;
+		Found = true;
+	}
+	
+	closedir(Directory);
+	
+	return Found;
+}
+
+static unsigned long LogStore_KernelBootKey(void)
+{ /*Zero if /proc isn't there, and then we go by the monotonic clock instead.*/
+	char Buffer[64];
+	long Length;
+	int Descriptor;
+	
+	if ((Descriptor = open("/proc/sys/kernel/random/boot_id", O_RDONLY | O_CLOEXEC)) == -1) return 0;
+	
+	Length = read(Descriptor, Buffer, sizeof Buffer);
+	close(Descriptor);
+	
+	return Length > 0 ? HashBytes(Buffer, Length) : 0;
+}
+
+static Bool LogIndex_Grow(void **Array, unsigned long *Capacity, unsigned long Count, unsigned long Size)
+{
+	void *NewArray = NULL;
+	
+	if (Count < *Capacity) return true;
+	
+	if (!(NewArray = realloc(*Array, (*Capacity ? *Capacity * 2 : 16) * Size))) return false;
+	
+	*Array = NewArray;
+	*Capacity = *Capacity ? *Capacity * 2 : 16;
+	return true;
+}
+
+static void LogIndex_Reset(struct _LogIndex *Index)
+{
+	free(Index->Objects);
+	free(Index->Marks);
+	memset(Index, 0, sizeof(struct _LogIndex));
+}
+
+static struct _LogIndexObject *LogIndex_FindObject(const struct _LogIndex *Index, unsigned long Hash, unsigned long *Slot)
+{ /*Binary search. Slot gets where it would go if it's not there.*/
+	unsigned long Low = 0, High = Index->Header.ObjectCount, Mid;
+	
+	while (Low < High)
+	{
+		Mid = (Low + High) / 2;
+		
+		if (Index->Objects[Mid].Hash == Hash) return Index->Objects + Mid;
+		
+		if (Index->Objects[Mid].Hash < Hash) Low = Mid + 1;
+		else High = Mid;
+	}
+	
+	if (Slot) *Slot = Low;
+	return NULL;
+}
+
+static void LogIndex_Add(struct _LogIndex *Index, const struct _LogRecordHeader *Record, unsigned long Offset)
+{
+	struct _LogIndexHeader *const Header = &Index->Header;
+	struct _LogIndexObject *Object = NULL;
+	const struct _LogIndexMark *LastMark = Header->MarkCount ? Index->Marks + Header->MarkCount - 1 : NULL;
+	unsigned long Slot;
+	
+	if (!LastMark || LastMark->BootID != Record->BootID || Offset - LastMark->Offset >= LOGSTORE_MARK_SPACING)
+	{
+		if (LogIndex_Grow((void**)&Index->Marks, &Index->MarkCapacity, Header->MarkCount, sizeof(struct _LogIndexMark)))
+		{
+			Index->Marks[Header->MarkCount].Offset = Offset;
+			Index->Marks[Header->MarkCount].BootID = Record->BootID;
+			Index->Marks[Header->MarkCount].WallTime = Record->WallTime;
+			++Header->MarkCount;
+		}
+	}
+	
+	if (Record->ObjectHash && !(Object = LogIndex_FindObject(Index, Record->ObjectHash, &Slot)) &&
+		LogIndex_Grow((void**)&Index->Objects, &Index->ObjectCapacity, Header->ObjectCount, sizeof(struct _LogIndexObject)))
+	{
+		memmove(Index->Objects + Slot + 1, Index->Objects + Slot, (Header->ObjectCount - Slot) * sizeof(struct _LogIndexObject));
+		++Header->ObjectCount;
+		
+		Object = Index->Objects + Slot;
+		Object->Hash = Record->ObjectHash;
+		Object->Records = 0;
+		Object->FirstOffset = Offset;
+	}
+	
+	if (Object) ++Object->Records;
+	
+	if (!Header->Records++)
+	{
+		Header->FirstBoot = Record->BootID;
+		Header->FirstWall = Record->WallTime;
+	}
+	
+	Header->LastBoot = Record->BootID;
+	Header->LastBootKey = Record->BootKey;
+	Header->LastWall = Record->WallTime;
+	Header->LastMono = Record->MonoSec;
+}
+
+static Bool LogIndex_Write(const struct _LogIndex *Index, unsigned long Segment, unsigned long SegmentSize)
+{ /*Written whole to a temporary and renamed in, so a reader never sees half of one.*/
+	char IndexPath[MAX_LINE_SIZE], TempPath[MAX_LINE_SIZE + 8];
+	struct _LogIndexHeader Header = Index->Header;
+	const unsigned long ObjectsSize = Header.ObjectCount * sizeof(struct _LogIndexObject);
+	const unsigned long MarksSize = Header.MarkCount * sizeof(struct _LogIndexMark);
+	int Descriptor;
+	Bool WriteOK;
+	
+	memcpy(Header.Magic, LOGSTORE_INDEX_MAGIC, sizeof Header.Magic);
+	Header.Version = LOGSTORE_VERSION;
+	Header.SegmentSize = SegmentSize;
+	Header.Checksum = (HashBytes((const char*)Index->Objects, ObjectsSize) ^ HashBytes((const char*)Index->Marks, MarksSize));
+	
+	LogStore_Path(IndexPath, sizeof IndexPath, Segment, "idx");
+	snprintf(TempPath, sizeof TempPath, "%s.new", IndexPath);
+	
+	if ((Descriptor = open(TempPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) == -1) return false;
+	
+	WriteOK = (write(Descriptor, &Header, sizeof Header) == sizeof Header &&
+				write(Descriptor, Index->Objects, ObjectsSize) == (long)ObjectsSize &&
+				write(Descriptor, Index->Marks, MarksSize) == (long)MarksSize);
+	close(Descriptor);
+	
+	if (!WriteOK || rename(TempPath, IndexPath) != 0)
+	{
+		unlink(TempPath);
+		return false;
+	}
+	
+	return true;
+}
+
+static Bool LogIndex_Read(struct _LogIndex *Index, unsigned long Segment, unsigned long SegmentSize)
+{ /*Only succeeds if the index is sound and was made for the segment as it is now.*/
+	char IndexPath[MAX_LINE_SIZE];
+	struct _LogIndexHeader *const Header = &Index->Header;
+	unsigned long ObjectsSize, MarksSize;
+	int Descriptor;
+	Bool ReadOK;
+	
+	memset(Index, 0, sizeof(struct _LogIndex));
+	LogStore_Path(IndexPath, sizeof IndexPath, Segment, "idx");
+	
+	if ((Descriptor = open(IndexPath, O_RDONLY | O_CLOEXEC)) == -1) return false;
+	
+	if (read(Descriptor, Header, sizeof(struct _LogIndexHeader)) != sizeof(struct _LogIndexHeader) ||
+		memcmp(Header->Magic, LOGSTORE_INDEX_MAGIC, sizeof Header->Magic) != 0 || Header->Version != LOGSTORE_VERSION ||
+		Header->SegmentSize != SegmentSize || Header->ObjectCount > SegmentSize || Header->MarkCount > SegmentSize)
+	{
+		close(Descriptor);
+		return false;
+	}
+	
+	ObjectsSize = Header->ObjectCount * sizeof(struct _LogIndexObject);
+	MarksSize = Header->MarkCount * sizeof(struct _LogIndexMark);
+	
+	Index->Objects = malloc(ObjectsSize + 1);
+	Index->Marks = malloc(MarksSize + 1);
+	
+	ReadOK = (Index->Objects && Index->Marks && read(Descriptor, Index->Objects, ObjectsSize) == (long)ObjectsSize &&
+			read(Descriptor, Index->Marks, MarksSize) == (long)MarksSize &&
+			(HashBytes((const char*)Index->Objects, ObjectsSize) ^ HashBytes((const char*)Index->Marks, MarksSize)) == Header->Checksum);
+	close(Descriptor);
+	
+	if (!ReadOK) LogIndex_Reset(Index);
+	
+	return ReadOK;
+}
+
+static const struct _LogRecordHeader *LogStore_NextRecord(const char *Data, unsigned long Start, unsigned long Size, unsigned long Offset)
+{ /*Data holds the segment from Start on. NULL at the end, or at a record torn by a crash.*/
+	const struct _LogRecordHeader *Record = (const struct _LogRecordHeader*)(Data + Offset - Start);
+	
+	if (Size - Offset < sizeof(struct _LogRecordHeader) || Record->Length > Size - Offset ||
+		Record->Length < sizeof(struct _LogRecordHeader) + Record->ObjectLength + Record->MessageLength + 2 ||
+		Record->Length != LOGSTORE_ALIGN(Record->Length))
+	{
+		return NULL;
+	}
+	
+	return Record;
+}
+
+static char *LogStore_ReadSegment(unsigned long Segment, unsigned long Offset, unsigned long *SizeOut)
+{ /*Everything from Offset on. *SizeOut is how far into the segment that got us.*/
+	char SegmentPath[MAX_LINE_SIZE], *Data = NULL;
+	struct _LogSegmentHeader Header;
+	struct stat FileStat;
+	unsigned long Done = Offset;
+	long Ret;
+	int Descriptor;
+	
+	LogStore_Path(SegmentPath, sizeof SegmentPath, Segment, "seg");
+	
+	if ((Descriptor = open(SegmentPath, O_RDONLY | O_CLOEXEC)) == -1) return NULL;
+	
+	if (fstat(Descriptor, &FileStat) != 0 || read(Descriptor, &Header, sizeof Header) != sizeof Header ||
+		memcmp(Header.Magic, LOGSTORE_MAGIC, sizeof Header.Magic) != 0 || Header.Version != LOGSTORE_VERSION ||
+		(unsigned long)FileStat.st_size < Offset || !(Data = malloc(FileStat.st_size - Offset + 1)))
+	{
+		close(Descriptor);
+		return NULL;
+	}
+	
+	lseek(Descriptor, Offset, SEEK_SET);
+	
+	while (Done < (unsigned long)FileStat.st_size && (Ret = read(Descriptor, Data + Done - Offset, FileStat.st_size - Done)) > 0)
+	{
+		Done += Ret;
+	}
+	
+	close(Descriptor);
+	
+	*SizeOut = Done;
+	return Data;
+}
+
+static Bool LogStore_NewSegment(unsigned long Segment)
+{
+	char SegmentPath[MAX_LINE_SIZE];
+	struct _LogSegmentHeader Header;
+	unsigned long Old;
+	
+	memset(&Header, 0, sizeof Header);
+	memcpy(Header.Magic, LOGSTORE_MAGIC, sizeof Header.Magic);
+	Header.Version = LOGSTORE_VERSION;
+	Header.Segment = Segment;
+	
+	LogStore_Path(SegmentPath, sizeof SegmentPath, Segment, "seg");
+	
+	if ((LogStore.Descriptor = open(SegmentPath, O_WRONLY | O_APPEND | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) == -1)
+	{
+		return false;
+	}
+	
+	if (write(LogStore.Descriptor, &Header, sizeof Header) != sizeof Header)
+	{
+		close(LogStore.Descriptor);
+		LogStore.Descriptor = -1;
+		return false;
+	}
+	
+	LogStore.Segment = Segment;
+	LogStore.Size = sizeof Header;
+	LogIndex_Reset(&LogStore.Index);
+	
+	/*Only the newest LOGSTORE_MAX_SEGMENTS are kept. Everything older goes, back to the first one that's already gone.*/
+	for (Old = Segment; Old > LOGSTORE_MAX_SEGMENTS; --Old)
+	{
+		LogStore_Path(SegmentPath, sizeof SegmentPath, Old - LOGSTORE_MAX_SEGMENTS, "seg");
+		if (unlink(SegmentPath) != 0) break;
+		
+		LogStore_Path(SegmentPath, sizeof SegmentPath, Old - LOGSTORE_MAX_SEGMENTS, "idx");
+		unlink(SegmentPath);
+	}
+	
+	return true;
+}
+
+static Bool LogStore_Resume(unsigned long Segment)
+{ /*Picks up the last segment after a reexec or a reboot. The index gets rebuilt from its records,
+	* and a torn record at the end gets cut off, so the next one lands where it should.*/
+	char SegmentPath[MAX_LINE_SIZE], *Data = NULL;
+	const struct _LogRecordHeader *Record = NULL;
+	unsigned long Size = 0, Offset = sizeof(struct _LogSegmentHeader);
+	
+	if (!(Data = LogStore_ReadSegment(Segment, 0, &Size))) return false;
+	
+	LogIndex_Reset(&LogStore.Index);
+	
+	for (; (Record = LogStore_NextRecord(Data, 0, Size, Offset)); Offset += Record->Length)
+	{
+		LogIndex_Add(&LogStore.Index, Record, Offset);
+	}
+	
+	free(Data);
+	
+	LogStore_Path(SegmentPath, sizeof SegmentPath, Segment, "seg");
+	
+	if ((LogStore.Descriptor = open(SegmentPath, O_WRONLY | O_APPEND | O_CLOEXEC)) == -1) return false;
+	
+	if (Offset != Size) ftruncate(LogStore.Descriptor, Offset);
+	
+	LogStore.Segment = Segment;
+	LogStore.Size = Offset;
+	
+	return true;
+}
+
+Bool LogStore_Open(void)
+{
+	unsigned long First = 0, Last = 0, LastBoot = 0, LastBootKey = 0, LastMono = 0;
+	struct _LogIndex Previous;
+	struct timespec Mono;
+	
+	if (LogStore.Open) return true;
+	
+	mkdir(LOGSTORE_DIR, 0755);
+	
+	if (!LogStore_ListSegments(&First, &Last))
+	{
+		if (!LogStore_NewSegment(1)) return false;
+	}
+	else if (!LogStore_Resume(Last) && !LogStore_NewSegment(Last + 1))
+	{
+		return false;
+	}
+	
+	if (LogStore.Index.Header.Records)
+	{
+		LastBoot = LogStore.Index.Header.LastBoot;
+		LastBootKey = LogStore.Index.Header.LastBootKey;
+		LastMono = LogStore.Index.Header.LastMono;
+	}
+	else if (LogStore.Segment > 1)
+	{ /*Empty segment, so we go by the index of the one before it. If that's gone too, it's a new boot.*/
+		char SegmentPath[MAX_LINE_SIZE];
+		struct stat FileStat;
+		
+		LogStore_Path(SegmentPath, sizeof SegmentPath, LogStore.Segment - 1, "seg");
+		
+		if (stat(SegmentPath, &FileStat) == 0 && LogIndex_Read(&Previous, LogStore.Segment - 1, FileStat.st_size))
+		{
+			LastBoot = Previous.Header.LastBoot;
+			LastBootKey = Previous.Header.LastBootKey;
+			LastMono = Previous.Header.LastMono;
+			LogIndex_Reset(&Previous);
+		}
+	}
+	
+	clock_gettime(CLOCK_MONOTONIC, &Mono);
+	LogStore.BootKey = LogStore_KernelBootKey();
+	
+	if (!LastBoot) LogStore.BootID = 1;
+	else if (LogStore.BootKey && LastBootKey) LogStore.BootID = LastBoot + (LogStore.BootKey != LastBootKey);
+	else LogStore.BootID = LastBoot + ((unsigned long)Mono.tv_sec < LastMono);
+	
+	LogStore.PendingUsed = 0;
+	LogStore.Open = true;
+	
+	return true;
+}
+
+void LogStore_Flush(void)
+{
+	const char *Data = LogStore.Pending;
+	unsigned long Length = LogStore.PendingUsed;
+	long Ret;
+	
+	if (!LogStore.Open || !Length || LogStore.Descriptor == -1) return;
+	
+	while (Length > 0)
+	{
+		if ((Ret = write(LogStore.Descriptor, Data, Length)) > 0)
+		{
+			Data += Ret;
+			Length -= Ret;
+		}
+		else if (Ret == -1 && errno == EINTR) continue;
+		else break;
+	}
+	
+	if (LogSyncPolicy != LOGSYNC_NONE) fsync(LogStore.Descriptor);
+	
+	/*If the disk's full, what didn't go can't be counted, or the index would point past the end.*/
+	LogStore.Size -= Length;
+	LogStore.PendingUsed = 0;
+}
+
+static void LogStore_Seal(void)
+{ /*The next record starts a new segment.*/
+	LogStore_Flush();
+	LogIndex_Write(&LogStore.Index, LogStore.Segment, LogStore.Size);
+	
+	close(LogStore.Descriptor);
+	LogStore.Descriptor = -1;
+}
+
+void LogStore_Add(const char *ObjectID, unsigned char Severity, const char *Message, unsigned long MessageLength)
+{
+	struct _LogRecordHeader Record;
+	struct timespec Mono;
+	const unsigned long ObjectLength = ObjectID ? strlen(ObjectID) : 0;
+	char *Worker = NULL;
+	
+	if (!LogStore.Open) return;
+	
+	if (LogStore.Descriptor == -1 && !LogStore_NewSegment(LogStore.Segment + 1)) return;
+	
+	Record.Length = LOGSTORE_ALIGN(sizeof Record + ObjectLength + MessageLength + 2);
+	
+	if (Record.Length > sizeof LogStore.Pending) return;
+	
+	if (sizeof LogStore.Pending - LogStore.PendingUsed < Record.Length) LogStore_Flush();
+	
+	clock_gettime(CLOCK_MONOTONIC, &Mono);
+	
+	Record.BootID = LogStore.BootID;
+	Record.BootKey = LogStore.BootKey;
+	Record.WallTime = time(NULL);
+	Record.MonoSec = Mono.tv_sec;
+	Record.MonoNsec = Mono.tv_nsec;
+	Record.ObjectHash = ObjectLength ? HashBytes(ObjectID, ObjectLength) | 1 : 0; /*Never zero for a real object.*/
+	Record.Severity = Severity;
+	Record.ObjectLength = ObjectLength;
+	Record.MessageLength = MessageLength;
+	
+	Worker = LogStore.Pending + LogStore.PendingUsed;
+	memcpy(Worker, &Record, sizeof Record);
+	memcpy(Worker += sizeof Record, ObjectID ? ObjectID : "", ObjectLength + 1);
+	memcpy(Worker += ObjectLength + 1, Message, MessageLength);
+	memset(Worker + MessageLength, 0, Record.Length - sizeof Record - ObjectLength - 1 - MessageLength);
+	
+	LogIndex_Add(&LogStore.Index, &Record, LogStore.Size);
+	
+	LogStore.PendingUsed += Record.Length;
+	LogStore.Size += Record.Length;
+	
+	if (LogStore.Size >= LOGSTORE_SEGMENT_SIZE) LogStore_Seal();
+}
+
+void LogStore_Close(void)
+{ /*The index gets written for the segment we were on too, so a query doesn't have to scan it.*/
+	if (!LogStore.Open) return;
+	
+	if (LogStore.Descriptor != -1) LogStore_Seal();
+	
+	LogIndex_Reset(&LogStore.Index);
+	LogStore.Open = false;
+}
+
+void LogStore_ForkChild(void)
+{ /*The child must never write to the store or its indexes. The descriptor closes itself on exec.*/
+	LogStore.Open = false;
+	LogStore.Descriptor = -1;
+	LogStore.PendingUsed = 0;
+}
+
+static void LogStore_PrintRecord(const struct _LogRecordHeader *Record)
+{
+	const char *const ObjectID = (const char*)(Record + 1);
+	const time_t WallTime = Record->WallTime;
+	struct tm TimeStruct;
+	const char *Color = Record->Severity <= LOGSEV_ERR ? CONSOLE_COLOR_RED :
+						Record->Severity == LOGSEV_WARNING ? CONSOLE_COLOR_YELLOW : NULL;
+	
+	localtime_r(&WallTime, &TimeStruct);
+	
+	printf("[%02d:%02d:%02d | %d-%02d-%02d] #%lu %s: %s%s%s\n", TimeStruct.tm_hour, TimeStruct.tm_min, TimeStruct.tm_sec,
+			TimeStruct.tm_year + 1900, TimeStruct.tm_mon + 1, TimeStruct.tm_mday, Record->BootID,
+			*ObjectID ? ObjectID : "epoch", Color ? Color : "", ObjectID + Record->ObjectLength + 1,
+			Color ? CONSOLE_ENDCOLOR : "");
+}
+
+rStatus LogStore_Query(const char *ObjectID, long Boot)
+{ /*Prints ObjectID's records, or everyone's if it's NULL, from boot Boot on.
+	* Zero or less counts back from the newest boot, so 0 is this one and -1 the one before.*/
+	unsigned long First = 0, Last = 0, Segment, Size, Start, Offset, ObjectHash = 0, Printed = 0, Inc;
+	struct _LogIndex Index;
+	const struct _LogIndexObject *Object = NULL;
+	const struct _LogRecordHeader *Record = NULL;
+	char *Data = NULL, SegmentPath[MAX_LINE_SIZE];
+	struct stat FileStat;
+	
+	if (!LogStore_ListSegments(&First, &Last))
+	{
+		fprintf(stderr, "No structured log in " LOGSTORE_DIR ". Is LogStore enabled in " CONF_NAME "?\n");
+		return FAILURE;
+	}
+	
+	if (ObjectID) ObjectHash = HashBytes(ObjectID, strlen(ObjectID)) | 1;
+	
+	if (Boot <= 0)
+	{ /*Find the newest boot. It's at the end of the newest segment that has anything in it.*/
+		unsigned long Newest = 0;
+		
+		for (Segment = Last; Segment >= First && !Newest; --Segment)
+		{ /*Segments start at 1, so this can't wrap.*/
+			if (!(Data = LogStore_ReadSegment(Segment, 0, &Size))) continue;
+			
+			for (Offset = sizeof(struct _LogSegmentHeader); (Record = LogStore_NextRecord(Data, 0, Size, Offset)); Offset += Record->Length)
+			{
+				Newest = Record->BootID;
+			}
+			
+			free(Data);
+		}
+		
+		Boot += Newest;
+		if (Boot < 1) Boot = 1;
+	}
+	
+	for (Segment = First; Segment <= Last; ++Segment)
+	{
+		LogStore_Path(SegmentPath, sizeof SegmentPath, Segment, "seg");
+		
+		if (stat(SegmentPath, &FileStat) != 0) continue;
+		
+		Offset = sizeof(struct _LogSegmentHeader);
+		Object = NULL;
+		
+		if (LogIndex_Read(&Index, Segment, FileStat.st_size))
+		{ /*Skip what can't have anything for us, and seek past what's from before Boot.*/
+			if (Index.Header.LastBoot < (unsigned long)Boot ||
+				(ObjectHash && !(Object = LogIndex_FindObject(&Index, ObjectHash, NULL))))
+			{
+				LogIndex_Reset(&Index);
+				continue;
+			}
+			
+			for (Inc = 0; Inc < Index.Header.MarkCount && Index.Marks[Inc].BootID < (unsigned long)Boot; ++Inc);
+			
+			if (Inc < Index.Header.MarkCount) Offset = Index.Marks[Inc].Offset;
+			if (Object && Object->FirstOffset > Offset) Offset = Object->FirstOffset;
+			
+			LogIndex_Reset(&Index);
+		}
+		
+		if (!(Data = LogStore_ReadSegment(Segment, (Start = Offset), &Size))) continue;
+		
+		for (; (Record = LogStore_NextRecord(Data, Start, Size, Offset)); Offset += Record->Length)
+		{
+			if (Record->BootID < (unsigned long)Boot) continue;
+			
+			if (ObjectHash && (Record->ObjectHash != ObjectHash || strcmp((const char*)(Record + 1), ObjectID) != 0)) continue;
+			
+			LogStore_PrintRecord(Record);
+			++Printed;
+		}
+		
+		free(Data);
+	}
+	
+	if (!Printed) fprintf(stderr, "Nothing logged%s%s since boot #%ld.\n", ObjectID ? " for " : "", ObjectID ? ObjectID : "", Boot);
+	
+	return SUCCESS;
+}
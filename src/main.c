@@ -16,6 +16,8 @@
 #include <pwd.h>
 #include <sys/reboot.h>
 #include <sys/shm.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
 
 #ifndef NO_EXECINFO
 #include <execinfo.h>
@@ -28,7 +30,45 @@
 
 /*Forward declarations for static functions.*/
 static rStatus ProcessGenericHalt(int argc, char **argv);
+static const char *JobOpName(unsigned char Opcode)
+{
+	switch (Opcode)
+	{
+		case MEMBUS_OP_OBJSTART:
+			return "start";
+		case MEMBUS_OP_OBJSTOP:
+			return "stop";
+		case MEMBUS_OP_OBJRELOAD:
+			return "reload";
+		case MEMBUS_OP_RUNLEVEL:
+			return "runlevel";
+		case MEMBUS_OP_BATCH:
+			return "batch";
+		default:
+			return "unknown";
+	}
+}
+
+static const char *JobStatusName(unsigned char Status)
+{
+	switch (Status)
+	{
+		case MEMBUS_STATUS_OK:
+			return "succeeded";
+		case MEMBUS_STATUS_WARNING:
+			return "succeeded with a warning";
+		case MEMBUS_STATUS_CANCELLED:
+			return "was cancelled";
+		case MEMBUS_STATUS_PENDING:
+			return "is pending";
+		default:
+			return "failed";
+	}
+}
+
 static Bool __CmdIs(const char *CArg, const char *InCmd);
+static const char *JobOpName(unsigned char Opcode);
+static const char *JobStatusName(unsigned char Status);
 static void PrintEpochHelp(const char *RootCommand, const char *InCmd);
 static rStatus HandleEpochCommand(int argc, char **argv);
 static void SigHandler(int Signal);
@@ -220,12 +260,15 @@ static void PrintEpochHelp(const char *RootCommand, const char *InCmd)
 		 "Enter poweroff, halt, or reboot to do the obvious."
 		),
 		
-		( "[disable/enable] objectid:\n\t" CONSOLE_ENDCOLOR
+		( "[disable/enable] objectid [objectid ...]:\n\t" CONSOLE_ENDCOLOR
 		  "Enter disable or enable followed by an object ID to disable or enable\n\tthat object."
+		  " More than one object ID, or a pattern like worker*, does them all at once."
 		),
 		
-		( "[start/stop/restart] objectid:\n\t" CONSOLE_ENDCOLOR
+		( "[start/stop/restart/reload] objectid [objectid ...]:\n\t" CONSOLE_ENDCOLOR
 		  "Enter start, stop, or restart followed by an object ID to control\n\tthat object."
+		  " With more than one object ID or a pattern like worker*, they all run\n\t"
+		  "at once, stopping and starting in priority order, and each result is printed."
 		),
 		
 		( "objrl objectid [del/add/check] runlevel:\n\t" CONSOLE_ENDCOLOR
@@ -249,18 +292,30 @@ static void PrintEpochHelp(const char *RootCommand, const char *InCmd)
 		),
 			
 		
-		( "configreload:\n\t" CONSOLE_ENDCOLOR
+		( "configreload [apply]:\n\t" CONSOLE_ENDCOLOR
 		
 		  "Enter configreload to reload the configuration file from disk.\n\t"
 		  "This is useful for when you change it\n\t"
-		  "to add or remove services, change runlevels, and more."
+		  "to add or remove services, change runlevels, and more.\n\t"
+		  "With apply, removed objects are stopped, new ones are started,\n\t"
+		  "and running objects whose commands or user changed are restarted."
+		),
+		
+		( "compileconfig:\n\t" CONSOLE_ENDCOLOR
+		
+		  "Parses the configuration file and saves it in a binary form\n\t"
+		  "that Epoch can load at boot without parsing anything.\n\t"
+		  "If the configuration file changes afterwards, the old one is ignored\n\t"
+		  "until you run compileconfig again."
 		),
 		
 		( "reexec:\n\t" CONSOLE_ENDCOLOR
 		
 		  "Enter reeexec to partially restart Epoch from disk.\n\t"
 		  "This is necessary for updating the Epoch binary to prevent\n\t"
-		  "a failure with unmounting the filesystem the binary is on."
+		  "a failure with unmounting the filesystem the binary is on.\n\t"
+		  "To upgrade from an Epoch that predates the state memfd, install the\n\t"
+		  "new binary first and run this one's reexec, not the old one's."
 		),
 		
 		( "runlevel:\n\t" CONSOLE_ENDCOLOR
@@ -281,14 +336,42 @@ static void PrintEpochHelp(const char *RootCommand, const char *InCmd)
 		  "the PID will be retrieved from that."
 		),
 		
+		( "jobs [list/status/wait/cancel] [jobid]:\n\t" CONSOLE_ENDCOLOR
+		
+		  "Starts, stops, reloads and runlevel changes run as jobs in the background.\n\t"
+		  "list shows the jobs that haven't finished yet, status shows one job,\n\t"
+		  "wait waits for a job to finish, and cancel cancels it."
+		),
+		
+		( "subscribe [objectid ...]:\n\t" CONSOLE_ENDCOLOR
+		
+		  "Prints object starts, exits, stops, restarts, runlevel changes and\n\t"
+		  "config reloads as they happen, one per line, until interrupted.\n\t"
+		  "If object IDs are given, only events for those objects are shown.\n\t"
+		  "If we fall too far behind, DROPPED says how many events were lost."
+		),
+		
+		( "tail objectid:\n\t" CONSOLE_ENDCOLOR
+		
+		  "Prints the last lines the object printed, if it captures it's output,\n\t"
+		  "and how it last exited. Epoch keeps TailBufferSize KiB of this for each object."
+		),
+		
+		( "log [objectid/all] [boot]:\n\t" CONSOLE_ENDCOLOR
+		
+		  "Prints the structured log, if LogStore is enabled, for one object or all of them.\n\t"
+		  "With a boot number, it starts at that boot. Zero or less counts back\n\t"
+		  "from this boot, so -1 is the one before. The default is this boot."
+		),
+		
 		( "version:\n\t" CONSOLE_ENDCOLOR
 		
 		  "Prints the current version of the Epoch Init System."
 		)
 	};
 	
-	enum { HCMD, ENDIS, STAP, OBJRL, STATUS, SETCAD, CONFRL, REEXEC,
-		RLCTL, GETPID, KILLOBJ, VER, ENUM_MAX };
+	enum { HCMD, ENDIS, STAP, OBJRL, STATUS, SETCAD, CONFRL, COMPILECONF, REEXEC,
+		RLCTL, GETPID, KILLOBJ, JOBS, SUBSCRIBE, TAILOBJ, LOGQUERY, VER, ENUM_MAX };
 	
 	
 	printf("%s\nCompiled %s %s\n\n", VERSIONSTRING, __DATE__, __TIME__);
@@ -339,6 +422,11 @@ static void PrintEpochHelp(const char *RootCommand, const char *InCmd)
 		printf(CONSOLE_COLOR_GREEN "%s %s\n\n", RootCommand, HelpMsgs[CONFRL]);
 		return;
 	}
+	else if (!strcmp(InCmd, "compileconfig"))
+	{
+		printf(CONSOLE_COLOR_GREEN "%s %s\n\n", RootCommand, HelpMsgs[COMPILECONF]);
+		return;
+	}
 	else if (!strcmp(InCmd, "reexec"))
 	{
 		printf(CONSOLE_COLOR_GREEN "%s %s\n\n", RootCommand, HelpMsgs[REEXEC]);
@@ -359,6 +447,26 @@ static void PrintEpochHelp(const char *RootCommand, const char *InCmd)
 		printf(CONSOLE_COLOR_GREEN "%s %s\n\n", RootCommand, HelpMsgs[KILLOBJ]);
 		return;
 	}
+	else if (!strcmp(InCmd, "jobs"))
+	{
+		printf(CONSOLE_COLOR_GREEN "%s %s\n\n", RootCommand, HelpMsgs[JOBS]);
+		return;
+	}
+	else if (!strcmp(InCmd, "subscribe"))
+	{
+		printf(CONSOLE_COLOR_GREEN "%s %s\n\n", RootCommand, HelpMsgs[SUBSCRIBE]);
+		return;
+	}
+	else if (!strcmp(InCmd, "tail"))
+	{
+		printf(CONSOLE_COLOR_GREEN "%s %s\n\n", RootCommand, HelpMsgs[TAILOBJ]);
+		return;
+	}
+	else if (!strcmp(InCmd, "log"))
+	{
+		printf(CONSOLE_COLOR_GREEN "%s %s\n\n", RootCommand, HelpMsgs[LOGQUERY]);
+		return;
+	}
 	else if (!strcmp(InCmd, "version"))
 	{
 		printf(CONSOLE_COLOR_GREEN "%s %s\n\n", RootCommand, HelpMsgs[VER]);
@@ -376,13 +484,14 @@ static rStatus ProcessGenericHalt(int argc, char **argv)
 	/*Figure out what we are.*/
 	if (CmdIs("poweroff") || CmdIs("halt") || CmdIs("reboot"))
 	{
-		char *GCode = NULL, *SuccessMsg = NULL, *FailMsg[2] = { NULL, NULL };
+		char *SuccessMsg = NULL, *FailMsg[2] = { NULL, NULL };
+		unsigned char GCode = MEMBUS_OP_NONE;
 		const char *CArg = NULL;
 		signed long OSCode = -1;
 
 		if (CmdIs("poweroff"))
 		{
-			GCode = MEMBUS_CODE_POWEROFF;
+			GCode = MEMBUS_OP_POWEROFF;
 			OSCode = OSCTL_LINUX_POWEROFF;
 			SuccessMsg = "Power off in progress.";
 			FailMsg[0] = "Failed to request immediate poweroff.";
@@ -390,7 +499,7 @@ static rStatus ProcessGenericHalt(int argc, char **argv)
 		}
 		else if (CmdIs("reboot"))
 		{
-			GCode = MEMBUS_CODE_REBOOT;
+			GCode = MEMBUS_OP_REBOOT;
 			OSCode = OSCTL_LINUX_REBOOT;
 			SuccessMsg = "Reboot in progress.";
 			FailMsg[0] = "Failed to request immediate reboot.";
@@ -398,7 +507,7 @@ static rStatus ProcessGenericHalt(int argc, char **argv)
 		}
 		else if (CmdIs("halt"))
 		{
-			GCode = MEMBUS_CODE_HALT;
+			GCode = MEMBUS_OP_HALT;
 			OSCode = OSCTL_LINUX_HALT;
 			SuccessMsg = "System halt in progress.";
 			FailMsg[0] = "Failed to request immediate halt.";
@@ -514,6 +623,7 @@ static rStatus HandleEpochCommand(int argc, char **argv)
 	else if (ArgIs("reexec"))
 	{
 		char InStream[MAX_LINE_SIZE];
+		unsigned long Inc = 0;
 		
 		if (argc > 2)
 		{
@@ -522,6 +632,40 @@ static rStatus HandleEpochCommand(int argc, char **argv)
 			return FAILURE;
 		}
 		
+		if (MemBus_LegacyConnect(MEMKEY))
+		{ /*We were installed over an Epoch from before the state memfd. It has it's own membus and
+			* does the handover it's own way, and we're what it execs, so it all still works out.
+			* It takes it's membus down first, and we wait for the new one to come up.*/
+			if (!MemBus_LegacyWrite(MEMBUS_CODE_RXD))
+			{
+				MemBus_LegacyDisconnect();
+				puts(CONSOLE_COLOR_RED "FAILED TO REEXECUTE!" CONSOLE_ENDCOLOR);
+				return FAILURE;
+			}
+			
+			puts("Re-executing Epoch."); fflush(NULL);
+			
+			while (!MemBus_LegacyEaten()) usleep(100);
+			MemBus_LegacyDisconnect();
+			
+			/*If it's still the old membus after thirty seconds, it put that back up because it failed.*/
+			for (Inc = 0; (MemBus_LegacyPresent(MEMKEY) || shmget((key_t)MEMKEY, 0, 0660) == -1) && Inc < 30000; ++Inc)
+			{
+				usleep(1000);
+			}
+			
+			if (Inc == 30000 || !InitMemBus(false))
+			{
+				puts(CONSOLE_COLOR_RED "FAILED TO REEXECUTE!" CONSOLE_ENDCOLOR);
+				return FAILURE;
+			}
+			
+			puts("Reexecution successful.");
+			ShutdownMemBus(false);
+			
+			return SUCCESS;
+		}
+		
 		if (!InitMemBus(false))
 		{
 			return FAILURE;
@@ -531,17 +675,17 @@ static rStatus HandleEpochCommand(int argc, char **argv)
 		
 		puts("Re-executing Epoch."); fflush(NULL);
 		
-		ShutdownMemBus(false);
-		while (shmget(MEMKEY, MEMBUS_SIZE, 0660) != -1) usleep(100); /*Wait for it to quit...*/
-		while (shmget(MEMKEY, MEMBUS_SIZE, 0660) == -1) usleep(100); /*Then wait for it to start...*/
-		InitMemBus(false);
-
+		/*The membus stays put across the reexec, so we just wait for the new Epoch to answer.*/
 		while (!MemBus_Read(InStream, false)) usleep(100);
 		
 		if (!strcmp(InStream, MEMBUS_CODE_ACKNOWLEDGED " " MEMBUS_CODE_RXD))
 		{
 			puts("Reexecution successful.");
 		}
+		else if (!strcmp(InStream, MEMBUS_CODE_WARNING " " MEMBUS_CODE_RXD))
+		{
+			puts(CONSOLE_COLOR_YELLOW "Reexecuted, but saved state was lost." CONSOLE_ENDCOLOR);
+		}
 		else
 		{
 			puts(CONSOLE_COLOR_RED "FAILED TO REEXECUTE!" CONSOLE_ENDCOLOR);
@@ -553,12 +697,11 @@ static rStatus HandleEpochCommand(int argc, char **argv)
 	}	
 	else if (ArgIs("configreload"))
 	{
-		char TRecv[MEMBUS_MSGSIZE];
-		char TBuf[3][MAX_LINE_SIZE];
+		rStatus RV = SUCCESS;
 		
-		if (argc > 2)
+		if (argc > 3 || (argc == 3 && strcmp(argv[2], "apply") != 0))
 		{
-			puts("Too many arguments.\n");
+			puts(argc > 3 ? "Too many arguments.\n" : "Bad argument.\n");
 			PrintEpochHelp(argv[0], "configreload");
 			return FAILURE;
 		}
@@ -568,48 +711,91 @@ static rStatus HandleEpochCommand(int argc, char **argv)
 			
 			return FAILURE;
 		}
-
-		if (!MemBus_Write(MEMBUS_CODE_RESET, false))
+		
+		RV = ReloadControl(argc == 3);
+		
+		ShutdownMemBus(false);
+		return RV;
+	}
+	else if (ArgIs("compileconfig"))
+	{
+		if (argc > 2)
 		{
-			SpitError("Failed to write to membus.");
-			ShutdownMemBus(false);
+			puts("Too many arguments.\n");
+			PrintEpochHelp(argv[0], "compileconfig");
 			return FAILURE;
 		}
 		
-		while (!MemBus_Read(TRecv, false)) usleep(1000);
+		if (!CompileConfig())
+		{
+			puts(CONSOLE_COLOR_RED "Failed to compile the configuration file." CONSOLE_ENDCOLOR);
+			return FAILURE;
+		}
 		
-		snprintf(TBuf[0], sizeof TBuf[0], "%s %s", MEMBUS_CODE_ACKNOWLEDGED, MEMBUS_CODE_RESET);
-		snprintf(TBuf[1], sizeof TBuf[1], "%s %s", MEMBUS_CODE_FAILURE, MEMBUS_CODE_RESET);
-		snprintf(TBuf[2], sizeof TBuf[2], "%s %s", MEMBUS_CODE_BADPARAM, MEMBUS_CODE_RESET);
+		printf("Configuration compiled to \"%s" CONFIGCACHE_SUFFIX "\".\n", ConfigFile);
+		return SUCCESS;
+	}
+	else if (ArgIs("tail"))
+	{
+		char OutBuf[MEMBUS_MSGSIZE], InBuf[MEMBUS_MSGSIZE];
+		rStatus RV = SUCCESS;
 		
-		if (!strcmp(TBuf[0], TRecv))
+		if (argc != 3)
 		{
-			puts("Reload successful.");
-			ShutdownMemBus(false);
+			puts(argc > 3 ? "Too many arguments.\n" : "Too few arguments.\n");
+			PrintEpochHelp(argv[0], "tail");
+			return FAILURE;
+		}
+		
+		if (!InitMemBus(false)) return FAILURE;
+		
+		snprintf(OutBuf, sizeof OutBuf, "%s %s", MEMBUS_CODE_TAIL, argv[2]);
+		MemBus_Write(OutBuf, false);
+		
+		for (;;)
+		{ /*As many messages of lines as it takes, then OK or FAIL.*/
+			while (!MemBus_Read(InBuf, false)) usleep(100);
 			
-			return SUCCESS;
+			if (strncmp(InBuf, MEMBUS_CODE_TAIL " ", sizeof MEMBUS_CODE_TAIL) != 0) break;
+			
+			fputs(InBuf + sizeof MEMBUS_CODE_TAIL, stdout);
 		}
-		else if (!strcmp(TBuf[1], TRecv))
+		
+		if (!strncmp(InBuf, MEMBUS_CODE_FAILURE " ", sizeof MEMBUS_CODE_FAILURE))
 		{
-			puts("Reload failed!");
-			ShutdownMemBus(false);
-			
-			return FAILURE;
+			fprintf(stderr, "Nothing kept for object %s. Does it capture it's output?\n", argv[2]);
+			RV = FAILURE;
 		}
-		else if (!strcmp(TBuf[2], TRecv))
+		else if (strncmp(InBuf, MEMBUS_CODE_ACKNOWLEDGED " ", sizeof MEMBUS_CODE_ACKNOWLEDGED) != 0)
 		{
-			SpitError("We are being told that MEMBUS_CODE_RESET is not a valid signal! Please report to Epoch.");
-			ShutdownMemBus(false);
-			
+			SpitError("Bad response received over membus. Please report this to Epoch.");
+			RV = FAILURE;
+		}
+		
+		ShutdownMemBus(false);
+		return RV;
+	}
+	else if (ArgIs("log"))
+	{ /*Reads the log store straight off the disk. Epoch itself isn't involved.*/
+		const char *ObjectID = (argc >= 3 && strcmp(argv[2], "all") != 0 ? argv[2] : NULL);
+		char *End = NULL;
+		long Boot = 0;
+		
+		if (argc > 4)
+		{
+			puts("Too many arguments.");
+			PrintEpochHelp(argv[0], "log");
 			return FAILURE;
 		}
-		else
+		
+		if (argc == 4 && ((Boot = strtol(argv[3], &End, 10)), *End != '\0' || End == argv[3]))
 		{
-			SpitError("Unknown response received! Can't handle this! Report to Epoch please!");
-			ShutdownMemBus(false);
-			
+			puts("Bad boot number.");
+			PrintEpochHelp(argv[0], "log");
 			return FAILURE;
 		}
+		
+		return LogStore_Query(ObjectID, Boot);
 	}
 	else if (ArgIs("status"))
 	{
@@ -863,7 +1049,7 @@ static rStatus HandleEpochCommand(int argc, char **argv)
 	}
 	else if (ArgIs("runlevel"))
 	{
-		char InBuf[MEMBUS_MSGSIZE];
+		unsigned char Frame[MEMBUS_MSGSIZE];
 		rStatus RV = SUCCESS;
 		
 		if (argc > 3)
@@ -880,58 +1066,43 @@ static rStatus HandleEpochCommand(int argc, char **argv)
 		
 		if (argc == 2)
 		{
-			MemBus_Write(MEMBUS_CODE_GETRL, false);
+			const char *RL = NULL;
 			
-			while (!MemBus_Read(InBuf, false)) usleep(1000);
+			MemBus_FrameInit(Frame, MEMBUS_OP_GETRL, 0);
 			
-			if (!strcmp(MEMBUS_CODE_BADPARAM " " MEMBUS_CODE_GETRL, InBuf))
+			if (MemBus_Transact(Frame) == MEMBUS_STATUS_OK && (RL = MemBus_FrameGetString(Frame, MEMBUS_TLV_RUNLEVEL, 0)))
 			{
-				SpitError("We are being told that MEMBUS_CODE_GETRL is not valid.\n"
-						"This is a bug. Please report to Epoch.");
-				RV = FAILURE;
+				printf("Current runlevel is \"%s\".\n", RL);
 			}
-			else if (!strncmp(MEMBUS_CODE_GETRL " ", InBuf, strlen(MEMBUS_CODE_GETRL " ")))
+			else
 			{
-				printf("Current runlevel is \"%s\".\n", InBuf + strlen(MEMBUS_CODE_GETRL " "));
-				RV = SUCCESS;
-			
+				SpitError("Unable to retrieve the current runlevel over the membus.\n"
+						"This is a bug. Please report to Epoch.");
+				RV = FAILURE;
 			}
 		}
 		else
 		{
-			char OutBuf[MEMBUS_MSGSIZE];
-			char PossibleResponses[3][MEMBUS_MSGSIZE] = { { '\0' } };
-			
-			
-			snprintf(OutBuf, sizeof OutBuf, "%s %s", MEMBUS_CODE_RUNLEVEL, argv[2]);
-			
-			snprintf(PossibleResponses[0], MEMBUS_MSGSIZE, "%s %s", MEMBUS_CODE_ACKNOWLEDGED, OutBuf);
-			snprintf(PossibleResponses[1], MEMBUS_MSGSIZE, "%s %s", MEMBUS_CODE_FAILURE, OutBuf);
-			snprintf(PossibleResponses[2], MEMBUS_MSGSIZE, "%s %s", MEMBUS_CODE_BADPARAM, OutBuf);
-			
+			MemBus_FrameInit(Frame, MEMBUS_OP_RUNLEVEL, 0);
+			MemBus_FrameAddString(Frame, MEMBUS_TLV_RUNLEVEL, argv[2]);
 			
-			MemBus_Write(OutBuf, false);
-			
-			while (!MemBus_Read(InBuf, false)) usleep(1000);
-			
-			if (!strcmp(PossibleResponses[0], InBuf))
-			{
-				RV = SUCCESS;
-			}
-			else if (!strcmp(PossibleResponses[1], InBuf))
+			switch (MemBus_Transact(Frame))
 			{
-				RV = FAILURE;
-				fprintf(stderr, "Unable to switch to runlevel %s.\n", argv[2]);
-			}
-			else if (!strcmp(PossibleResponses[2], InBuf))
-			{
-				RV = FAILURE;
-				SpitError("We are being told we sent bad data over the membus.\nThis is a bug. Please report.");
-			}
-			else
-			{
-				RV = FAILURE;
-				SpitError("We have received a corrupted response over the membus.\nThis is a bug. Please report.");
+				case MEMBUS_STATUS_OK:
+					RV = SUCCESS;
+					break;
+				case MEMBUS_STATUS_FAILURE:
+					RV = FAILURE;
+					fprintf(stderr, "Unable to switch to runlevel %s.\n", argv[2]);
+					break;
+				case MEMBUS_STATUS_BADPARAM:
+					RV = FAILURE;
+					SpitError("We are being told we sent bad data over the membus.\nThis is a bug. Please report.");
+					break;
+				default:
+					RV = FAILURE;
+					SpitError("We have received a corrupted response over the membus.\nThis is a bug. Please report.");
+					break;
 			}
 		}
 		
@@ -940,7 +1111,8 @@ static rStatus HandleEpochCommand(int argc, char **argv)
 	}
 	else if (ArgIs("setcad"))
 	{
-		const char *MCode = NULL, *ReportLump = NULL;
+		const char *ReportLump = NULL;
+		unsigned char MCode = MEMBUS_OP_NONE;
 		rStatus RetVal = SUCCESS;
 		
 		if (argc != 3)
@@ -967,12 +1139,12 @@ static rStatus HandleEpochCommand(int argc, char **argv)
 		
 		if (ArgIs("on"))
 		{
-			MCode = MEMBUS_CODE_CADON;
+			MCode = MEMBUS_OP_CADON;
 			ReportLump = "enable";
 		}
 		else if (ArgIs("off"))
 		{
-			MCode = MEMBUS_CODE_CADOFF;
+			MCode = MEMBUS_OP_CADOFF;
 			ReportLump = "disable";
 		}
 		else
@@ -995,6 +1167,21 @@ static rStatus HandleEpochCommand(int argc, char **argv)
 		ShutdownMemBus(false);
 		return RetVal;
 	}
+	else if ((ArgIs("start") || ArgIs("stop") || ArgIs("restart") || ArgIs("reload") || ArgIs("enable") || ArgIs("disable")) &&
+			(argc > 3 || (argc == 3 && strpbrk(argv[2], "*?[") != NULL)))
+	{ /*More than one object, or a pattern. Epoch does them all in one go.*/
+		rStatus RV = SUCCESS;
+		
+		if (!InitMemBus(false))
+		{
+			return FAILURE;
+		}
+		
+		RV = BatchControl(Jobs_BatchOpLookup(CArg), (const char**)argv + 2, argc - 2);
+		
+		ShutdownMemBus(false);
+		return RV;
+	}
 	else if (ArgIs("enable") || ArgIs("disable"))
 	{
 		rStatus RV = SUCCESS;
@@ -1026,7 +1213,7 @@ static rStatus HandleEpochCommand(int argc, char **argv)
 		snprintf(TOut, sizeof TOut, (Enabling ? "Enabling %s" : "Disabling %s"), CArg);
 		RenderStatusReport(TOut);
 		
-		RV = ObjControl(CArg, (Enabling ? MEMBUS_CODE_OBJENABLE : MEMBUS_CODE_OBJDISABLE));
+		RV = ObjControl(CArg, (Enabling ? MEMBUS_OP_OBJENABLE : MEMBUS_OP_OBJDISABLE));
 		CompleteStatusReport(TOut, RV, false);
 		
 		ShutdownMemBus(false);
@@ -1082,11 +1269,11 @@ static rStatus HandleEpochCommand(int argc, char **argv)
 		
 		if (StartMode < RESTART)
 		{
-			RV = ObjControl(argv[2], (StartMode == START ? MEMBUS_CODE_OBJSTART : MEMBUS_CODE_OBJSTOP));
+			RV = ObjControl(argv[2], (StartMode == START ? MEMBUS_OP_OBJSTART : MEMBUS_OP_OBJSTOP));
 		}
 		else
 		{
-			RV = (ObjControl(argv[2], MEMBUS_CODE_OBJSTOP) && ObjControl(argv[2], MEMBUS_CODE_OBJSTART));
+			RV = (ObjControl(argv[2], MEMBUS_OP_OBJSTOP) && ObjControl(argv[2], MEMBUS_OP_OBJSTART));
 		}
 		
 		CompleteStatusReport(TOut, RV, false);
@@ -1097,10 +1284,7 @@ static rStatus HandleEpochCommand(int argc, char **argv)
 	else if (ArgIs("reload"))
 	{
 		rStatus RV = SUCCESS;
-		char InBuf[MEMBUS_MSGSIZE], OutBuf[MEMBUS_MSGSIZE];
-		char PossibleResponses[4][MEMBUS_MSGSIZE];
 		char StatusBuf[MAX_LINE_SIZE];
-		Bool Botched = false;
 		
 		if (argc != 3)
 		{
@@ -1122,51 +1306,12 @@ static rStatus HandleEpochCommand(int argc, char **argv)
 			return FAILURE;
 		}
 		
-		snprintf(OutBuf, sizeof OutBuf, "%s %s", MEMBUS_CODE_OBJRELOAD, argv[2]);
-		
-		snprintf(PossibleResponses[0], MEMBUS_MSGSIZE, "%s %s", MEMBUS_CODE_ACKNOWLEDGED, OutBuf);
-		snprintf(PossibleResponses[1], MEMBUS_MSGSIZE, "%s %s", MEMBUS_CODE_WARNING, OutBuf);
-		snprintf(PossibleResponses[2], MEMBUS_MSGSIZE, "%s %s", MEMBUS_CODE_FAILURE, OutBuf);
-		snprintf(PossibleResponses[3], MEMBUS_MSGSIZE, "%s %s", MEMBUS_CODE_BADPARAM, OutBuf);
-		
 		snprintf(StatusBuf, MAX_LINE_SIZE, "Reloading %s", argv[2]);
 		RenderStatusReport(StatusBuf);
 		
-		MemBus_Write(OutBuf, false);
+		RV = ObjControl(argv[2], MEMBUS_OP_OBJRELOAD);
 		
-		while (!MemBus_Read(InBuf, false)) usleep(1000);
-		
-		if (!strcmp(InBuf, PossibleResponses[0]))
-		{
-			RV = SUCCESS;
-		}
-		else if (!strcmp(InBuf, PossibleResponses[1]))
-		{
-			RV = WARNING;
-		}
-		else if (!strcmp(InBuf, PossibleResponses[2]))
-		{
-			RV = FAILURE;
-		}
-		else if (!strcmp(InBuf, PossibleResponses[3]))
-		{
-			CompleteStatusReport(StatusBuf, (RV = FAILURE), false);
-			SpitError("We are being told that we sent a bad parameter over membus.\n"
-						"This is probably a bug. Please report to Epoch!");
-			Botched = true;
-		}
-		else
-		{
-			CompleteStatusReport(StatusBuf, (RV = FAILURE), false);
-			SpitError("Bad parameter received over membus! This is probably a bug.\n"
-						"Please report to Epoch!");
-			Botched = true;
-		}
-		
-		if (!Botched)
-		{
-			CompleteStatusReport(StatusBuf, RV, false);
-		}
+		CompleteStatusReport(StatusBuf, RV, false);
 		
 		ShutdownMemBus(false);
 		
@@ -1175,9 +1320,9 @@ static rStatus HandleEpochCommand(int argc, char **argv)
 	else if (ArgIs("getpid"))
 	{
 		rStatus RV = SUCCESS;
-		char InBuf[MEMBUS_MSGSIZE];
-		char OutBuf[MEMBUS_MSGSIZE];
-		char PossibleResponses[3][MEMBUS_MSGSIZE];
+		unsigned char Frame[MEMBUS_MSGSIZE];
+		const void *PIDValue = NULL;
+		unsigned long PID = 0;
 		
 		if (argc != 3)
 		{
@@ -1196,36 +1341,31 @@ static rStatus HandleEpochCommand(int argc, char **argv)
 		
 		if (!InitMemBus(false)) return FAILURE;
 		
-		snprintf(OutBuf, sizeof InBuf, "%s %s", MEMBUS_CODE_SENDPID, argv[2]);
-		
-		snprintf(PossibleResponses[0], sizeof PossibleResponses[0], "%s %s ", MEMBUS_CODE_SENDPID, argv[2]);
-		snprintf(PossibleResponses[1], sizeof PossibleResponses[1], "%s %s", MEMBUS_CODE_FAILURE, OutBuf);
-		snprintf(PossibleResponses[2], sizeof PossibleResponses[2], "%s %s", MEMBUS_CODE_BADPARAM, OutBuf);
-		
-		MemBus_Write(OutBuf, false);
-		
-		while (!MemBus_Read(InBuf, false)) usleep(1000);
+		MemBus_FrameInit(Frame, MEMBUS_OP_SENDPID, 0);
+		MemBus_FrameAddString(Frame, MEMBUS_TLV_OBJECTID, argv[2]);
 		
-		if (!strncmp(InBuf, PossibleResponses[0], strlen(PossibleResponses[0])))
-		{
-			const char *TextPID = InBuf + strlen(PossibleResponses[0]);
-			
-			printf("PID for object %s: %s\n", argv[2], TextPID);
-		}
-		else if (!strcmp(PossibleResponses[1], InBuf))
+		switch (MemBus_Transact(Frame))
 		{
-			fprintf(stderr, CONSOLE_COLOR_RED "Unable to retrieve PID for object %s" CONSOLE_ENDCOLOR "\n", argv[2]);
-			RV = FAILURE;
-		}
-		else if (!strcmp(PossibleResponses[2], InBuf))
-		{
-			SpitError("We are being told that MEMBUS_CODE_SENDPID is not understood. Please report this to Epoch.");
-			RV = FAILURE;
-		}
-		else
-		{
-			SpitError("Bad response received over membus. Please report this to Epoch.");
-			RV = FAILURE;
+			case MEMBUS_STATUS_OK:
+				if ((PIDValue = MemBus_FrameGet(Frame, MEMBUS_TLV_PID, 0, NULL)))
+				{
+					memcpy(&PID, PIDValue, sizeof(long));
+					printf("PID for object %s: %lu\n", argv[2], PID);
+					break;
+				}
+				/*Fall through, we got an OK without a PID.*/
+			default:
+				SpitError("Bad response received over membus. Please report this to Epoch.");
+				RV = FAILURE;
+				break;
+			case MEMBUS_STATUS_FAILURE:
+				fprintf(stderr, CONSOLE_COLOR_RED "Unable to retrieve PID for object %s" CONSOLE_ENDCOLOR "\n", argv[2]);
+				RV = FAILURE;
+				break;
+			case MEMBUS_STATUS_BADPARAM:
+				SpitError("We are being told that MEMBUS_OP_SENDPID is not understood. Please report this to Epoch.");
+				RV = FAILURE;
+				break;
 		}
 		
 		ShutdownMemBus(false);
@@ -1233,8 +1373,6 @@ static rStatus HandleEpochCommand(int argc, char **argv)
 	}
 	else if (ArgIs("kill"))
 	{
-		char InBuf[MEMBUS_MSGSIZE], OutBuf[MEMBUS_MSGSIZE];
-		char PossibleResponses[3][MEMBUS_MSGSIZE];
 		rStatus RV = SUCCESS;
 		
 		if (argc != 3)
@@ -1254,46 +1392,187 @@ static rStatus HandleEpochCommand(int argc, char **argv)
 		
 		if (!InitMemBus(false)) return FAILURE;
 		
-		snprintf(OutBuf, sizeof OutBuf, "%s %s", MEMBUS_CODE_KILLOBJ, argv[2]);
+		if ((RV = ObjControl(argv[2], MEMBUS_OP_KILLOBJ)))
+		{
+			printf("Object %s successfully killed.\n", argv[2]);
+		}
+		else
+		{
+			fprintf(stderr, CONSOLE_COLOR_RED "* " CONSOLE_ENDCOLOR "Unable to kill object %s.\n", argv[2]);
+		}
 		
-		snprintf(PossibleResponses[0], sizeof PossibleResponses[0], "%s %s", MEMBUS_CODE_ACKNOWLEDGED, OutBuf);
-		snprintf(PossibleResponses[1], sizeof PossibleResponses[1], "%s %s", MEMBUS_CODE_FAILURE, OutBuf);
-		snprintf(PossibleResponses[2], sizeof PossibleResponses[2], "%s %s", MEMBUS_CODE_BADPARAM, OutBuf);
+		ShutdownMemBus(false);
 		
-		MemBus_Write(OutBuf, false);
+		return RV;
+	}
+	else if (ArgIs("jobs"))
+	{
+		unsigned char Frame[MEMBUS_MSGSIZE], Status, Opcode = MEMBUS_OP_JOBLIST;
+		const unsigned char *Info = NULL;
+		unsigned long JobID = 0, Inc = 0;
+		rStatus RV = SUCCESS;
+		
+		if (argc > 4)
+		{
+			puts("Too many arguments.\n");
+			PrintEpochHelp(argv[0], "jobs");
+			return FAILURE;
+		}
 		
-		while (!MemBus_Read(InBuf, false)) usleep(1000);
+		CArg = (argc > 2 ? argv[2] : "list");
 		
-		if (!strcmp(InBuf, PossibleResponses[0]))
+		if (ArgIs("status")) Opcode = MEMBUS_OP_JOBSTAT;
+		else if (ArgIs("wait")) Opcode = MEMBUS_OP_JOBWAIT;
+		else if (ArgIs("cancel")) Opcode = MEMBUS_OP_JOBCANCEL;
+		else if (!ArgIs("list") || argc == 4)
 		{
-			printf("Object %s successfully killed.\n", argv[2]);
+			fprintf(stderr, CONSOLE_COLOR_RED "* " CONSOLE_ENDCOLOR "Invalid jobs option %s.\n", CArg);
+			PrintEpochHelp(argv[0], "jobs");
+			return FAILURE;
 		}
-		else if (!strcmp(InBuf, PossibleResponses[1]))
+		
+		if (Opcode != MEMBUS_OP_JOBLIST)
 		{
-			fprintf(stderr, CONSOLE_COLOR_RED "* " CONSOLE_ENDCOLOR "Unable to kill object %s.\n", argv[2]);
-			RV = FAILURE;
+			if (argc != 4 || !AllNumeric(argv[3]))
+			{
+				puts("Please specify a numeric job ID.\n");
+				PrintEpochHelp(argv[0], "jobs");
+				return FAILURE;
+			}
+			
+			JobID = strtoul(argv[3], NULL, 10);
 		}
-		else if (!strcmp(InBuf, PossibleResponses[2]))
+		
+		if (!InitMemBus(false)) return FAILURE;
+		
+		MemBus_FrameInit(Frame, Opcode, 0);
+		
+		if (JobID) MemBus_FrameAdd(Frame, MEMBUS_TLV_JOBID, &JobID, sizeof(long));
+		
+		Status = MemBus_Transact(Frame);
+		ShutdownMemBus(false);
+		
+		if (Status == MEMBUS_STATUS_BADPARAM)
 		{
-			SpitError("We are being told that MEMBUS_CODE_KILLOBJ is not understood.\n"
-						"Please report to Epoch.");
-			RV = FAILURE;
+			fprintf(stderr, CONSOLE_COLOR_RED "* " CONSOLE_ENDCOLOR "No such job %lu.\n", JobID);
+			return FAILURE;
 		}
-		else
+		else if (Status == MEMBUS_STATUS_BADREPLY)
 		{
-			SpitError("Bad response received over membus. This is likely a bug, please report to Epoch.");
-			RV = FAILURE;
+			SpitError("Received unrecognized or corrupted response via membus! Please report to Epoch.");
+			return FAILURE;
 		}
 		
-		ShutdownMemBus(false);
+		switch (Opcode)
+		{
+			case MEMBUS_OP_JOBLIST:
+			case MEMBUS_OP_JOBSTAT:
+				for (Inc = 0; (Info = MemBus_FrameGet(Frame, MEMBUS_TLV_JOBINFO, Inc, NULL)); ++Inc)
+				{
+					unsigned long TJobID = 0;
+					
+					memcpy(&TJobID, Info, sizeof(long));
+					Info += sizeof(long);
+					
+					printf("Job %lu: %s %s, %s.\n", TJobID, JobOpName(Info[0]), (const char*)Info + 3,
+							Info[1] == JOBSTATE_DONE ? JobStatusName(Info[2]) : Jobs_StateName(Info[1]));
+				}
+				
+				if (Opcode == MEMBUS_OP_JOBLIST && Inc == 0) puts("No jobs pending.");
+				break;
+			case MEMBUS_OP_JOBWAIT:
+				printf("Job %lu %s.\n", JobID, JobStatusName(Status));
+				RV = (Status == MEMBUS_STATUS_OK ? SUCCESS : Status == MEMBUS_STATUS_WARNING ? WARNING : FAILURE);
+				break;
+			default:
+				if (Status == MEMBUS_STATUS_OK)
+				{
+					printf("Job %lu cancelled.\n", JobID);
+				}
+				else
+				{
+					fprintf(stderr, CONSOLE_COLOR_RED "* " CONSOLE_ENDCOLOR "Job %lu has already finished.\n", JobID);
+					RV = FAILURE;
+				}
+				break;
+		}
 		
 		return RV;
 	}
+	else if (ArgIs("subscribe"))
+	{
+		unsigned char Frame[MEMBUS_MSGSIZE];
+		const char *Subject = NULL;
+		const void *Value = NULL;
+		long EventValue = 0;
+		unsigned long Sequence = 0, EventTime = 0;
+		time_t TimeCore;
+		struct tm TimeStruct;
+		int Descriptor = -1;
+		
+		/*No membus here. Subscribers would hog it, and nobody else could get a word in.*/
+		if ((Descriptor = Events_Connect((const char**)argv + 2, argc - 2)) == -1)
+		{
+			SpitError("Unable to subscribe to Epoch's event stream. Is Epoch running?");
+			return FAILURE;
+		}
+		
+		setvbuf(stdout, NULL, _IOLBF, 0); /*Whoever reads us wants each event as it comes.*/
+		
+		while (recv(Descriptor, Frame, sizeof Frame, 0) >= (ssize_t)MEMBUS_FRAME_HEADSIZE)
+		{
+			if (Frame[0] != EVENTS_FRAME_MAGIC) continue;
+			
+			memcpy(&Sequence, Frame + 4, sizeof(long));
+			
+			EventValue = 0;
+			if ((Value = MemBus_FrameGet(Frame, MEMBUS_TLV_VALUE, 0, NULL))) memcpy(&EventValue, Value, sizeof(long));
+			
+			EventTime = 0;
+			if ((Value = MemBus_FrameGet(Frame, MEMBUS_TLV_TIME, 0, NULL))) memcpy(&EventTime, Value, sizeof(long));
+			
+			if (!(Subject = MemBus_FrameGetString(Frame, MEMBUS_TLV_OBJECTID, 0)) &&
+				!(Subject = MemBus_FrameGetString(Frame, MEMBUS_TLV_RUNLEVEL, 0)))
+			{
+				Subject = "-";
+			}
+			
+			TimeCore = (time_t)EventTime;
+			localtime_r(&TimeCore, &TimeStruct);
+			
+			printf("%02d:%02d:%02d %lu %s %s", TimeStruct.tm_hour, TimeStruct.tm_min, TimeStruct.tm_sec,
+					Sequence, Events_TypeName(Frame[1]), Subject);
+			
+			switch (Frame[1])
+			{
+				case EVENT_STARTED:
+				case EVENT_READY:
+				case EVENT_RESTARTED:
+					printf(" pid %ld\n", EventValue);
+					break;
+				case EVENT_EXITED:
+					if (WIFSIGNALED((int)EventValue)) printf(" signal %d\n", WTERMSIG((int)EventValue));
+					else printf(" status %d\n", WEXITSTATUS((int)EventValue));
+					break;
+				case EVENT_DROPPED:
+					printf(" %ld events lost\n", EventValue);
+					break;
+				default:
+					putchar('\n');
+					break;
+			}
+		}
+		
+		close(Descriptor);
+		
+		SpitError("Event stream closed by Epoch.");
+		return FAILURE;
+	}
 	else if (ArgIs("objrl"))
 	{
 		const char *ObjectID = argv[2], *RL = argv[4];
-		char OBuf[MEMBUS_MSGSIZE];
-		char IBuf[MEMBUS_MSGSIZE];
+		unsigned char Frame[MEMBUS_MSGSIZE], Status, Opcode = MEMBUS_OP_NONE;
+		const unsigned char *CNumber = NULL;
 		rStatus ExitStatus = SUCCESS;
 		
 		if (argc != 5)
@@ -1310,6 +1589,17 @@ static rStatus HandleEpochCommand(int argc, char **argv)
 			PrintEpochHelp(argv[0], "objrl");
 			return FAILURE;
 		}
+		
+		CArg = argv[3];
+		
+		if (ArgIs("add")) Opcode = MEMBUS_OP_OBJRLS_ADD;
+		else if (ArgIs("del")) Opcode = MEMBUS_OP_OBJRLS_DEL;
+		else if (ArgIs("check")) Opcode = MEMBUS_OP_OBJRLS_CHECK;
+		else
+		{
+			fprintf(stderr, CONSOLE_COLOR_RED "* " CONSOLE_ENDCOLOR "Invalid runlevel option %s.\n", CArg);
+			return FAILURE;
+		}
 
 		if (!InitMemBus(false))
 		{
@@ -1317,134 +1607,85 @@ static rStatus HandleEpochCommand(int argc, char **argv)
 			return FAILURE;
 		}
 		
-		CArg = argv[3];
+		MemBus_FrameInit(Frame, Opcode, 0);
+		MemBus_FrameAddString(Frame, MEMBUS_TLV_OBJECTID, ObjectID);
+		MemBus_FrameAddString(Frame, MEMBUS_TLV_RUNLEVEL, RL);
 		
-		if (ArgIs("add"))
-		{
-			snprintf(OBuf, sizeof OBuf, "%s %s %s", MEMBUS_CODE_OBJRLS_ADD, ObjectID, RL);
-		}
-		else if (ArgIs("del"))
-		{
-			snprintf(OBuf, sizeof OBuf, "%s %s %s", MEMBUS_CODE_OBJRLS_DEL, ObjectID, RL);
-		}
-		else if (ArgIs("check"))
-		{
-			snprintf(OBuf, sizeof OBuf, "%s %s %s", MEMBUS_CODE_OBJRLS_CHECK, ObjectID, RL);
-		}
-		else
+		Status = MemBus_Transact(Frame);
+		ShutdownMemBus(false);
+		
+		if (Status == MEMBUS_STATUS_BADPARAM)
 		{
-			fprintf(stderr, CONSOLE_COLOR_RED "* " CONSOLE_ENDCOLOR "Invalid runlevel option %s.\n", CArg);
-			ShutdownMemBus(false);
+			SpitError("Internal membus error, received BADPARAM upon your request. Please report to Epoch.");
 			return FAILURE;
 		}
-		
-		if (!MemBus_Write(OBuf, false))
+		else if (Status != MEMBUS_STATUS_OK && Status != MEMBUS_STATUS_FAILURE)
 		{
-			SpitError("Failed to write to membus.");
-			ShutdownMemBus(false);
+			SpitError("Received unrecognized or corrupted response via membus! Please report to Epoch.");
 			return FAILURE;
 		}
 		
-		while (!MemBus_Read(IBuf, false)) usleep(1000);
-		
-		if (ArgIs("add") || ArgIs("del"))
-		{	
-			char PossibleResponses[3][MEMBUS_MSGSIZE];
-			
-			snprintf(PossibleResponses[0], sizeof PossibleResponses[0], "%s %s %s %s", MEMBUS_CODE_ACKNOWLEDGED,
-					(ArgIs("add") ? MEMBUS_CODE_OBJRLS_ADD : MEMBUS_CODE_OBJRLS_DEL), ObjectID, RL);
-			
-			snprintf(PossibleResponses[1], sizeof PossibleResponses[1], "%s %s %s %s", MEMBUS_CODE_FAILURE,
-					(ArgIs("add") ? MEMBUS_CODE_OBJRLS_ADD : MEMBUS_CODE_OBJRLS_DEL), ObjectID, RL);
-					
-			snprintf(PossibleResponses[2], sizeof PossibleResponses[2], "%s %s", MEMBUS_CODE_BADPARAM, OBuf);
-			
-			if (!strcmp(PossibleResponses[0], IBuf))
+		if (Opcode != MEMBUS_OP_OBJRLS_CHECK)
+		{
+			if (Status == MEMBUS_STATUS_OK)
 			{
 				char *PSFormat[2] = { "Object %s added to runlevel %s\n", "Object %s deleted from runlevel %s\n" };
 				printf(PSFormat[(ArgIs("add") ? 0 : 1)], ObjectID, RL);
 			}
-			else if (!strcmp(PossibleResponses[1], IBuf))
-			{
-				char *PSFormat[2] = { "Unable to add %s to runlevel %s!\n", "Unable to remove %s from runlevel %s!\n" };
+			else if (Opcode == MEMBUS_OP_OBJRLS_ADD && (CNumber = MemBus_FrameGet(Frame, MEMBUS_TLV_VALUE, 0, NULL)))
+			{ /*Runlevels nothing uses anymore are forgotten on the next configreload.*/
+				unsigned long MaxRunlevels;
 				
-				fprintf(stderr, PSFormat[(ArgIs("add") ? 0 : 1)], ObjectID, RL);
-				ExitStatus = FAILURE;
-			}
-			else if (!strcmp(PossibleResponses[2], IBuf))
-			{
-				SpitError("Internal membus error, received BADPARAM upon your request. Please report to Epoch.");
+				memcpy(&MaxRunlevels, CNumber, sizeof(long));
+				fprintf(stderr, "Unable to add %s to runlevel %s! Epoch can only keep track of %lu different runlevels.\n",
+						ObjectID, RL, MaxRunlevels);
 				ExitStatus = FAILURE;
 			}
 			else
 			{
-				SpitError("Received unrecognized or corrupted response via membus! Please report to Epoch.");
+				char *PSFormat[2] = { "Unable to add %s to runlevel %s!\n", "Unable to remove %s from runlevel %s!\n" };
+				
+				fprintf(stderr, PSFormat[(ArgIs("add") ? 0 : 1)], ObjectID, RL);
 				ExitStatus = FAILURE;
 			}
 			
-			ShutdownMemBus(false);
 			return ExitStatus;
 		}
-		else if (ArgIs("check"))
+		
+		if (Status == MEMBUS_STATUS_FAILURE)
 		{
-			char PossibleResponses[3][MEMBUS_MSGSIZE];
-	
-			snprintf(PossibleResponses[0], sizeof PossibleResponses[0], "%s %s %s ", MEMBUS_CODE_OBJRLS_CHECK, ObjectID, RL);
-			snprintf(PossibleResponses[1], sizeof PossibleResponses[1], "%s %s", MEMBUS_CODE_FAILURE, OBuf);
-			snprintf(PossibleResponses[2], sizeof PossibleResponses[2], "%s %s", MEMBUS_CODE_BADPARAM, OBuf);
+			fprintf(stderr, CONSOLE_COLOR_RED "* " CONSOLE_ENDCOLOR 
+					"Unable to determine if object %s belongs to runlevel %s. Does it exist?\n", ObjectID, RL);
+			return FAILURE;
+		}
 		
-			if (!strncmp(PossibleResponses[0], IBuf, strlen(PossibleResponses[0])))
-			{
-				char CNumber[2] = { '\0', '\0' };
-				const char *CNS = IBuf + strlen(PossibleResponses[0]);
-				
-				CNumber[0] = *CNS;
-				
-				if (*CNumber == '0')
-				{
-					printf(CONSOLE_COLOR_RED "Object %s is NOT enabled for runlevel %s.\n" CONSOLE_ENDCOLOR,
-							ObjectID, RL);
-				}
-				else if (*CNumber == '1')
-				{
-					printf(CONSOLE_COLOR_GREEN "Object %s is enabled for runlevel %s.\n" CONSOLE_ENDCOLOR,
-							ObjectID, RL);
-				}
-				else if (*CNumber == '2')
-				{
-					printf(CONSOLE_COLOR_CYAN "Object %s is inherited by the runlevel %s.\n" CONSOLE_ENDCOLOR,
-							ObjectID, RL);
-				}
-				else
-				{
-					SpitError("Internal error, bad status number received from membus. Please report to Epoch.");
-					ExitStatus = FAILURE;
-				}
-				ShutdownMemBus(false);
-				
-				return ExitStatus;
-			}
-			else if (!strcmp(PossibleResponses[1], IBuf))
-			{
-				fprintf(stderr, CONSOLE_COLOR_RED "* " CONSOLE_ENDCOLOR 
-						"Unable to determine if object %s belongs to runlevel %s. Does it exist?\n", ObjectID, RL);
-				ShutdownMemBus(false);
-				return FAILURE;
-			}
-			else if (!strcmp(PossibleResponses[2], IBuf))
-			{
-				SpitError("We are being told that we sent a bad signal over the membus. "
-							"This is a bug, please report to epoch.");
-				ShutdownMemBus(false);
-				return FAILURE;
-			}
-			else
-			{
-				SpitError("Received unrecognized or corrupted response via membus! Please report to Epoch.");
-				ShutdownMemBus(false);
-				return FAILURE;
-			}
+		if (!(CNumber = MemBus_FrameGet(Frame, MEMBUS_TLV_VALUE, 0, NULL)))
+		{
+			SpitError("Internal error, no status number received from membus. Please report to Epoch.");
+			return FAILURE;
 		}
+		
+		switch (*CNumber)
+		{
+			case 0:
+				printf(CONSOLE_COLOR_RED "Object %s is NOT enabled for runlevel %s.\n" CONSOLE_ENDCOLOR,
+						ObjectID, RL);
+				break;
+			case 1:
+				printf(CONSOLE_COLOR_GREEN "Object %s is enabled for runlevel %s.\n" CONSOLE_ENDCOLOR,
+						ObjectID, RL);
+				break;
+			case 2:
+				printf(CONSOLE_COLOR_CYAN "Object %s is inherited by the runlevel %s.\n" CONSOLE_ENDCOLOR,
+						ObjectID, RL);
+				break;
+			default:
+				SpitError("Internal error, bad status number received from membus. Please report to Epoch.");
+				ExitStatus = FAILURE;
+				break;
+		}
+		
+		return ExitStatus;
 	}
 	else
 	{
@@ -1563,65 +1804,42 @@ int main(int argc, char **argv)
 	{ /*This is a bit long winded here, however, it's better than devoting a function for it.*/
 		if (argc == 2)
 		{
-			char TmpBuf[MEMBUS_MSGSIZE];
-			char MembusResponse[MEMBUS_MSGSIZE];
-			char PossibleResponses[3][MEMBUS_MSGSIZE];
+			unsigned char Frame[MEMBUS_MSGSIZE];
+			unsigned char Status;
 			
-			if (strlen(argv[1]) >= MEMBUS_MSGSIZE)
+			if (strlen(argv[1]) >= MAX_DESCRIPT_SIZE)
 			{
 				SpitError("Runlevel name too long. Please specify a runlevel with a sane name.");
 				return 1;
 			}
 			
-			snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_RUNLEVEL, argv[1]);
-			snprintf(PossibleResponses[0], sizeof PossibleResponses[0], "%s %s", MEMBUS_CODE_ACKNOWLEDGED, TmpBuf);
-			snprintf(PossibleResponses[1], sizeof PossibleResponses[1], "%s %s", MEMBUS_CODE_FAILURE, TmpBuf);
-			snprintf(PossibleResponses[2], sizeof PossibleResponses[2], "%s %s", MEMBUS_CODE_BADPARAM, TmpBuf);
-			
 			if (!InitMemBus(false))
 			{
 				SpitError("Failed to communicate with Epoch init, membus is down.");
 				return 1;
 			}
 			
-			if (!MemBus_Write(TmpBuf, false))
-			{				
-				SpitError("Failed to change runlevels, failed to write to membus after establishing connection.\n"
-							"Is Epoch the running boot system?");		
-				ShutdownMemBus(false);
-				
-				return 1;
-			}
+			MemBus_FrameInit(Frame, MEMBUS_OP_RUNLEVEL, 0);
+			MemBus_FrameAddString(Frame, MEMBUS_TLV_RUNLEVEL, argv[1]);
 			
-			while (!MemBus_Read(MembusResponse, false)) usleep(1000);
+			Status = MemBus_Transact(Frame);
+			ShutdownMemBus(false);
 			
-			if (!strcmp(MembusResponse, PossibleResponses[0]))
-			{
-				ShutdownMemBus(false);
-				
-				return 0;
-			}
-			else if (!strcmp(MembusResponse, PossibleResponses[1]))
-			{
-				fprintf(stderr, CONSOLE_COLOR_RED "* " CONSOLE_ENDCOLOR "Failed to change runlevel to \"%s\".\n", argv[1]);
-				ShutdownMemBus(false);
-				
-				return 1;
-			}
-			else if (!strcmp(MembusResponse, PossibleResponses[2]))
+			switch (Status)
 			{
-				ShutdownMemBus(false);
-				SpitError("We are being told that MEMBUS_CODE_RUNLEVEL is not understood.\n"
-						"This is bad. Please report to Epoch.");
-				
-				return 1;
-			}
-			else
-			{
-				SpitError("Invalid response provided over membus.");
-				ShutdownMemBus(false);
-				
-				return 1;
+				case MEMBUS_STATUS_OK:
+					return 0;
+				case MEMBUS_STATUS_FAILURE:
+					fprintf(stderr, CONSOLE_COLOR_RED "* " CONSOLE_ENDCOLOR "Failed to change runlevel to \"%s\".\n", argv[1]);
+					return 1;
+				case MEMBUS_STATUS_BADPARAM:
+					SpitError("We are being told that MEMBUS_OP_RUNLEVEL is not understood.\n"
+							"This is bad. Please report to Epoch.");
+					return 1;
+				default:
+					SpitError("Failed to change runlevels, invalid response provided over membus.\n"
+							"Is Epoch the running boot system?");
+					return 1;
 			}
 		}
 		else
@@ -14,6 +14,8 @@
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
+#include <errno.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
@@ -21,7 +23,20 @@
 #include <time.h>
 #include "epoch.h"
 
+#define MEMBUS_HEADER_MAGIC 0x45424c31 /*Bump this if struct _MemBusHeader changes.*/
+#define MEMBUS_SEGMENT_SIZE (sizeof(struct _MemBusHeader) + MEMBUS_SIZE)
+
+struct _MemBusHeader
+{ /*The front of the segment. The server and client halves come after it.*/
+	unsigned long Magic; /*MEMBUS_HEADER_MAGIC once the lock is set up.*/
+	pthread_mutex_t Lock;
+	unsigned long LockPID; /*Who has the lock, for the server's benefit.*/
+	unsigned long LockSerial; /*Goes up every time a client takes the lock.*/
+};
+
 /*Memory bus uhh, static globals.*/
+static void MemBus_BuildCodeTable(void);
+static const char *MemBus_CodeName(unsigned char Opcode);
 
 struct _MemBusInterface MemBus;
 
@@ -29,17 +44,57 @@ Bool BusRunning;
 signed long MemBusKey = MEMKEY;
 int MemDescriptor;
 
+static void MemBus_ResetHalves(void)
+{ /*Whatever was in flight is meaningless now.*/
+	*MemBus.Server.Status = MEMBUS_NOMSG;
+	*MemBus.Server.Message = '\0';
+	*MemBus.Client.Status = MEMBUS_NOMSG;
+	*MemBus.Client.Message = '\0';
+}
+
+static rStatus MemBus_InitLock(struct _MemBusHeader *Header)
+{ /*Process shared so clients can use it, and robust so a client that dies holding it can't lock everyone out.*/
+	pthread_mutexattr_t Attr;
+	
+	if (pthread_mutexattr_init(&Attr) != 0) return FAILURE;
+	
+	if (pthread_mutexattr_setpshared(&Attr, PTHREAD_PROCESS_SHARED) != 0 ||
+		pthread_mutexattr_setrobust(&Attr, PTHREAD_MUTEX_ROBUST) != 0 ||
+		pthread_mutex_init(&Header->Lock, &Attr) != 0)
+	{
+		pthread_mutexattr_destroy(&Attr);
+		return FAILURE;
+	}
+	
+	pthread_mutexattr_destroy(&Attr);
+	
+	Header->LockPID = 0;
+	Header->LockSerial = 0;
+	Header->Magic = MEMBUS_HEADER_MAGIC;
+	
+	return SUCCESS;
+}
+
 rStatus InitMemBus(Bool ServerSide)
 { /*Fire up the memory bus.*/
+	struct _MemBusHeader *Header = NULL;
 	char CheckCode = 0;
 	unsigned long Inc = 0;
+	int LockStatus = 0;
 	
 	
 	if (BusRunning) return SUCCESS;
 	
 	memset(&MemBus, 0, sizeof(struct _MemBusInterface));
 	
-	if ((MemDescriptor = shmget((key_t)MemBusKey, MEMBUS_SIZE + sizeof(long) * 2, (ServerSide ? (IPC_CREAT | 0660) : 0660))) < 0)
+	if ((MemDescriptor = shmget((key_t)MemBusKey, MEMBUS_SEGMENT_SIZE, (ServerSide ? (IPC_CREAT | 0660) : 0660))) < 0 &&
+		ServerSide && errno == EINVAL && (MemDescriptor = shmget((key_t)MemBusKey, 0, 0660)) >= 0)
+	{ /*A leftover segment from an Epoch with a smaller membus. Nobody can use it with us anyways.*/
+		shmctl(MemDescriptor, IPC_RMID, NULL);
+		MemDescriptor = shmget((key_t)MemBusKey, MEMBUS_SEGMENT_SIZE, IPC_CREAT | 0660);
+	}
+	
+	if (MemDescriptor < 0)
 	{
 		if (ServerSide) SpitError("InitMemBus(): Failed to allocate memory bus."); /*should probably use perror*/
 		else SpitError("InitMemBus(): Failed to connect to memory bus. Permissions?");
@@ -54,33 +109,54 @@ rStatus InitMemBus(Bool ServerSide)
 	}
 	
 	/*Status.*/
-	MemBus.LockPID = MemBus.Root;
-	MemBus.LockTime = (unsigned long*) ((char*)MemBus.Root + sizeof(long));
+	Header = MemBus.Root;
+	MemBus.Lock = &Header->Lock;
+	MemBus.LockPID = &Header->LockPID;
+	MemBus.LockSerial = &Header->LockSerial;
 	
 	/*Server side.*/
-	MemBus.Server.Status = (unsigned char*)MemBus.Root + sizeof(long) * 2;
+	MemBus.Server.Status = (unsigned char*)MemBus.Root + sizeof(struct _MemBusHeader);
 	MemBus.Server.BinMessage = MemBus.Server.Status + 1;
 	MemBus.Server.Message = (char*)MemBus.Server.BinMessage;
 	
 	/*Client side.*/
-	MemBus.Client.Status = (unsigned char*)MemBus.Root + sizeof(long) * 2 + MEMBUS_SIZE/2;
+	MemBus.Client.Status = MemBus.Server.Status + MEMBUS_SIZE/2;
 	MemBus.Client.BinMessage = MemBus.Client.Status + 1;
 	MemBus.Client.Message = (char*)MemBus.Client.BinMessage;
 	
 	if (ServerSide) /*Don't nuke messages on startup if we aren't init.*/
 	{
-		memset((void*)MemBus.Root, 0, MEMBUS_SIZE); /*Zero it out just to be neat. Probably don't really need this.*/
+		MemBus_BuildCodeTable();
+		
+		/*A segment that outlived an exec of us keeps it's lock, since the client who asked for it still holds it.*/
+		if (Header->Magic != MEMBUS_HEADER_MAGIC)
+		{
+			memset((void*)MemBus.Root, 0, MEMBUS_SEGMENT_SIZE);
+			
+			if (!MemBus_InitLock(Header))
+			{
+				SpitError("InitMemBus(): Failed to set up the membus lock.");
+				shmdt(MemBus.Root);
+				memset(&MemBus, 0, sizeof(struct _MemBusInterface));
+				return FAILURE;
+			}
+		}
+		
+		memset(MemBus.Server.Status, 0, MEMBUS_SIZE);
 		
 		*MemBus.Server.Status = MEMBUS_NOMSG; /*Set to no message by default.*/
+		*MemBus.Client.Status = MEMBUS_NOMSG;
 	}
 	else
 	{ /*Client side stuff.*/
-		for (; *MemBus.Server.Status != MEMBUS_NOMSG && *MemBus.Server.Status != MEMBUS_MSG; ++Inc)
+		for (; Header->Magic != MEMBUS_HEADER_MAGIC ||
+			(*MemBus.Server.Status != MEMBUS_NOMSG && *MemBus.Server.Status != MEMBUS_MSG); ++Inc)
 		{ /*Wait for server-side to finish setting up it's half, if it was just starting up itself.*/
 			if (Inc == 100000) /*Ten secs.*/
 			{
 				SmallError("Cannot connect to Epoch over MemBus, stream corrupted. Aborting MemBus initialization.");
 				BusRunning = false;
+				shmdt(MemBus.Root);
 				memset(&MemBus, 0, sizeof(struct _MemBusInterface));
 				
 				return FAILURE;
@@ -89,16 +165,25 @@ rStatus InitMemBus(Bool ServerSide)
 			usleep(100);
 		}
 		
-		/*Check the lock.*/
-		if (*MemBus.LockPID != 0 && *MemBus.LockPID != getpid())
+		/*Take the lock. If whoever had it died holding it, the kernel hands it straight to us.*/
+		if ((LockStatus = pthread_mutex_trylock(&Header->Lock)) == EOWNERDEAD)
+		{
+			pthread_mutex_consistent(&Header->Lock);
+			MemBus_ResetHalves(); /*Whatever they were in the middle of.*/
+		}
+		else if (LockStatus != 0)
 		{
 			SmallError("Another client is currently connected to the membus. Cannot continue!");
 			BusRunning = false;
+			shmdt(MemBus.Root);
 			memset(&MemBus, 0, sizeof(struct _MemBusInterface));
 
 			return FAILURE;
 		}
 		
+		*MemBus.LockPID = getpid();
+		++*MemBus.LockSerial;
+		
 		CheckCode = *MemBus.Server.Status = (*MemBus.Server.Status == MEMBUS_MSG ? MEMBUS_CHECKALIVE_MSG : MEMBUS_CHECKALIVE_NOMSG); /*Ask server-side if they're alive.*/
 		
 		for (Inc = 0; *MemBus.Server.Status == CheckCode; ++Inc)
@@ -107,7 +192,12 @@ rStatus InitMemBus(Bool ServerSide)
 			{ /*Ten seconds.*/
 				SmallError("Cannot connect to Epoch over MemBus, timeout expired. Aborting MemBus initialization.");
 				
+				*MemBus.Server.Status = (CheckCode == MEMBUS_CHECKALIVE_MSG ? MEMBUS_MSG : MEMBUS_NOMSG);
+				*MemBus.LockPID = 0;
+				pthread_mutex_unlock(&Header->Lock);
+				
 				BusRunning = false;
+				shmdt(MemBus.Root);
 				memset(&MemBus, 0, sizeof(struct _MemBusInterface));
 
 				return FAILURE;
@@ -116,10 +206,6 @@ rStatus InitMemBus(Bool ServerSide)
 			usleep(100);
 		}
 		
-		/*Acquire the lock.*/
-		*MemBus.LockPID = getpid();
-		*MemBus.LockTime = time(NULL);
-
 		*MemBus.Client.Status = MEMBUS_NOMSG;
 	}
 	/*Either the server side is alive, or we ARE the server side.*/
@@ -284,694 +370,1112 @@ Bool HandleMemBusPings(void)
 }
 
 Bool CheckMemBusIntegrity(void)
-{
+{ /*Server side. If the client holding the lock died, take it back right away, so any job
+	* replies meant for them get dropped and nobody is left waiting on a message they'll never eat.*/
+	int LockStatus = 0;
+	
 	if (!BusRunning) return true;
 	
-	if (*MemBus.LockPID == 0) return true;
+	if (*MemBus.LockPID == 0 || kill((pid_t)*MemBus.LockPID, 0) == 0 || errno != ESRCH) return true;
 	
-	if (*MemBus.LockTime + 60 < time(NULL))
-	{ /*Anything after a minute needs to be disconnected.*/
-		*MemBus.Server.Status = MEMBUS_NOMSG;
-		*MemBus.Server.Message = '\0';
-		*MemBus.Client.Status = MEMBUS_NOMSG;
-		*MemBus.Client.Message = '\0';
-		*MemBus.LockTime = 0;
+	if ((LockStatus = pthread_mutex_trylock(MemBus.Lock)) == EBUSY)
+	{ /*Somebody new already got it back.*/
+		return true;
+	}
+	
+	if (LockStatus == EOWNERDEAD) pthread_mutex_consistent(MemBus.Lock);
+	
+	if (LockStatus == 0 || LockStatus == EOWNERDEAD)
+	{
+		MemBus_ResetHalves();
 		*MemBus.LockPID = 0;
-		return false;
+		pthread_mutex_unlock(MemBus.Lock);
 	}
 	
-	return true;	
+	return false;
 }
 	
-void ParseMemBus(void)
-{ /*This function handles EVERYTHING passed to us via membus. It's truly vast.*/
-#define BusDataIs(x) !strncmp(x, BusData, strlen(x))
-	char BusData[MEMBUS_MSGSIZE];
+/**The framed binary protocol.**/
 
-	if (!BusRunning) return;
+void MemBus_FrameInit(unsigned char *Frame, unsigned char Opcode, unsigned long RequestID)
+{ /*Starts an empty frame.*/
+	unsigned short Length = 0;
 	
-	if (!MemBus_Read(BusData, true))
-	{
-		return;
-	}
+	Frame[0] = MEMBUS_FRAME_MAGIC;
+	Frame[1] = Opcode;
+	memcpy(Frame + 2, &Length, sizeof(short));
+	memcpy(Frame + 4, &RequestID, sizeof(long));
+}
+
+unsigned long MemBus_FrameSize(const unsigned char *Frame)
+{
+	unsigned short Length;
+	
+	memcpy(&Length, Frame + 2, sizeof(short));
+	
+	return MEMBUS_FRAME_HEADSIZE + Length;
+}
+
+Bool MemBus_FrameAdd(unsigned char *Frame, unsigned char Type, const void *Value, unsigned short ValueLength)
+{ /*Appends a TLV argument. Returns false if it won't fit in one message.*/
+	unsigned long Size = MemBus_FrameSize(Frame);
+	unsigned short Length;
 	
-	/*If we got a signal over the membus.*/
-	if (BusDataIs(MEMBUS_CODE_RESET))
+	if (Size + MEMBUS_TLV_HEADSIZE + ValueLength > MEMBUS_MSGSIZE)
 	{
-		if (ReloadConfig())
-		{
-			MemBus_Write(MEMBUS_CODE_ACKNOWLEDGED " " MEMBUS_CODE_RESET, true);
-		}
-		else
-		{
-			MemBus_Write(MEMBUS_CODE_FAILURE " " MEMBUS_CODE_RESET, true);
-		}
+		return false;
 	}
-	else if (BusDataIs(MEMBUS_CODE_OBJSTART) || BusDataIs(MEMBUS_CODE_OBJSTOP))
+	
+	Frame[Size] = Type;
+	memcpy(Frame + Size + 1, &ValueLength, sizeof(short));
+	memcpy(Frame + Size + MEMBUS_TLV_HEADSIZE, Value, ValueLength);
+	
+	Length = Size - MEMBUS_FRAME_HEADSIZE + MEMBUS_TLV_HEADSIZE + ValueLength;
+	memcpy(Frame + 2, &Length, sizeof(short));
+	
+	return true;
+}
+
+Bool MemBus_FrameAddString(unsigned char *Frame, unsigned char Type, const char *Value)
+{
+	return MemBus_FrameAdd(Frame, Type, Value, strlen(Value) + 1);
+}
+
+const void *MemBus_FrameGet(const unsigned char *Frame, unsigned char Type, unsigned long Index, unsigned short *LengthOut)
+{ /*Finds the Index'th TLV of the given type. Bounds checked, so it's safe on garbage.*/
+	const unsigned char *Worker = Frame + MEMBUS_FRAME_HEADSIZE;
+	const unsigned char *End = Frame + MemBus_FrameSize(Frame);
+	unsigned short Length = 0;
+	
+	if (MemBus_FrameSize(Frame) > MEMBUS_MSGSIZE) return NULL;
+	
+	for (; Worker + MEMBUS_TLV_HEADSIZE <= End; Worker += MEMBUS_TLV_HEADSIZE + Length)
 	{
-		unsigned long LOffset = strlen((BusDataIs(MEMBUS_CODE_OBJSTART) ? MEMBUS_CODE_OBJSTART " " : MEMBUS_CODE_OBJSTOP " "));
-		char *TWorker = BusData + LOffset;
-		ObjTable *CurObj = LookupObjectInTable(TWorker);
-		char TmpBuf[MEMBUS_MSGSIZE], *MCode = MEMBUS_CODE_FAILURE;
-		rStatus DidWork;
+		memcpy(&Length, Worker + 1, sizeof(short));
 		
-		if (LOffset >= strlen(BusData) || BusData[LOffset] == ' ')
-		{ /*No argument?*/
-			snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_BADPARAM, BusData);
-			MemBus_Write(TmpBuf, true);
-			
-			return;
-		}
+		if (Worker + MEMBUS_TLV_HEADSIZE + Length > End) break;
 		
-		if (CurObj)
-		{ /*If we ask to start a HaltCmdOnly command, run the stop command instead, because that's all that we use.*/
-			DidWork = ProcessConfigObject(CurObj, (BusDataIs(MEMBUS_CODE_OBJSTART) && !CurObj->Opts.HaltCmdOnly), false);
-			
-			snprintf(TmpBuf, sizeof TmpBuf, "Manual %s of object %s %s%s", (BusDataIs(MEMBUS_CODE_OBJSTART) ? "start" : "stop"),
-					CurObj->ObjectID, (DidWork ? "succeeded" : "failed"), ((DidWork == WARNING) ? " with a warning" : ""));
-			WriteLogLine(TmpBuf, true);
-		}
-		else
+		if (*Worker == Type && Index-- == 0)
 		{
-			DidWork = FAILURE;
+			if (LengthOut) *LengthOut = Length;
+			return Worker + MEMBUS_TLV_HEADSIZE;
 		}
+	}
+	
+	return NULL;
+}
+
+const char *MemBus_FrameGetString(const unsigned char *Frame, unsigned char Type, unsigned long Index)
+{ /*Same as above, but only if it's a properly terminated string.*/
+	unsigned short Length = 0;
+	const char *Value = MemBus_FrameGet(Frame, Type, Index, &Length);
+	
+	if (!Value || Length == 0 || Value[Length - 1] != '\0') return NULL;
+	
+	return Value;
+}
+
+unsigned char MemBus_Transact(unsigned char *Frame)
+{ /*Client side. Sends the request frame, then overwrites it with the reply. Returns the reply status.*/
+	static unsigned long RequestCounter = 0;
+	const unsigned char Opcode = Frame[1];
+	unsigned long RequestID = ++RequestCounter, ReplyID = 0;
+	const unsigned char *Status = NULL;
+	
+	memcpy(Frame + 4, &RequestID, sizeof(long));
+	
+	if (!MemBus_BinWrite(Frame, MemBus_FrameSize(Frame), false))
+	{
+		return MEMBUS_STATUS_BADREPLY;
+	}
+	
+	while (!MemBus_BinRead(Frame, MEMBUS_MSGSIZE, false)) usleep(1000);
+	
+	memcpy(&ReplyID, Frame + 4, sizeof(long));
+	
+	if (Frame[0] != MEMBUS_FRAME_MAGIC || Frame[1] != Opcode || ReplyID != RequestID ||
+		!(Status = MemBus_FrameGet(Frame, MEMBUS_TLV_STATUS, 0, NULL)))
+	{
+		return MEMBUS_STATUS_BADREPLY;
+	}
+	
+	return *Status;
+}
+
+unsigned char MemBus_WaitJob(unsigned char *Frame)
+{ /*Client side. Takes a reply carrying a JOBID and waits for that job to finish.
+	* The frame is overwritten with the final reply.*/
+	const void *Value = MemBus_FrameGet(Frame, MEMBUS_TLV_JOBID, 0, NULL);
+	unsigned long JobID = 0;
+	
+	if (!Value) return MEMBUS_STATUS_BADREPLY;
+	
+	memcpy(&JobID, Value, sizeof(long));
+	
+	MemBus_FrameInit(Frame, MEMBUS_OP_JOBWAIT, 0);
+	MemBus_FrameAdd(Frame, MEMBUS_TLV_JOBID, &JobID, sizeof(long));
+	
+	return MemBus_Transact(Frame);
+}
+
+/**Server side dispatch.**/
+
+static const char *MemBus_StatusCode(unsigned char Status)
+{ /*What the text protocol calls each status.*/
+	static const char *const StatusCodes[] = { MEMBUS_CODE_FAILURE, MEMBUS_CODE_ACKNOWLEDGED,
+												MEMBUS_CODE_WARNING, MEMBUS_CODE_BADPARAM, MEMBUS_CODE_FAILURE,
+												MEMBUS_CODE_PENDING, MEMBUS_CODE_CANCELLED };
+	
+	return StatusCodes[Status > MEMBUS_STATUS_CANCELLED ? 0 : Status];
+}
+
+void MemBus_ReplyValue(const struct _MemBusRequest *Req, unsigned char Status, const char *TextReply,
+					unsigned char ValueType, const void *Value, unsigned short ValueLength)
+{ /*Replies in whatever protocol the request came in. Text replies echo the request unless TextReply is given.*/
+	if (Req->Binary)
+	{
+		unsigned char Frame[MEMBUS_MSGSIZE];
 		
-		switch (DidWork)
-		{
-			case SUCCESS:
-				MCode = MEMBUS_CODE_ACKNOWLEDGED;
-				break;
-			case WARNING:
-				MCode = MEMBUS_CODE_WARNING;
-				break;
-			case FAILURE:
-				MCode = MEMBUS_CODE_FAILURE;
-				break;
-				
-		}
+		MemBus_FrameInit(Frame, Req->Opcode, Req->RequestID);
+		MemBus_FrameAdd(Frame, MEMBUS_TLV_STATUS, &Status, 1);
 		
-		snprintf(TmpBuf, sizeof TmpBuf, "%s %s %s",
-				MCode, (BusDataIs(MEMBUS_CODE_OBJSTART) ? MEMBUS_CODE_OBJSTART : MEMBUS_CODE_OBJSTOP), TWorker);
+		if (Value) MemBus_FrameAdd(Frame, ValueType, Value, ValueLength);
 		
-		MemBus_Write(TmpBuf, true);
+		MemBus_BinWrite(Frame, MemBus_FrameSize(Frame), true);
 	}
-	else if (BusDataIs(MEMBUS_CODE_LSOBJS))
-	{ /*Done for mostly third party stuff.*/
-		char OutBuf[MEMBUS_MSGSIZE];
-		unsigned char *BinWorker = (void*)OutBuf;
-		ObjTable *Worker = ObjectTable;
-		unsigned long TPID = 0;
-		const unsigned long Length = strlen(MEMBUS_CODE_LSOBJS " " MEMBUS_LSOBJS_VERSION) + 1;
-		
-		for (; Worker->Next; Worker = Worker->Next)
-		{
-			const struct _RLTree *RLWorker = Worker->ObjectRunlevels;
-			
-			
-			if (strlen(BusData) > strlen(MEMBUS_CODE_LSOBJS) &&
-				strcmp(BusData + strlen(MEMBUS_CODE_LSOBJS " "), Worker->ObjectID) != 0)
-			{ /*Allow for getting status of just one object.*/
-					continue;
-			}
-			
-			if (!Worker->Opts.HasPIDFile || !(TPID = ReadPIDFile(Worker)))
-			{
-				TPID = Worker->ObjectPID;
-			}
-			
-			/*We need a version for this protocol, because relevant options can change with updates.
-			 * Not all options are here, because some are not really useful.*/
-						
-			strncpy(OutBuf, MEMBUS_CODE_LSOBJS " " MEMBUS_LSOBJS_VERSION, Length);
-			
-			BinWorker = (unsigned char*)OutBuf + Length;
-			
-			*BinWorker++ = (Worker->Started && !Worker->Opts.HaltCmdOnly);
-			*BinWorker++ = ObjectProcessRunning(Worker);
-			*BinWorker++ = Worker->Enabled;
-			*BinWorker++ = Worker->TermSignal;
-			*BinWorker++ = Worker->ReloadCommandSignal;
-			
-			memcpy(BinWorker, &Worker->UserID, sizeof(long));
-			memcpy((BinWorker += sizeof(long)), &Worker->GroupID, sizeof(long));
-			
-			memcpy((BinWorker += sizeof(long)), &Worker->Opts.StopMode, sizeof(enum _StopMode));
-			memcpy((BinWorker += sizeof(enum _StopMode)), &TPID, sizeof(long));
-			
-			memcpy((BinWorker += sizeof(long)), &Worker->StartedSince, sizeof(long));
-			memcpy(BinWorker + sizeof(long), &Worker->Opts.StopTimeout, sizeof(long));
-			
-			
-			MemBus_BinWrite(OutBuf, MEMBUS_MSGSIZE, true);
-			
-			snprintf(OutBuf, sizeof OutBuf, "%s %s", Worker->ObjectID, Worker->ObjectDescription);
-			
-			MemBus_Write(OutBuf, true);
-			
-			*OutBuf = '\0';
-			
-			BinWorker = (void*)OutBuf;
-			/*Write it over binary now.*/
-			if (Worker->Opts.RawDescription) *BinWorker++ = COPT_RAWDESCRIPTION;
-			if (Worker->Opts.HaltCmdOnly) *BinWorker++ = COPT_HALTONLY;
-			if (Worker->Opts.Persistent) *BinWorker++ = COPT_PERSISTENT;
-			if (Worker->Opts.Fork) *BinWorker++ = COPT_FORK;
-			if (Worker->Opts.IsService) *BinWorker++ = COPT_SERVICE;
-			if (Worker->Opts.AutoRestart) *BinWorker++ = COPT_AUTORESTART;
-			if (Worker->Opts.ForceShell) *BinWorker++ = COPT_FORCESHELL;
-			if (Worker->Opts.NoStopWait) *BinWorker++ = COPT_NOSTOPWAIT;
-			if (Worker->Opts.Exec) *BinWorker++ = COPT_EXEC;
-			if (Worker->Opts.PivotRoot) *BinWorker++ = COPT_PIVOTROOT;
-	
-			*BinWorker = 0;
-			
-			MemBus_BinWrite(OutBuf, MEMBUS_MSGSIZE, true);
-			
-			if (RLWorker)
-			{
-				for (; RLWorker->Next; RLWorker = RLWorker->Next)
-				{ /*Send all runlevels.*/
-					snprintf(OutBuf, sizeof OutBuf, "%s %s %s %s", MEMBUS_CODE_LSOBJS,
-							MEMBUS_LSOBJS_VERSION, Worker->ObjectID, RLWorker->RL);
-
-					MemBus_Write(OutBuf, true);
-				}
-			}
-		}
-		
-		/*This says we are done.*/
-		MemBus_Write(MEMBUS_CODE_ACKNOWLEDGED " " MEMBUS_CODE_LSOBJS, true);
-		return;
-	}					
-	else if (BusDataIs(MEMBUS_CODE_GETRL))
+	else if (TextReply)
+	{
+		MemBus_Write(TextReply, true);
+	}
+	else
 	{
 		char TmpBuf[MEMBUS_MSGSIZE];
 		
-		snprintf(TmpBuf, sizeof TmpBuf, MEMBUS_CODE_GETRL " %s", CurRunlevel);
+		snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MemBus_StatusCode(Status), Req->Text);
 		MemBus_Write(TmpBuf, true);
-	}		
-	else if (BusDataIs(MEMBUS_CODE_OBJENABLE) || BusDataIs(MEMBUS_CODE_OBJDISABLE))
-	{
-		Bool EnablingThis = (BusDataIs(MEMBUS_CODE_OBJENABLE) ? true : false);
-		unsigned long LOffset = strlen(EnablingThis ? MEMBUS_CODE_OBJENABLE " " : MEMBUS_CODE_OBJDISABLE " ");
-		char *OurSignal = EnablingThis ? MEMBUS_CODE_OBJENABLE : MEMBUS_CODE_OBJDISABLE;
-		char *TWorker = BusData + LOffset;
-		ObjTable *CurObj = LookupObjectInTable(TWorker);
-		char TmpBuf[MEMBUS_MSGSIZE];
-		rStatus DidWork = FAILURE;
+	}
+}
+
+void MemBus_ReplyBatch(const struct _MemBusRequest *Req, const struct _EpochJob *Job)
+{ /*Every object's result in one reply, as many as will fit. The VALUE TLV is a long with
+	* how many objects were in the batch, so clients can tell if some got left off.*/
+	unsigned long Inc = 0;
+	
+	if (Req->Binary)
+	{
+		unsigned char Frame[MEMBUS_MSGSIZE], Entry[MAX_DESCRIPT_SIZE + 1];
+		const unsigned char Status = Job->Status;
 		
-		if (LOffset >= strlen(BusData) || BusData[LOffset] == ' ')
-		{ /*No argument?*/
-			snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_BADPARAM, BusData);
-			MemBus_Write(TmpBuf, true);
-			
-			return;
-		}
+		MemBus_FrameInit(Frame, Req->Opcode, Req->RequestID);
+		MemBus_FrameAdd(Frame, MEMBUS_TLV_STATUS, &Status, 1);
+		MemBus_FrameAdd(Frame, MEMBUS_TLV_JOBID, &Job->JobID, sizeof(long));
+		MemBus_FrameAdd(Frame, MEMBUS_TLV_VALUE, &Job->BatchCount, sizeof(long));
 		
-		if (!CurObj)
+		for (; Inc < Job->BatchCount; ++Inc)
 		{
-			snprintf(TmpBuf, sizeof TmpBuf, "%s %s %s", MEMBUS_CODE_FAILURE, OurSignal, TWorker);
-			MemBus_Write(TmpBuf, true);
+			const unsigned short Length = strlen(Job->Batch[Inc].ObjectID) + 1;
 			
-			return;
+			Entry[0] = Job->Batch[Inc].Status;
+			memcpy(Entry + 1, Job->Batch[Inc].ObjectID, Length);
+			
+			if (!MemBus_FrameAdd(Frame, MEMBUS_TLV_BATCHRESULT, Entry, Length + 1)) break;
 		}
 		
-		CurObj->Enabled = (EnablingThis ? true : false);
-		DidWork = EditConfigValue(TWorker, "ObjectEnabled", EnablingThis ? "true" : "false");
+		MemBus_BinWrite(Frame, MemBus_FrameSize(Frame), true);
+	}
+	else
+	{ /*OK BATCH start foo*: foo1=OK foo2=FAIL*/
+		char TmpBuf[MEMBUS_MSGSIZE];
+		unsigned long Length = snprintf(TmpBuf, sizeof TmpBuf, "%s %s:", MemBus_StatusCode(Job->Status), Req->Text);
 		
-		switch (DidWork)
+		for (; Inc < Job->BatchCount && Length < sizeof TmpBuf; ++Inc)
 		{
-			case SUCCESS:
-				snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_ACKNOWLEDGED, BusData);
-				break;
-			case WARNING:
-				snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_WARNING, BusData);
-				break;
-			case FAILURE:
-				snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_FAILURE, BusData);
-				break;
-			default:
-				snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_FAILURE, BusData);
-				break;
+			Length += snprintf(TmpBuf + Length, sizeof TmpBuf - Length, " %s=%s", Job->Batch[Inc].ObjectID,
+								MemBus_StatusCode(Job->Batch[Inc].Status));
 		}
-			
-			
+		
 		MemBus_Write(TmpBuf, true);
 	}
-	else if (BusDataIs(MEMBUS_CODE_RUNLEVEL))
+}
+
+void MemBus_Reply(const struct _MemBusRequest *Req, unsigned char Status)
+{
+	MemBus_ReplyValue(Req, Status, NULL, MEMBUS_TLV_NONE, NULL, 0);
+}
+
+static void MemBus_ReplyJob(struct _MemBusRequest *Req, unsigned long JobID, Bool Deferred)
+{ /*Binary clients get the job ID right away and can wait on it with JOBWAIT.
+	* Old text clients expect the answer only once it's done, so they wait if Deferred is set.*/
+	struct _EpochJob *Job = Jobs_Lookup(JobID);
+	
+	if (!Job)
+	{
+		MemBus_Reply(Req, MEMBUS_STATUS_FAILURE);
+		return;
+	}
+	
+	if (!Req->Binary && Deferred)
 	{
-		unsigned long LOffset = strlen(MEMBUS_CODE_RUNLEVEL " ");
-		char *TWorker = BusData + LOffset;
-		char TmpBuf[MEMBUS_MSGSIZE];
+		Jobs_SetWaiter(Job, Req);
+		return;
+	}
+	
+	MemBus_ReplyValue(Req, MEMBUS_STATUS_OK, NULL, MEMBUS_TLV_JOBID, &JobID, sizeof(long));
+}
+
+static void MemBusHandler_Reset(struct _MemBusRequest *Req)
+{ /*With "apply", the changes get started, stopped and restarted as a batch job, and the client can wait on that.*/
+	const Bool Apply = (Req->Args[0] != NULL && !strcmp(Req->Args[0], "apply"));
+	unsigned long JobID = 0;
+	
+	if (Req->Args[0] && !Apply)
+	{
+		MemBus_Reply(Req, MEMBUS_STATUS_BADPARAM);
+		return;
+	}
+	
+	if (!ReloadConfig(Apply ? &JobID : NULL))
+	{
+		MemBus_Reply(Req, MEMBUS_STATUS_FAILURE);
+		return;
+	}
+	
+	if (JobID)
+	{
+		MemBus_ReplyJob(Req, JobID, true);
+		return;
+	}
+	
+	MemBus_Reply(Req, MEMBUS_STATUS_OK);
+}
+
+static void MemBusHandler_ObjStartStop(struct _MemBusRequest *Req)
+{
+	if (!LookupObjectInTable(Req->Args[0]))
+	{
+		MemBus_Reply(Req, MEMBUS_STATUS_FAILURE);
+		return;
+	}
+	
+	MemBus_ReplyJob(Req, Jobs_Create(Req->Opcode, Req->Args[0], 0), true);
+}
+
+static void MemBusHandler_LSObjs(struct _MemBusRequest *Req)
+{ /*Done for mostly third party stuff. The reply is always a V2 stream, whichever protocol asked.*/
+	char OutBuf[MEMBUS_MSGSIZE];
+	unsigned char *BinWorker = (void*)OutBuf;
+	ObjTable *Worker = ObjectTable;
+	unsigned long TPID = 0;
+	const unsigned long Length = strlen(MEMBUS_CODE_LSOBJS " " MEMBUS_LSOBJS_VERSION) + 1;
+	
+	for (; Worker < ObjectTable + ObjectCount; ++Worker)
+	{
+		const char *RL = NULL;
+		unsigned long ID = 0;
 		
-		if (LOffset >= strlen(BusData) || BusData[LOffset] == ' ')
-		{ /*No argument?*/
-			snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_BADPARAM, BusData);
-			MemBus_Write(TmpBuf, true);
-			
-			return;
+		if (Req->Args[0] && strcmp(Req->Args[0], Worker->ObjectID) != 0)
+		{ /*Allow for getting status of just one object.*/
+			continue;
 		}
 		
-		if (ObjRL_ValidRunlevel(TWorker))
-		{
-			/*Tell them everything is OK, because we don't want to wait the whole time for the runlevel to start up.*/
-			snprintf(TmpBuf, sizeof TmpBuf, "%s %s %s", MEMBUS_CODE_ACKNOWLEDGED, MEMBUS_CODE_RUNLEVEL, TWorker);
-			MemBus_Write(TmpBuf, true);
-		}
-		else
+		Config_Materialize(Worker); /*The rest of it is about to be printed.*/
+		
+		if (!Worker->Opts.HasPIDFile || !(TPID = ReadPIDFile(Worker)))
 		{
-			snprintf(TmpBuf, sizeof TmpBuf, "%s %s %s", MEMBUS_CODE_FAILURE, MEMBUS_CODE_RUNLEVEL, TWorker);
-			MemBus_Write(TmpBuf, true);
-			return;
+			TPID = Worker->ObjectPID;
 		}
 		
-		snprintf(TmpBuf, sizeof TmpBuf, CONSOLE_COLOR_CYAN "Changing runlevel to \"%s\"...\n" CONSOLE_ENDCOLOR, TWorker);
-		WriteLogLine(TmpBuf, true);
+		/*We need a version for this protocol, because relevant options can change with updates.
+		 * Not all options are here, because some are not really useful.*/
+		strncpy(OutBuf, MEMBUS_CODE_LSOBJS " " MEMBUS_LSOBJS_VERSION, Length);
 		
-		printf("%s", TmpBuf);
-		fflush(stdout);
+		BinWorker = (unsigned char*)OutBuf + Length;
 		
-		if (!SwitchRunlevels(TWorker)) /*Switch to it.*/
-		{
-			char TmpBuf[1024];
-			
-			snprintf(TmpBuf, sizeof TmpBuf, "Failed to switch to runlevel \"%s\".", TWorker);
-			SpitError(TmpBuf);
-			WriteLogLine(TmpBuf, true);
-		}
-		else
-		{
-			snprintf(TmpBuf, sizeof TmpBuf, CONSOLE_COLOR_GREEN "Switched to runlevel \"%s\"." CONSOLE_ENDCOLOR, TWorker);
-			puts(TmpBuf);
-			WriteLogLine(TmpBuf, true);
-		}
-	}
-	else if (BusDataIs(MEMBUS_CODE_OBJRLS))
-	{
-		unsigned long LOffset;
-		char *TWorker = NULL;
-		ObjTable *CurObj = NULL;
-		char TmpBuf[MEMBUS_MSGSIZE];
-		char TRL[MAX_DESCRIPT_SIZE];
-		char TID[MAX_DESCRIPT_SIZE];
-		unsigned long Inc = 0;
-		
-		if (BusDataIs(MEMBUS_CODE_OBJRLS_CHECK)) LOffset = strlen(MEMBUS_CODE_OBJRLS_CHECK " ");
-		else if (BusDataIs(MEMBUS_CODE_OBJRLS_ADD)) LOffset = strlen(MEMBUS_CODE_OBJRLS_ADD " ");
-		else if (BusDataIs(MEMBUS_CODE_OBJRLS_DEL)) LOffset = strlen(MEMBUS_CODE_OBJRLS_DEL " ");
-		else
-		{
-			snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_BADPARAM, BusData);
-			MemBus_Write(TmpBuf, true);
-			return;
-		}
+		*BinWorker++ = (Worker->Started && !Worker->Opts.HaltCmdOnly);
+		*BinWorker++ = ObjectProcessRunning(Worker);
+		*BinWorker++ = Worker->Enabled;
+		*BinWorker++ = Worker->TermSignal;
+		*BinWorker++ = Worker->ReloadCommandSignal;
 		
-		TWorker = BusData + LOffset;
+		memcpy(BinWorker, &Worker->UserID, sizeof(long));
+		memcpy((BinWorker += sizeof(long)), &Worker->GroupID, sizeof(long));
 		
-		if (LOffset >= strlen(BusData) || BusData[LOffset] == ' ')
-		{ /*No argument?*/
-			snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_BADPARAM, BusData);
-			MemBus_Write(TmpBuf, true);
-
-			return;
-		}
+		memcpy((BinWorker += sizeof(long)), &Worker->Opts.StopMode, sizeof(enum _StopMode));
+		memcpy((BinWorker += sizeof(enum _StopMode)), &TPID, sizeof(long));
 		
-		for (; TWorker[Inc] != ' ' && TWorker[Inc] != '\0'; ++Inc)
-		{
-			TID[Inc] = TWorker[Inc];
-		}
-		TID[Inc] = '\0';
+		memcpy((BinWorker += sizeof(long)), &Worker->StartedSince, sizeof(long));
+		memcpy(BinWorker + sizeof(long), &Worker->Opts.StopTimeout, sizeof(long));
 		
-		if ((TWorker = strstr(TWorker, " ")) == NULL)
-		{
-			snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_BADPARAM, BusData);
-			MemBus_Write(TmpBuf, true);
-
-			return;
-		}
-		++TWorker;
+		MemBus_BinWrite(OutBuf, MEMBUS_MSGSIZE, true);
 		
-		snprintf(TRL, sizeof TRL, "%s", TWorker);
+		snprintf(OutBuf, sizeof OutBuf, "%s %s", Worker->ObjectID, Worker->ObjectDescription);
 		
-		if ((CurObj = LookupObjectInTable(TID)))
-		{
-			if (CurObj->Opts.HaltCmdOnly)
-			{ /*These objects have no runlevels.*/
-				snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_FAILURE, BusData);
-				MemBus_Write(TmpBuf, true);
-				return;
-			}
+		MemBus_Write(OutBuf, true);
+		
+		*OutBuf = '\0';
+		
+		BinWorker = (void*)OutBuf;
+		/*Write it over binary now.*/
+		if (Worker->Opts.RawDescription) *BinWorker++ = COPT_RAWDESCRIPTION;
+		if (Worker->Opts.HaltCmdOnly) *BinWorker++ = COPT_HALTONLY;
+		if (Worker->Opts.Persistent) *BinWorker++ = COPT_PERSISTENT;
+		if (Worker->Opts.Fork) *BinWorker++ = COPT_FORK;
+		if (Worker->Opts.IsService) *BinWorker++ = COPT_SERVICE;
+		if (Worker->Opts.AutoRestart) *BinWorker++ = COPT_AUTORESTART;
+		if (Worker->Opts.ForceShell) *BinWorker++ = COPT_FORCESHELL;
+		if (Worker->Opts.NoStopWait) *BinWorker++ = COPT_NOSTOPWAIT;
+		if (Worker->Opts.Exec) *BinWorker++ = COPT_EXEC;
+		if (Worker->Opts.PivotRoot) *BinWorker++ = COPT_PIVOTROOT;
+		
+		*BinWorker = 0;
+		
+		MemBus_BinWrite(OutBuf, MEMBUS_MSGSIZE, true);
+		
+		for (; (RL = ObjRL_GetName(ID)); ++ID)
+		{ /*Send all runlevels.*/
+			if (!RLSET_HAS(Worker->ObjectRunlevels, ID)) continue;
 			
-			if (BusDataIs(MEMBUS_CODE_OBJRLS_CHECK))
-			{
-				snprintf(TmpBuf, sizeof TmpBuf, "%s %s %s %d", MEMBUS_CODE_OBJRLS_CHECK, TID, TRL,
-						ObjRL_CheckRunlevel(TRL, CurObj, true));
-			}
-			else if (BusDataIs(MEMBUS_CODE_OBJRLS_ADD) || BusDataIs(MEMBUS_CODE_OBJRLS_DEL))
-			{
-				char *RLStream = malloc(MAX_DESCRIPT_SIZE + 1);
-				struct _RLTree *ObjRLS = CurObj->ObjectRunlevels;
-				
-				if (BusDataIs(MEMBUS_CODE_OBJRLS_ADD))
-				{
-					if (!ObjRL_CheckRunlevel(TRL, CurObj, false))
-					{
-						ObjRL_AddRunlevel(TRL, CurObj);
-					}
-				}
-				else
-				{
-					unsigned long TInc = 0;
-					
-					/*Count number of entries.*/
-					for (; ObjRLS->Next != NULL; ++TInc) ObjRLS = ObjRLS->Next;
-					
-					if (TInc == 1 || !ObjRL_DelRunlevel(TRL, CurObj))
-					{
-						snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_FAILURE, BusData);
-						MemBus_Write(TmpBuf, true);
-						free(RLStream);
-						return;
-					}
-					ObjRLS = CurObj->ObjectRunlevels;
-					if (!ObjRLS->Next)
-					{
-						ObjRLS->Next = malloc(sizeof(struct _RLTree));
-						ObjRLS->Next->Prev = ObjRLS;
-						ObjRLS->Next->Next = NULL;
-					}
-				}
-				
-				*RLStream = '\0';
-
-				for (; ObjRLS->Next != NULL; ObjRLS = ObjRLS->Next)
-				{
-					strncat(RLStream, ObjRLS->RL, MAX_DESCRIPT_SIZE);
-						
-					if (ObjRLS->Next->Next != NULL)
-					{
-						strncat(RLStream, " ", 1);
-						RLStream = realloc(RLStream, strlen(RLStream) + MAX_DESCRIPT_SIZE);
-					}
-				}
-				
-				if (!EditConfigValue(CurObj->ObjectID, "ObjectRunlevels", RLStream))
-				{
-					snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_FAILURE, BusData);
-					MemBus_Write(TmpBuf, true);
-					free(RLStream);
-					return;
-				}
-				
-				free(RLStream);
-				
-				snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_ACKNOWLEDGED, BusData);
-				
-			}
+			snprintf(OutBuf, sizeof OutBuf, "%s %s %s %s", MEMBUS_CODE_LSOBJS,
+					MEMBUS_LSOBJS_VERSION, Worker->ObjectID, RL);
 			
-			MemBus_Write(TmpBuf, true);
-		}
-		else
-		{
-			snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_FAILURE, BusData);
-			MemBus_Write(TmpBuf, true);
+			MemBus_Write(OutBuf, true);
 		}
 	}
-	/*Power functions that close everything first.*/
-	else if (BusDataIs(MEMBUS_CODE_HALT) || BusDataIs(MEMBUS_CODE_POWEROFF) || BusDataIs(MEMBUS_CODE_REBOOT))
-	{
-	unsigned long LOffset = 0, Signal = OSCTL_LINUX_REBOOT;
-		char *TWorker = NULL, *MSig = NULL;
-		char TmpBuf[MEMBUS_MSGSIZE];
-		
-		if (BusDataIs(MEMBUS_CODE_HALT))
-		{
-			LOffset = strlen(MEMBUS_CODE_HALT " ");
-			Signal = OSCTL_LINUX_HALT;
-			MSig = MEMBUS_CODE_HALT;
-			
-		}
-		else if (BusDataIs(MEMBUS_CODE_POWEROFF))
-		{
-			LOffset = strlen(MEMBUS_CODE_POWEROFF " ");
-			Signal = OSCTL_LINUX_POWEROFF;
-			MSig = MEMBUS_CODE_POWEROFF;
-		}
-		else if (BusDataIs(MEMBUS_CODE_REBOOT))
-		{
-			LOffset = strlen(MEMBUS_CODE_REBOOT " ");
-			Signal = OSCTL_LINUX_REBOOT;
-			MSig = MEMBUS_CODE_REBOOT;
-		}
-		
-		
-		TWorker = BusData + LOffset;
-		
-		if (LOffset >= strlen(BusData) || BusData[LOffset] == ' ')
-		{ /*No argument? Just do the action.*/
-			
-			snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_ACKNOWLEDGED, MSig);
-			MemBus_Write(TmpBuf, true);
-			
-			while (!MemBus_Read(TmpBuf, true)) usleep(100); /*Wait to be told they received it.*/
-			
-			LaunchShutdown(Signal);
-
-			return;
-		}
-		
-		if (strstr(TWorker, ":") && strstr(TWorker, "/"))
-		{
-			char MsgBuf[MAX_LINE_SIZE];
-			const char *HType = NULL;
-			char Hr[16], Min[16];
-			
-			if (HaltParams.HaltMode != -1)
-			{/*Don't let us schedule two shutdowns.*/
-				snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_FAILURE, BusData);
-				
-				MemBus_Write(TmpBuf, true);
-				return;
-			}
-				
-			if (sscanf(TWorker, "%lu:%lu:%lu %lu/%lu/%lu", &HaltParams.TargetHour, &HaltParams.TargetMin,
-				&HaltParams.TargetSec, &HaltParams.TargetMonth, &HaltParams.TargetDay, &HaltParams.TargetYear) != 6)
-			{
-				SpitError("Invalid time signature for HALT/REBOOT/POWEROFF over membus.\n"
-							"Please report to Epoch. This is probably a bug.");
+	
+	/*This says we are done.*/
+	MemBus_Write(MEMBUS_CODE_ACKNOWLEDGED " " MEMBUS_CODE_LSOBJS, true);
+}
 
-				snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_BADPARAM, BusData);
-				MemBus_Write(TmpBuf, true);
-				
-				return;
-			}
-			
-			++HaltParams.JobID;
-			HaltParams.HaltMode = Signal;
+static void MemBusHandler_GetRL(struct _MemBusRequest *Req)
+{
+	char TmpBuf[MEMBUS_MSGSIZE];
+	
+	snprintf(TmpBuf, sizeof TmpBuf, MEMBUS_CODE_GETRL " %s", CurRunlevel);
+	MemBus_ReplyValue(Req, MEMBUS_STATUS_OK, TmpBuf, MEMBUS_TLV_RUNLEVEL, CurRunlevel, strlen(CurRunlevel) + 1);
+}
 
-			snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_ACKNOWLEDGED, BusData);
-			MemBus_Write(TmpBuf, true);
+static void MemBusHandler_ObjEnable(struct _MemBusRequest *Req)
+{
+	const Bool EnablingThis = (Req->Opcode == MEMBUS_OP_OBJENABLE);
+	ObjTable *CurObj = LookupObjectInTable(Req->Args[0]);
+	
+	if (!CurObj)
+	{
+		MemBus_Reply(Req, MEMBUS_STATUS_FAILURE);
+		return;
+	}
+	
+	CurObj->Enabled = EnablingThis;
+	
+	MemBus_Reply(Req, (unsigned char)Overlay_SaveEnabled(CurObj));
+}
 
-			if (Signal == OSCTL_LINUX_HALT) HType = "halt";
-			else if (Signal == OSCTL_LINUX_POWEROFF) HType = "poweroff";
-			else if (Signal == OSCTL_LINUX_REBOOT) HType = "reboot";
+static void MemBusHandler_Runlevel(struct _MemBusRequest *Req)
+{
+	if (!ObjRL_ValidRunlevel(Req->Args[0]))
+	{
+		MemBus_Reply(Req, MEMBUS_STATUS_FAILURE);
+		return;
+	}
+	
+	/*Tell them everything is OK, because we don't want to wait the whole time for the runlevel to start up.*/
+	MemBus_ReplyJob(Req, Jobs_Create(MEMBUS_OP_RUNLEVEL, Req->Args[0], 0), false);
+}
 
-			snprintf(Hr, 16, (HaltParams.TargetHour >= 10) ? "%ld" : "0%ld", HaltParams.TargetHour);
-			snprintf(Min, 16, (HaltParams.TargetMin >= 10) ? "%ld" : "0%ld", HaltParams.TargetMin);
+static void MemBusHandler_ObjRLS(struct _MemBusRequest *Req)
+{
+	const char *TID = Req->Args[0], *TRL = Req->Args[1];
+	ObjTable *CurObj = LookupObjectInTable(TID);
+	
+	if (!CurObj || CurObj->Opts.HaltCmdOnly)
+	{ /*HaltCmdOnly objects have no runlevels.*/
+		MemBus_Reply(Req, MEMBUS_STATUS_FAILURE);
+		return;
+	}
+	
+	if (Req->Opcode == MEMBUS_OP_OBJRLS_CHECK)
+	{
+		char TmpBuf[MEMBUS_MSGSIZE];
+		unsigned char Result = ObjRL_CheckRunlevel(TRL, CurObj, true);
+		
+		snprintf(TmpBuf, sizeof TmpBuf, "%s %s %s %d", MEMBUS_CODE_OBJRLS_CHECK, TID, TRL, Result);
+		MemBus_ReplyValue(Req, MEMBUS_STATUS_OK, TmpBuf, MEMBUS_TLV_VALUE, &Result, 1);
+		return;
+	}
+	
+	if (Req->Opcode == MEMBUS_OP_OBJRLS_ADD)
+	{
+		if (!ObjRL_AddRunlevel(TRL, CurObj))
+		{ /*A new name with all MAX_RUNLEVELS taken. The VALUE tells the client that's why.*/
+			const unsigned long MaxRunlevels = MAX_RUNLEVELS;
 			
-			snprintf(MsgBuf, sizeof MsgBuf, "System is going down for %s at %s:%s %ld/%ld/%ld!",
-				HType, Hr, Min, HaltParams.TargetMonth, HaltParams.TargetDay, HaltParams.TargetYear);
-					
-			EmulWall(MsgBuf, false);
+			MemBus_ReplyValue(Req, MEMBUS_STATUS_FAILURE, NULL, MEMBUS_TLV_VALUE, &MaxRunlevels, sizeof(long));
 			return;
 		}
-		else
-		{
-				SpitError("Time signature doesn't even contain a semicolon and a slash!\n"
-						"This is probably a bug, please report to Epoch.");
+	}
+	else if (ObjRL_CountRunlevels(CurObj) == 1 || !ObjRL_DelRunlevel(TRL, CurObj))
+	{ /*Don't leave it with no runlevels at all.*/
+		MemBus_Reply(Req, MEMBUS_STATUS_FAILURE);
+		return;
+	}
+	
+	MemBus_Reply(Req, Overlay_SaveRunlevels(CurObj) ? MEMBUS_STATUS_OK : MEMBUS_STATUS_FAILURE);
+}
 
-				snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_BADPARAM, BusData);
-				MemBus_Write(TmpBuf, true);
-				return;
-		}
+static void MemBusHandler_Halt(struct _MemBusRequest *Req)
+{ /*Power functions that close everything first.*/
+	unsigned long Signal = OSCTL_LINUX_REBOOT;
+	const char *TWorker = Req->Args[0], *HType = NULL;
+	char MsgBuf[MAX_LINE_SIZE];
+	char Hr[16], Min[16];
+	
+	switch (Req->Opcode)
+	{
+		case MEMBUS_OP_HALT:
+			Signal = OSCTL_LINUX_HALT;
+			HType = "halt";
+			break;
+		case MEMBUS_OP_POWEROFF:
+			Signal = OSCTL_LINUX_POWEROFF;
+			HType = "poweroff";
+			break;
+		default:
+			Signal = OSCTL_LINUX_REBOOT;
+			HType = "reboot";
+			break;
 	}
-	else if (BusDataIs(MEMBUS_CODE_ABORTHALT))
+	
+	if (!TWorker || *TWorker == '\0' || *TWorker == ' ')
+	{ /*No argument? Just do the action.*/
+		MemBus_Reply(Req, MEMBUS_STATUS_OK);
+		
+		while (!MemBus_BinRead(MsgBuf, MEMBUS_MSGSIZE, true)) usleep(100); /*Wait to be told they received it.*/
+		
+		LaunchShutdown(Signal);
+		return;
+	}
+	
+	if (!strstr(TWorker, ":") || !strstr(TWorker, "/"))
 	{
-		char MsgBuf[MAX_LINE_SIZE];
-		char Hr[16], Min[16];
-			
-		snprintf(Hr, 16, (HaltParams.TargetHour >= 10) ? "%ld" : "0%ld", HaltParams.TargetHour);
-		snprintf(Min, 16, (HaltParams.TargetMin >= 10) ? "%ld" : "0%ld", HaltParams.TargetMin);
+		SpitError("Time signature doesn't even contain a semicolon and a slash!\n"
+				"This is probably a bug, please report to Epoch.");
 		
-		if (HaltParams.HaltMode != -1)
-		{
-			HaltParams.HaltMode = -1; /*-1 does the real cancellation.*/
-		}
-		else
-		{ /*Nothing scheduled?*/
-			MemBus_Write(MEMBUS_CODE_FAILURE " " MEMBUS_CODE_ABORTHALT, true);
-			return;
-		}
+		MemBus_Reply(Req, MEMBUS_STATUS_BADPARAM);
+		return;
+	}
+	
+	if (HaltParams.HaltMode != -1)
+	{/*Don't let us schedule two shutdowns.*/
+		MemBus_Reply(Req, MEMBUS_STATUS_FAILURE);
+		return;
+	}
+	
+	if (sscanf(TWorker, "%lu:%lu:%lu %lu/%lu/%lu", &HaltParams.TargetHour, &HaltParams.TargetMin,
+		&HaltParams.TargetSec, &HaltParams.TargetMonth, &HaltParams.TargetDay, &HaltParams.TargetYear) != 6)
+	{
+		SpitError("Invalid time signature for HALT/REBOOT/POWEROFF over membus.\n"
+					"Please report to Epoch. This is probably a bug.");
 		
-		snprintf(MsgBuf, sizeof MsgBuf, "%s %s:%s %ld/%ld/%ld %s", "The shutdown scheduled for",
-				Hr, Min, HaltParams.TargetMonth, HaltParams.TargetDay, HaltParams.TargetYear,
-				"has been aborted.");
+		MemBus_Reply(Req, MEMBUS_STATUS_BADPARAM);
+		return;
+	}
+	
+	++HaltParams.JobID;
+	HaltParams.HaltMode = Signal;
+	
+	MemBus_Reply(Req, MEMBUS_STATUS_OK);
+	
+	snprintf(Hr, 16, (HaltParams.TargetHour >= 10) ? "%ld" : "0%ld", HaltParams.TargetHour);
+	snprintf(Min, 16, (HaltParams.TargetMin >= 10) ? "%ld" : "0%ld", HaltParams.TargetMin);
+	
+	snprintf(MsgBuf, sizeof MsgBuf, "System is going down for %s at %s:%s %ld/%ld/%ld!",
+		HType, Hr, Min, HaltParams.TargetMonth, HaltParams.TargetDay, HaltParams.TargetYear);
+	
+	EmulWall(MsgBuf, false);
+}
+
+static void MemBusHandler_AbortHalt(struct _MemBusRequest *Req)
+{
+	char MsgBuf[MAX_LINE_SIZE];
+	char Hr[16], Min[16];
+	
+	if (HaltParams.HaltMode == -1)
+	{ /*Nothing scheduled?*/
+		MemBus_Reply(Req, MEMBUS_STATUS_FAILURE);
+		return;
+	}
+	
+	HaltParams.HaltMode = -1; /*-1 does the real cancellation.*/
+	
+	snprintf(Hr, 16, (HaltParams.TargetHour >= 10) ? "%ld" : "0%ld", HaltParams.TargetHour);
+	snprintf(Min, 16, (HaltParams.TargetMin >= 10) ? "%ld" : "0%ld", HaltParams.TargetMin);
+	
+	snprintf(MsgBuf, sizeof MsgBuf, "%s %s:%s %ld/%ld/%ld %s", "The shutdown scheduled for",
+			Hr, Min, HaltParams.TargetMonth, HaltParams.TargetDay, HaltParams.TargetYear,
+			"has been aborted.");
+	
+	EmulWall(MsgBuf, false);
+	
+	MemBus_Reply(Req, MEMBUS_STATUS_OK);
+}
+
+static void MemBusHandler_CAD(struct _MemBusRequest *Req)
+{ /*Ctrl-Alt-Del control.*/
+	const unsigned long Cmd = (Req->Opcode == MEMBUS_OP_CADON ? OSCTL_LINUX_ENABLE_CTRLALTDEL : OSCTL_LINUX_DISABLE_CTRLALTDEL);
+	
+	MemBus_Reply(Req, !reboot(Cmd) ? MEMBUS_STATUS_OK : MEMBUS_STATUS_FAILURE);
+}
+
+static void MemBusHandler_SendPID(struct _MemBusRequest *Req)
+{
+	char TmpBuf[MEMBUS_MSGSIZE];
+	const ObjTable *TmpObj = LookupObjectInTable(Req->Args[0]);
+	unsigned long TPID = 0;
+	
+	if (!TmpObj || !TmpObj->Started)
+	{ /*Bad argument?*/
+		MemBus_Reply(Req, MEMBUS_STATUS_FAILURE);
+		return;
+	}
+	
+	TPID = (TmpObj->Opts.HasPIDFile ? ReadPIDFile(TmpObj) : TmpObj->ObjectPID);
+	
+	snprintf(TmpBuf, sizeof TmpBuf, "%s %s %lu", MEMBUS_CODE_SENDPID, Req->Args[0], TPID);
+	MemBus_ReplyValue(Req, MEMBUS_STATUS_OK, TmpBuf, MEMBUS_TLV_PID, &TPID, sizeof(long));
+}
+
+static void MemBusHandler_KillObj(struct _MemBusRequest *Req)
+{
+	ObjTable *TmpObj = LookupObjectInTable(Req->Args[0]);
+	
+	if (!TmpObj || !TmpObj->Started)
+	{ /*Bad argument?*/
+		MemBus_Reply(Req, MEMBUS_STATUS_FAILURE);
+		return;
+	}
+	
+	/*Attempt to send SIGKILL to the PID.*/
+	if (!TmpObj->ObjectPID || 
+		kill((TmpObj->Opts.HasPIDFile ? ReadPIDFile(TmpObj) : TmpObj->ObjectPID), SIGKILL) != 0)
+	{
+		MemBus_Reply(Req, MEMBUS_STATUS_FAILURE);
+		return;
+	}
+	
+	TmpObj->Started = false; /*Mark it as stopped now that it's dead.*/
+	TmpObj->ObjectPID = 0; /*Erase the PID.*/
+	TmpObj->StartedSince = 0;
+	
+	MemBus_Reply(Req, MEMBUS_STATUS_OK);
+}
+
+static void MemBusHandler_ObjReload(struct _MemBusRequest *Req)
+{
+	const ObjTable *TmpObj = LookupObjectInTable(Req->Args[0]);
+	
+	if (!TmpObj || !TmpObj->Started || (TmpObj->ObjectReloadCommand == NULL && TmpObj->ReloadCommandSignal == 0))
+	{
+		MemBus_Reply(Req, MEMBUS_STATUS_FAILURE);
+		return;
+	}
+	
+	MemBus_ReplyJob(Req, Jobs_Create(MEMBUS_OP_OBJRELOAD, Req->Args[0], 0), true);
+}
 
-		EmulWall(MsgBuf, false);
+static void MemBusHandler_RXD(struct _MemBusRequest *Req)
+{ /*Restart Epoch from disk, but saves object states and whatnot.
+	* Done mainly so we can unmount the filesystem after someone updates /sbin/epoch.*/
+	
+	/**We set this so when we come back we'll know if we are doing a regular reexec.**/
+	setenv("EPOCHRXDMEMBUS", "1", true);
+	
+	ReexecuteEpoch();
+}
 
-		MemBus_Write(MEMBUS_CODE_ACKNOWLEDGED " " MEMBUS_CODE_ABORTHALT, true);
+static void MemBusHandler_Batch(struct _MemBusRequest *Req)
+{ /*Like a single start or stop, binary clients get a job ID to JOBWAIT on, and the results come with that.*/
+	const unsigned char BatchOp = Jobs_BatchOpLookup(Req->Args[0]);
+	
+	if (BatchOp == BATCH_MAX)
+	{
+		MemBus_Reply(Req, MEMBUS_STATUS_BADPARAM);
 		return;
 	}
-	/*Ctrl-Alt-Del control.*/
-	else if (BusDataIs(MEMBUS_CODE_CADOFF))
+	
+	MemBus_ReplyJob(Req, Jobs_CreateBatch(BatchOp, Req->Args[1]), true);
+}
+
+static struct _EpochJob *MemBus_GetJob(struct _MemBusRequest *Req)
+{ /*Sends BADPARAM for us if the job ID is bogus or long forgotten.*/
+	struct _EpochJob *Job = NULL;
+	
+	if (!AllNumeric(Req->Args[0]) || !(Job = Jobs_Lookup(strtoul(Req->Args[0], NULL, 10))))
 	{
-		if (!reboot(OSCTL_LINUX_DISABLE_CTRLALTDEL))
+		MemBus_Reply(Req, MEMBUS_STATUS_BADPARAM);
+		return NULL;
+	}
+	
+	return Job;
+}
+
+static unsigned short MemBus_JobInfo(const struct _EpochJob *Job, unsigned char *OutBuf)
+{ /*The JOBINFO TLV value.*/
+	const unsigned long Length = strlen(Job->Target) + 1;
+	
+	memcpy(OutBuf, &Job->JobID, sizeof(long));
+	OutBuf[sizeof(long)] = Job->Opcode;
+	OutBuf[sizeof(long) + 1] = Job->State;
+	OutBuf[sizeof(long) + 2] = Job->Status;
+	memcpy(OutBuf + sizeof(long) + 3, Job->Target, Length);
+	
+	return sizeof(long) + 3 + Length;
+}
+
+static void MemBusHandler_JobStat(struct _MemBusRequest *Req)
+{
+	unsigned char Info[sizeof(long) + 3 + MAX_DESCRIPT_SIZE];
+	char TmpBuf[MEMBUS_MSGSIZE];
+	const struct _EpochJob *Job = MemBus_GetJob(Req);
+	
+	if (!Job) return;
+	
+	snprintf(TmpBuf, sizeof TmpBuf, "%s %lu %s %s %s", MEMBUS_CODE_JOBSTAT, Job->JobID,
+			MemBus_CodeName(Job->Opcode), Job->Target, Jobs_StateName(Job->State));
+	MemBus_ReplyValue(Req, Job->Status, TmpBuf, MEMBUS_TLV_JOBINFO, Info, MemBus_JobInfo(Job, Info));
+}
+
+static void MemBusHandler_JobWait(struct _MemBusRequest *Req)
+{
+	struct _EpochJob *Job = MemBus_GetJob(Req);
+	
+	if (!Job) return;
+	
+	if (Job->State != JOBSTATE_DONE)
+	{
+		Jobs_SetWaiter(Job, Req);
+	}
+	else if (Job->Opcode == MEMBUS_OP_BATCH)
+	{
+		MemBus_ReplyBatch(Req, Job);
+	}
+	else
+	{
+		MemBus_ReplyValue(Req, Job->Status, NULL, MEMBUS_TLV_JOBID, &Job->JobID, sizeof(long));
+	}
+}
+
+static void MemBusHandler_JobCancel(struct _MemBusRequest *Req)
+{
+	const struct _EpochJob *Job = MemBus_GetJob(Req);
+	
+	if (!Job) return;
+	
+	MemBus_Reply(Req, Jobs_Cancel(Job->JobID) ? MEMBUS_STATUS_OK : MEMBUS_STATUS_FAILURE);
+}
+
+static void MemBusHandler_JobList(struct _MemBusRequest *Req)
+{ /*Everything not yet finished. Binary gets a JOBINFO per job, text gets them comma separated.*/
+	unsigned char Frame[MEMBUS_MSGSIZE], Info[sizeof(long) + 3 + MAX_DESCRIPT_SIZE], Status = MEMBUS_STATUS_OK;
+	char TmpBuf[MEMBUS_MSGSIZE];
+	const struct _EpochJob *Worker = JobList;
+	unsigned long Length = 0;
+	
+	MemBus_FrameInit(Frame, Req->Opcode, Req->RequestID);
+	MemBus_FrameAdd(Frame, MEMBUS_TLV_STATUS, &Status, 1);
+	
+	Length = snprintf(TmpBuf, sizeof TmpBuf, "%s", MEMBUS_CODE_JOBLIST);
+	
+	for (; Worker; Worker = Worker->Next)
+	{
+		if (Worker->State == JOBSTATE_DONE) continue;
+		
+		if (Req->Binary)
 		{
-			MemBus_Write(MEMBUS_CODE_ACKNOWLEDGED " " MEMBUS_CODE_CADOFF, true);
+			if (!MemBus_FrameAdd(Frame, MEMBUS_TLV_JOBINFO, Info, MemBus_JobInfo(Worker, Info))) break;
 		}
-		else
+		else if (Length < sizeof TmpBuf)
 		{
-			MemBus_Write(MEMBUS_CODE_FAILURE " " MEMBUS_CODE_CADOFF, true);
+			Length += snprintf(TmpBuf + Length, sizeof TmpBuf - Length, "%s %lu %s %s %s",
+							(Length > sizeof MEMBUS_CODE_JOBLIST ? "," : ""), Worker->JobID,
+							MemBus_CodeName(Worker->Opcode), Worker->Target, Jobs_StateName(Worker->State));
 		}
 	}
-	else if (BusDataIs(MEMBUS_CODE_CADON))
+	
+	if (Req->Binary)
+	{
+		MemBus_BinWrite(Frame, MemBus_FrameSize(Frame), true);
+	}
+	else
 	{
-		if (!reboot(OSCTL_LINUX_ENABLE_CTRLALTDEL))
+		MemBus_Write(TmpBuf, true);
+	}
+}
+
+static void MemBusHandler_Tail(struct _MemBusRequest *Req)
+{ /*The reply is always a text stream, whichever protocol asked, like LSOBJS.
+	* As many whole lines as fit go in each message, then OK or FAIL to say we're done.*/
+	char OutBuf[MEMBUS_MSGSIZE];
+	const unsigned long Prefix = sizeof MEMBUS_CODE_TAIL;
+	unsigned long Offset = 0, Length;
+	
+	memcpy(OutBuf, MEMBUS_CODE_TAIL " ", Prefix);
+	
+	while ((Length = Tail_Read(Req->Args[0], Offset, OutBuf + Prefix, sizeof OutBuf - Prefix - 1)))
+	{
+		OutBuf[Prefix + Length] = '\0';
+		Offset += Length;
+		
+		if (!MemBus_Write(OutBuf, true)) return; /*They went away.*/
+	}
+	
+	snprintf(OutBuf, sizeof OutBuf, "%s %s %s", Offset ? MEMBUS_CODE_ACKNOWLEDGED : MEMBUS_CODE_FAILURE,
+			MEMBUS_CODE_TAIL, Req->Args[0]);
+	MemBus_Write(OutBuf, true);
+}
+
+/*Indexed by opcode, so this must stay in the same order as enum _MemBusOpcode.*/
+static const struct _MemBusCommand
+{
+	const char *Code;
+	unsigned char Opcode;
+	unsigned char MinArgs;
+	unsigned char ArgTypes[MEMBUS_MAX_ARGS]; /*What TLVs carry the arguments in the binary protocol.*/
+	void (*Handler)(struct _MemBusRequest *Req);
+} MemBusCommands[MEMBUS_OP_MAX] =
+{
+	{ NULL, MEMBUS_OP_NONE, 0, { 0, 0 }, NULL },
+	{ MEMBUS_CODE_RESET, MEMBUS_OP_RESET, 0, { MEMBUS_TLV_OPTION, 0 }, MemBusHandler_Reset },
+	{ MEMBUS_CODE_OBJSTART, MEMBUS_OP_OBJSTART, 1, { MEMBUS_TLV_OBJECTID, 0 }, MemBusHandler_ObjStartStop },
+	{ MEMBUS_CODE_OBJSTOP, MEMBUS_OP_OBJSTOP, 1, { MEMBUS_TLV_OBJECTID, 0 }, MemBusHandler_ObjStartStop },
+	{ MEMBUS_CODE_OBJENABLE, MEMBUS_OP_OBJENABLE, 1, { MEMBUS_TLV_OBJECTID, 0 }, MemBusHandler_ObjEnable },
+	{ MEMBUS_CODE_OBJDISABLE, MEMBUS_OP_OBJDISABLE, 1, { MEMBUS_TLV_OBJECTID, 0 }, MemBusHandler_ObjEnable },
+	{ MEMBUS_CODE_OBJRELOAD, MEMBUS_OP_OBJRELOAD, 1, { MEMBUS_TLV_OBJECTID, 0 }, MemBusHandler_ObjReload },
+	{ MEMBUS_CODE_OBJRLS_CHECK, MEMBUS_OP_OBJRLS_CHECK, 2, { MEMBUS_TLV_OBJECTID, MEMBUS_TLV_RUNLEVEL }, MemBusHandler_ObjRLS },
+	{ MEMBUS_CODE_OBJRLS_ADD, MEMBUS_OP_OBJRLS_ADD, 2, { MEMBUS_TLV_OBJECTID, MEMBUS_TLV_RUNLEVEL }, MemBusHandler_ObjRLS },
+	{ MEMBUS_CODE_OBJRLS_DEL, MEMBUS_OP_OBJRLS_DEL, 2, { MEMBUS_TLV_OBJECTID, MEMBUS_TLV_RUNLEVEL }, MemBusHandler_ObjRLS },
+	{ MEMBUS_CODE_RUNLEVEL, MEMBUS_OP_RUNLEVEL, 1, { MEMBUS_TLV_RUNLEVEL, 0 }, MemBusHandler_Runlevel },
+	{ MEMBUS_CODE_GETRL, MEMBUS_OP_GETRL, 0, { 0, 0 }, MemBusHandler_GetRL },
+	{ MEMBUS_CODE_KILLOBJ, MEMBUS_OP_KILLOBJ, 1, { MEMBUS_TLV_OBJECTID, 0 }, MemBusHandler_KillObj },
+	{ MEMBUS_CODE_SENDPID, MEMBUS_OP_SENDPID, 1, { MEMBUS_TLV_OBJECTID, 0 }, MemBusHandler_SendPID },
+	{ MEMBUS_CODE_LSOBJS, MEMBUS_OP_LSOBJS, 0, { MEMBUS_TLV_OBJECTID, 0 }, MemBusHandler_LSObjs },
+	{ MEMBUS_CODE_RXD, MEMBUS_OP_RXD, 0, { 0, 0 }, MemBusHandler_RXD },
+	{ MEMBUS_CODE_HALT, MEMBUS_OP_HALT, 0, { MEMBUS_TLV_TIME, 0 }, MemBusHandler_Halt },
+	{ MEMBUS_CODE_POWEROFF, MEMBUS_OP_POWEROFF, 0, { MEMBUS_TLV_TIME, 0 }, MemBusHandler_Halt },
+	{ MEMBUS_CODE_REBOOT, MEMBUS_OP_REBOOT, 0, { MEMBUS_TLV_TIME, 0 }, MemBusHandler_Halt },
+	{ MEMBUS_CODE_ABORTHALT, MEMBUS_OP_ABORTHALT, 0, { 0, 0 }, MemBusHandler_AbortHalt },
+	{ MEMBUS_CODE_CADON, MEMBUS_OP_CADON, 0, { 0, 0 }, MemBusHandler_CAD },
+	{ MEMBUS_CODE_CADOFF, MEMBUS_OP_CADOFF, 0, { 0, 0 }, MemBusHandler_CAD },
+	{ MEMBUS_CODE_JOBSTAT, MEMBUS_OP_JOBSTAT, 1, { MEMBUS_TLV_JOBID, 0 }, MemBusHandler_JobStat },
+	{ MEMBUS_CODE_JOBWAIT, MEMBUS_OP_JOBWAIT, 1, { MEMBUS_TLV_JOBID, 0 }, MemBusHandler_JobWait },
+	{ MEMBUS_CODE_JOBCANCEL, MEMBUS_OP_JOBCANCEL, 1, { MEMBUS_TLV_JOBID, 0 }, MemBusHandler_JobCancel },
+	{ MEMBUS_CODE_JOBLIST, MEMBUS_OP_JOBLIST, 0, { 0, 0 }, MemBusHandler_JobList },
+	{ MEMBUS_CODE_BATCH, MEMBUS_OP_BATCH, 2, { MEMBUS_TLV_BATCHOP, MEMBUS_TLV_PATTERNS }, MemBusHandler_Batch },
+	{ MEMBUS_CODE_TAIL, MEMBUS_OP_TAIL, 1, { MEMBUS_TLV_OBJECTID, 0 }, MemBusHandler_Tail }
+};
+
+static const char *MemBus_CodeName(unsigned char Opcode)
+{
+	return (Opcode > MEMBUS_OP_NONE && Opcode < MEMBUS_OP_MAX) ? MemBusCommands[Opcode].Code : "UNKNOWN";
+}
+
+/*Text codes are looked up through this, by hash of the whole first word. Zero means an empty slot.*/
+#define MEMBUS_CODEHASH_SIZE 64
+static unsigned char TextCodeTable[MEMBUS_CODEHASH_SIZE];
+
+static void MemBus_BuildCodeTable(void)
+{
+	unsigned long Inc = 1, Slot;
+	
+	memset(TextCodeTable, 0, sizeof TextCodeTable);
+	
+	for (; Inc < MEMBUS_OP_MAX; ++Inc)
+	{
+		const char *Code = MemBusCommands[Inc].Code;
+		
+		if (MemBusCommands[Inc].Opcode != Inc)
 		{
-			MemBus_Write(MEMBUS_CODE_ACKNOWLEDGED " " MEMBUS_CODE_CADON, true);
+			SpitError("MemBus_BuildCodeTable(): MemBusCommands is out of order with enum _MemBusOpcode!");
+			continue;
 		}
-		else
+		
+		Slot = HashBytes(Code, strlen(Code)) % MEMBUS_CODEHASH_SIZE;
+		
+		while (TextCodeTable[Slot]) Slot = (Slot + 1) % MEMBUS_CODEHASH_SIZE;
+		
+		TextCodeTable[Slot] = (unsigned char)Inc;
+	}
+}
+
+static unsigned char MemBus_LookupCode(const char *Token, unsigned long Length)
+{ /*Exact match on the whole token, so OBJRLS_ADD and such can't be mistaken for each other.*/
+	unsigned long Slot = HashBytes(Token, Length) % MEMBUS_CODEHASH_SIZE;
+	
+	for (; TextCodeTable[Slot]; Slot = (Slot + 1) % MEMBUS_CODEHASH_SIZE)
+	{
+		const char *Code = MemBusCommands[TextCodeTable[Slot]].Code;
+		
+		if (!strncmp(Code, Token, Length) && Code[Length] == '\0')
 		{
-			MemBus_Write(MEMBUS_CODE_FAILURE " " MEMBUS_CODE_CADON, true);
+			return TextCodeTable[Slot];
 		}
 	}
-	else if (BusDataIs(MEMBUS_CODE_SENDPID))
+	
+	return MEMBUS_OP_NONE;
+}
+
+static Bool MemBus_DecodeText(const char *BusData, struct _MemBusRequest *Req)
+{ /*The compatibility shim for the old text protocol. Returns false if it's not something we understand.*/
+	const struct _MemBusCommand *Cmd = NULL;
+	unsigned long TokLen = 0, Inc = 0;
+	char *Worker = NULL;
+	
+	Req->Binary = false;
+	Req->RequestID = 0;
+	snprintf(Req->Text, sizeof Req->Text, "%s", BusData);
+	
+	for (; BusData[TokLen] != ' ' && BusData[TokLen] != '\0'; ++TokLen);
+	
+	if (!(Req->Opcode = MemBus_LookupCode(BusData, TokLen)))
+	{
+		return false;
+	}
+	
+	Cmd = &MemBusCommands[Req->Opcode];
+	
+	if (BusData[TokLen] == '\0')
 	{
-		char TmpBuf[MEMBUS_MSGSIZE];
-		unsigned long LOffset = strlen(MEMBUS_CODE_SENDPID " ");
-		const char *TWorker = BusData + LOffset;
-		const ObjTable *TmpObj = NULL;
-		
-		if (LOffset >= strlen(BusData) || BusData[LOffset] == ' ')
-		{ /*No argument?*/
-			snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_BADPARAM, BusData);
-			MemBus_Write(TmpBuf, true);
+		return Cmd->MinArgs == 0;
+	}
 	
-			return;
-		}
+	snprintf(Req->ArgBuf, sizeof Req->ArgBuf, "%s", BusData + TokLen + 1);
+	
+	/*Only split as many times as the command has arguments. The last one gets the rest of the line.*/
+	for (Worker = Req->ArgBuf, Inc = 0; Inc < MEMBUS_MAX_ARGS && Cmd->ArgTypes[Inc] != 0; ++Inc)
+	{
+		Req->Args[Inc] = Worker;
 		
-		if (!(TmpObj = LookupObjectInTable(TWorker)) || !TmpObj->Started)
-		{ /*Bad argument?*/
-			snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_FAILURE, BusData);
-			MemBus_Write(TmpBuf, true);
+		if (Inc + 1 < MEMBUS_MAX_ARGS && Cmd->ArgTypes[Inc + 1] != 0)
+		{
+			if (!(Worker = strchr(Worker, ' '))) break;
 			
-			return;
+			*Worker++ = '\0';
 		}
-		
-		snprintf(TmpBuf, sizeof TmpBuf, "%s %s %lu", MEMBUS_CODE_SENDPID, TWorker,
-				(TmpObj->Opts.HasPIDFile ? ReadPIDFile(TmpObj) : TmpObj->ObjectPID));
-		MemBus_Write(TmpBuf, true);
 	}
-	else if (BusDataIs(MEMBUS_CODE_KILLOBJ) || BusDataIs(MEMBUS_CODE_OBJRELOAD))
+	
+	return true;
+}
+
+static Bool MemBus_DecodeFrame(const unsigned char *Frame, struct _MemBusRequest *Req)
+{
+	const struct _MemBusCommand *Cmd = NULL;
+	unsigned long Inc = 0;
+	
+	Req->Binary = true;
+	Req->Opcode = Frame[1];
+	memcpy(&Req->RequestID, Frame + 4, sizeof(long));
+	*Req->Text = '\0';
+	
+	if (Req->Opcode == MEMBUS_OP_NONE || Req->Opcode >= MEMBUS_OP_MAX || MemBus_FrameSize(Frame) > MEMBUS_MSGSIZE)
 	{
-		char TmpBuf[MEMBUS_MSGSIZE];
-		unsigned long LOffset = (BusDataIs(MEMBUS_CODE_KILLOBJ) ? strlen(MEMBUS_CODE_KILLOBJ " ")
-								: strlen(MEMBUS_CODE_OBJRELOAD " "));
-		const char *TWorker = BusData + LOffset;
-		ObjTable *TmpObj = NULL;
-		
-		if (LOffset >= strlen(BusData) || BusData[LOffset] == ' ')
-		{ /*No argument?*/
-			snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_BADPARAM, BusData);
-			MemBus_Write(TmpBuf, true);
+		return false;
+	}
+	
+	Cmd = &MemBusCommands[Req->Opcode];
+	
+	for (; Inc < MEMBUS_MAX_ARGS && Cmd->ArgTypes[Inc] != 0; ++Inc)
+	{
+		if (Cmd->ArgTypes[Inc] == MEMBUS_TLV_JOBID)
+		{ /*Numbers are turned into text, so handlers only ever deal with strings.*/
+			unsigned short Length = 0;
+			const void *Value = MemBus_FrameGet(Frame, MEMBUS_TLV_JOBID, 0, &Length);
+			unsigned long JobID = 0;
 			
-			return;
-		}
-		
-		if (!(TmpObj = LookupObjectInTable(TWorker)) || !TmpObj->Started)
-		{ /*Bad argument?*/
-			snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_FAILURE, BusData);
-			MemBus_Write(TmpBuf, true);
+			if (!Value || Length != sizeof(long)) continue;
 			
-			return;
+			memcpy(&JobID, Value, sizeof(long));
+			snprintf(Req->ArgBuf, sizeof Req->ArgBuf, "%lu", JobID);
+			Req->Args[Inc] = Req->ArgBuf;
+			continue;
 		}
 		
-		if (BusDataIs(MEMBUS_CODE_KILLOBJ))
+		Req->Args[Inc] = MemBus_FrameGetString(Frame, Cmd->ArgTypes[Inc], 0);
+	}
+	
+	/*The text protocol needs this for echoing, and some handlers use it for log messages.*/
+	snprintf(Req->Text, sizeof Req->Text, "%s%s%s%s%s", Cmd->Code, Req->Args[0] ? " " : "", Req->Args[0] ? Req->Args[0] : "",
+			Req->Args[1] ? " " : "", Req->Args[1] ? Req->Args[1] : "");
+	
+	return true;
+}
+
+void ParseMemBus(void)
+{ /*This function handles EVERYTHING passed to us via membus.
+	* We figure out what was sent, check its arguments, and hand it to a handler from MemBusCommands.*/
+	unsigned char BusData[MEMBUS_MSGSIZE + 1];
+	struct _MemBusRequest Req;
+	unsigned long Inc = 0;
+	
+	if (!BusRunning) return;
+	
+	if (!MemBus_BinRead(BusData, MEMBUS_MSGSIZE, true))
+	{
+		return;
+	}
+	BusData[MEMBUS_MSGSIZE] = '\0';
+	
+	memset(Req.Args, 0, sizeof Req.Args);
+	
+	if (!(*BusData == MEMBUS_FRAME_MAGIC ? MemBus_DecodeFrame(BusData, &Req) : MemBus_DecodeText((char*)BusData, &Req)))
+	{ /*Something we don't understand. Send BADPARAM.*/
+		MemBus_Reply(&Req, MEMBUS_STATUS_BADPARAM);
+		return;
+	}
+	
+	for (; Inc < MemBusCommands[Req.Opcode].MinArgs; ++Inc)
+	{ /*Missing an argument?*/
+		if (!Req.Args[Inc] || *Req.Args[Inc] == '\0' || *Req.Args[Inc] == ' ')
 		{
-			/*Attempt to send SIGKILL to the PID.*/
-			if (!TmpObj->ObjectPID || 
-				kill((TmpObj->Opts.HasPIDFile ? ReadPIDFile(TmpObj) : TmpObj->ObjectPID), SIGKILL) != 0)
-			{
-				snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_FAILURE, BusData);
-			}
-			else
-			{
-				snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_ACKNOWLEDGED, BusData);
-				TmpObj->Started = false; /*Mark it as stopped now that it's dead.*/
-				TmpObj->ObjectPID = 0; /*Erase the PID.*/
-				TmpObj->StartedSince = 0;
-			}
-			MemBus_Write(TmpBuf, true);
+			MemBus_Reply(&Req, MEMBUS_STATUS_BADPARAM);
+			return;
 		}
-		else
+	}
+	
+	MemBusCommands[Req.Opcode].Handler(&Req);
+}
+
+/**The membus as Epochs from before the framed protocol laid it out, just enough of it to be their client.
+ * We need that for one thing: taking over from one of them with a reexec after we've been installed over it.
+ * Their lock was just two longs, the PID and time, and a MEMBUS_SIZE missing it's parentheses
+ * put their client half sizeof(long) * 3 past 4096. Remove this once nobody can be upgrading from those.**/
+#define MEMBUS_LEGACY_SEGMENT_SIZE (4096 + sizeof(long) * 4)
+#define MEMBUS_LEGACY_SERVER_OFFSET (sizeof(long) * 2)
+#define MEMBUS_LEGACY_CLIENT_OFFSET (4096 + sizeof(long) * 3)
+
+static struct
+{
+	unsigned char *Root;
+	unsigned char *Server;
+	unsigned char *Client;
+} LegacyBus;
+
+static int MemBus_LegacyFind(signed long Key)
+{ /*Their segment at Key, if that's what's there.*/
+	struct shmid_ds SegInfo;
+	int Descriptor;
+	
+	if ((Descriptor = shmget((key_t)Key, 0, 0660)) < 0 || shmctl(Descriptor, IPC_STAT, &SegInfo) != 0 ||
+		SegInfo.shm_segsz != MEMBUS_LEGACY_SEGMENT_SIZE)
+	{
+		return -1;
+	}
+	
+	return Descriptor;
+}
+
+Bool MemBus_LegacyPresent(signed long Key)
+{
+	return MemBus_LegacyFind(Key) != -1;
+}
+
+rStatus MemBus_LegacyConnect(signed long Key)
+{ /*Fails quietly if there's no segment at Key, or it isn't one of theirs.*/
+	unsigned char CheckCode = 0;
+	unsigned long Inc = 0;
+	int Descriptor;
+	
+	if ((Descriptor = MemBus_LegacyFind(Key)) == -1) return FAILURE;
+	
+	if ((LegacyBus.Root = shmat(Descriptor, NULL, 0)) == (void*)-1)
+	{
+		LegacyBus.Root = NULL;
+		return FAILURE;
+	}
+	
+	LegacyBus.Server = LegacyBus.Root + MEMBUS_LEGACY_SERVER_OFFSET;
+	LegacyBus.Client = LegacyBus.Root + MEMBUS_LEGACY_CLIENT_OFFSET;
+	
+	/*Same dance as they did it.*/
+	for (; *LegacyBus.Server != MEMBUS_NOMSG && *LegacyBus.Server != MEMBUS_MSG; ++Inc)
+	{
+		if (Inc == 100000) goto Fail;
+		usleep(100);
+	}
+	
+	if (*(unsigned long*)LegacyBus.Root != 0 && *(unsigned long*)LegacyBus.Root != (unsigned long)getpid())
+	{
+		SmallError("Another client is currently connected to the membus. Cannot continue!");
+		goto Fail;
+	}
+	
+	CheckCode = *LegacyBus.Server = (*LegacyBus.Server == MEMBUS_MSG ? MEMBUS_CHECKALIVE_MSG : MEMBUS_CHECKALIVE_NOMSG);
+	
+	for (Inc = 0; *LegacyBus.Server == CheckCode; ++Inc)
+	{
+		if (Inc == 100000)
 		{
-			rStatus RV = SUCCESS;
-			const char *MCode = MEMBUS_CODE_ACKNOWLEDGED, *RMsg = NULL;
-			char LogOut[MAX_LINE_SIZE];
-			
-			if (TmpObj->ObjectReloadCommand == NULL && TmpObj->ReloadCommandSignal == 0)
-			{
-				snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_FAILURE, BusData);
-				MemBus_Write(TmpBuf, true);
-				return;
-			}
-			
-			RV = ProcessReloadCommand(TmpObj, false);
-			
-			switch (RV)
-			{
-				case SUCCESS:
-					MCode = MEMBUS_CODE_ACKNOWLEDGED;
-					RMsg = "succeeded";
-					break;
-				case WARNING:
-					MCode = MEMBUS_CODE_WARNING;
-					RMsg = "succeeded with a warning";
-					break;
-				case FAILURE:
-					MCode = MEMBUS_CODE_FAILURE;
-					RMsg = "failed";
-					break;
-				default:
-					break;
-			}
-			
-			snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MCode, BusData);
-			
-			MemBus_Write(TmpBuf, true);
-			
-			snprintf(LogOut, MAX_LINE_SIZE, "Reload of object %s %s.", TWorker, RMsg);
-			WriteLogLine(LogOut, true);
+			*LegacyBus.Server = (CheckCode == MEMBUS_CHECKALIVE_MSG ? MEMBUS_MSG : MEMBUS_NOMSG);
+			goto Fail;
 		}
+		usleep(100);
 	}
-	else if (BusDataIs(MEMBUS_CODE_RXD))
-	{ /*Restart Epoch from disk, but saves object states and whatnot.
-		* Done mainly so we can unmount the filesystem after someone updates /sbin/epoch.*/
-		
-		/**We set this so when we come back we'll know if we are doing a regular reexec.**/
-		setenv("EPOCHRXDMEMBUS", "1", true);
-		
-		ReexecuteEpoch();
-	}
-	/*Something we don't understand. Send BADPARAM.*/
-	else
+	
+	((unsigned long*)LegacyBus.Root)[0] = getpid();
+	((unsigned long*)LegacyBus.Root)[1] = time(NULL);
+	*LegacyBus.Client = MEMBUS_NOMSG;
+	
+	return SUCCESS;
+	
+Fail:
+	shmdt(LegacyBus.Root);
+	memset(&LegacyBus, 0, sizeof LegacyBus);
+	return FAILURE;
+}
+
+unsigned long MemBus_LegacyBinRead(void *OutStream, unsigned long MaxOutSize)
+{ /*Their messages ran past the end of what they asked for, into the rest of the page. It's there, so we do too.*/
+	if (!LegacyBus.Root || *LegacyBus.Client != MEMBUS_MSG) return 0;
+	
+	if (MaxOutSize > MEMBUS_MSGSIZE) MaxOutSize = MEMBUS_MSGSIZE;
+	
+	memcpy(OutStream, LegacyBus.Client + 1, MaxOutSize);
+	*LegacyBus.Client = MEMBUS_NOMSG;
+	
+	return MaxOutSize;
+}
+
+rStatus MemBus_LegacyWrite(const char *InStream)
+{
+	unsigned short WaitCount = 0;
+	
+	if (!LegacyBus.Root) return FAILURE;
+	
+	while (*LegacyBus.Server != MEMBUS_NOMSG)
 	{
-		char TmpBuf[MEMBUS_MSGSIZE];
-		
-		snprintf(TmpBuf, sizeof TmpBuf, "%s %s", MEMBUS_CODE_BADPARAM, BusData);
+		usleep(1000);
 		
-		MemBus_Write(TmpBuf, true);
+		if (++WaitCount == 10000) return FAILURE;
 	}
+	
+	snprintf((char*)LegacyBus.Server + 1, MEMBUS_MSGSIZE, "%s", InStream);
+	*LegacyBus.Server = MEMBUS_MSG;
+	
+	return SUCCESS;
+}
+
+Bool MemBus_LegacyEaten(void)
+{ /*True once the server's picked up what we wrote, or gone away.*/
+	return !LegacyBus.Root || *LegacyBus.Server != MEMBUS_MSG;
+}
+
+void MemBus_LegacyDisconnect(void)
+{
+	if (!LegacyBus.Root) return;
+	
+	((unsigned long*)LegacyBus.Root)[0] = 0;
+	((unsigned long*)LegacyBus.Root)[1] = 0;
+	
+	shmdt(LegacyBus.Root);
+	memset(&LegacyBus, 0, sizeof LegacyBus);
 }
 
 rStatus ShutdownMemBus(Bool ServerSide)
@@ -996,7 +1500,7 @@ rStatus ShutdownMemBus(Bool ServerSide)
 	else
 	{ /*Release the client lock.*/
 		*MemBus.LockPID = 0;
-		*MemBus.LockTime = 0;
+		pthread_mutex_unlock(MemBus.Lock);
 	}
 	
 	if (shmdt(MemBus.Root) != 0)
@@ -19,121 +19,206 @@
 /*To shut up some weird compilers. I don't know what this thing wants from me.*/
 pid_t getsid(pid_t);
 
-rStatus SendPowerControl(const char *MembusCode)
+rStatus SendPowerControl(unsigned char Opcode)
 { /*Client side to send a request to halt/reboot/power off/disable or enable CAD/etc.*/
-	char InitsResponse[MEMBUS_MSGSIZE], *PCode[2], *PErrMsg;
+	unsigned char Frame[MEMBUS_MSGSIZE];
+	const char *PErrMsg = NULL;
+	unsigned char Status;
 	
-	if (!strcmp(MembusCode, MEMBUS_CODE_HALT))
+	switch (Opcode)
 	{
-		PCode[0] = MEMBUS_CODE_ACKNOWLEDGED " " MEMBUS_CODE_HALT;
-		PCode[1] = MEMBUS_CODE_FAILURE " " MEMBUS_CODE_HALT;
-		PErrMsg = "Unable to halt.";
-	}
-	else if (!strcmp(MembusCode, MEMBUS_CODE_POWEROFF))
-	{
-		PCode[0] = MEMBUS_CODE_ACKNOWLEDGED " " MEMBUS_CODE_POWEROFF;
-		PCode[1] = MEMBUS_CODE_FAILURE " " MEMBUS_CODE_POWEROFF;
-		PErrMsg = "Unable to power off.";
-	}
-	else if (!strcmp(MembusCode, MEMBUS_CODE_REBOOT))
-	{
-		PCode[0] = MEMBUS_CODE_ACKNOWLEDGED " " MEMBUS_CODE_REBOOT;
-		PCode[1] = MEMBUS_CODE_FAILURE " " MEMBUS_CODE_REBOOT;
-		PErrMsg = "Unable to reboot.";
-	}
-	else if (!strcmp(MembusCode, MEMBUS_CODE_CADON))
-	{
-		PCode[0] = MEMBUS_CODE_ACKNOWLEDGED " " MEMBUS_CODE_CADON;
-		PCode[1] = MEMBUS_CODE_FAILURE " " MEMBUS_CODE_CADON;
-		PErrMsg = "Unable to enable CTRL-ALT-DEL instant reboot.";
-	}
-	else if (!strcmp(MembusCode, MEMBUS_CODE_CADOFF))
-	{
-		PCode[0] = MEMBUS_CODE_ACKNOWLEDGED " " MEMBUS_CODE_CADOFF;
-		PCode[1] = MEMBUS_CODE_FAILURE " " MEMBUS_CODE_CADOFF;
-		PErrMsg = "Unable to disable CTRL-ALT-DEL instant reboot.";
-	}
-	else
-	{
-		SpitError("Invalid MEMBUS_CODE passed to SendPowerControl().");
-		return FAILURE;
+		case MEMBUS_OP_HALT:
+			PErrMsg = "Unable to halt.";
+			break;
+		case MEMBUS_OP_POWEROFF:
+			PErrMsg = "Unable to power off.";
+			break;
+		case MEMBUS_OP_REBOOT:
+			PErrMsg = "Unable to reboot.";
+			break;
+		case MEMBUS_OP_CADON:
+			PErrMsg = "Unable to enable CTRL-ALT-DEL instant reboot.";
+			break;
+		case MEMBUS_OP_CADOFF:
+			PErrMsg = "Unable to disable CTRL-ALT-DEL instant reboot.";
+			break;
+		default:
+			SpitError("Invalid opcode passed to SendPowerControl().");
+			return FAILURE;
 	}
 	
-	if (!MemBus_Write(MembusCode, false))
+	MemBus_FrameInit(Frame, Opcode, 0);
+	
+	if ((Status = MemBus_Transact(Frame)) == MEMBUS_STATUS_BADREPLY)
 	{
-		SpitError("Failed to write to membus.");
+		SpitError("Failed to communicate over membus.");
 		return FAILURE;
 	}
 	
-	while (!MemBus_Read(InitsResponse, false)) usleep(1000); /*0.001 secs.*/
-	
-	MemBus_Write(MembusCode, false); /*Tells init it can shut down the membus.*/
+	if (Opcode == MEMBUS_OP_HALT || Opcode == MEMBUS_OP_POWEROFF || Opcode == MEMBUS_OP_REBOOT)
+	{ /*Tells init it can shut down the membus.*/
+		MemBus_BinWrite(Frame, MemBus_FrameSize(Frame), false);
+	}
 	
-	if (!strcmp(InitsResponse, PCode[0]))
+	if (Status != MEMBUS_STATUS_OK)
 	{
-		ShutdownMemBus(false);
-		return SUCCESS;
-	}
-	else if (!strcmp(InitsResponse, PCode[1]))
-	{ /*Nothing uses this right now.*/
 		SpitError(PErrMsg);
 		ShutdownMemBus(false);
 		
 		return FAILURE;
 	}
 	
+	ShutdownMemBus(false);
 	return SUCCESS;
 }
 
-rStatus ObjControl(const char *ObjectID, const char *MemBusSignal)
+rStatus ObjControl(const char *ObjectID, unsigned char Opcode)
 { /*Start and stop or disable services.*/
-	char RemoteResponse[MEMBUS_MSGSIZE];
-	char OutMsg[MEMBUS_MSGSIZE];
-	char PossibleResponses[4][MEMBUS_MSGSIZE];
+	unsigned char Frame[MEMBUS_MSGSIZE], Status;
 	
-	snprintf(OutMsg, sizeof OutMsg, "%s %s", MemBusSignal, ObjectID);
+	MemBus_FrameInit(Frame, Opcode, 0);
 	
-	if (!MemBus_Write(OutMsg, false))
+	if (!MemBus_FrameAddString(Frame, MEMBUS_TLV_OBJECTID, ObjectID))
 	{
 		return FAILURE;
 	}
 	
-	while (!MemBus_Read(RemoteResponse, false)) usleep(1000); /*0.001 secs*/
+	Status = MemBus_Transact(Frame);
 	
-	snprintf(PossibleResponses[0], sizeof PossibleResponses[0], "%s %s %s",
-		MEMBUS_CODE_ACKNOWLEDGED, MemBusSignal, ObjectID);
-		
-	snprintf(PossibleResponses[1], sizeof PossibleResponses[1], "%s %s %s",
-		MEMBUS_CODE_FAILURE, MemBusSignal, ObjectID);
-		
-	snprintf(PossibleResponses[2], sizeof PossibleResponses[2], "%s %s",
-		MEMBUS_CODE_BADPARAM, OutMsg);
+	if (Status == MEMBUS_STATUS_OK && MemBus_FrameGet(Frame, MEMBUS_TLV_JOBID, 0, NULL))
+	{ /*It's been queued as a job. Wait for it to finish.*/
+		Status = MemBus_WaitJob(Frame);
+	}
+	
+	switch (Status)
+	{
+		case MEMBUS_STATUS_OK:
+			return SUCCESS;
+		case MEMBUS_STATUS_WARNING:
+			return WARNING;
+		case MEMBUS_STATUS_FAILURE:
+			return FAILURE;
+		case MEMBUS_STATUS_CANCELLED:
+			SmallError("\nThe job was cancelled.");
+			return FAILURE;
+		case MEMBUS_STATUS_BADPARAM:
+			SpitError("\nWe are being told that we sent a bad parameter.");
+			return FAILURE;
+		default:
+			SpitError("\nReceived invalid reply from membus.");
+			return FAILURE;
+	}
+}
 
-	snprintf(PossibleResponses[3], sizeof PossibleResponses[3], "%s %s %s",
-		MEMBUS_CODE_WARNING, MemBusSignal, ObjectID);
-		
-	if (!strcmp(RemoteResponse, PossibleResponses[0]))
+static void PrintBatchResults(const unsigned char *Frame, const char *Action)
+{ /*One status report line per object in a batch reply.*/
+	const unsigned char *Result = NULL;
+	const void *Value = NULL;
+	unsigned long Inc = 0, Total = 0;
+	char TOut[MAX_LINE_SIZE];
+	
+	if ((Value = MemBus_FrameGet(Frame, MEMBUS_TLV_VALUE, 0, NULL))) memcpy(&Total, Value, sizeof(long));
+	
+	for (Inc = 0; (Result = MemBus_FrameGet(Frame, MEMBUS_TLV_BATCHRESULT, Inc, NULL)); ++Inc)
 	{
-		return SUCCESS;
+		snprintf(TOut, sizeof TOut, "%s %s", Action, (const char*)Result + 1);
+		RenderStatusReport(TOut);
+		CompleteStatusReport(TOut, (*Result == MEMBUS_STATUS_OK ? SUCCESS :
+							*Result == MEMBUS_STATUS_WARNING ? WARNING : FAILURE), false);
 	}
-	else if (!strcmp(RemoteResponse, PossibleResponses[1]))
+	
+	if (Inc < Total)
 	{
+		printf("...and %lu more. Check the log for the rest.\n", Total - Inc);
+	}
+}
+
+rStatus BatchControl(unsigned char BatchOp, const char **Patterns, unsigned long NumPatterns)
+{ /*Same as above, but for a whole list of objects and globs at once, and we print how each one went.*/
+	static const char *const ActionStrings[BATCH_MAX] = { "Starting", "Stopping", "Restarting",
+														"Reloading", "Enabling", "Disabling" };
+	unsigned char Frame[MEMBUS_MSGSIZE], Status;
+	char PatBuf[MEMBUS_MSGSIZE];
+	unsigned long Inc = 0, Length = 0;
+	
+	if (BatchOp >= BATCH_MAX) return FAILURE;
+	
+	for (*PatBuf = '\0'; Inc < NumPatterns && Length < sizeof PatBuf; ++Inc)
+	{
+		Length += snprintf(PatBuf + Length, sizeof PatBuf - Length, "%s%s", (Inc ? " " : ""), Patterns[Inc]);
+	}
+	
+	MemBus_FrameInit(Frame, MEMBUS_OP_BATCH, 0);
+	
+	if (Length >= sizeof PatBuf || !MemBus_FrameAddString(Frame, MEMBUS_TLV_BATCHOP, Jobs_BatchOpName(BatchOp)) ||
+		!MemBus_FrameAddString(Frame, MEMBUS_TLV_PATTERNS, PatBuf))
+	{
+		SpitError("Too many object IDs for one batch.");
 		return FAILURE;
 	}
-	else if (!strcmp(RemoteResponse, PossibleResponses[3]))
+	
+	Status = MemBus_Transact(Frame);
+	
+	if (Status == MEMBUS_STATUS_OK && MemBus_FrameGet(Frame, MEMBUS_TLV_JOBID, 0, NULL))
+	{ /*The results come back with the job.*/
+		Status = MemBus_WaitJob(Frame);
+	}
+	
+	if (Status == MEMBUS_STATUS_BADREPLY || Status == MEMBUS_STATUS_BADPARAM)
 	{
-		return WARNING;
+		SpitError("Received invalid reply from membus.");
+		return FAILURE;
 	}
-	else if (!strcmp(RemoteResponse, PossibleResponses[2]))
+	
+	if (!MemBus_FrameGet(Frame, MEMBUS_TLV_VALUE, 0, NULL))
 	{
-		SpitError("\nWe are being told that we sent a bad parameter.");
+		SmallError("No objects match.");
 		return FAILURE;
 	}
-	else
+	
+	PrintBatchResults(Frame, ActionStrings[BatchOp]);
+	
+	return Status == MEMBUS_STATUS_OK ? SUCCESS : Status == MEMBUS_STATUS_WARNING ? WARNING : FAILURE;
+}
+
+rStatus ReloadControl(Bool ApplyChanges)
+{ /*Reloads the config, and with ApplyChanges, waits for what changed to be started, stopped or restarted.*/
+	unsigned char Frame[MEMBUS_MSGSIZE], Status;
+	
+	MemBus_FrameInit(Frame, MEMBUS_OP_RESET, 0);
+	
+	if (ApplyChanges && !MemBus_FrameAddString(Frame, MEMBUS_TLV_OPTION, "apply"))
 	{
-		SpitError("\nReceived invalid reply from membus.");
 		return FAILURE;
 	}
+	
+	Status = MemBus_Transact(Frame);
+	
+	if (Status == MEMBUS_STATUS_OK && MemBus_FrameGet(Frame, MEMBUS_TLV_JOBID, 0, NULL))
+	{
+		puts("Reload successful. Applying changes.");
+		
+		Status = MemBus_WaitJob(Frame);
+		PrintBatchResults(Frame, "Updating");
+		
+		return Status == MEMBUS_STATUS_OK ? SUCCESS : Status == MEMBUS_STATUS_WARNING ? WARNING : FAILURE;
+	}
+	
+	switch (Status)
+	{
+		case MEMBUS_STATUS_OK:
+			puts(ApplyChanges ? "Reload successful. Nothing needed restarting." : "Reload successful.");
+			return SUCCESS;
+		case MEMBUS_STATUS_FAILURE:
+			puts("Reload failed!");
+			return FAILURE;
+		case MEMBUS_STATUS_BADPARAM:
+			SpitError("We are being told that MEMBUS_OP_RESET is not a valid signal! Please report to Epoch.");
+			return FAILURE;
+		default:
+			SpitError("Unknown response received! Can't handle this! Report to Epoch please!");
+			return FAILURE;
+	}
 }
 
 rStatus EmulKillall5(unsigned long InSignal)
@@ -275,9 +360,8 @@ rStatus EmulShutdown(long ArgumentCount, const char **ArgStream)
 { /*Eyesore, but it works.*/
 	const char **TPtr = ArgStream + 1; /*Skip past the equivalent of argv[0].*/
 	unsigned long TargetHr = 0, TargetMin = 0;
-	const char *THalt = NULL;
-	char PossibleResponses[3][MEMBUS_MSGSIZE];
-	char TmpBuf[MEMBUS_MSGSIZE], InRecv[MEMBUS_MSGSIZE], TimeFormat[32];
+	unsigned char THalt = MEMBUS_OP_NONE, Frame[MEMBUS_MSGSIZE], Status;
+	char TimeFormat[32];
 	short Inc = 0;
 	short TimeIsSet = 0, HaltModeSet = 0;
 	Bool AbortingShutdown = false, ImmediateHalt = false;
@@ -286,26 +370,26 @@ rStatus EmulShutdown(long ArgumentCount, const char **ArgStream)
 	{
 		if (!strcmp(*TPtr, "-h") || !strcmp(*TPtr, "--halt") || !strcmp(*TPtr, "-H"))
 		{
-			THalt = MEMBUS_CODE_HALT;
+			THalt = MEMBUS_OP_HALT;
 			++HaltModeSet;
 			continue;
 		}
 		else if (!strcmp(*TPtr, "-R") || !strcmp(*TPtr, "-r") || !strcmp(*TPtr, "--reboot"))
 		{
-			THalt = MEMBUS_CODE_REBOOT;
+			THalt = MEMBUS_OP_REBOOT;
 			++HaltModeSet;
 			continue;
 		}
 		else if (!strcmp(*TPtr, "-p") || !strcmp(*TPtr, "-P") || !strcmp(*TPtr, "--poweroff"))
 		{
-			THalt = MEMBUS_CODE_POWEROFF;
+			THalt = MEMBUS_OP_POWEROFF;
 			++HaltModeSet;
 			continue;
 		}
 		else if (!strcmp(*TPtr, "-c") || !strcmp(*TPtr, "--cancel"))
 		{
 			AbortingShutdown = true;
-			snprintf(TmpBuf, sizeof TmpBuf, "%s", MEMBUS_CODE_ABORTHALT);
+			THalt = MEMBUS_OP_ABORTHALT;
 			break;
 		}
 		else if (strstr(*TPtr, ":") && **TPtr != '-')
@@ -396,51 +480,37 @@ rStatus EmulShutdown(long ArgumentCount, const char **ArgStream)
 			fprintf(stderr, "%s\n", "Multiple time arguments specified. Please specify only one.");
 			return FAILURE;
 		}
-		
-		if (!ImmediateHalt)
-		{
-			snprintf(TmpBuf, sizeof TmpBuf, "%s %s", THalt, TimeFormat);
-		}
 	}
 	
-	if (ImmediateHalt)
+	MemBus_FrameInit(Frame, THalt, 0);
+	
+	if (!AbortingShutdown && !ImmediateHalt)
 	{
-		snprintf(TmpBuf, sizeof TmpBuf, "%s", THalt);
+		MemBus_FrameAddString(Frame, MEMBUS_TLV_TIME, TimeFormat);
 	}
 	
-	snprintf(PossibleResponses[0], MEMBUS_MSGSIZE, "%s %s", MEMBUS_CODE_ACKNOWLEDGED, TmpBuf);
-	snprintf(PossibleResponses[1], MEMBUS_MSGSIZE, "%s %s", MEMBUS_CODE_FAILURE, TmpBuf);
-	snprintf(PossibleResponses[2], MEMBUS_MSGSIZE, "%s %s", MEMBUS_CODE_BADPARAM, TmpBuf);
-	
 	if (!InitMemBus(false))
 	{
 		SpitError("Failed to connect to membus.");
 		return FAILURE;
 	}
 	
-	if (!MemBus_Write(TmpBuf, false))
-	{
-		SpitError("Failed to write to membus.");
-		ShutdownMemBus(false);
-		return FAILURE;
-	}
-	
-	while (!MemBus_Read(InRecv, false)) usleep(1000); /*Wait for a response.*/
+	Status = MemBus_Transact(Frame);
 	
-	if (ImmediateHalt) MemBus_Write(" ", false); /*Tells init it can shut down the membus.*/
+	if (ImmediateHalt) MemBus_BinWrite(Frame, MemBus_FrameSize(Frame), false); /*Tells init it can shut down the membus.*/
 	
 	if (!ShutdownMemBus(false))
 	{
 		SpitError("Failed to shut down membus! This could spell serious issues.");
 	}
 	
-	if (!strcmp(InRecv, PossibleResponses[0]))
+	if (Status == MEMBUS_STATUS_OK)
 	{
 		return SUCCESS;
 	}
-	else if (!strcmp(InRecv, PossibleResponses[1]))
+	else if (Status == MEMBUS_STATUS_FAILURE)
 	{
-		if (!strcmp(TmpBuf, MEMBUS_CODE_ABORTHALT))
+		if (AbortingShutdown)
 		{
 			fprintf(stderr, "%s\n", "Failed to abort shutdown. Is a shutdown scheduled?");
 		}
@@ -450,7 +520,7 @@ rStatus EmulShutdown(long ArgumentCount, const char **ArgStream)
 		}
 		return FAILURE;
 	}
-	else if (!strcmp(InRecv, PossibleResponses[2]))
+	else if (Status == MEMBUS_STATUS_BADPARAM)
 	{
 		SpitError("We are being told that we sent a bad parameter over the membus!"
 					"Please report this to Epoch, as it's likely a bug.");
@@ -0,0 +1,240 @@
+/*This code is part of the Epoch Init System.
+* The Epoch Init System is maintained by Subsentient.
+* This software is public domain.
+* Please read the file UNLICENSE.TXT for more information.*/
+
+/**This file keeps the runtime state overlay. "epoch enable/disable" and "epoch objrl"
+ * used to rewrite epoch.conf from inside PID 1. Now they append one line to a journal
+ * next to it, and InitConfig() plays the journal back on top of whatever it parsed.
+ * Each record remembers what the config file said when it was made, so if somebody
+ * edits epoch.conf by hand afterwards, their edit wins.**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "epoch.h"
+
+/*Records in the journal right now. We rewrite it from the table once it gets to OVERLAY_COMPACT_AT.*/
+static unsigned long JournalRecords;
+
+static void Overlay_Path(char *Out, unsigned long OutSize)
+{
+	snprintf(Out, OutSize, "%s" OVERLAY_SUFFIX, ConfigFile);
+}
+
+static unsigned long Overlay_HashRunlevels(const ObjTable *CurObj)
+{ /*Order doesn't matter, since the config cache doesn't keep it.*/
+	const char *RL = NULL;
+	unsigned long Hash = 0, ID = 0;
+	
+	for (; (RL = ObjRL_GetName(ID)); ++ID)
+	{
+		if (RLSET_HAS(CurObj->ObjectRunlevels, ID)) Hash = (Hash + HashBytes(RL, strlen(RL))) & 0xFFFFFFFF;
+	}
+	
+	return Hash;
+}
+
+static unsigned long Overlay_FormatEnabled(char *Out, unsigned long OutSize, const ObjTable *CurObj)
+{ /*E, the new value, the config file's value, then the object ID.*/
+	return snprintf(Out, OutSize, "E\t%d\t%d\t%s\n", CurObj->Enabled ? 1 : 0, CurObj->ConfigEnabled ? 1 : 0, CurObj->ObjectID);
+}
+
+static unsigned long Overlay_FormatRunlevels(char *Out, unsigned long OutSize, const ObjTable *CurObj)
+{ /*R, the hash of the config file's runlevels, the object ID, then the new runlevels.*/
+	unsigned long Length = snprintf(Out, OutSize, "R\t%lu\t%s\t", CurObj->ConfigRunlevels, CurObj->ObjectID);
+	const unsigned long Start = Length;
+	const char *RL = NULL;
+	unsigned long ID = 0;
+	
+	for (; (RL = ObjRL_GetName(ID)) && Length < OutSize; ++ID)
+	{
+		if (!RLSET_HAS(CurObj->ObjectRunlevels, ID)) continue;
+		
+		Length += snprintf(Out + Length, OutSize - Length, "%s%s", Length > Start ? " " : "", RL);
+	}
+	
+	if (Length < OutSize) Length += snprintf(Out + Length, OutSize - Length, "\n");
+	
+	return Length;
+}
+
+static void Overlay_Compact(void)
+{ /*Writes out only what differs from the config file now, and swaps it in whole.*/
+	char JournalPath[MAX_LINE_SIZE], TempPath[MAX_LINE_SIZE + 8], Line[MAX_LINE_SIZE * 2];
+	const ObjTable *Worker = ObjectTable;
+	unsigned long Length, Records = 0;
+	int Descriptor;
+	Bool WriteOK = true;
+	
+	Overlay_Path(JournalPath, sizeof JournalPath);
+	snprintf(TempPath, sizeof TempPath, "%s.new", JournalPath);
+	
+	if ((Descriptor = open(TempPath, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) return;
+	
+	for (; Worker < ObjectTable + ObjectCount && WriteOK; ++Worker)
+	{
+		if (Worker->Enabled != Worker->ConfigEnabled)
+		{
+			Length = Overlay_FormatEnabled(Line, sizeof Line, Worker);
+			WriteOK = (Length < sizeof Line && write(Descriptor, Line, Length) == (long)Length);
+			++Records;
+		}
+		
+		if (WriteOK && Overlay_HashRunlevels(Worker) != Worker->ConfigRunlevels)
+		{
+			Length = Overlay_FormatRunlevels(Line, sizeof Line, Worker);
+			WriteOK = (Length < sizeof Line && write(Descriptor, Line, Length) == (long)Length);
+			++Records;
+		}
+	}
+	
+	if (!WriteOK || fsync(Descriptor) != 0)
+	{
+		close(Descriptor);
+		unlink(TempPath);
+		return;
+	}
+	
+	close(Descriptor);
+	
+	if (rename(TempPath, JournalPath) != 0)
+	{
+		unlink(TempPath);
+		return;
+	}
+	
+	JournalRecords = Records;
+}
+
+static rStatus Overlay_Append(const char *Line, unsigned long Length)
+{
+	char JournalPath[MAX_LINE_SIZE];
+	int Descriptor;
+	Bool WriteOK;
+	
+	Overlay_Path(JournalPath, sizeof JournalPath);
+	
+	if ((Descriptor = open(JournalPath, O_WRONLY | O_APPEND | O_CREAT, 0644)) == -1)
+	{
+		return FAILURE;
+	}
+	
+	/*One write, so a crash leaves at worst a partial last line, and that gets skipped.*/
+	WriteOK = (write(Descriptor, Line, Length) == (long)Length && fsync(Descriptor) == 0);
+	close(Descriptor);
+	
+	if (!WriteOK) return FAILURE;
+	
+	if (++JournalRecords >= OVERLAY_COMPACT_AT) Overlay_Compact();
+	
+	return SUCCESS;
+}
+
+rStatus Overlay_SaveEnabled(const ObjTable *CurObj)
+{
+	char Line[MAX_LINE_SIZE];
+	const unsigned long Length = Overlay_FormatEnabled(Line, sizeof Line, CurObj);
+	
+	if (Length >= sizeof Line) return FAILURE;
+	
+	return Overlay_Append(Line, Length);
+}
+
+rStatus Overlay_SaveRunlevels(const ObjTable *CurObj)
+{
+	char Line[MAX_LINE_SIZE * 2];
+	const unsigned long Length = Overlay_FormatRunlevels(Line, sizeof Line, CurObj);
+	
+	if (Length >= sizeof Line) return FAILURE;
+	
+	return Overlay_Append(Line, Length);
+}
+
+static void Overlay_ApplyLine(char *Line)
+{ /*Line is one record without its newline. Anything that doesn't make sense is skipped.*/
+	char *Fields[4] = { NULL }, *Worker = Line, *RL = NULL;
+	unsigned long NumFields = 1;
+	ObjTable *CurObj = NULL;
+	
+	/*Both kinds have four fields. For R, the last one is the runlevels.*/
+	for (Fields[0] = Line; NumFields < 4 && (Worker = strchr(Worker, '\t')); ++NumFields)
+	{
+		*Worker++ = '\0';
+		Fields[NumFields] = Worker;
+	}
+	
+	if (NumFields != 4) return;
+	
+	if (!strcmp(Fields[0], "E"))
+	{
+		if (!(CurObj = LookupObjectInTable(Fields[3])) ||
+			(*Fields[2] == '1') != (CurObj->ConfigEnabled != false))
+		{ /*Gone, or epoch.conf has changed since.*/
+			return;
+		}
+		
+		CurObj->Enabled = (*Fields[1] == '1');
+	}
+	else if (!strcmp(Fields[0], "R"))
+	{
+		if (!(CurObj = LookupObjectInTable(Fields[2])) ||
+			strtoul(Fields[1], NULL, 10) != CurObj->ConfigRunlevels)
+		{
+			return;
+		}
+		
+		ObjRL_ClearRunlevels(CurObj);
+		
+		for (RL = strtok(Fields[3], " "); RL; RL = strtok(NULL, " "))
+		{
+			ObjRL_AddRunlevel(RL, CurObj);
+		}
+	}
+}
+
+void Overlay_Load(void)
+{ /*Called by InitConfig() when the table is ready. Notes down what the config file said first.*/
+	char JournalPath[MAX_LINE_SIZE], *Journal = NULL, *Worker = NULL, *LineEnd = NULL;
+	ObjTable *CurObj = ObjectTable;
+	struct stat FileStat;
+	FILE *Descriptor = NULL;
+	
+	for (; CurObj < ObjectTable + ObjectCount; ++CurObj)
+	{
+		CurObj->ConfigEnabled = CurObj->Enabled;
+		CurObj->ConfigRunlevels = Overlay_HashRunlevels(CurObj);
+	}
+	
+	JournalRecords = 0;
+	Overlay_Path(JournalPath, sizeof JournalPath);
+	
+	if (stat(JournalPath, &FileStat) != 0 || !(Descriptor = fopen(JournalPath, "r")))
+	{ /*Nothing's been changed at runtime, ever.*/
+		return;
+	}
+	
+	if (!(Journal = malloc(FileStat.st_size + 1)))
+	{
+		fclose(Descriptor);
+		return;
+	}
+	
+	Journal[fread(Journal, 1, FileStat.st_size, Descriptor)] = '\0';
+	fclose(Descriptor);
+	
+	for (Worker = Journal; (LineEnd = strchr(Worker, '\n')); Worker = LineEnd + 1)
+	{
+		*LineEnd = '\0';
+		Overlay_ApplyLine(Worker);
+		++JournalRecords;
+	}
+	
+	free(Journal);
+	
+	if (JournalRecords >= OVERLAY_COMPACT_AT) Overlay_Compact();
+}
@@ -25,11 +25,11 @@ BootMode CurrentBootMode;
 
 /**Function forward declarations.**/
 
-static rStatus ExecuteConfigObject(ObjTable *InObj, const char *CurCmd);
+static rStatus ExecuteConfigObject(ObjTable *InObj, const char *CurCmd, unsigned char CmdKind);
 
 /**Actual functions.**/
 
-static Bool FileUsable(const char *FileName)
+Bool FileUsable(const char *FileName)
 {
 	FILE *TS = fopen(FileName, "r");
 	
@@ -44,8 +44,10 @@ static Bool FileUsable(const char *FileName)
 	}
 }	
 
-static rStatus ExecuteConfigObject(ObjTable *InObj, const char *CurCmd)
-{ /*Not making static because this is probably going to be useful for other stuff.*/
+unsigned long LaunchObjectCommand(ObjTable *InObj, const char *CurCmd, unsigned char CmdKind, Bool *ShellDissolvesOut)
+{ /*Forks off CurCmd and returns the PID without waiting on it. The exit status
+	* must be fed to CompleteObjectCommand() once the child is reaped.
+	* CmdKind says which of the object's commands it is. Identical commands share one string, so the pointer can't.*/
 #ifdef NOMMU
 #define ForkFunc() vfork()
 #else
@@ -53,8 +55,7 @@ static rStatus ExecuteConfigObject(ObjTable *InObj, const char *CurCmd)
 #endif
 
 	pid_t LaunchPID;
-	rStatus ExitStatus = FAILURE; /*We failed unless we succeeded.*/
-	int RawExitStatus, Inc = 0;
+	int Inc = 0, CaptureOut = -1, CaptureErr = -1;
 	sigset_t SigMaker[2];	
 #ifndef NOSHELL
 	Bool ShellEnabled = true; /*If we use shells.*/
@@ -62,15 +63,17 @@ static rStatus ExecuteConfigObject(ObjTable *InObj, const char *CurCmd)
 	Bool ForceShell = InObj->Opts.ForceShell;
 	static Bool DidWarn = false;
 	const char *ShellPath = "/bin/sh";
+#endif
 	
 	if (CurCmd == NULL)
 	{
-		const char *ErrMsg = "NULL value passed to ExecuteConfigObject()! This is likely a bug.";
+		const char *ErrMsg = "NULL value passed to LaunchObjectCommand()! This is likely a bug.";
 		SpitError(ErrMsg);
 		WriteLogLine(ErrMsg, true);
 		
-		return FAILURE;
+		return 0;
 	}
+#ifndef NOSHELL
 	
 	/*Check how we should handle PIDs for each shell. In order to get the PID, exit status,
 	* and support shell commands, we need to jump through a bunch of hoops.*/
@@ -170,6 +173,10 @@ static rStatus ExecuteConfigObject(ObjTable *InObj, const char *CurCmd)
 	
 	sigprocmask(SIG_BLOCK, &SigMaker[0], NULL);
 	
+	/*The pipes have to exist before the child does. If we can't make one, it just prints where we do.*/
+	if (InObj->Opts.CaptureStdout) CaptureOut = Capture_Descriptor(InObj, false);
+	if (InObj->Opts.CaptureStderr) CaptureErr = Capture_Descriptor(InObj, true);
+	
 	/**Actually do the (v)fork().**/
 	LaunchPID = ForkFunc();
 	
@@ -181,12 +188,16 @@ static rStatus ExecuteConfigObject(ObjTable *InObj, const char *CurCmd)
 	
 	if (LaunchPID > 0)
 	{
-			CurrentTask.Node = InObj;
-			CurrentTask.TaskName = InObj->ObjectID;
-			CurrentTask.PID = LaunchPID;
-			CurrentTask.Set = true;
-			
-			sigprocmask(SIG_UNBLOCK, &SigMaker[1], NULL); /*Unblock now that (v)fork() is complete.*/
+#ifndef NOSHELL
+		if (ShellDissolvesOut) *ShellDissolvesOut = ShellDissolves;
+#else
+		if (ShellDissolvesOut) *ShellDissolvesOut = true;
+#endif
+		sigprocmask(SIG_UNBLOCK, &SigMaker[1], NULL); /*Unblock now that (v)fork() is complete.*/
+		
+		if (CmdKind == OBJCMD_START) Events_Emit(EVENT_STARTED, InObj->ObjectID, (long)LaunchPID);
+		
+		return LaunchPID;
 	}
 	
 	if (LaunchPID == 0) /**Child process code.**/
@@ -207,7 +218,7 @@ static rStatus ExecuteConfigObject(ObjTable *InObj, const char *CurCmd)
 		
 #ifndef NOMMU /*Can't do this because vfork() blocks the parent.*/
 		/*If we are supposed to spawn off as a daemon, do this.*/
-		if (InObj->Opts.Fork && CurCmd == InObj->ObjectStartCommand)
+		if (InObj->Opts.Fork && CmdKind == OBJCMD_START)
 		{
 			pid_t Subchild = 0;
 			
@@ -228,7 +239,7 @@ static rStatus ExecuteConfigObject(ObjTable *InObj, const char *CurCmd)
 		/*Change our session id.*/
 		setsid();
 		
-		if (InObj->ObjectWorkingDirectory != NULL && CurCmd == InObj->ObjectStartCommand)
+		if (InObj->ObjectWorkingDirectory != NULL && CmdKind == OBJCMD_START)
 		{ /*Switch directories if desired.*/
 			if (chdir(InObj->ObjectWorkingDirectory) == -1)
 			{ /*Failed to chdir.*/
@@ -240,19 +251,27 @@ static rStatus ExecuteConfigObject(ObjTable *InObj, const char *CurCmd)
 		
 		
 		/*stdout*/
-		if (InObj->ObjectStdout != NULL)
+		if (CaptureOut != -1)
+		{ /*dup2() doesn't copy close-on-exec, so this one gets through.*/
+			dup2(CaptureOut, STDOUT_FILENO);
+		}
+		else if (InObj->ObjectStdout != NULL)
 		{
 			freopen(InObj->ObjectStdout, "a", stdout); /*We don't deal with the return code.*/
 		}
 		
 		/*stderr*/
-		if (InObj->ObjectStderr != NULL)
+		if (CaptureErr != -1)
+		{
+			dup2(CaptureErr, STDERR_FILENO);
+		}
+		else if (InObj->ObjectStderr != NULL)
 		{
 			freopen(InObj->ObjectStderr, "a", stderr);
 		}
 		
 		/**The ordering of this is important to make the file descriptors work for an alternative stdout/stderr.**/
-		if (CurCmd == InObj->ObjectStartCommand)
+		if (CmdKind == OBJCMD_START)
 		{ /*Set user and group if desired.*/
 
 			if (InObj->UserID != 0)
@@ -300,7 +319,7 @@ static rStatus ExecuteConfigObject(ObjTable *InObj, const char *CurCmd)
 			
 			while ((Worker = WhitespaceArg(Worker))) ++NumSpaces;
 			
-			ArgV = malloc(sizeof(char*) * NumSpaces + 1);
+			ArgV = malloc(sizeof(char*) * (NumSpaces + 1));
 			
 			for (Worker = NCmd, Inc = 0; Inc < NumSpaces; ++Inc)
 			{
@@ -329,23 +348,22 @@ static rStatus ExecuteConfigObject(ObjTable *InObj, const char *CurCmd)
 		/*We still around to talk about it? We were supposed to be imaged with the new command!*/
 	}
 	
-	/**Parent code resumes.**/
-	waitpid(LaunchPID, &RawExitStatus, 0); /*Wait for the process to exit.*/
+	_exit(1); /*Never reached.*/
+}
 
-	CurrentTask.Set = false;
-	CurrentTask.Node = NULL;
-	CurrentTask.TaskName = NULL;
-	CurrentTask.PID = 0; /*Set back to zero for the next one.*/
+rStatus CompleteObjectCommand(ObjTable *InObj, unsigned char CmdKind, unsigned long LaunchPID,
+							int RawExitStatus, Bool ShellDissolves)
+{ /*The second half of LaunchObjectCommand(), once we have the exit status.*/
+	rStatus ExitStatus = FAILURE; /*We failed unless we succeeded.*/
 	
-	if (CurCmd == InObj->ObjectStartCommand)
+	if (CmdKind == OBJCMD_START)
 	{
 		InObj->ObjectPID = LaunchPID; /*Save our PID.*/
-#ifndef NOSHELL		
+		
 		if (!ShellDissolves)
 		{
 			++InObj->ObjectPID; /*This probably won't always work, but 99.9999999% of the time, yes, it will.*/
 		}
-#endif
 		if (InObj->Opts.IsService)
 		{ /*If we specify that this is a service, one up the PID again.*/
 			++InObj->ObjectPID;
@@ -355,7 +373,9 @@ static rStatus ExecuteConfigObject(ObjTable *InObj, const char *CurCmd)
 		if (InObj->Opts.Fork) ++InObj->ObjectPID;
 #endif		
 		/*Check if the PID we found is accurate and update it if not. This method is very,
-		 * very accurate compared to the buggy morass above.*/
+		 * very accurate compared to the buggy morass above.
+		 * Anything held from before we launched doesn't have it, so toss that first.*/
+		ProcScan_Invalidate();
 		AdvancedPIDFind(InObj, true);
 	}
 	
@@ -378,6 +398,41 @@ static rStatus ExecuteConfigObject(ObjTable *InObj, const char *CurCmd)
 	return ExitStatus;
 }
 
+static rStatus ExecuteConfigObject(ObjTable *InObj, const char *CurCmd, unsigned char CmdKind)
+{ /*Runs a command and waits for it, the way everything did before jobs.c.*/
+	unsigned long LaunchPID;
+	int RawExitStatus = 0;
+	Bool ShellDissolves = true;
+	
+	if (!(LaunchPID = LaunchObjectCommand(InObj, CurCmd, CmdKind, &ShellDissolves)))
+	{
+		return FAILURE;
+	}
+	
+	CurrentTask.Node = InObj;
+	CurrentTask.TaskName = InObj->ObjectID;
+	CurrentTask.PID = LaunchPID;
+	CurrentTask.Set = true;
+	
+	if (InObj->Opts.CaptureStdout || InObj->Opts.CaptureStderr)
+	{ /*It could fill the pipe and wait on us while we wait on it, so keep reading.*/
+		while (waitpid(LaunchPID, &RawExitStatus, WNOHANG) == 0) Capture_Service(50);
+		
+		Capture_Service(0); /*So what it said goes in before how it went.*/
+	}
+	else
+	{
+		waitpid(LaunchPID, &RawExitStatus, 0); /*Wait for the process to exit.*/
+	}
+
+	CurrentTask.Set = false;
+	CurrentTask.Node = NULL;
+	CurrentTask.TaskName = NULL;
+	CurrentTask.PID = 0; /*Set back to zero for the next one.*/
+	
+	return CompleteObjectCommand(InObj, CmdKind, LaunchPID, RawExitStatus, ShellDissolves);
+}
+
 rStatus ProcessConfigObject(ObjTable *CurObj, Bool IsStartingMode, Bool PrintStatus)
 {
 	char PrintOutStream[1024];
@@ -465,10 +520,10 @@ rStatus ProcessConfigObject(ObjTable *CurObj, Bool IsStartingMode, Bool PrintSta
 			
 		if (CurObj->ObjectPrestartCommand != NULL)
 		{
-			PrestartExitStatus = ExecuteConfigObject(CurObj, CurObj->ObjectPrestartCommand);
+			PrestartExitStatus = ExecuteConfigObject(CurObj, CurObj->ObjectPrestartCommand, OBJCMD_PRESTART);
 		}
 		
-		ExitStatus = ExecuteConfigObject(CurObj, CurObj->ObjectStartCommand);
+		ExitStatus = ExecuteConfigObject(CurObj, CurObj->ObjectStartCommand, OBJCMD_START);
 		
 		if (PrestartExitStatus != SUCCESS && ExitStatus)
 		{
@@ -521,6 +576,7 @@ rStatus ProcessConfigObject(ObjTable *CurObj, Bool IsStartingMode, Bool PrintSta
 		if (ExitStatus)
 		{
 			CurObj->StartedSince = time(NULL);
+			Events_Emit(EVENT_READY, CurObj->ObjectID, (long)CurObj->ObjectPID);
 		}
 		
 		if (PrintStatus)
@@ -545,7 +601,7 @@ rStatus ProcessConfigObject(ObjTable *CurObj, Bool IsStartingMode, Bool PrintSta
 					RenderStatusReport(PrintOutStream);
 				}
 				
-				ExitStatus = ExecuteConfigObject(CurObj, CurObj->ObjectStopCommand);
+				ExitStatus = ExecuteConfigObject(CurObj, CurObj->ObjectStopCommand, OBJCMD_STOP);
 				
 				if (!CurObj->Opts.NoStopWait)
 				{
@@ -765,6 +821,8 @@ rStatus ProcessConfigObject(ObjTable *CurObj, Bool IsStartingMode, Bool PrintSta
 			}
 		}
 		
+		if (ExitStatus) Events_Emit(EVENT_STOPPED, CurObj->ObjectID, 0);
+		
 		/*Now that the object is stopped, we should reset the autorestart to it's previous state.*/
 		CurObj->Opts.AutoRestart = LastAutoRestartState;
 	}
@@ -812,7 +870,9 @@ rStatus RunAllObjects(Bool IsStartingMode)
 			
 			if ((IsStartingMode ? !CurObj->Started : CurObj->Started))
 			{
+				Log_SetObject(CurObj->ObjectID);
 				ProcessConfigObject(CurObj, IsStartingMode, true);
+				Log_SetObject(NULL);
 			}
 		}
 	}
@@ -848,7 +908,7 @@ rStatus ProcessReloadCommand(ObjTable *CurObj, Bool PrintStatus)
 	}
 	else
 	{
-		RetVal = ExecuteConfigObject(CurObj, CurObj->ObjectReloadCommand);
+		RetVal = ExecuteConfigObject(CurObj, CurObj->ObjectReloadCommand, OBJCMD_RELOAD);
 	}
 	
 	if (PrintStatus)
@@ -858,67 +918,3 @@ rStatus ProcessReloadCommand(ObjTable *CurObj, Bool PrintStatus)
 	
 	return RetVal;
 }
-
-rStatus SwitchRunlevels(const char *Runlevel)
-{
-	unsigned long NumInRunlevel = 0, CurPriority = 1, MaxPriority;
-	ObjTable *TObj = ObjectTable;
-	ObjTable *LastNode = NULL;
-	/*Check the runlevel has objects first.*/
-	
-	for (; TObj->Next != NULL; TObj = TObj->Next)
-	{ /*I think a while loop would look much better, but if I did that,
-		* I'd get folks asking "why didn't you use a for loop?", so here!*/
-		if (!TObj->Opts.HaltCmdOnly && ObjRL_CheckRunlevel(Runlevel, TObj, true) &&
-			TObj->Enabled && TObj->ObjectStartPriority > 0)
-		{
-			++NumInRunlevel;
-		}
-	}
-	
-	if (NumInRunlevel == 0)
-	{
-		return FAILURE;
-	}
-	
-	/*Stop everything not meant for this runlevel.*/
-	for (MaxPriority = GetHighestPriority(false); CurPriority <= MaxPriority; ++CurPriority)
-	{
-		for (LastNode = NULL; (TObj = GetObjectByPriority(CurRunlevel, LastNode, false, CurPriority)); LastNode = TObj)
-		{
-			if (TObj == (void*)-1)
-			{
-				return FAILURE;
-			}
-			
-			if (TObj->Started && !TObj->Opts.Persistent && !TObj->Opts.HaltCmdOnly &&
-				!ObjRL_CheckRunlevel(Runlevel, TObj, true))
-			{
-				ProcessConfigObject(TObj, false, true);
-			}
-		}
-	}
-	
-	/*Good to go, so change us to the new runlevel.*/
-	snprintf(CurRunlevel, MAX_DESCRIPT_SIZE, "%s", Runlevel);
-	MaxPriority = GetHighestPriority(true);
-	
-	/*Now start the things that ARE meant for our runlevel.*/
-	for (CurPriority = 1; CurPriority <= MaxPriority; ++CurPriority)
-	{
-		for (LastNode = NULL; (TObj = GetObjectByPriority(CurRunlevel, LastNode, true, CurPriority)); LastNode = TObj)
-		{
-			if (TObj == (void*)-1)
-			{
-				return FAILURE;
-			}
-			
-			if (TObj->Enabled && !TObj->Started)
-			{
-				ProcessConfigObject(TObj, true, true);
-			}
-		}
-	}
-	
-	return SUCCESS;
-}
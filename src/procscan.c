@@ -0,0 +1,260 @@
+/*This code is part of the Epoch Init System.
+* The Epoch Init System is maintained by Subsentient.
+* This software is public domain.
+* Please read the file UNLICENSE.TXT for more information.*/
+
+/**This file takes snapshots of /proc, so finding PIDs for lots of objects doesn't mean
+ * walking /proc and opening every cmdline once per object. A snapshot is every process's
+ * PID and command line, sorted by command line so all the processes starting with
+ * some prefix sit together and a binary search finds them.
+ * Normally a snapshot is taken for one lookup and thrown away. Between ProcScan_Hold()
+ * and ProcScan_Unhold(), the first lookup takes one and the rest reuse it.
+ * The shutdown kill phase holds one too, and goes through every process in it.**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include "epoch.h"
+
+#define PROCSCAN_DIRBUF_SIZE 32768
+
+struct _LinuxDirent64
+{ /*What getdents64 fills our buffer with. glibc doesn't give us this one,
+	* and C89 has no long long, so the 64 bit inode and offset are just bytes to us.*/
+	unsigned char d_ino_off[16];
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[1];
+};
+
+static struct _ProcEntry
+{
+	unsigned long PID;
+	unsigned long Offset; /*Into ProcText.*/
+	unsigned long Length;
+} *ProcEntries;
+
+static unsigned long ProcCount, ProcAlloc;
+static char *ProcText;
+static unsigned long ProcTextUsed, ProcTextAlloc;
+static Bool ProcTaken, ProcHeld;
+
+static int ProcScan_Compare(const void *First_, const void *Second_)
+{
+	const struct _ProcEntry *First = First_, *Second = Second_;
+	const unsigned long Shortest = First->Length < Second->Length ? First->Length : Second->Length;
+	int Result = memcmp(ProcText + First->Offset, ProcText + Second->Offset, Shortest);
+	
+	if (Result != 0) return Result;
+	if (First->Length != Second->Length) return First->Length < Second->Length ? -1 : 1;
+	
+	return First->PID < Second->PID ? -1 : First->PID > Second->PID;
+}
+
+static Bool ProcScan_ReadCmdLine(int ProcFD, const char *PIDName, unsigned long PID)
+{ /*Adds one process. False only if we ran out of memory.*/
+	char FileName[64];
+	struct _ProcEntry *Entry = NULL;
+	long Got;
+	unsigned long Inc;
+	int Descriptor;
+	
+	snprintf(FileName, sizeof FileName, "%s/cmdline", PIDName);
+	
+	if ((Descriptor = openat(ProcFD, FileName, O_RDONLY | O_CLOEXEC)) == -1)
+	{ /*It probably just exited.*/
+		return true;
+	}
+	
+	if (ProcCount == ProcAlloc)
+	{
+		const unsigned long NewAlloc = ProcAlloc ? ProcAlloc * 2 : 256;
+		void *NewEntries = realloc(ProcEntries, NewAlloc * sizeof(struct _ProcEntry));
+		
+		if (!NewEntries) goto Fail;
+		
+		ProcEntries = NewEntries;
+		ProcAlloc = NewAlloc;
+	}
+	
+	if (ProcTextAlloc - ProcTextUsed < MAX_LINE_SIZE)
+	{
+		const unsigned long NewAlloc = ProcTextAlloc ? ProcTextAlloc * 2 : MAX_LINE_SIZE * 64;
+		void *NewText = realloc(ProcText, NewAlloc);
+		
+		if (!NewText) goto Fail;
+		
+		ProcText = NewText;
+		ProcTextAlloc = NewAlloc;
+	}
+	
+	Entry = ProcEntries + ProcCount;
+	Entry->PID = PID;
+	Entry->Offset = ProcTextUsed;
+	Entry->Length = 0;
+	
+	/*Same as it always was, the first MAX_LINE_SIZE - 1 bytes are all we look at.*/
+	while (Entry->Length < MAX_LINE_SIZE - 1 &&
+			(Got = read(Descriptor, ProcText + ProcTextUsed + Entry->Length, MAX_LINE_SIZE - 1 - Entry->Length)) > 0)
+	{
+		Entry->Length += Got;
+	}
+	
+	close(Descriptor);
+	
+	for (Inc = 0; Inc < Entry->Length; ++Inc)
+	{ /*The arguments are separated by NULs, and we want spaces.*/
+		if (ProcText[ProcTextUsed + Inc] == '\0') ProcText[ProcTextUsed + Inc] = ' ';
+	}
+	
+	ProcTextUsed += Entry->Length;
+	++ProcCount;
+	
+	return true;
+	
+Fail:
+	close(Descriptor);
+	return false;
+}
+
+static rStatus ProcScan_Take(void)
+{
+	char *DirBuf = NULL;
+	struct _LinuxDirent64 *DirPtr = NULL;
+	long Got, Inc;
+	int ProcFD;
+	
+	ProcCount = ProcTextUsed = 0;
+	
+	if ((ProcFD = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+	{
+		return FAILURE;
+	}
+	
+	if (!(DirBuf = malloc(PROCSCAN_DIRBUF_SIZE)))
+	{
+		close(ProcFD);
+		return FAILURE;
+	}
+	
+	while ((Got = syscall(SYS_getdents64, ProcFD, DirBuf, PROCSCAN_DIRBUF_SIZE)) > 0)
+	{
+		for (Inc = 0; Inc < Got; Inc += DirPtr->d_reclen)
+		{
+			DirPtr = (struct _LinuxDirent64*)(DirBuf + Inc);
+			
+			if (!AllNumeric(DirPtr->d_name)) continue;
+			
+			if (!ProcScan_ReadCmdLine(ProcFD, DirPtr->d_name, strtoul(DirPtr->d_name, NULL, 10)))
+			{
+				free(DirBuf);
+				close(ProcFD);
+				return FAILURE;
+			}
+		}
+	}
+	
+	free(DirBuf);
+	close(ProcFD);
+	
+	if (Got < 0) return FAILURE;
+	
+	qsort(ProcEntries, ProcCount, sizeof(struct _ProcEntry), ProcScan_Compare);
+	ProcTaken = true;
+	
+	return SUCCESS;
+}
+
+static void ProcScan_Release(void)
+{
+	free(ProcEntries);
+	free(ProcText);
+	
+	ProcEntries = NULL;
+	ProcText = NULL;
+	ProcCount = ProcAlloc = ProcTextUsed = ProcTextAlloc = 0;
+	ProcTaken = false;
+}
+
+void ProcScan_Hold(void)
+{
+	ProcHeld = true;
+}
+
+void ProcScan_Invalidate(void)
+{ /*For when whatever's held is out of date, like right after we launch something.
+	* The next lookup takes a new one, and that's held too if this was.*/
+	if (ProcTaken) ProcScan_Release();
+}
+
+void ProcScan_Unhold(void)
+{
+	ProcHeld = false;
+	ProcScan_Invalidate();
+}
+
+rStatus ProcScan_Snapshot(void)
+{ /*Makes sure there's one to go through. Only makes sense while held.*/
+	if (ProcTaken) return SUCCESS;
+	
+	if (!ProcScan_Take())
+	{
+		ProcScan_Release();
+		return FAILURE;
+	}
+	
+	return SUCCESS;
+}
+
+unsigned long ProcScan_Count(void)
+{
+	return ProcCount;
+}
+
+unsigned long ProcScan_Entry(unsigned long Index, const char **CmdLine, unsigned long *Length)
+{ /*The PID of one process in the snapshot, with its command line, which isn't NUL terminated.*/
+	if (Index >= ProcCount) return 0;
+	
+	*CmdLine = ProcText + ProcEntries[Index].Offset;
+	*Length = ProcEntries[Index].Length;
+	
+	return ProcEntries[Index].PID;
+}
+
+unsigned long ProcScan_Find(const char *Prefix, unsigned long MinPID)
+{ /*Returns the lowest PID at or above MinPID whose command line starts with Prefix, or zero.*/
+	const unsigned long PrefixLen = strlen(Prefix);
+	unsigned long Low = 0, High, Inc, Found = 0;
+	int Result;
+	
+	if (!ProcScan_Snapshot()) return 0;
+	
+	/*Find the first entry that doesn't sort before Prefix.*/
+	for (High = ProcCount; Low < High; )
+	{
+		const struct _ProcEntry *const Entry = ProcEntries + (Low + High) / 2;
+		
+		Result = memcmp(ProcText + Entry->Offset, Prefix, Entry->Length < PrefixLen ? Entry->Length : PrefixLen);
+		
+		if (Result < 0 || (Result == 0 && Entry->Length < PrefixLen)) Low = (Low + High) / 2 + 1;
+		else High = (Low + High) / 2;
+	}
+	
+	/*Everything starting with Prefix is right here, together.*/
+	for (Inc = Low; Inc < ProcCount && ProcEntries[Inc].Length >= PrefixLen &&
+		!memcmp(ProcText + ProcEntries[Inc].Offset, Prefix, PrefixLen); ++Inc)
+	{
+		if (ProcEntries[Inc].PID >= MinPID && (!Found || ProcEntries[Inc].PID < Found))
+		{
+			Found = ProcEntries[Inc].PID;
+		}
+	}
+	
+	if (!ProcHeld) ProcScan_Release();
+	
+	return Found;
+}
@@ -0,0 +1,404 @@
+/*This code is part of the Epoch Init System.
+* The Epoch Init System is maintained by Subsentient.
+* This software is public domain.
+* Please read the file UNLICENSE.TXT for more information.*/
+
+/**This file is a small syslog daemon that lives in the primary loop, for "SyslogReceiver true".
+ * We bind /dev/log ourselves, take datagrams off it a batch at a time with recvmmsg(),
+ * work out the priority and the program's tag from RFC 3164 or RFC 5424 framing,
+ * and log the message under the tag, the same way as captured object output.
+ * SyslogFacilities and SyslogSeverity say what's kept, and SyslogRateLimit
+ * stops one chatty program from drowning out the rest.**/
+
+#define _GNU_SOURCE /*For recvmmsg().*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "epoch.h"
+
+#define SYSLOG_TAG_SIZE 48
+#define SYSLOG_DEFAULT_PRI 13 /*user.notice, what syslog(3) uses when nobody says.*/
+
+static struct _SyslogRate
+{ /*Per tag. When they're all taken, the one idle longest gets reused.*/
+	char Tag[SYSLOG_TAG_SIZE];
+	unsigned long WindowStart;
+	unsigned long WindowMessages;
+	unsigned long Suppressed;
+} Rates[SYSLOG_RATE_SLOTS];
+
+static const char *const FacilityNames[] = { "kern", "user", "mail", "daemon", "auth", "syslog", "lpr", "news",
+											"uucp", "cron", "authpriv", "ftp", "ntp", "security", "console",
+											"solaris-cron", "local0", "local1", "local2", "local3", "local4",
+											"local5", "local6", "local7" };
+
+static const char *const SeverityNames[] = { "emerg", "alert", "crit", "err", "warning", "notice", "info", "debug" };
+
+static int SyslogDescriptor = -1;
+static Bool SyslogFailed; /*So we don't try to bind every trip through the loop after it didn't work.*/
+
+Bool SyslogReceiver;
+unsigned char SyslogSeverity = LOGSEV_INFO;
+unsigned long SyslogFacilities = SYSLOG_ALL_FACILITIES, SyslogRateLimit = SYSLOG_DEFAULT_RATE;
+
+Bool Syslog_ParseSeverity(const char *Name, unsigned char *Out)
+{
+	unsigned long Inc = 0;
+	
+	if (AllNumeric(Name) && strtoul(Name, NULL, 10) <= LOGSEV_DEBUG)
+	{
+		*Out = (unsigned char)strtoul(Name, NULL, 10);
+		return true;
+	}
+	
+	for (; Inc < sizeof SeverityNames / sizeof *SeverityNames; ++Inc)
+	{
+		if (!strcmp(Name, SeverityNames[Inc]))
+		{
+			*Out = (unsigned char)Inc;
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+Bool Syslog_ParseFacilities(const char *List, unsigned long *Out)
+{ /*Facility names separated by spaces or commas, or "all". Out is a bitmask of facility numbers.*/
+	char Copy[MAX_LINE_SIZE], *Word = NULL;
+	unsigned long Inc, Mask = 0;
+	
+	snprintf(Copy, sizeof Copy, "%s", List);
+	
+	for (Word = strtok(Copy, " ,\t"); Word; Word = strtok(NULL, " ,\t"))
+	{
+		if (!strcmp(Word, "all"))
+		{
+			Mask = SYSLOG_ALL_FACILITIES;
+			continue;
+		}
+		
+		for (Inc = 0; Inc < sizeof FacilityNames / sizeof *FacilityNames && strcmp(Word, FacilityNames[Inc]) != 0; ++Inc);
+		
+		if (Inc == sizeof FacilityNames / sizeof *FacilityNames) return false;
+		
+		Mask |= 1ul << Inc;
+	}
+	
+	if (!Mask) return false;
+	
+	*Out = Mask;
+	return true;
+}
+
+static rStatus Syslog_Init(void)
+{
+	struct sockaddr_un Addr;
+	struct stat FileStat;
+	
+	memset(&Addr, 0, sizeof Addr);
+	Addr.sun_family = AF_UNIX;
+	snprintf(Addr.sun_path, sizeof Addr.sun_path, "%s", SYSLOG_SOCKET);
+	
+	if ((SyslogDescriptor = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1) return FAILURE;
+	
+	/*A stale socket from before a crash, or someone else's. Either way, we were told it's ours.*/
+	if (lstat(SYSLOG_SOCKET, &FileStat) == 0 && S_ISSOCK(FileStat.st_mode)) unlink(SYSLOG_SOCKET);
+	
+	if (bind(SyslogDescriptor, (struct sockaddr*)&Addr, sizeof Addr) == -1)
+	{
+		close(SyslogDescriptor);
+		SyslogDescriptor = -1;
+		return FAILURE;
+	}
+	
+	chmod(SYSLOG_SOCKET, 0666); /*Everybody gets to log.*/
+	
+	return SUCCESS;
+}
+
+static void Syslog_ReportSuppressed(struct _SyslogRate *Rate)
+{
+	char OutBuf[MAX_LINE_SIZE];
+	
+	snprintf(OutBuf, sizeof OutBuf, "SYSLOG: " CONSOLE_COLOR_YELLOW "Suppressed %lu messages from \"%s\", "
+			"it went over SyslogRateLimit." CONSOLE_ENDCOLOR, Rate->Suppressed, Rate->Tag);
+	WriteLogLine(OutBuf, true);
+	
+	Rate->Suppressed = 0;
+}
+
+void Syslog_Shutdown(void)
+{
+	unsigned long Inc = 0;
+	
+	if (SyslogDescriptor == -1) return;
+	
+	for (; Inc < SYSLOG_RATE_SLOTS; ++Inc)
+	{
+		if (Rates[Inc].Suppressed) Syslog_ReportSuppressed(&Rates[Inc]);
+	}
+	
+	close(SyslogDescriptor);
+	SyslogDescriptor = -1;
+	unlink(SYSLOG_SOCKET);
+}
+
+static Bool Syslog_Admit(const char *Tag, unsigned long Now)
+{
+	struct _SyslogRate *Rate = NULL, *Oldest = Rates;
+	unsigned long Inc = 0;
+	
+	if (!SyslogRateLimit) return true;
+	
+	for (; Inc < SYSLOG_RATE_SLOTS; ++Inc)
+	{
+		if (!strcmp(Rates[Inc].Tag, Tag))
+		{
+			Rate = &Rates[Inc];
+			break;
+		}
+		
+		if (Rates[Inc].WindowStart < Oldest->WindowStart) Oldest = &Rates[Inc];
+	}
+	
+	if (!Rate)
+	{
+		Rate = Oldest;
+		snprintf(Rate->Tag, sizeof Rate->Tag, "%s", Tag);
+		Rate->WindowStart = Now;
+		Rate->WindowMessages = Rate->Suppressed = 0;
+	}
+	
+	if (Rate->WindowStart != Now)
+	{
+		if (Rate->Suppressed) Syslog_ReportSuppressed(Rate);
+		
+		Rate->WindowStart = Now;
+		Rate->WindowMessages = 0;
+	}
+	
+	if (Rate->WindowMessages >= SyslogRateLimit)
+	{
+		++Rate->Suppressed;
+		return false;
+	}
+	
+	++Rate->WindowMessages;
+	return true;
+}
+
+static const char *Syslog_Word(const char *Worker, const char *End, const char **WordEnd)
+{ /*One space separated field of an RFC 5424 header. Returns where the next starts, or NULL if it ran out.*/
+	const char *Space = memchr(Worker, ' ', End - Worker);
+	
+	if (!Space) return NULL;
+	
+	*WordEnd = Space;
+	return Space + 1;
+}
+
+static const char *Syslog_Parse5424(const char *Worker, const char *End, char *Tag)
+{ /*Worker is just past "<PRI>1 ". TIMESTAMP HOSTNAME APP-NAME PROCID MSGID STRUCTURED-DATA MSG.
+	* Returns the start of MSG, or NULL if it isn't laid out like that.*/
+	const char *WordEnd = NULL, *AppName = NULL;
+	unsigned long Inc = 0;
+	Bool Quoted = false;
+	
+	for (; Inc < 5; ++Inc)
+	{
+		if (Inc == 2) AppName = Worker;
+		if (!(Worker = Syslog_Word(Worker, End, &WordEnd))) return NULL;
+		if (Inc == 2 && !(WordEnd - AppName == 1 && *AppName == '-'))
+		{
+			snprintf(Tag, SYSLOG_TAG_SIZE, "%.*s", (int)(WordEnd - AppName), AppName);
+		}
+	}
+	
+	if (Worker < End && *Worker == '-')
+	{
+		++Worker;
+	}
+	else
+	{ /*[id param="value"]... Values can have escaped quotes and brackets in them.*/
+		while (Worker < End && *Worker == '[')
+		{
+			for (++Worker; Worker < End && (Quoted || *Worker != ']'); ++Worker)
+			{
+				if (*Worker == '\\' && Worker + 1 < End) ++Worker;
+				else if (*Worker == '"') Quoted = !Quoted;
+			}
+			
+			if (Worker < End) ++Worker;
+		}
+	}
+	
+	if (Worker < End && *Worker == ' ') ++Worker;
+	
+	/*A UTF-8 byte order mark is allowed in front.*/
+	if (End - Worker >= 3 && !memcmp(Worker, "\xEF\xBB\xBF", 3)) Worker += 3;
+	
+	return Worker;
+}
+
+static const char *Syslog_Parse3164(const char *Worker, const char *End, char *Tag)
+{ /*Mmm dd hh:mm:ss TAG[pid]: MSG. What syslog(3) sends. The timestamp is ours anyway, so it's skipped.*/
+	const char *TagStart = NULL;
+	
+	if (End - Worker >= 16 && Worker[3] == ' ' && Worker[6] == ' ' && Worker[9] == ':' && Worker[12] == ':' &&
+		Worker[15] == ' ')
+	{
+		Worker += 16;
+	}
+	
+	for (TagStart = Worker; Worker < End && Worker - TagStart < SYSLOG_TAG_SIZE - 1 &&
+		(isalnum((unsigned char)*Worker) || (*Worker && strchr("-_./", *Worker))); ++Worker);
+	
+	if (Worker == TagStart || Worker == End || (*Worker != ':' && *Worker != '['))
+	{ /*No tag we can see.*/
+		return TagStart;
+	}
+	
+	snprintf(Tag, SYSLOG_TAG_SIZE, "%.*s", (int)(Worker - TagStart), TagStart);
+	
+	if (*Worker == '[')
+	{ /*The PID. We log under the program, so "epoch log" finds all of it.*/
+		const char *Bracket = memchr(Worker, ']', End - Worker);
+		
+		if (Bracket) Worker = Bracket + 1;
+	}
+	
+	if (Worker < End && *Worker == ':') ++Worker;
+	if (Worker < End && *Worker == ' ') ++Worker;
+	
+	return Worker;
+}
+
+static void Syslog_Message(const char *Data, unsigned long Length, unsigned long Now)
+{
+	const char *Worker = Data, *End = Data + Length;
+	char Tag[SYSLOG_TAG_SIZE] = "syslog";
+	unsigned long Priority = SYSLOG_DEFAULT_PRI;
+	
+	/*Some senders put a newline or a NUL on the end.*/
+	while (End > Worker && (End[-1] == '\n' || End[-1] == '\0' || End[-1] == '\r')) --End;
+	
+	if (Worker < End && *Worker == '<')
+	{
+		const char *Digits = ++Worker;
+		
+		for (Priority = 0; Worker < End && Worker - Digits < 3 && isdigit((unsigned char)*Worker); ++Worker)
+		{
+			Priority = Priority * 10 + (*Worker - '0');
+		}
+		
+		if (Worker == End || *Worker != '>' || Worker == Digits || Priority > 191)
+		{ /*Not a priority after all.*/
+			Worker = Data;
+			Priority = SYSLOG_DEFAULT_PRI;
+		}
+		else ++Worker;
+	}
+	
+	if ((Priority & 7) > SyslogSeverity || !(SyslogFacilities & (1ul << (Priority >> 3)))) return;
+	
+	if (End - Worker >= 2 && Worker[0] == '1' && Worker[1] == ' ')
+	{
+		const char *Message = Syslog_Parse5424(Worker + 2, End, Tag);
+		
+		Worker = Message ? Message : Worker;
+	}
+	else
+	{
+		Worker = Syslog_Parse3164(Worker, End, Tag);
+	}
+	
+	if (!Syslog_Admit(Tag, Now)) return;
+	
+	WriteObjectLogLine(Tag, (unsigned char)(Priority & 7), Worker, End - Worker);
+}
+
+void Syslog_Service(void)
+{ /*Up to SYSLOG_BATCH datagrams per recvmmsg(), and a few of those per trip, so a flood can't keep us here.*/
+	static char Buffers[SYSLOG_BATCH][SYSLOG_MAX_DATAGRAM];
+	struct mmsghdr Messages[SYSLOG_BATCH];
+	struct iovec Vectors[SYSLOG_BATCH];
+	unsigned long Inc, Rounds = 0;
+	const unsigned long Now = time(NULL);
+	int Received;
+	
+	if (!SyslogReceiver)
+	{
+		SyslogFailed = false;
+		Syslog_Shutdown();
+		return;
+	}
+	
+	if (SyslogDescriptor == -1)
+	{
+		if (SyslogFailed) return;
+		
+		if (!Syslog_Init())
+		{
+			const char *ErrMsg = "Failed to bind \"" SYSLOG_SOCKET "\". The built in syslog receiver won't work.";
+			
+			SyslogFailed = true;
+			SpitWarning(ErrMsg);
+			WriteLogLine(ErrMsg, true);
+			return;
+		}
+	}
+	
+	for (Inc = 0; Inc < SYSLOG_RATE_SLOTS; ++Inc)
+	{ /*Quiet since they went over the limit, so they won't send anything to trigger the note.*/
+		if (Rates[Inc].Suppressed && Rates[Inc].WindowStart != Now) Syslog_ReportSuppressed(&Rates[Inc]);
+	}
+	
+	do
+	{
+		memset(Messages, 0, sizeof Messages);
+		
+		for (Inc = 0; Inc < SYSLOG_BATCH; ++Inc)
+		{
+			Vectors[Inc].iov_base = Buffers[Inc];
+			Vectors[Inc].iov_len = sizeof Buffers[Inc];
+			Messages[Inc].msg_hdr.msg_iov = &Vectors[Inc];
+			Messages[Inc].msg_hdr.msg_iovlen = 1;
+		}
+		
+		if ((Received = recvmmsg(SyslogDescriptor, Messages, SYSLOG_BATCH, MSG_DONTWAIT, NULL)) <= 0) return;
+		
+		for (Inc = 0; Inc < (unsigned long)Received; ++Inc)
+		{
+			Syslog_Message(Buffers[Inc], Messages[Inc].msg_len, Now);
+		}
+	} while (Received == SYSLOG_BATCH && ++Rounds < SYSLOG_MAX_ROUNDS);
+}
+
+void Syslog_SaveState(struct _RXDState *State)
+{ /*For reexec. Whatever's queued on the socket stays there for the new image.*/
+	int Descriptor;
+	
+	if (SyslogDescriptor == -1 || (Descriptor = RXD_AddDescriptor(State, SyslogDescriptor)) == -1) return;
+	
+	RXD_Append(State, RXD_REC_SYSLOG, &Descriptor, sizeof(int));
+}
+
+rStatus Syslog_RestoreState(const void *Data, unsigned long Length)
+{
+	if (Length != sizeof(int)) return FAILURE;
+	
+	memcpy(&SyslogDescriptor, Data, sizeof(int));
+	fcntl(SyslogDescriptor, F_SETFD, FD_CLOEXEC);
+	
+	return SUCCESS;
+}
@@ -0,0 +1,276 @@
+/*This code is part of the Epoch Init System.
+* The Epoch Init System is maintained by Subsentient.
+* This software is public domain.
+* Please read the file UNLICENSE.TXT for more information.*/
+
+/**This file keeps the last few kilobytes each object printed, and how it exited,
+ * so "epoch tail" can show why something died without anyone digging through logs.
+ * Each object gets a ring of TailBufferSize bytes the first time it says something.
+ * All of them together stay under TailMemoryLimit. When a new one won't fit, the least
+ * recently used buffer of an object that isn't running goes. If none can go, the new one
+ * doesn't get made. TailBufferSize 0 turns it all off and frees what we had.**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "epoch.h"
+
+static struct _TailBuffer
+{
+	struct _TailBuffer *Next; /*The list is kept most recently used first.*/
+	char ObjectID[MAX_DESCRIPT_SIZE];
+	unsigned long Size; /*Of Data, which follows this struct in the same allocation.*/
+	unsigned long Head; /*Where the oldest byte is.*/
+	unsigned long Used;
+	char *Data;
+} *TailList;
+
+static unsigned long TailTotal; /*Bytes all the buffers take, headers included.*/
+
+unsigned long TailBufferSize = TAIL_DEFAULT_SIZE, TailMemoryLimit = TAIL_DEFAULT_LIMIT;
+
+static void Tail_Release(void)
+{
+	struct _TailBuffer *Next = NULL;
+	
+	for (; TailList; TailList = Next)
+	{
+		Next = TailList->Next;
+		free(TailList);
+	}
+	
+	TailTotal = 0;
+}
+
+static struct _TailBuffer *Tail_Find(const char *ObjectID)
+{ /*Moves it to the front, since whoever asks is about to use it.*/
+	struct _TailBuffer *Worker = TailList, *Prev = NULL;
+	
+	for (; Worker; Prev = Worker, Worker = Worker->Next)
+	{
+		if (strcmp(Worker->ObjectID, ObjectID) != 0) continue;
+		
+		if (Prev)
+		{
+			Prev->Next = Worker->Next;
+			Worker->Next = TailList;
+			TailList = Worker;
+		}
+		
+		return Worker;
+	}
+	
+	return NULL;
+}
+
+static Bool Tail_Evict(void)
+{ /*Frees the least recently used buffer of an object that isn't running.*/
+	struct _TailBuffer *Worker = TailList, *Prev = NULL, *Victim = NULL, *VictimPrev = NULL;
+	const ObjTable *CurObj = NULL;
+	
+	for (; Worker; Prev = Worker, Worker = Worker->Next)
+	{
+		if ((CurObj = LookupObjectInTable(Worker->ObjectID)) && CurObj->Started) continue;
+		
+		Victim = Worker;
+		VictimPrev = Prev;
+	}
+	
+	if (!Victim) return false;
+	
+	if (VictimPrev) VictimPrev->Next = Victim->Next;
+	else TailList = Victim->Next;
+	
+	TailTotal -= sizeof(struct _TailBuffer) + Victim->Size;
+	free(Victim);
+	
+	return true;
+}
+
+static struct _TailBuffer *Tail_New(const char *ObjectID, unsigned long Size, Bool AtFront)
+{
+	struct _TailBuffer *Buffer = NULL, *Worker = NULL;
+	const unsigned long Total = sizeof(struct _TailBuffer) + Size;
+	
+	while (TailTotal + Total > TailMemoryLimit)
+	{
+		if (!Tail_Evict()) return NULL;
+	}
+	
+	if (!(Buffer = malloc(Total))) return NULL;
+	
+	snprintf(Buffer->ObjectID, sizeof Buffer->ObjectID, "%s", ObjectID);
+	Buffer->Size = Size;
+	Buffer->Head = Buffer->Used = 0;
+	Buffer->Data = (char*)(Buffer + 1);
+	Buffer->Next = NULL;
+	
+	if (AtFront || !TailList)
+	{
+		Buffer->Next = TailList;
+		TailList = Buffer;
+	}
+	else
+	{ /*Reexec restores them in the order they were, so the oldest goes last.*/
+		for (Worker = TailList; Worker->Next; Worker = Worker->Next);
+		Worker->Next = Buffer;
+	}
+	
+	TailTotal += Total;
+	
+	return Buffer;
+}
+
+static void Tail_Write(struct _TailBuffer *Buffer, const char *Data, unsigned long Length)
+{ /*Whole lines drop off the front until it fits. A line bigger than the ring keeps its end.*/
+	unsigned long Start, Chunk;
+	
+	if (Length > Buffer->Size)
+	{
+		Data += Length - Buffer->Size;
+		Length = Buffer->Size;
+	}
+	
+	while (Buffer->Size - Buffer->Used < Length)
+	{ /*Drop the oldest line, newline and all.*/
+		while (Buffer->Used)
+		{
+			const char Dropped = Buffer->Data[Buffer->Head];
+			
+			Buffer->Head = (Buffer->Head + 1) % Buffer->Size;
+			--Buffer->Used;
+			
+			if (Dropped == '\n') break;
+		}
+	}
+	
+	Start = (Buffer->Head + Buffer->Used) % Buffer->Size;
+	Chunk = Buffer->Size - Start < Length ? Buffer->Size - Start : Length;
+	
+	memcpy(Buffer->Data + Start, Data, Chunk);
+	memcpy(Buffer->Data, Data + Chunk, Length - Chunk);
+	Buffer->Used += Length;
+}
+
+static void Tail_Add(const char *ObjectID, const char *Line, unsigned long Length, Bool Create)
+{
+	static time_t LastTime;
+	static char Stamp[16];
+	char OutBuf[MAX_LINE_SIZE + sizeof Stamp + 1];
+	struct _TailBuffer *Buffer = NULL;
+	const time_t Now = time(NULL);
+	unsigned long Total;
+	struct tm TimeStruct;
+	
+	if (!TailBufferSize)
+	{
+		if (TailList) Tail_Release();
+		return;
+	}
+	
+	if (!(Buffer = Tail_Find(ObjectID)) && (!Create || !(Buffer = Tail_New(ObjectID, TailBufferSize, true)))) return;
+	
+	if (Now != LastTime)
+	{
+		LastTime = Now;
+		localtime_r(&Now, &TimeStruct);
+		strftime(Stamp, sizeof Stamp, "%H:%M:%S", &TimeStruct);
+	}
+	
+	if (Length > MAX_LINE_SIZE) Length = MAX_LINE_SIZE;
+	
+	Total = snprintf(OutBuf, sizeof OutBuf, "%s %.*s\n", Stamp, (int)Length, Line);
+	if (Total >= sizeof OutBuf) Total = sizeof OutBuf - 1;
+	
+	Tail_Write(Buffer, OutBuf, Total);
+}
+
+void Tail_Append(const char *ObjectID, const char *Line, unsigned long Length)
+{ /*A line the object printed, without its newline.*/
+	Tail_Add(ObjectID, Line, Length, true);
+}
+
+void Tail_Exited(const char *ObjectID, int RawExitStatus)
+{ /*Only goes in if the object has a buffer already. An exit on it's own isn't worth one.*/
+	char OutBuf[128];
+	unsigned long Length;
+	
+	if (WIFSIGNALED(RawExitStatus))
+	{
+		Length = snprintf(OutBuf, sizeof OutBuf, "-- Killed by signal %d. --", WTERMSIG(RawExitStatus));
+	}
+	else
+	{
+		Length = snprintf(OutBuf, sizeof OutBuf, "-- Exited with status %d. --", WEXITSTATUS(RawExitStatus));
+	}
+	
+	Tail_Add(ObjectID, OutBuf, Length, false);
+}
+
+unsigned long Tail_Read(const char *ObjectID, unsigned long Offset, char *Out, unsigned long OutSize)
+{ /*Copies out up to OutSize bytes, starting Offset bytes into the buffer. Stops after the last newline
+	* that fits, so lines don't get split between reads. Returns how much it copied, zero at the end.*/
+	const struct _TailBuffer *Buffer = TailList;
+	unsigned long Length, Inc = 0;
+	
+	for (; Buffer && strcmp(Buffer->ObjectID, ObjectID) != 0; Buffer = Buffer->Next);
+	
+	if (!Buffer || Offset >= Buffer->Used) return 0;
+	
+	Length = Buffer->Used - Offset < OutSize ? Buffer->Used - Offset : OutSize;
+	
+	for (; Inc < Length; ++Inc)
+	{
+		Out[Inc] = Buffer->Data[(Buffer->Head + Offset + Inc) % Buffer->Size];
+	}
+	
+	if (Offset + Length < Buffer->Used)
+	{ /*Back up to a line boundary if there is one.*/
+		for (Inc = Length; Inc > 0 && Out[Inc - 1] != '\n'; --Inc);
+		if (Inc > 0) Length = Inc;
+	}
+	
+	return Length;
+}
+
+void Tail_SaveState(struct _RXDState *State)
+{ /*For reexec. One record per buffer, most recently used first, with the contents in order.*/
+	const struct _TailBuffer *Buffer = TailList;
+	unsigned long Chunk;
+	
+	for (; Buffer; Buffer = Buffer->Next)
+	{
+		RXD_Append(State, RXD_REC_TAIL, &Buffer->Size, sizeof(long));
+		RXD_Extend(State, Buffer->ObjectID, strlen(Buffer->ObjectID) + 1);
+		
+		Chunk = Buffer->Size - Buffer->Head < Buffer->Used ? Buffer->Size - Buffer->Head : Buffer->Used;
+		RXD_Extend(State, Buffer->Data + Buffer->Head, Chunk);
+		RXD_Extend(State, Buffer->Data, Buffer->Used - Chunk);
+	}
+}
+
+rStatus Tail_RestoreState(const void *Data, unsigned long Length)
+{
+	struct _TailBuffer *Buffer = NULL;
+	const char *ObjectID = (const char*)Data + sizeof(long), *IDEnd = NULL;
+	unsigned long Size, Used;
+	
+	if (Length < sizeof(long) || !TailBufferSize) return FAILURE;
+	
+	memcpy(&Size, Data, sizeof(long));
+	
+	if (!(IDEnd = memchr(ObjectID, '\0', Length - sizeof(long))) || IDEnd - ObjectID >= MAX_DESCRIPT_SIZE ||
+		(Used = (const char*)Data + Length - (IDEnd + 1)) > Size || !Size)
+	{
+		return FAILURE;
+	}
+	
+	if (!(Buffer = Tail_New(ObjectID, Size, false))) return FAILURE;
+	
+	memcpy(Buffer->Data, IDEnd + 1, Used);
+	Buffer->Used = Used;
+	
+	return SUCCESS;
+}
@@ -14,13 +14,38 @@
 #include <unistd.h>
 #include <dirent.h>
 #include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
 #include "epoch.h"
 
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
 /**Constants**/
 Bool EnableLogging = true;
 Bool LogInMemory = true; /*This is necessary so long as we have a readonly filesystem.*/
 Bool BlankLogOnBoot = true;
-char *MemLogBuffer;
+struct _MemLog MemLog = { NULL, NULL, 0, 0, MEMLOG_DEFAULT_LIMIT };
+unsigned char LogSyncPolicy = LOGSYNC_NONE;
+unsigned long LogRotateSize, LogRotateAge; /*Bytes and seconds. Zero means never.*/
+unsigned long LogRotateKeep = LOGROTATE_DEFAULT_KEEP;
+
+/*The log file stays open, and lines wait in LogBuffer until it fills up,
+ * LOG_FLUSH_INTERVAL goes by, or we're going down.*/
+static int LogDescriptor = -1;
+static char LogBuffer[LOG_BUFFER_SIZE];
+static unsigned long LogUsed;
+static time_t LogPendingSince; /*When the oldest line in LogBuffer came in.*/
+static time_t LogOpenedAt; /*When we started on this system.log, for LogRotateAge.*/
+static time_t LogStampTime = -1;
+static char LogStamp[64];
+static Bool LogHooked;
+static char LogObject[MAX_DESCRIPT_SIZE]; /*What the lines going to the log store are about. Empty for Epoch itself.*/
 
 /*Days in the month, for time stuff.*/
 static const unsigned char MDays[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
@@ -43,61 +68,419 @@ Bool AllNumeric(const char *InStream)
 	return true;
 }
 
-rStatus WriteLogLine(const char *InStream, Bool AddDate)
-{ /*This is pretty much the entire logging system.*/
-	FILE *Descriptor = NULL;
-	char Hr[16], Min[16], Sec[16], Month[16], Day[16], Year[16], OBuf[MAX_LINE_SIZE + 64] = { '\0' };
-	static Bool FailedBefore = false;
+unsigned long HashBytes(const char *InStream, unsigned long Length)
+{ /*32-bit FNV-1a. Used for our lookup tables, so it just needs to be quick and spread well.*/
+	unsigned long Hash = 2166136261UL;
+
+	for (; Length > 0; --Length, ++InStream)
+	{
+		Hash ^= (unsigned char)*InStream;
+		Hash = (Hash * 16777619UL) & 0xFFFFFFFFUL;
+	}
+
+	return Hash;
+}
+
+static void Log_ForkChild(void)
+{ /*Those lines are the parent's to write, not ours.*/
+	LogUsed = 0;
+	LogStore_ForkChild();
+}
+
+static void Log_Stamp(time_t Now)
+{ /*Only redone when the second changes. Lines come in bursts, so most of them get it for free.*/
+	struct tm TimeStruct;
 	
-	if (!EnableLogging)
+	if (Now == LogStampTime) return;
+	
+	localtime_r(&Now, &TimeStruct);
+	snprintf(LogStamp, sizeof LogStamp, "[%02d:%02d:%02d | %d-%02d-%02d]", TimeStruct.tm_hour, TimeStruct.tm_min,
+			TimeStruct.tm_sec, TimeStruct.tm_year + 1900, TimeStruct.tm_mon + 1, TimeStruct.tm_mday);
+	LogStampTime = Now;
+}
+
+Bool Log_Open(Bool Truncate)
+{ /*Opens the log file once and keeps it. Truncate empties it, like BlankLogOnBoot wants.*/
+	if (LogDescriptor == -1)
 	{
+		if ((LogDescriptor = open(LOGDIR LOGFILE_NAME, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC | (Truncate ? O_TRUNC : 0), 0666)) == -1)
+		{
+			return false;
+		}
+		
+		time(&LogOpenedAt);
+		
+		if (!LogHooked)
+		{ /*Anything still waiting gets written when a client process exits.*/
+			atexit(Log_Shutdown);
+			pthread_atfork(NULL, NULL, Log_ForkChild);
+			LogHooked = true;
+		}
+	}
+	else if (Truncate)
+	{
+		LogUsed = 0;
+		ftruncate(LogDescriptor, 0);
+	}
+	
+	return true;
+}
+
+static void Log_WriteOut(const char *Data, unsigned long Length)
+{
+	long Ret = 0;
+	
+	while (Length > 0)
+	{
+		if ((Ret = write(LogDescriptor, Data, Length)) > 0)
+		{
+			Data += Ret;
+			Length -= Ret;
+		}
+		else if (Ret == -1 && errno == EINTR) continue;
+		else break; /*Full disk or the like. Nothing we can do but drop it.*/
+	}
+	
+	if (LogSyncPolicy != LOGSYNC_NONE) fsync(LogDescriptor);
+}
+
+void Log_Flush(void)
+{
+	LogStore_Flush();
+	
+	if (!LogUsed || LogDescriptor == -1) return;
+	
+	Log_WriteOut(LogBuffer, LogUsed);
+	LogUsed = 0;
+}
+
+rStatus Log_Write(const char *Data, unsigned long Length)
+{ /*Queues already formatted text. Anything too big to ever fit goes straight out.*/
+	time_t Now;
+	
+	if (!Log_Open(false)) return FAILURE;
+	
+	time(&Now);
+	
+	if (LOG_BUFFER_SIZE - LogUsed < Length) Log_Flush();
+	
+	if (Length > LOG_BUFFER_SIZE)
+	{
+		Log_WriteOut(Data, Length);
 		return SUCCESS;
 	}
 	
-	if (!LogInMemory && !(Descriptor = fopen(LOGDIR LOGFILE_NAME, "a")))
+	if (!LogUsed) LogPendingSince = Now;
+	
+	memcpy(LogBuffer + LogUsed, Data, Length);
+	LogUsed += Length;
+	
+	if (LogSyncPolicy == LOGSYNC_LINE || Now - LogPendingSince >= LOG_FLUSH_INTERVAL) Log_Flush();
+	
+	return SUCCESS;
+}
+
+static void Log_Rotate(time_t Now)
+{ /*Sets system.log aside under a name with the time in it, and starts a new one.
+	* Compressing it and deleting old ones is up to a child, so we don't wait on any of that.*/
+	char NewPath[MAX_LINE_SIZE];
+	struct tm TimeStruct;
+	struct stat FileStat;
+	
+	localtime_r(&Now, &TimeStruct);
+	snprintf(NewPath, sizeof NewPath, LOGDIR LOGFILE_NAME "-%d%02d%02d-%02d%02d%02d", TimeStruct.tm_year + 1900,
+			TimeStruct.tm_mon + 1, TimeStruct.tm_mday, TimeStruct.tm_hour, TimeStruct.tm_min, TimeStruct.tm_sec);
+	
+	if (stat(NewPath, &FileStat) == 0) return; /*Twice in one second. It can wait for the next one.*/
+	
+	Log_Flush();
+	
+	if (rename(LOGDIR LOGFILE_NAME, NewPath) != 0)
+	{ /*Don't try again every pass of the loop.*/
+		LogOpenedAt = Now;
+		return;
+	}
+	
+	close(LogDescriptor);
+	LogDescriptor = -1;
+	
+	if (!Log_Open(false)) return;
+	
+	LogRotate_Spawn();
+}
+
+void Log_Service(void)
+{ /*Called from the primary loop, so a quiet log still gets written within LOG_FLUSH_INTERVAL.
+	* Since that's only ever PID 1, this is also where system.log gets rotated.*/
+	const time_t Now = time(NULL);
+	struct stat FileStat;
+	
+	if (LogUsed && Now - LogPendingSince >= LOG_FLUSH_INTERVAL) Log_Flush();
+	
+	if (LogDescriptor == -1 || (!LogRotateSize && !LogRotateAge) || fstat(LogDescriptor, &FileStat) != 0 ||
+		FileStat.st_size == 0)
 	{
-		if (!FailedBefore)
+		return;
+	}
+	
+	if ((LogRotateSize && (unsigned long)FileStat.st_size + LogUsed >= LogRotateSize) ||
+		(LogRotateAge && Now - LogOpenedAt >= (time_t)LogRotateAge))
+	{
+		Log_Rotate(Now);
+	}
+}
+
+void Log_Shutdown(void)
+{
+	Log_Flush();
+	LogStore_Close();
+	
+	if (LogDescriptor != -1)
+	{
+		close(LogDescriptor);
+		LogDescriptor = -1;
+	}
+}
+
+void Log_SetObject(const char *ObjectID)
+{ /*Lines logged from now on are tagged with ObjectID in the log store, until this is called again with NULL.*/
+	snprintf(LogObject, sizeof LogObject, "%s", ObjectID ? ObjectID : "");
+}
+
+static unsigned long Log_StoreText(char *Out, const char *InStream, unsigned char *Severity)
+{ /*The log store keeps lines without color codes. Those are also how we tell errors and warnings apart.*/
+	char *Worker = Out;
+	
+	*Severity = LOGSEV_INFO;
+	
+	for (; *InStream != '\0' && Worker < Out + MAX_LINE_SIZE - 1; ++InStream)
+	{
+		if (*InStream != '\033')
 		{
-			FailedBefore = true;
-			SpitWarning("Cannot write to log file. Log system is inoperative. Check permissions?");
+			*Worker++ = *InStream;
+			continue;
 		}
 		
-		return FAILURE;
+		if (!strncmp(InStream, CONSOLE_COLOR_RED, sizeof CONSOLE_COLOR_RED - 1)) *Severity = LOGSEV_ERR;
+		else if (!strncmp(InStream, CONSOLE_COLOR_YELLOW, sizeof CONSOLE_COLOR_YELLOW - 1) && *Severity != LOGSEV_ERR)
+		{
+			*Severity = LOGSEV_WARNING;
+		}
+		
+		if (InStream[1] != '[') continue;
+		
+		for (InStream += 2; *InStream != '\0' && !isalpha(*InStream); ++InStream);
+		if (*InStream == '\0') break;
 	}
 	
-	GetCurrentTime(Hr, Min, Sec, Year, Month, Day);
+	while (Worker > Out && Worker[-1] == '\n') --Worker;
 	
-	if (AddDate)
+	*Worker = '\0';
+	return Worker - Out;
+}
+
+static struct _MemLogPage *MemLog_NewPage(void)
+{ /*Past the limit, the oldest page gets reused as the new tail, so the log keeps its newest lines.*/
+	struct _MemLogPage *Page = NULL;
+	
+	if (MemLog.Head && MemLog.Limit && (MemLog.Pages + 1) * MEMLOG_PAGE_SIZE > MemLog.Limit)
 	{
-		snprintf(OBuf, MAX_LINE_SIZE + 64, "[%s:%s:%s | %s-%s-%s] %s\n", Hr, Min, Sec, Year, Month, Day, InStream);
+		Page = MemLog.Head;
+		MemLog.DroppedLines += Page->Lines;
+		MemLog.DroppedBytes += Page->Used;
+		MemLog.Size -= Page->Used;
+		
+		if (!(MemLog.Head = Page->Next)) MemLog.Tail = NULL;
+		--MemLog.Pages;
 	}
-	else
+	else if (!(Page = malloc(sizeof(struct _MemLogPage))))
 	{
-		snprintf(OBuf, MAX_LINE_SIZE, "%s\n", InStream);
+		return NULL;
 	}
 	
-	if (LogInMemory)
+	Page->Next = NULL;
+	Page->Used = 0;
+	Page->Lines = 0;
+	
+	if (MemLog.Tail) MemLog.Tail->Next = Page;
+	else MemLog.Head = Page;
+	
+	MemLog.Tail = Page;
+	++MemLog.Pages;
+	
+	return Page;
+}
+
+void MemLog_Append(const char *Data, unsigned long Length)
+{ /*Lines don't straddle two pages unless they're bigger than one, so dropping a page drops whole lines.*/
+	struct _MemLogPage *Page = MemLog.Tail;
+	const char *Worker = NULL;
+	unsigned long Chunk;
+	
+	for (; Length > 0; Data += Chunk, Length -= Chunk)
 	{
-		if (MemLogBuffer == NULL)
+		Chunk = Length > MEMLOG_PAGE_SIZE ? MEMLOG_PAGE_SIZE : Length;
+		
+		if ((!Page || MEMLOG_PAGE_SIZE - Page->Used < Chunk) && !(Page = MemLog_NewPage()))
 		{
-			MemLogBuffer = malloc(1);
-			*MemLogBuffer = '\0';
+			++MemLog.DroppedLines;
+			MemLog.DroppedBytes += Length;
+			return;
 		}
 		
-		MemLogBuffer = realloc(MemLogBuffer, strlen(MemLogBuffer) + strlen(OBuf) + 1);
+		memcpy(Page->Data + Page->Used, Data, Chunk);
+		Page->Used += Chunk;
+		MemLog.Size += Chunk;
 		
-		strncat(MemLogBuffer, OBuf, strlen(OBuf));
+		for (Worker = Data; (Worker = memchr(Worker, '\n', Data + Chunk - Worker)); ++Worker) ++Page->Lines;
+	}
+}
+
+rStatus MemLog_WriteOut(void)
+{ /*Everything goes out in one writev(), behind a note about anything the limit cost us.*/
+	struct iovec *Vectors = NULL;
+	const struct _MemLogPage *Page = MemLog.Head;
+	char Note[MAX_LINE_SIZE];
+	unsigned long NumVectors = 0, Done = 0, Total;
+	long Written;
+	
+	if (LogDescriptor == -1 || !(Vectors = malloc(sizeof(struct iovec) * (MemLog.Pages + 1)))) return FAILURE;
+	
+	if (MemLog.DroppedLines)
+	{
+		Log_Stamp(time(NULL));
+		Vectors[0].iov_base = Note;
+		Vectors[0].iov_len = snprintf(Note, sizeof Note, "%s " CONSOLE_COLOR_YELLOW "Dropped the oldest %lu lines (%lu bytes) "
+									"of the boot log, it went over MemLogLimit." CONSOLE_ENDCOLOR "\n",
+									LogStamp, MemLog.DroppedLines, MemLog.DroppedBytes);
+		++NumVectors;
+	}
+	
+	for (; Page; Page = Page->Next, ++NumVectors)
+	{
+		Vectors[NumVectors].iov_base = (void*)Page->Data;
+		Vectors[NumVectors].iov_len = Page->Used;
+	}
+	
+	while (Done < NumVectors)
+	{ /*Only loops if there's more than IOV_MAX pages or the kernel takes part of it.*/
+		Total = NumVectors - Done > IOV_MAX ? IOV_MAX : NumVectors - Done;
+		
+		if ((Written = writev(LogDescriptor, Vectors + Done, Total)) == -1)
+		{
+			if (errno == EINTR) continue;
+			break;
+		}
+		
+		for (; Done < NumVectors && (unsigned long)Written >= Vectors[Done].iov_len; ++Done)
+		{
+			Written -= Vectors[Done].iov_len;
+		}
+		
+		if (Written > 0)
+		{ /*Finish the one it stopped in the middle of, and carry on from the next.*/
+			Log_WriteOut((const char*)Vectors[Done].iov_base + Written, Vectors[Done].iov_len - Written);
+			++Done;
+		}
+	}
+	
+	if (LogSyncPolicy != LOGSYNC_NONE) fsync(LogDescriptor);
+	
+	free(Vectors);
+	
+	return Done == NumVectors ? SUCCESS : FAILURE;
+}
+
+void MemLog_Release(void)
+{
+	struct _MemLogPage *Next = NULL;
+	
+	for (; MemLog.Head; MemLog.Head = Next)
+	{
+		Next = MemLog.Head->Next;
+		free(MemLog.Head);
+	}
+	
+	MemLog.Tail = NULL;
+	MemLog.Pages = MemLog.Size = MemLog.DroppedLines = MemLog.DroppedBytes = 0;
+}
+
+rStatus WriteLogLine(const char *InStream, Bool AddDate)
+{ /*This is pretty much the entire logging system.*/
+	char OBuf[MAX_LINE_SIZE + 64];
+	unsigned long Length;
+	static Bool FailedBefore = false;
+	
+	if (!EnableLogging)
+	{
+		return SUCCESS;
+	}
+	
+	if (AddDate)
+	{
+		Log_Stamp(time(NULL));
+		Length = snprintf(OBuf, MAX_LINE_SIZE + 64, "%s %s\n", LogStamp, InStream);
+		if (Length >= MAX_LINE_SIZE + 64) Length = MAX_LINE_SIZE + 64 - 1;
 	}
 	else
 	{
-		fwrite(OBuf, 1, strlen(OBuf), Descriptor);
+		Length = snprintf(OBuf, MAX_LINE_SIZE, "%s\n", InStream);
+		if (Length >= MAX_LINE_SIZE) Length = MAX_LINE_SIZE - 1;
+	}
+	
+	if (LogInMemory)
+	{
+		MemLog_Append(OBuf, Length);
+		return SUCCESS;
+	}
+	
+	if (LogStoreEnabled)
+	{
+		char StoreBuf[MAX_LINE_SIZE];
+		unsigned char Severity;
+		const unsigned long StoreLength = Log_StoreText(StoreBuf, InStream, &Severity);
 		
-		fflush(Descriptor);
-		fclose(Descriptor);
+		LogStore_Add(*LogObject ? LogObject : NULL, Severity, StoreBuf, StoreLength);
+	}
+	
+	if (!Log_Write(OBuf, Length))
+	{
+		if (!FailedBefore)
+		{
+			FailedBefore = true;
+			SpitWarning("Cannot write to log file. Log system is inoperative. Check permissions?");
+		}
+		
+		return FAILURE;
 	}
 	
 	return SUCCESS;
 }
+
+rStatus WriteObjectLogLine(const char *Source, unsigned char Severity, const char *Line, unsigned long Length)
+{ /*For text that comes from somewhere other than Epoch, like an object's captured output.
+	* It goes in as it is, with Source in front. No colors are looked at, we already know the severity.*/
+	char OBuf[MAX_LINE_SIZE + MAX_DESCRIPT_SIZE + 64];
+	unsigned long Total;
+	
+	if (!EnableLogging) return SUCCESS;
+	
+	if (Length > MAX_LINE_SIZE) Length = MAX_LINE_SIZE;
+	
+	Log_Stamp(time(NULL));
+	Total = snprintf(OBuf, sizeof OBuf, "%s %s: %.*s\n", LogStamp, Source, (int)Length, Line);
+	if (Total >= sizeof OBuf) Total = sizeof OBuf - 1;
+	
+	if (LogInMemory)
+	{
+		MemLog_Append(OBuf, Total);
+		return SUCCESS;
+	}
+	
+	if (LogStoreEnabled) LogStore_Add(Source, Severity, Line, Length);
+	
+	return Log_Write(OBuf, Total);
+}
 	
 
 Bool ObjectProcessRunning(const ObjTable *InObj)
@@ -266,25 +649,16 @@ void GetCurrentTime(char *OutHr, char *OutMin, char *OutSec, char *OutYear, char
 
 unsigned long AdvancedPIDFind(ObjTable *InObj, Bool UpdatePID)
 { /*Advaaaanced! Ooh, shiney!
-	*Ok, seriously now, it finds PIDs by scanning /proc/somenumber/cmdline.*/
-	DIR *ProcDir = NULL;
-	struct dirent *DirPtr = NULL;
-	char FileName[MAX_LINE_SIZE];
-	char FileBuf[MAX_LINE_SIZE];
+	*Ok, seriously now, it finds PIDs by matching /proc/somenumber/cmdline.
+	* procscan.c does the actual looking, so a held snapshot gets reused.*/
 	char CmdLine[MAX_LINE_SIZE];
-	unsigned long Inc = 0, Streamsize = 0, Countdown = 0;
-	FILE *Descriptor = NULL;
+	unsigned long Countdown = 0, RealPID;
 	
 	if (InObj->ObjectStartCommand == NULL)
 	{
 		return 0;
 	}	
 	
-	if (!(ProcDir = opendir("/proc/")))
-	{
-		return 0;
-	}
-	
 	/*Remove forbidden characters.*/
 	snprintf(CmdLine, sizeof CmdLine, "%s", InObj->ObjectStartCommand);
 		
@@ -295,58 +669,12 @@ unsigned long AdvancedPIDFind(ObjTable *InObj, Bool UpdatePID)
 		CmdLine[Countdown] = '\0';
 	}
 	
-	while ((DirPtr = readdir(ProcDir)))
+	if ((RealPID = ProcScan_Find(CmdLine, InObj->ObjectPID)) && UpdatePID)
 	{
-		if (AllNumeric(DirPtr->d_name) && atol(DirPtr->d_name) >= InObj->ObjectPID)
-		{
-			int TChar;
-			
-			snprintf(FileName, sizeof FileName, "/proc/%s/cmdline", DirPtr->d_name);
-			
-			if (!(Descriptor = fopen(FileName, "r")))
-			{
-				closedir(ProcDir);
-				return 0;
-			}
-			
-			for (Inc = 0; (TChar = getc(Descriptor)) != EOF && Inc < MAX_LINE_SIZE - 1; ++Inc)
-			{
-				*(unsigned char*)&FileBuf[Inc] = (unsigned char)TChar;
-			}
-			FileBuf[Inc] = '\0';
-			
-			Streamsize = Inc;
-			
-			fclose(Descriptor);
-			
-			for (Inc = 0; Inc < Streamsize; ++Inc)
-			{ /*We need to replace the NUL characters with spaces.*/
-				if (FileBuf[Inc] == '\0')
-				{
-					FileBuf[Inc] = ' ';
-				}
-			}
-			
-			if (!strncmp(FileBuf, CmdLine, strlen(CmdLine)))
-			{
-				unsigned long RealPID;
-				
-				RealPID = atol(DirPtr->d_name);
-				
-				if (UpdatePID)
-				{
-					InObj->ObjectPID = RealPID;
-				}
-				
-				closedir(ProcDir);
-				return RealPID;
-				
-			}
-		}
+		InObj->ObjectPID = RealPID;
 	}
-	closedir(ProcDir);
 	
-	return 0;
+	return RealPID;
 }		
 
 